@@ -0,0 +1,293 @@
+#!/usr/bin/env python3
+#
+# brickpico_stream.py - Reference client for BrickPico output streaming protocol
+#
+# Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Usage:
+#   brickpico_stream.py <device> levels <level1> [<level2> ...]
+#      (levels stay active until streaming mode times out)
+#   brickpico_stream.py <device> fade [seconds] [rate]
+#   brickpico_stream.py <device> bench [seconds] [rate]
+#   brickpico_stream.py loopback [seconds] [rate]
+#
+# <device> is the BrickPico USB serial console (for example /dev/ttyACM0).
+# Streaming mode is enabled using SCPI command "SYS:STREAM" and ends when
+# this client exits (or after 30 seconds without frames).
+#
+# 'loopback' runs the benchmark against an emulated device over a
+# pseudo-terminal, to measure the host side (framing + tty) overhead.
+#
+# See src/stream.c for protocol description.
+#
+
+import os
+import select
+import struct
+import sys
+import threading
+import time
+import tty
+
+LEVELS = 0x01
+PING = 0x02
+STATS = 0x03
+EXIT = 0x04
+REPLY = 0x80
+ERROR = 0xff
+
+LEVEL_MAX = 0xffff
+
+
+def _crc_table():
+    table = []
+    for i in range(256):
+        c = i << 24
+        for _ in range(8):
+            c = ((c << 1) ^ 0x04c11db7) if c & 0x80000000 else (c << 1)
+        table.append(c & 0xffffffff)
+    return table
+
+
+CRC_TABLE = _crc_table()
+
+
+def crc32(data, crc=0xffffffff):
+    """CRC-32 as calculated by xcrc32() in firmware (non-reflected)."""
+    for b in data:
+        crc = ((crc << 8) & 0xffffffff) ^ CRC_TABLE[((crc >> 24) ^ b) & 0xff]
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_pos = 0
+    code = 1
+    for b in data:
+        if b:
+            out.append(b)
+            code += 1
+        if not b or code == 0xff:
+            out[code_pos] = code
+            code_pos = len(out)
+            out.append(0)
+            code = 1
+    out[code_pos] = code
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            return None
+        out += data[i:i + code - 1]
+        i += code - 1
+        if code < 0xff and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def make_frame(ftype, data=b''):
+    frame = bytes([ftype]) + data
+    return b'\0' + cobs_encode(frame + struct.pack('<I', crc32(frame))) + b'\0'
+
+
+def parse_frame(raw):
+    """Return (type, data) or None if frame is invalid."""
+    frame = cobs_decode(raw)
+    if not frame or len(frame) < 5:
+        return None
+    body, crc = frame[:-4], struct.unpack('<I', frame[-4:])[0]
+    if crc32(body) != crc:
+        return None
+    return body[0], body[1:]
+
+
+class StreamClient:
+    def __init__(self, fd):
+        self.fd = fd
+        self.rxbuf = b''
+        self.outputs = 0
+
+    @classmethod
+    def open(cls, device):
+        fd = os.open(device, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(fd)
+        return cls(fd)
+
+    def close(self):
+        os.close(self.fd)
+
+    def send(self, ftype, data=b''):
+        os.write(self.fd, make_frame(ftype, data))
+
+    def recv(self, timeout=1.0):
+        """Wait for next valid frame, return (type, data) or None on timeout."""
+        deadline = time.monotonic() + timeout
+        while True:
+            while b'\0' in self.rxbuf:
+                raw, self.rxbuf = self.rxbuf.split(b'\0', 1)
+                if raw:
+                    f = parse_frame(raw)
+                    if f:
+                        return f
+            left = deadline - time.monotonic()
+            if left <= 0:
+                return None
+            r, _, _ = select.select([self.fd], [], [], left)
+            if r:
+                self.rxbuf += os.read(self.fd, 4096)
+
+    def start(self):
+        """Enable streaming mode and wait for HELLO frame."""
+        os.write(self.fd, b'\rSYS:STREAM\r')
+        while True:
+            f = self.recv(3.0)
+            if f is None:
+                raise RuntimeError('no response from device')
+            if f[0] == REPLY and len(f[1]) >= 2:
+                self.outputs = f[1][1]
+                return f[1][0]
+
+    def stop(self):
+        self.send(EXIT)
+        while True:
+            f = self.recv(1.0)
+            if f is None or f[0] == REPLY | EXIT:
+                return
+
+    def levels(self, levels):
+        self.send(LEVELS, struct.pack('<%dH' % len(levels), *levels))
+
+    def ping(self, data=b'ping'):
+        t = time.perf_counter()
+        self.send(PING, data)
+        while True:
+            f = self.recv(1.0)
+            if f is None:
+                return None
+            if f[0] == REPLY | PING and f[1] == data:
+                return time.perf_counter() - t
+
+    def stats(self):
+        self.send(STATS)
+        while True:
+            f = self.recv(1.0)
+            if f is None:
+                return None
+            if f[0] == REPLY | STATS:
+                return struct.unpack('<4I', f[1])
+
+
+def emulated_device(fd, stop):
+    """Minimal emulation of the firmware side of the protocol."""
+    buf = b''
+    stats = [0, 0, 0, 0]
+    while not stop.is_set():
+        r, _, _ = select.select([fd], [], [], 0.1)
+        if not r:
+            continue
+        try:
+            buf += os.read(fd, 4096)
+        except OSError:
+            return
+        if b'SYS:STREAM\r' in buf:
+            buf = buf.split(b'SYS:STREAM\r', 1)[1]
+            os.write(fd, make_frame(REPLY, bytes([1, 16])))
+        while b'\0' in buf:
+            raw, buf = buf.split(b'\0', 1)
+            if not raw:
+                continue
+            f = parse_frame(raw)
+            if not f:
+                stats[2] += 1
+                continue
+            stats[0] += 1
+            if f[0] == LEVELS:
+                stats[1] += 1
+            elif f[0] == PING:
+                os.write(fd, make_frame(REPLY | PING, f[1]))
+            elif f[0] == STATS:
+                os.write(fd, make_frame(REPLY | STATS, struct.pack('<4I', *stats)))
+            elif f[0] == EXIT:
+                os.write(fd, make_frame(REPLY | EXIT))
+
+
+def benchmark(client, seconds, rate):
+    n = client.outputs or 16
+    period = 1.0 / rate
+    frames = 0
+    rtt = []
+    t_start = time.perf_counter()
+    t_next = t_start
+    while time.perf_counter() - t_start < seconds:
+        phase = (frames % rate) / rate
+        client.levels([int(LEVEL_MAX * phase)] * n)
+        frames += 1
+        if frames % 10 == 0:
+            t = client.ping()
+            if t is not None:
+                rtt.append(t)
+        t_next += period
+        delay = t_next - time.perf_counter()
+        if delay > 0:
+            time.sleep(delay)
+    elapsed = time.perf_counter() - t_start
+    frame_len = len(make_frame(LEVELS, b'\xff\xff' * n))
+
+    print('outputs:        %d' % n)
+    print('frames sent:    %d (%.1f frames/s, %d bytes/frame)' % (frames, frames / elapsed, frame_len))
+    if rtt:
+        rtt.sort()
+        print('ping rtt (ms):  min %.3f, median %.3f, max %.3f (%d samples)' % (
+            rtt[0] * 1000, rtt[len(rtt) // 2] * 1000, rtt[-1] * 1000, len(rtt)))
+    s = client.stats()
+    if s:
+        print('device stats:   frames=%d, level_frames=%d, crc_errors=%d, frame_errors=%d' % s)
+
+
+def main():
+    args = sys.argv[1:]
+    stop = None
+    if args[0] == 'loopback':
+        master, slave = os.openpty()
+        tty.setraw(master)
+        stop = threading.Event()
+        threading.Thread(target=emulated_device, args=(master, stop), daemon=True).start()
+        client = StreamClient.open(os.ttyname(slave))
+        os.close(slave)
+        args = ['loopback', 'bench'] + args[1:]
+    elif len(args) >= 2 and args[1] in ('levels', 'fade', 'bench'):
+        client = StreamClient.open(args[0])
+    else:
+        print('usage: %s <device> levels|fade|bench [args]' % sys.argv[0])
+        return 1
+
+    version = client.start()
+    print('streaming mode enabled (protocol %d, %d outputs)' % (version, client.outputs))
+    try:
+        cmd = args[1]
+        if cmd == 'levels':
+            client.levels([int(x) for x in args[2:]])
+        else:
+            seconds = float(args[2]) if len(args) > 2 else 5.0
+            rate = int(args[3]) if len(args) > 3 else 100
+            benchmark(client, seconds, rate)
+    finally:
+        if cmd != 'levels':
+            client.stop()
+        if stop:
+            stop.set()
+        client.close()
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
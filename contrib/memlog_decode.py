@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+#
+# memlog_decode.py - Decode BrickPico persistent memory log from a memory dump
+#
+# Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# Usage: memlog_decode.py <persistent_memory dump> <brickpico.bin>
+#
+# Dump must contain 'struct persistent_memory_block' (for example saved
+# using a debugger: "dump binary memory pmem.bin &persistent_memory
+# (&persistent_memory + 1)"). Firmware image (.bin) must be the same
+# firmware that wrote the log, as binary log entries refer to format
+# strings in flash.
+#
+
+import re
+import struct
+import sys
+
+XIP_BASE = 0x10000000
+PMEM_ID = 0xbaddeca3
+
+# Layout of struct persistent_memory_block (arm-none-eabi)
+OFS_ID = 0
+OFS_LOG_RB = 48    # u8_ringbuffer_t: buf, free_buf, size, free, head, tail, items
+OFS_LOG = 144
+LOG_BIN_MARKER = 0x01
+LOG_BIN_HDR_LEN = 12
+
+SPEC_RE = re.compile(r'%([-+ #0]*)(\d*)(?:\.(\d*))?(hh|h|ll|l|j|z|t)?([diouxXcpfFeEgGaAs%])')
+
+
+def c_string(data, offset):
+    end = data.find(b'\0', offset)
+    if end < 0:
+        end = len(data)
+    return data[offset:end].decode('utf-8', 'replace')
+
+
+def format_entry(entry, firmware):
+    """Format binary log entry using format string from firmware image."""
+    if len(entry) < LOG_BIN_HDR_LEN:
+        return '<truncated binary log entry>'
+    info = entry[1]
+    t = int.from_bytes(entry[2:8], 'little')
+    fmt_addr = int.from_bytes(entry[8:12], 'little')
+    if fmt_addr < XIP_BASE or fmt_addr - XIP_BASE >= len(firmware):
+        return '<invalid binary log entry>'
+    fmt = c_string(firmware, fmt_addr - XIP_BASE)
+
+    args = entry[LOG_BIN_HDR_LEN:]
+    pos = 0
+    out = []
+    last = 0
+    for m in SPEC_RE.finditer(fmt):
+        out.append(fmt[last:m.start()])
+        last = m.end()
+        flags, width, prec, lenmod, conv = m.groups()
+        if conv == '%':
+            out.append('%')
+            continue
+        spec = '%' + flags + width + ('.' + prec if prec is not None else '')
+        if conv == 's':
+            end = args.find(b'\0', pos)
+            if end < 0:
+                break
+            val = args[pos:end].decode('utf-8', 'replace')
+            pos = end + 1
+            out.append((spec + 's') % val)
+        elif conv in 'fFeEgGaA':
+            val = struct.unpack_from('<d', args, pos)[0]
+            pos += 8
+            out.append((spec + (conv if conv not in 'aA' else 'e')) % val)
+        else:
+            size = 8 if lenmod in ('ll', 'j') else 4
+            val = int.from_bytes(args[pos:pos + size], 'little')
+            pos += size
+            if conv in 'di' and val >= 1 << (size * 8 - 1):
+                val -= 1 << (size * 8)
+            if conv == 'p':
+                out.append('0x%x' % val)
+            elif conv == 'c':
+                out.append(chr(val & 0xff))
+            else:
+                out.append((spec + ('d' if conv in 'iu' else conv)) % val)
+    out.append(fmt[last:])
+
+    msg = ''.join(out).rstrip('\n')
+    return '[%6u.%06u][%u] %s' % (t // 1000000, t % 1000000, info & 0x0f, msg)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print('usage: %s <persistent_memory dump> <brickpico.bin>' % sys.argv[0])
+        return 1
+
+    with open(sys.argv[1], 'rb') as f:
+        pmem = f.read()
+    with open(sys.argv[2], 'rb') as f:
+        firmware = f.read()
+
+    if struct.unpack_from('<I', pmem, OFS_ID)[0] != PMEM_ID:
+        print('persistent memory block not found (invalid id)')
+        return 2
+
+    _, _, size, free, head, tail, items = struct.unpack_from('<IB3xIIIII', pmem, OFS_LOG_RB)
+    log = pmem[OFS_LOG:OFS_LOG + size]
+    if len(log) != size or head >= size or tail >= size:
+        print('invalid log ringbuffer')
+        return 2
+
+    print('logbuffer: items=%u, size=%u, free=%u' % (items, size, free))
+    o = head
+    for i in range(items):
+        length = log[o]
+        entry = bytes(log[(o + 1 + j) % size] for j in range(length))
+        if entry and entry[0] == LOG_BIN_MARKER:
+            print('>' + format_entry(entry, firmware))
+        else:
+            print('>' + c_string(entry, 0))
+        o = (o + length + 2) % size
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -25,6 +25,9 @@
 #include <math.h>
 #include <malloc.h>
 #include "pico/stdlib.h"
+#include "pico/stdio/driver.h"
+#include "pico/stdio_usb.h"
+#include "pico/stdio_uart.h"
 #include "pico/mutex.h"
 #include "pico/multicore.h"
 #include "pico/util/datetime.h"
@@ -42,9 +45,7 @@
 #include "brickpico.h"
 
 
-static struct brickpico_config core1_config;
 static struct brickpico_state core1_state;
-static struct brickpico_state transfer_state;
 static struct brickpico_state system_state;
 struct brickpico_state *brickpico_state = &system_state;
 static struct brickpico_fw_settings system_settings;
@@ -54,49 +55,263 @@ struct persistent_memory_block __uninitialized_ram(persistent_memory);
 struct persistent_memory_block *persistent_mem = &persistent_memory;
 u8_ringbuffer_t *log_rb = NULL;
 
-#define PERSISTENT_MEMORY_ID 0xbaddecaf
-#define PERSISTENT_MEMORY_CRC_LEN offsetof(struct persistent_memory_block, crc32)
+#define PERSISTENT_MEMORY_ID 0xbaddeca3
+#define PERSISTENT_MEMORY_HEADER_LEN offsetof(struct persistent_memory_block, header_crc32)
 
 auto_init_mutex(pmem_mutex_inst);
 mutex_t *pmem_mutex = &pmem_mutex_inst;
-auto_init_mutex(state_mutex_inst);
-mutex_t *state_mutex = &state_mutex_inst;
 bool rebooted_by_watchdog = false;
 
+struct core1_config;
 
+/* Output state (and config view) mailbox from core0 to core1 (seqlock).
+   Sequence number is odd while core0 is updating the mailbox. */
+struct core1_mailbox {
+	volatile uint32_t seq;
+	uint8_t pwm[OUTPUT_MAX_COUNT];
+	uint8_t pwr[OUTPUT_MAX_COUNT];
+	const struct core1_config *config;
+	bool direct;        /* use (streamed) output levels directly, bypassing effects */
+	uint16_t level[OUTPUT_MAX_COUNT];
+	uint64_t t_cmd;     /* timestamp of output change command (latency mode) */
+	uint8_t ramp_id[OUTPUT_MAX_COUNT];   /* incremented when new ramp is started */
+	uint32_t ramp_ms[OUTPUT_MAX_COUNT];  /* duration of latest ramp */
+};
+
+static struct core1_mailbox core1_mailbox;
+static spin_lock_t *core1_mailbox_lock = NULL;
+static bool core1_batch = false;
+static uint8_t core1_batch_deferred = 0;
+#define BATCH_DEFER_STREAM 0x01
+#define BATCH_DEFER_TIMER  0x02
+static bool direct_mode = false;
+static uint16_t direct_level[OUTPUT_MAX_COUNT];
+static uint8_t ramp_id[OUTPUT_MAX_COUNT];
+static uint32_t ramp_ms[OUTPUT_MAX_COUNT];
+static volatile bool output_latency_mode = false;
+static uint64_t output_latency_t_cmd = 0;
+static struct output_latency_stats output_latency;
+
+#define CONSOLE_INPUT_MAX 1024
+
+/* Console (command line) input, each stdio driver is read separately
+   so that commands can be attributed to the session they came from. */
+struct console_input {
+	struct stdio_driver *driver;
+	struct stdio_driver *prev;  /* driver preceding (not yet registered) driver */
+	bool pending;
+	char buf[CONSOLE_INPUT_MAX + 1];
+	int len;
+};
+
+static struct console_input console_input[CONSOLE_SOURCE_COUNT];
+static uint32_t usb_session = 0;
+static bool usb_connected = false;
+
+/* Compact (read-only) view of the configuration used by core1.
+   core0 publishes a new version into the inactive buffer, core1 acknowledges
+   the version it is using. Buffers and effect contexts retired by core0 are
+   reused/freed only after core1 has acknowledged a version not referring to them. */
+struct core1_output_config {
+	enum light_effect_types effect;
+	void *effect_ctx;
+	uint16_t max_current;
+	uint8_t priority;
+};
+
+struct core1_config {
+	uint32_t version;
+	uint32_t effect_rate;
+	uint32_t power_budget;
+	struct core1_output_config outputs[OUTPUT_MAX_COUNT];
+};
+
+#define RETIRED_CTX_MAX (2 * OUTPUT_MAX_COUNT)
+
+struct retired_ctx {
+	void *ctx;
+	uint32_t version;   /* first config version not referring to ctx */
+};
+
+static struct core1_config core1_config_buf[2];
+static struct core1_config * volatile core1_config_view = &core1_config_buf[0];
+static volatile uint32_t core1_config_ack = 0;
+static struct retired_ctx retired_ctx[RETIRED_CTX_MAX];
+
+
+static uint32_t pmem_header_crc(const struct persistent_memory_block *m)
+{
+	return xcrc32_fast((unsigned char*)m, PERSISTENT_MEMORY_HEADER_LEN, 0);
+}
+
+static uint32_t pmem_log_rb_crc(const struct persistent_memory_block *m)
+{
+	return xcrc32_fast((unsigned char*)&m->log_rb, sizeof(m->log_rb), 0);
+}
+
+static uint32_t pmem_log_chunk_crc(const struct persistent_memory_block *m, uint chunk)
+{
+	return xcrc32_fast(&m->log[chunk * PERSISTENT_LOG_CHUNK_SIZE], PERSISTENT_LOG_CHUNK_SIZE, 0);
+}
+
+/* Return bitmask of log chunks overlapping given (ringbuffer) range */
+static uint32_t pmem_log_chunk_mask(size_t offset, size_t len)
+{
+	uint32_t mask = 0;
+	size_t end;
+
+	if (len < 1)
+		return 0;
+	if (len >= PERSISTENT_LOG_SIZE)
+		return (1UL << PERSISTENT_LOG_CHUNKS) - 1;
+
+	offset %= PERSISTENT_LOG_SIZE;
+	end = offset + len - 1;
+	if (end >= PERSISTENT_LOG_SIZE) {
+		/* range wraps around */
+		mask |= pmem_log_chunk_mask(0, end - PERSISTENT_LOG_SIZE + 1);
+		end = PERSISTENT_LOG_SIZE - 1;
+	}
+	for (uint i = offset / PERSISTENT_LOG_CHUNK_SIZE; i <= end / PERSISTENT_LOG_CHUNK_SIZE; i++)
+		mask |= (1UL << i);
+
+	return mask;
+}
+
+/**
+ * Update checksum of persistent memory block header.
+ */
 void update_persistent_memory_crc()
 {
 	struct persistent_memory_block *m = persistent_mem;
 
-	m->crc32 = xcrc32((unsigned char*)m, PERSISTENT_MEMORY_CRC_LEN, 0);
+	m->header_crc32 = pmem_header_crc(m);
 }
 
+/**
+ * Update checksums of log ringbuffer after it has been modified.
+ * Only the log chunks overlapping modified range are checksummed.
+ *
+ * @param offset Offset of modified data in log buffer.
+ * @param len Length of modified data.
+ */
+void update_persistent_memory_log_crc(size_t offset, size_t len)
+{
+	struct persistent_memory_block *m = persistent_mem;
+	uint32_t mask = pmem_log_chunk_mask(offset, len);
+
+	for (uint i = 0; i < PERSISTENT_LOG_CHUNKS; i++) {
+		if (mask & (1UL << i))
+			m->log_crc32[i] = pmem_log_chunk_crc(m, i);
+	}
+	m->log_rb_crc32 = pmem_log_rb_crc(m);
+}
+
+static void update_persistent_memory_all_crc()
+{
+	update_persistent_memory_crc();
+	update_persistent_memory_log_crc(0, PERSISTENT_LOG_SIZE);
+}
+
+/* Drop log entries overlapping corrupted chunks (and all older entries).
+   Returns number of entries dropped, or -1 if ringbuffer is not usable. */
+static int recover_persistent_log(struct persistent_memory_block *m, uint32_t bad_chunks)
+{
+	u8_ringbuffer_t *rb = &m->log_rb;
+	size_t o = rb->head;
+	size_t len;
+	int drop = 0;
+
+	for (int i = 0; i < rb->items; i++) {
+		len = rb->buf[o];
+		if (len < 1 || rb->buf[(o + len + 1) % rb->size] != len)
+			return -1;
+		if (pmem_log_chunk_mask(o, len + 2) & bad_chunks)
+			drop = i + 1;
+		o = (o + len + 2) % rb->size;
+	}
+
+	for (int i = 0; i < drop; i++)
+		u8_ringbuffer_remove_first_item(rb);
+
+	return drop;
+}
+
+extern char __flash_binary_start;
+extern char __flash_binary_end;
+
 void init_persistent_memory()
 {
 	struct persistent_memory_block *m = persistent_mem;
-	uint32_t crc;
+	u8_ringbuffer_t *rb = &m->log_rb;
+	uint32_t crc, bad_chunks = 0;
+	uint32_t fw_crc = xcrc32_fast((unsigned char*)&__flash_binary_start,
+				&__flash_binary_end - &__flash_binary_start, 0);
+	bool log_ok;
+	int res;
 
 	if (m->id == PERSISTENT_MEMORY_ID) {
-		crc = xcrc32((unsigned char*)m, PERSISTENT_MEMORY_CRC_LEN, 0);
-		if (crc == m->crc32) {
-			printf("Found persistent memory block\n");
+		printf("Found persistent memory block\n");
+
+		/* Check header */
+		crc = pmem_header_crc(m);
+		if (crc == m->header_crc32) {
 			if (m->saved_time.tv_sec > 0)
 				aon_timer_start(&m->saved_time);
-			if (m->uptime) {
+			if (m->uptime)
 				m->prev_uptime = m->uptime;
-				update_persistent_memory_crc();
+		} else {
+			printf("Corrupt persistent memory header"
+				" (CRC-32 mismatch  %08lx != %08lx)\n", crc, m->header_crc32);
+			m->saved_time.tv_sec = 0;
+			m->saved_time.tv_nsec = 0;
+			m->uptime = 0;
+			m->prev_uptime = 0;
+			m->firmware_crc32 = 0;
+		}
+
+		/* Check log ringbuffer */
+		crc = pmem_log_rb_crc(m);
+		log_ok = (crc == m->log_rb_crc32 && rb->buf == m->log
+			&& rb->size == sizeof(m->log) && rb->free <= rb->size
+			&& rb->head < rb->size && rb->tail < rb->size);
+		if (log_ok) {
+			for (uint i = 0; i < PERSISTENT_LOG_CHUNKS; i++) {
+				if (pmem_log_chunk_crc(m, i) != m->log_crc32[i])
+					bad_chunks |= (1UL << i);
 			}
-			return;
+			if (bad_chunks) {
+				res = recover_persistent_log(m, bad_chunks);
+				if (res < 0) {
+					log_ok = false;
+				} else {
+					printf("Corrupt persistent log (chunks %08lx): %d entries dropped\n",
+						bad_chunks, res);
+				}
+			}
+		}
+		if (!log_ok) {
+			printf("Corrupt persistent log, initializing log...\n");
+			memset(m->log, 0, sizeof(m->log));
+			u8_ringbuffer_init(rb, m->log, sizeof(m->log));
+		} else if (m->firmware_crc32 != fw_crc) {
+			/* Binary log entries refer to format strings in firmware */
+			res = log_rb_drop_binary(rb);
+			if (res > 0)
+				printf("Firmware changed: %d binary log entries dropped\n", res);
 		}
-		printf("Found corrupt persistent memory block"
-			" (CRC-32 mismatch  %08lx != %08lx)\n", crc, m->crc32);
+		m->firmware_crc32 = fw_crc;
+
+		update_persistent_memory_all_crc();
+		return;
 	}
 
 	printf("Initializing persistent memory block...\n");
 	memset(m, 0, sizeof(*m));
 	m->id = PERSISTENT_MEMORY_ID;
+	m->firmware_crc32 = fw_crc;
 	u8_ringbuffer_init(&m->log_rb, m->log, sizeof(m->log));
-	update_persistent_memory_crc();
+	update_persistent_memory_all_crc();
 }
 
 void update_persistent_memory()
@@ -132,6 +347,7 @@ void setup()
 
 
 	stdio_usb_init();
+	console_input[CMD_SOURCE_USB].driver = &stdio_usb;
 	/* Wait a while for USB Serial to connect... */
 	while (i++ < 40) {
 		if (stdio_usb_connected())
@@ -148,6 +364,7 @@ void setup()
 #if TTL_SERIAL > 0
 	stdio_uart_init_full(TTL_SERIAL_UART,
 			TTL_SERIAL_SPEED, TX_PIN, RX_PIN);
+	console_input[CMD_SOURCE_SERIAL].driver = &stdio_uart;
 	sleep_ms(5);
 #endif
 	printf("\n\n");
@@ -169,6 +386,7 @@ void setup()
 		clock_get_hz(clk_sys) / 1000000.0);
 	printf(" Serial Number: %s\n\n", pico_serial_str());
 
+	crc32_setup();
 	init_persistent_memory();
 	log_rb = &persistent_mem->log_rb;
 	printf("\n");
@@ -239,6 +457,9 @@ void clear_state(struct brickpico_state *s)
 	for (i = 0; i < OUTPUT_MAX_COUNT; i++) {
 		s->pwm[i] = 0;
 		s->pwr[i] = 0;
+		s->timer_effect[i] = 0;
+		s->effect[i] = EFFECT_NONE;
+		s->effect_ctx[i] = NULL;
 	}
 	s->temp = 0.0;
 	s->temp_prev = 0.0;
@@ -256,63 +477,497 @@ void clear_state(struct brickpico_state *s)
 
 void update_core1_state()
 {
-	mutex_enter_blocking(state_mutex);
-	memcpy(&transfer_state, &system_state, sizeof(transfer_state));
-	mutex_exit(state_mutex);
+	struct core1_mailbox *m = &core1_mailbox;
+	uint32_t irq;
+
+	if (core1_batch)
+		return;
+
+	irq = spin_lock_blocking(core1_mailbox_lock);
+	if (!memcmp(m->pwm, system_state.pwm, sizeof(m->pwm))
+		&& !memcmp(m->pwr, system_state.pwr, sizeof(m->pwr))
+		&& m->config == core1_config_view
+		&& m->direct == direct_mode
+		&& !memcmp(m->level, direct_level, sizeof(m->level))
+		&& !memcmp(m->ramp_id, ramp_id, sizeof(m->ramp_id))
+		&& !output_latency_t_cmd) {
+		/* No changes */
+		spin_unlock(core1_mailbox_lock, irq);
+		return;
+	}
+
+	m->seq++;
+	__dmb();
+	memcpy(m->pwm, system_state.pwm, sizeof(m->pwm));
+	memcpy(m->pwr, system_state.pwr, sizeof(m->pwr));
+	m->config = core1_config_view;
+	m->direct = direct_mode;
+	memcpy(m->level, direct_level, sizeof(m->level));
+	m->t_cmd = output_latency_t_cmd;
+	output_latency_t_cmd = 0;
+	memcpy(m->ramp_id, ramp_id, sizeof(m->ramp_id));
+	memcpy(m->ramp_ms, ramp_ms, sizeof(m->ramp_ms));
+	__dmb();
+	m->seq++;
+	spin_unlock(core1_mailbox_lock, irq);
+
+	/* Wake up core1 */
+	__sev();
+}
+
+static void reclaim_effect_ctx()
+{
+	uint32_t ack = core1_config_ack;
+
+	for (int i = 0; i < RETIRED_CTX_MAX; i++) {
+		struct retired_ctx *r = &retired_ctx[i];
+
+		if (r->ctx && (int32_t)(ack - r->version) >= 0) {
+			free(r->ctx);
+			r->ctx = NULL;
+		}
+	}
+}
+
+/* Return light effect currently active on output (effect set by
+   a timer event overrides the configured effect). */
+static enum light_effect_types output_effect(int i, void **ctx)
+{
+	if (brickpico_state->timer_effect[i]) {
+		*ctx = brickpico_state->effect_ctx[i];
+		return brickpico_state->effect[i];
+	}
+	*ctx = cfg->outputs[i].effect_ctx;
+	return cfg->outputs[i].effect;
+}
+
+void update_core1_config()
+{
+	struct core1_config *cur = core1_config_view;
+	struct core1_config *next;
+	enum light_effect_types effect;
+	void *ctx;
+	bool changed = false;
+
+	reclaim_effect_ctx();
+	if (core1_batch)
+		return;
+	update_pwm_config();
+
+	if (cur->version == 0 || cur->effect_rate != cfg->effect_rate
+		|| cur->power_budget != cfg->power_budget)
+		changed = true;
+	for (int i = 0; i < OUTPUT_COUNT && !changed; i++) {
+		effect = output_effect(i, &ctx);
+		if (cur->outputs[i].effect != effect
+			|| cur->outputs[i].effect_ctx != ctx
+			|| cur->outputs[i].max_current != cfg->outputs[i].max_current
+			|| cur->outputs[i].priority != cfg->outputs[i].priority)
+			changed = true;
+	}
+	if (!changed)
+		return;
+
+	if (core1_config_ack != cur->version) {
+		/* core1 may still be using the other buffer, try again later */
+		return;
+	}
+
+	next = (cur == &core1_config_buf[0] ? &core1_config_buf[1] : &core1_config_buf[0]);
+	next->version = cur->version + 1;
+	next->effect_rate = cfg->effect_rate;
+	next->power_budget = cfg->power_budget;
+	for (int i = 0; i < OUTPUT_MAX_COUNT; i++) {
+		next->outputs[i].effect = output_effect(i, &ctx);
+		next->outputs[i].effect_ctx = ctx;
+		next->outputs[i].max_current = cfg->outputs[i].max_current;
+		next->outputs[i].priority = cfg->outputs[i].priority;
+	}
+	__dmb();
+	core1_config_view = next;
+
+	/* Publish new config view (along with current output state) */
+	update_core1_state();
+}
+
+void begin_core1_batch()
+{
+	core1_batch = true;
+	core1_batch_deferred = 0;
+}
+
+/* Log notice (once per batch) about output changes held back by batch. */
+static void core1_batch_defer(uint8_t source, const char *name)
+{
+	if (core1_batch_deferred & source)
+		return;
+	core1_batch_deferred |= source;
+	log_msg(LOG_NOTICE, "Batch active, %s output changes deferred until batch ends", name);
+}
+
+void commit_core1_batch()
+{
+	int retry = 0;
+
+	if (!core1_batch)
+		return;
+	core1_batch = false;
+
+	/* Make sure core1 is done with the previous config version, so that
+	   config and output state changes can be published as one snapshot. */
+	while (core1_config_ack != core1_config_view->version && retry++ < 100)
+		sleep_ms(1);
+	if (core1_config_ack != core1_config_view->version)
+		log_msg(LOG_WARNING, "commit_core1_batch(): core1 config update pending");
+
+	update_core1_config();
+	update_core1_state();
+}
+
+bool core1_batch_active()
+{
+	return core1_batch;
+}
+
+void set_direct_output_levels(const uint16_t *level, uint count)
+{
+	if (count > OUTPUT_MAX_COUNT)
+		count = OUTPUT_MAX_COUNT;
+
+	memcpy(direct_level, level, count * sizeof(uint16_t));
+	direct_mode = true;
+	mark_output_change();
+	if (core1_batch)
+		core1_batch_defer(BATCH_DEFER_STREAM, "streamed");
+	update_core1_state();
+}
+
+void clear_direct_output_levels()
+{
+	if (!direct_mode)
+		return;
+
+	direct_mode = false;
+	memset(direct_level, 0, sizeof(direct_level));
+	update_core1_state();
+}
+
+/* Start ramping output (on core1) from its current level to the level
+   (set in the output state) to be published next. */
+void start_output_ramp(uint out, uint32_t duration_ms)
+{
+	if (out >= OUTPUT_MAX_COUNT)
+		return;
+
+	ramp_ms[out] = duration_ms;
+	ramp_id[out]++;
+}
+
+static bool core1_config_uses_ctx(const struct core1_config *c, const void *ctx)
+{
+	for (int i = 0; i < OUTPUT_MAX_COUNT; i++) {
+		if (c->outputs[i].effect_ctx == ctx)
+			return true;
+	}
+	return false;
+}
+
+void retire_effect_ctx(void *ctx)
+{
+	uint32_t version = core1_config_view->version + 1;
+	int retry = 0;
+
+	if (!ctx)
+		return;
+
+	/* Context that was never published to core1 (for example effect changed
+	   again while batch is active) can be freed right away. This keeps number
+	   of retired contexts bounded by the contexts referenced by the two
+	   config buffers (2 * OUTPUT_MAX_COUNT). */
+	if (!core1_config_uses_ctx(&core1_config_buf[0], ctx)
+		&& !core1_config_uses_ctx(&core1_config_buf[1], ctx)) {
+		free(ctx);
+		return;
+	}
+
+	do {
+		for (int i = 0; i < RETIRED_CTX_MAX; i++) {
+			if (!retired_ctx[i].ctx) {
+				retired_ctx[i].ctx = ctx;
+				retired_ctx[i].version = version;
+				return;
+			}
+		}
+		/* List full, wait for core1 to catch up... */
+		update_core1_config();
+		sleep_ms(1);
+	} while (retry++ < 500);
+
+	log_msg(LOG_WARNING, "retire_effect_ctx(): no free slots, leaking %p", ctx);
+}
+
+static bool read_core1_mailbox(struct brickpico_state *state, const struct core1_config **config,
+			bool *direct, uint16_t *level, uint8_t *r_id, uint32_t *r_ms,
+			uint32_t *seq, uint64_t *t_cmd)
+{
+	struct core1_mailbox *m = &core1_mailbox;
+	uint8_t pwm[OUTPUT_MAX_COUNT];
+	uint8_t pwr[OUTPUT_MAX_COUNT];
+	uint16_t lvl[OUTPUT_MAX_COUNT];
+	uint8_t id[OUTPUT_MAX_COUNT];
+	uint32_t ms[OUTPUT_MAX_COUNT];
+	const struct core1_config *c;
+	uint64_t t;
+	bool d;
+	uint32_t s;
+
+	for (int retry = 0; retry < 8; retry++) {
+		s = m->seq;
+		if (s & 1)
+			continue;
+		__dmb();
+		memcpy(pwm, m->pwm, sizeof(pwm));
+		memcpy(pwr, m->pwr, sizeof(pwr));
+		c = m->config;
+		d = m->direct;
+		memcpy(lvl, m->level, sizeof(lvl));
+		t = m->t_cmd;
+		memcpy(id, m->ramp_id, sizeof(id));
+		memcpy(ms, m->ramp_ms, sizeof(ms));
+		__dmb();
+		if (s == m->seq) {
+			memcpy(state->pwm, pwm, sizeof(state->pwm));
+			memcpy(state->pwr, pwr, sizeof(state->pwr));
+			if (c)
+				*config = c;
+			*direct = d;
+			memcpy(level, lvl, sizeof(lvl));
+			memcpy(r_id, id, sizeof(id));
+			memcpy(r_ms, ms, sizeof(ms));
+			if (t)
+				*t_cmd = t;
+			*seq = s;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void set_output_latency_mode(bool enabled)
+{
+	uint32_t irq = spin_lock_blocking(core1_mailbox_lock);
+
+	if (enabled && !output_latency_mode)
+		memset(&output_latency, 0, sizeof(output_latency));
+	output_latency_mode = enabled;
+	output_latency_t_cmd = 0;
+	spin_unlock(core1_mailbox_lock, irq);
+}
+
+bool get_output_latency_stats(struct output_latency_stats *stats)
+{
+	uint32_t irq = spin_lock_blocking(core1_mailbox_lock);
+
+	memcpy(stats, &output_latency, sizeof(*stats));
+	spin_unlock(core1_mailbox_lock, irq);
+
+	return output_latency_mode;
+}
+
+void mark_output_change()
+{
+	uint32_t irq;
+
+	if (!output_latency_mode)
+		return;
+
+	/* Timestamp is read and cleared by update_core1_state() */
+	irq = spin_lock_blocking(core1_mailbox_lock);
+	if (output_latency_mode && !output_latency_t_cmd)
+		output_latency_t_cmd = to_us_since_boot(get_absolute_time());
+	spin_unlock(core1_mailbox_lock, irq);
+}
+
+static void update_output_latency_stats(uint64_t t_cmd, uint64_t t_applied)
+{
+	uint32_t latency = t_applied - t_cmd;
+	uint32_t irq = spin_lock_blocking(core1_mailbox_lock);
+	struct output_latency_stats *s = &output_latency;
+
+	if (s->count == 0 || latency < s->min)
+		s->min = latency;
+	if (s->count == 0 || latency > s->max)
+		s->max = latency;
+	s->last = latency;
+	s->count++;
+	spin_unlock(core1_mailbox_lock, irq);
+
+	log_msg(LOG_INFO, "output change latency: %lu us", latency);
+}
+
+static volatile bool effect_tick = false;
+static volatile bool effect_stats_reset = false;
+static struct effect_tick_stats effect_stats;
+static spin_lock_t *effect_stats_lock = NULL;
+
+
+/* Output level ramp (run by core1) */
+struct output_ramp {
+	uint8_t id;
+	uint16_t from;      /* output level when ramp was started */
+	uint64_t t_start;
+	uint64_t len;       /* ramp duration (us), 0 = no ramp active */
+};
+
+
+static inline uint16_t output_ramp_level(struct output_ramp *r, uint16_t target, uint64_t t)
+{
+	uint64_t elapsed = t - r->t_start;
+
+	if (elapsed >= r->len) {
+		r->len = 0;
+		return target;
+	}
+
+	return r->from + ((int64_t)target - r->from) * (int64_t)elapsed / (int64_t)r->len;
+}
+
+static void effect_alarm_callback(uint alarm_num)
+{
+	effect_tick = true;
+}
+
+static uint32_t effect_period_us(uint32_t rate)
+{
+	if (rate < EFFECT_RATE_MIN)
+		rate = EFFECT_RATE_MIN;
+	else if (rate > EFFECT_RATE_MAX)
+		rate = EFFECT_RATE_MAX;
+
+	return 1000000 / rate;
+}
+
+static void update_effect_tick_stats(uint32_t rate, int64_t jitter, uint32_t missed)
+{
+	uint32_t irq = spin_lock_blocking(effect_stats_lock);
+	struct effect_tick_stats *s = &effect_stats;
+
+	if (effect_stats_reset || s->rate != rate) {
+		memset(s, 0, sizeof(*s));
+		s->rate = rate;
+		effect_stats_reset = false;
+	}
+	if (s->ticks == 0 || jitter < s->jitter_min)
+		s->jitter_min = jitter;
+	if (s->ticks == 0 || jitter > s->jitter_max)
+		s->jitter_max = jitter;
+	s->jitter_sum += jitter;
+	s->missed += missed;
+	s->ticks++;
+
+	spin_unlock(effect_stats_lock, irq);
+}
+
+void get_effect_tick_stats(struct effect_tick_stats *stats)
+{
+	uint32_t irq;
+
+	if (!effect_stats_lock) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+	irq = spin_lock_blocking(effect_stats_lock);
+	memcpy(stats, &effect_stats, sizeof(*stats));
+	spin_unlock(effect_stats_lock, irq);
+}
+
+void reset_effect_tick_stats()
+{
+	effect_stats_reset = true;
 }
 
 void core1_main()
 {
-	struct brickpico_config *config = &core1_config;
+	const struct core1_config *config = core1_config_view;
 	struct brickpico_state *state = &core1_state;
 	struct brickpico_state prev_state;
-	absolute_time_t t_now, t_last, t_config, t_state, t_tick, t_effect;
+	absolute_time_t t_now, t_tick, t_effect;
 	int64_t max_delta = 0;
-	int64_t delta;
-	uint8_t pwm[OUTPUT_MAX_COUNT];
+	int64_t delta, jitter;
+	uint16_t level[OUTPUT_MAX_COUNT];
+	uint16_t stream_level[OUTPUT_MAX_COUNT];
+	struct output_ramp ramp[OUTPUT_MAX_COUNT];
+	uint8_t r_id[OUTPUT_MAX_COUNT];
+	uint32_t r_ms[OUTPUT_MAX_COUNT];
+	uint32_t rate, period, missed;
+	uint32_t seq = 0;
+	uint32_t power_version = 0;
+	uint32_t frame_seq, latency_seq = 0;
+	uint64_t t_cmd = 0;
+	uint64_t latency_t_cmd = 0;
+	uint64_t t_applied;
+	uint effect_alarm;
+	bool tick;
+	bool direct = false;
 
 	log_msg(LOG_INFO, "core1: started...");
-	memset(pwm, 0, sizeof(pwm));
+	memset(level, 0, sizeof(level));
+	memset(stream_level, 0, sizeof(stream_level));
+	memset(ramp, 0, sizeof(ramp));
 
 	/* Allow core0 to pause this core... */
 	multicore_lockout_victim_init();
 
-	clear_state(&prev_state);
-	t_last = t_effect = t_config = t_state = t_tick = get_absolute_time();
+	effect_stats_lock = spin_lock_init(spin_lock_claim_unused(true));
 
-	while (1) {
-		t_now = get_absolute_time();
-		delta = absolute_time_diff_us(t_last, t_now);
-		t_last = t_now;
+	/* Effect updates are driven by a hardware alarm (with IRQ on this core)... */
+	effect_alarm = hardware_alarm_claim_unused(true);
+	hardware_alarm_set_callback(effect_alarm, effect_alarm_callback);
 
-		if (delta > max_delta) {
-			max_delta = delta;
-			log_msg(LOG_INFO, "core1: max_loop_time=%lld", max_delta);
-		}
+	/* Frame update (end of DMA chain) interrupt on this core too... */
+	setup_pwm_frame_irq();
 
-		if (time_passed(&t_tick, 60000)) {
-			log_msg(LOG_DEBUG, "tick");
-		}
+	clear_state(&prev_state);
+	t_tick = get_absolute_time();
+	rate = config->effect_rate;
+	period = effect_period_us(rate);
+	log_msg(LOG_INFO, "core1: effect update rate %lu Hz", 1000000 / period);
+	t_effect = delayed_by_us(t_tick, period);
+	if (hardware_alarm_set_target(effect_alarm, t_effect))
+		effect_tick = true;
 
-		if (time_passed(&t_config, 4000)) {
-			/* Attempt to update (read) config from core0 */
-			if (mutex_enter_timeout_us(config_mutex, 100)) {
-				memcpy(config, cfg, sizeof(*config));
-				mutex_exit(config_mutex);
-			} else {
-				log_msg(LOG_INFO, "failed to get config_mutex");
-			}
-		}
+	while (1) {
+		/* Let core0 know which config version is in use */
+		__dmb();
+		core1_config_ack = config->version;
+
+		/* Sleep until next effect tick or state/config change from core0... */
+		while (!effect_tick && core1_mailbox.seq == seq)
+			__wfe();
+		tick = effect_tick;
+		if (tick)
+			effect_tick = false;
 
-		if (time_passed(&t_state, 250)) {
-			/* Attempt to update (read) state from core0 */
-			if (mutex_enter_timeout_us(state_mutex, 100)) {
-				memcpy(&prev_state, state, sizeof(prev_state));
-				memcpy(state, &transfer_state, sizeof(*state));
-				mutex_exit(state_mutex);
+		t_now = get_absolute_time();
 
+		if (core1_mailbox.seq != seq) {
+			/* Read updated state (and config view) from core0 */
+			memcpy(prev_state.pwm, state->pwm, sizeof(prev_state.pwm));
+			memcpy(prev_state.pwr, state->pwr, sizeof(prev_state.pwr));
+			if (read_core1_mailbox(state, &config, &direct, stream_level,
+						r_id, r_ms, &seq, &t_cmd)) {
 				/* Check for changes... */
 				for(int i = 0; i < OUTPUT_COUNT; i++) {
+					if (ramp[i].id != r_id[i]) {
+						/* Start ramp from current output level */
+						ramp[i].id = r_id[i];
+						ramp[i].from = level[i];
+						ramp[i].t_start = to_us_since_boot(t_now);
+						ramp[i].len = (uint64_t)r_ms[i] * 1000;
+						log_msg(LOG_INFO, "output%d: ramp to '%u' in %lu ms", i + 1,
+							state->pwm[i], r_ms[i]);
+					}
 					if (prev_state.pwm[i] != state->pwm[i]) {
 						log_msg(LOG_INFO, "output%d: PWM change '%u' -> '%u'", i + 1,
 							prev_state.pwm[i], state->pwm[i]);
@@ -322,25 +977,206 @@ void core1_main()
 							prev_state.pwr[i], state->pwr[i]);
 					}
 				}
-			} else {
-				log_msg(LOG_INFO, "failed to get state_mutex");
 			}
 		}
 
-		if (time_passed(&t_effect, 100)) {
-			uint8_t new;
-			uint64_t t = to_us_since_boot(get_absolute_time());
+		/* Update power limits when config view has changed */
+		if (config->version != power_version) {
+			power_version = config->version;
+			set_pwm_power_budget(config->power_budget);
+			for (int i = 0; i < OUTPUT_COUNT; i++)
+				set_pwm_output_power(i, config->outputs[i].max_current,
+						config->outputs[i].priority);
+		}
+
+		/* Update light effects... */
+		{
+			uint16_t new;
+			uint64_t t = to_us_since_boot(t_now);
 
 			for(int i = 0; i < OUTPUT_COUNT; i++) {
-				new = light_effect(config->outputs[i].effect,
-						config->outputs[i].effect_ctx,
-						t, state->pwm[i],state->pwr[i]);
+				if (direct)
+					new = stream_level[i];
+				else
+					new = light_effect_hr(config->outputs[i].effect,
+							config->outputs[i].effect_ctx,
+							t, state->pwm[i],state->pwr[i]);
+				if (ramp[i].len && !direct)
+					new = output_ramp_level(&ramp[i], new, t);
+
+				if (new != level[i]) {
+					set_pwm_frame_lightness(i, new);
+					level[i] = new;
+				}
+			}
+			frame_seq = get_pwm_frame_seq();
+			if (update_pwm_frame() && t_cmd) {
+				/* Measure latency only if change was pushed out in a frame */
+				if (get_pwm_frame_seq() != frame_seq && !latency_t_cmd) {
+					latency_t_cmd = t_cmd;
+					latency_seq = get_pwm_frame_seq();
+				}
+				t_cmd = 0;
+			}
+			if (latency_t_cmd && get_pwm_frame_applied(latency_seq, &t_applied)) {
+				update_output_latency_stats(latency_t_cmd, t_applied);
+				latency_t_cmd = 0;
+			}
+		}
+
+		if (!tick)
+			continue;
+
+		/* Schedule next tick... */
+		jitter = absolute_time_diff_us(t_effect, t_now);
+		missed = 0;
+		if (rate != config->effect_rate) {
+			rate = config->effect_rate;
+			period = effect_period_us(rate);
+			log_msg(LOG_INFO, "core1: effect update rate %lu Hz", 1000000 / period);
+			t_effect = t_now;
+		}
+		t_effect = delayed_by_us(t_effect, period);
+		if (absolute_time_diff_us(t_now, t_effect) <= 0) {
+			/* Fell behind, skip missed ticks */
+			missed = absolute_time_diff_us(t_effect, t_now) / period + 1;
+			t_effect = delayed_by_us(t_effect, (uint64_t)missed * period);
+		}
+		update_effect_tick_stats(1000000 / period, jitter, missed);
+
+		if (time_passed(&t_tick, 60000)) {
+			log_msg(LOG_DEBUG, "tick");
+		}
 
-				if (new != pwm[i]) {
-					set_pwm_lightness(i, new);
-					pwm[i] = new;
+		if (hardware_alarm_set_target(effect_alarm, t_effect)) {
+			/* Target already passed, run next tick immediately */
+			effect_tick = true;
+		}
+
+		delta = absolute_time_diff_us(t_now, get_absolute_time());
+		if (delta > max_delta) {
+			max_delta = delta;
+			log_msg(LOG_INFO, "core1: max_loop_time=%lld", max_delta);
+		}
+	}
+}
+
+
+/* Return last stdio driver currently registered. */
+struct stdio_driver* last_stdio_driver()
+{
+	struct stdio_driver *d = &stdio_usb;
+
+	while (d->next)
+		d = d->next;
+
+	return d;
+}
+
+/* Attach stdio driver registered after given driver (prev) as
+   the console input of a command source. */
+void set_console_driver(enum command_sources source, struct stdio_driver *prev)
+{
+	struct console_input *in;
+
+	if (source >= CONSOLE_SOURCE_COUNT || !prev)
+		return;
+
+	in = &console_input[source];
+	in->driver = NULL;
+	in->prev = prev;
+	in->pending = true;
+	in->len = 0;
+}
+
+static bool console_driver_in_use(const struct stdio_driver *d)
+{
+	for (int i = 0; i < CONSOLE_SOURCE_COUNT; i++) {
+		if (console_input[i].driver == d)
+			return true;
+	}
+	return false;
+}
+
+/* Resolve drivers of sources whose driver was not yet registered
+   when server was started. */
+static void resolve_console_drivers()
+{
+	for (int i = 0; i < CONSOLE_SOURCE_COUNT; i++) {
+		struct console_input *in = &console_input[i];
+		struct stdio_driver *d;
+
+		if (!in->pending)
+			continue;
+		for (d = in->prev->next; d; d = d->next) {
+			if (!console_driver_in_use(d)) {
+				in->driver = d;
+				in->pending = false;
+				break;
+			}
+		}
+	}
+}
+
+/* Return identifier of current session of a command source. */
+uint32_t command_source_session(enum command_sources source)
+{
+	switch (source) {
+	case CMD_SOURCE_USB:
+		return usb_session;
+#if WIFI_SUPPORT
+	case CMD_SOURCE_TELNET:
+		return telnetserver_session();
+	case CMD_SOURCE_SSH:
+		return sshserver_session();
+	case CMD_SOURCE_MQTT:
+		return brickpico_mqtt_session();
+#endif
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static void process_console_input(const struct brickpico_config *cfg)
+{
+	bool connected = stdio_usb_connected();
+	char c;
+
+	/* New USB session whenever host (dis)connects */
+	if (connected != usb_connected) {
+		usb_connected = connected;
+		usb_session++;
+	}
+	resolve_console_drivers();
+
+	for (int i = 0; i < CONSOLE_SOURCE_COUNT; i++) {
+		struct console_input *in = &console_input[i];
+
+		if (!in->driver || !in->driver->in_chars)
+			continue;
+
+		while (!stream_mode_active() && in->driver->in_chars(&c, 1) == 1) {
+			if (c == (char)0xff || c == 0x00)
+				continue;
+			if (c == 0x7f || c == 0x08) {
+				if (in->len > 0) in->len--;
+				if (cfg->local_echo) printf("\b \b");
+				continue;
+			}
+			if (c == 10 || c == 13 || in->len >= CONSOLE_INPUT_MAX) {
+				if (cfg->local_echo) printf("\r\n");
+				in->buf[in->len] = 0;
+				if (in->len > 0) {
+					process_command(brickpico_state, (struct brickpico_config *)cfg, in->buf, i);
+					in->len = 0;
+					update_core1_state();
 				}
+				continue;
 			}
+			in->buf[in->len++] = c;
+			if (cfg->local_echo) printf("%c", c);
 		}
 	}
 }
@@ -350,19 +1186,16 @@ int main()
 {
 	absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(t_led, 0);
 	absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(t_network, 0);
-	absolute_time_t t_now, t_last, t_display, t_timer, t_temp, t_i2c_temp, t_ram;
+	absolute_time_t t_now, t_last, t_display, t_temp, t_i2c_temp, t_ram;
 	uint8_t led_state = 0;
 	int64_t max_delta = 0;
 	int64_t delta;
-	int c;
-	char input_buf[1024 + 1];
-	int i_ptr = 0;
 	int i2c_temp_delay = 1000;
 
 
 	set_binary_info(&system_settings);
 	clear_state(&system_state);
-	clear_state(&transfer_state);
+	core1_mailbox_lock = spin_lock_init(spin_lock_claim_unused(true));
 
 	/* Initialize MCU and other hardware... */
 	if (get_debug_level() >= 2)
@@ -372,18 +1205,21 @@ int main()
 		print_mallinfo();
 
 	/* Start second core (core1)... */
-	memcpy(&core1_config, cfg, sizeof(core1_config));
+	update_core1_config();
 	memcpy(&core1_state, &system_state, sizeof(core1_state));
 	update_core1_state();
 	multicore_launch_core1(core1_main);
 
+	/* Convert legacy config file now that flash writes can lock out core1 */
+	migrate_config();
+
 #if WATCHDOG_ENABLED
 	watchdog_enable(WATCHDOG_REBOOT_DELAY, 1);
 	log_msg(LOG_NOTICE, "Watchdog enabled.");
 #endif
 
 	t_last = get_absolute_time();
-	t_ram = t_i2c_temp = t_temp = t_timer = t_display = t_last;
+	t_ram = t_i2c_temp = t_temp = t_display = t_last;
 
 	while (1) {
 		t_now = get_absolute_time();
@@ -424,13 +1260,18 @@ int main()
 
 		/* Update display every 1000ms */
 		if (time_passed(&t_display, 1000)) {
+			check_command_batch();
 			update_core1_state();
+			update_core1_config();
 			display_status(brickpico_state, cfg);
 		}
 
 		/* Check for timer events */
-		if (time_passed(&t_timer, 10000)) {
-			handle_timer_events(cfg, brickpico_state);
+		if (handle_timer_events(cfg, brickpico_state) > 0) {
+			if (core1_batch)
+				core1_batch_defer(BATCH_DEFER_TIMER, "timer");
+			update_core1_config();
+			update_core1_state();
 		}
 
 		/* Check temperature */
@@ -444,27 +1285,9 @@ int main()
 		}
 
 		/* Process any (user) input */
-		while ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT) {
-			if (c == 0xff || c == 0x00)
-				continue;
-			if (c == 0x7f || c == 0x08) {
-				if (i_ptr > 0) i_ptr--;
-				if (cfg->local_echo) printf("\b \b");
-				continue;
-			}
-			if (c == 10 || c == 13 || i_ptr >= sizeof(input_buf) - 1) {
-				if (cfg->local_echo) printf("\r\n");
-				input_buf[i_ptr] = 0;
-				if (i_ptr > 0) {
-					process_command(brickpico_state, (struct brickpico_config *)cfg, input_buf);
-					i_ptr = 0;
-					update_core1_state();
-				}
-				continue;
-			}
-			input_buf[i_ptr++] = c;
-			if (cfg->local_echo) printf("%c", c);
-		}
+		process_stream_input();
+		if (!stream_mode_active())
+			process_console_input(cfg);
 #if WATCHDOG_ENABLED
 		watchdog_update();
 #endif
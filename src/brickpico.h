@@ -33,6 +33,9 @@
 
 #include "effects.h"
 #include "ringbuffer.h"
+#include "json_writer.h"
+#include "crc32.h"
+#include "solar.h"
 
 #ifndef BRICKPICO_MODEL
 #error unknown board model
@@ -45,6 +48,8 @@
 #define VSENSOR_COUNT            8
 
 #define MAX_NAME_LEN           64
+#define MAX_GAMMA_LEN          32
+#define MAX_PWM_PHASE_LEN      64
 #define MAX_MAP_POINTS         32
 #define MAX_GPIO_PINS          32
 
@@ -77,8 +82,17 @@
 #endif
 
 #define MAX_EVENT_NAME_LEN     30
+#define MAX_EVENT_ARGS_LEN     32
+#define TIMER_RAMP_MAX         65535
 #define MAX_EVENT_COUNT        20
 
+#define EFFECT_RATE_MIN        10     /* Light effect update rate limits (Hz) */
+#define EFFECT_RATE_MAX        1000
+#define OUTPUT_CURRENT_MAX     10000  /* Output full-scale current limit (mA) */
+#define POWER_BUDGET_MAX       65535  /* Power budget limit (mA) */
+#define POWER_PRIORITY_MAX     9
+#define EFFECT_RATE_DEFAULT    100
+
 #define BRICKPICO_FS_SIZE  (256*1024)
 #define BRICKPICO_FS_OFFSET  (PICO_FLASH_SIZE_BYTES - BRICKPICO_FS_SIZE)
 
@@ -87,8 +101,21 @@ enum timer_action_types {
 	ACTION_NONE = 0,
 	ACTION_ON = 1,
 	ACTION_OFF = 2,
+	ACTION_PWM = 3,
+	ACTION_EFFECT = 4,
+	ACTION_RAMP = 5,
+};
+#define TIMER_ACTION_ENUM_MAX 5
+
+enum timer_trigger_types {
+	TRIGGER_TIME = 0,
+	TRIGGER_DAWN = 1,
+	TRIGGER_SUNRISE = 2,
+	TRIGGER_SUNSET = 3,
+	TRIGGER_DUSK = 4,
 };
-#define TIMER_ACTION_ENUM_MAX 2
+#define TIMER_TRIGGER_ENUM_MAX 4
+#define TIMER_OFFSET_MAX 720
 
 enum vsensor_modes {
 	VSMODE_MANUAL = 0,
@@ -101,6 +128,16 @@ enum vsensor_modes {
 };
 #define VSMODE_ENUM_MAX 6
 
+enum command_sources {
+	CMD_SOURCE_USB = 0,      /* USB (CDC) console */
+	CMD_SOURCE_SERIAL = 1,   /* TTL serial (UART) console */
+	CMD_SOURCE_TELNET = 2,
+	CMD_SOURCE_SSH = 3,
+	CMD_SOURCE_MQTT = 4,
+};
+#define CONSOLE_SOURCE_COUNT 4  /* sources with (stdio) console input */
+#define CMD_SOURCE_COUNT 5
+
 
 struct ssh_public_key {
 	char username[MAX_USERNAME_LEN + 1];
@@ -112,11 +149,18 @@ struct ssh_public_key {
 
 struct timer_event {
 	char name[MAX_EVENT_NAME_LEN];
+	uint8_t trigger;        /* enum timer_trigger_types */
+	int16_t offset;         /* offset (minutes) from sunrise, sunset, etc. */
 	int8_t minute;          /* 0-59 */
 	int8_t hour;            /* 0-23 */
+	int8_t second;          /* 0-59 */
 	uint8_t wday;            /* bitmask for weekdays */
 	enum timer_action_types action;
 	uint16_t mask;          /* bitmask of outputs this applies to */
+	uint8_t pwm;            /* PWM, RAMP: (target) level 0..100 */
+	uint16_t duration;      /* RAMP: ramp duration (seconds) */
+	enum light_effect_types effect;  /* EFFECT: effect to set */
+	char effect_args[MAX_EVENT_ARGS_LEN];
 };
 
 struct pwm_output {
@@ -128,6 +172,10 @@ struct pwm_output {
 	uint8_t default_pwm;   /* 0..100 (PWM duty cycle) */
 	uint8_t default_state; /* 0 = off, 1 = on */
 	uint8_t type; /* 0 = Dimmer, 1 = Toggle (on/off) */
+	char gamma[MAX_GAMMA_LEN]; /* Lightness curve ("" = use system default) */
+	bool dither;   /* temporal dithering of PWM level */
+	uint16_t max_current;  /* current at 100% duty cycle (mA), 0 = not counted */
+	uint8_t priority;      /* power limiting priority (higher served first) */
 
 	/* Light effect settings */
 	enum light_effect_types effect;
@@ -155,13 +203,18 @@ struct brickpico_config {
 	char display_theme[16];
 	char display_logo[16];
 	char display_layout_r[64];
-	char gamma[16];
+	char gamma[MAX_GAMMA_LEN];
 	char name[32];
 	char timezone[64];
+	float latitude;
+	float longitude;
 	bool spi_active;
 	bool serial_active;
 	uint32_t i2c_speed;
 	uint pwm_freq;
+	char pwm_phase[MAX_PWM_PHASE_LEN];
+	uint32_t effect_rate;
+	uint32_t power_budget;  /* mA, 0 = no limit */
 	struct timer_event events[MAX_EVENT_COUNT];
 	uint8_t event_count;
 	double adc_ref_voltage;
@@ -214,6 +267,13 @@ struct brickpico_config {
 	void *i2c_context[VSENSOR_MAX_COUNT];
 };
 
+struct config_file_info {
+	uint32_t saves;         /* number of times configuration has been saved */
+	time_t last_save;       /* time of last save (0 = unknown) */
+	uint32_t size;          /* size of configuration data (0 = not saved) */
+	uint32_t crc32;         /* checksum of configuration data */
+};
+
 /* Firmware settings that can be modified with picotool */
 struct brickpico_fw_settings {
 	bool safemode;         /* Safe mode disables loading saved configuration during boot. */
@@ -224,6 +284,11 @@ struct brickpico_state {
 	/* outputs */
 	uint8_t pwm[OUTPUT_MAX_COUNT];
 	uint8_t pwr[OUTPUT_MAX_COUNT];
+	/* light effects set by timer events (override configured effect,
+	   not saved in configuration) */
+	uint8_t timer_effect[OUTPUT_MAX_COUNT];
+	enum light_effect_types effect[OUTPUT_MAX_COUNT];
+	void *effect_ctx[OUTPUT_MAX_COUNT];
 	float temp;
 	float temp_prev;
 	float vtemp[VSENSOR_MAX_COUNT];
@@ -233,14 +298,54 @@ struct brickpico_state {
 	float vtemp_prev[VSENSOR_MAX_COUNT];
 };
 
+struct effect_tick_stats {
+	uint32_t rate;          /* effect update rate (Hz) */
+	uint32_t ticks;         /* number of effect updates */
+	uint32_t missed;        /* number of missed (skipped) ticks */
+	int32_t jitter_min;     /* wakeup latency (us) */
+	int32_t jitter_max;
+	uint64_t jitter_sum;
+};
+
+struct output_latency_stats {
+	uint32_t count;         /* number of measured output changes */
+	uint32_t last;          /* command to PWM update latency (us) */
+	uint32_t min;
+	uint32_t max;
+};
+
+struct pwm_power_stats {
+	uint32_t budget;        /* power budget (mA), 0 = no limit */
+	uint32_t demand;        /* estimated current before limiting (mA) */
+	uint32_t current;       /* estimated current (mA) */
+	uint32_t peak;          /* peak estimated current (mA) */
+	uint16_t limited;       /* bitmask of outputs being limited */
+};
+
+struct stream_stats {
+	uint32_t frames;        /* valid frames received */
+	uint32_t level_frames;  /* output level frames received */
+	uint32_t crc_errors;
+	uint32_t frame_errors;  /* framing (COBS) or length errors */
+};
+
+#define PERSISTENT_LOG_SIZE        8192
+#define PERSISTENT_LOG_CHUNK_SIZE  512
+#define PERSISTENT_LOG_CHUNKS      (PERSISTENT_LOG_SIZE / PERSISTENT_LOG_CHUNK_SIZE)
+
+/* Persistent memory is split into independently checksummed segments:
+   header, log ringbuffer metadata and log buffer (in chunks). */
 struct persistent_memory_block {
 	uint32_t id;
 	struct timespec saved_time;
 	uint64_t uptime;
 	uint64_t prev_uptime;
+	uint32_t firmware_crc32;   /* checksum of firmware that wrote the log */
+	uint32_t header_crc32;
 	u8_ringbuffer_t log_rb;
-	uint32_t crc32;
-	uint8_t log[8192];
+	uint32_t log_rb_crc32;
+	uint32_t log_crc32[PERSISTENT_LOG_CHUNKS];
+	uint8_t log[PERSISTENT_LOG_SIZE];
 };
 
 
@@ -251,17 +356,36 @@ extern struct persistent_memory_block *persistent_mem;
 extern struct brickpico_state *brickpico_state;
 extern bool rebooted_by_watchdog;
 extern mutex_t *pmem_mutex;
-extern mutex_t *state_mutex;
 void update_persistent_memory_crc();
+void update_persistent_memory_log_crc(size_t offset, size_t len);
 void update_persistent_memory();
 void update_display_state();
 void update_core1_state();
+void update_core1_config();
+void begin_core1_batch();
+void commit_core1_batch();
+bool core1_batch_active();
+void set_direct_output_levels(const uint16_t *level, uint count);
+void clear_direct_output_levels();
+void retire_effect_ctx(void *ctx);
+void start_output_ramp(uint out, uint32_t duration_ms);
+void get_effect_tick_stats(struct effect_tick_stats *stats);
+void reset_effect_tick_stats();
+void set_output_latency_mode(bool enabled);
+bool get_output_latency_stats(struct output_latency_stats *stats);
+void mark_output_change();
+struct stdio_driver;
+struct stdio_driver* last_stdio_driver();
+void set_console_driver(enum command_sources source, struct stdio_driver *prev);
+uint32_t command_source_session(enum command_sources source);
 
 /* bi_decl.c */
 void set_binary_info(struct brickpico_fw_settings *settings);
 
 /* command.c */
-void process_command(struct brickpico_state *state, struct brickpico_config *config, char *command);
+void process_command(struct brickpico_state *state, struct brickpico_config *config, char *command,
+		enum command_sources source);
+void check_command_batch();
 int cmd_version(const char *cmd, const char *args, int query, char *prev_cmd);
 int last_command_status();
 
@@ -275,10 +399,19 @@ int str_to_ssh_pubkey(const char *s, struct ssh_public_key *pk);
 const char* ssh_pubkey_to_str(const struct ssh_public_key *pk, char *s, size_t s_len);
 #endif
 void read_config(bool use_default_config);
-void save_config();
+void config_to_json(json_writer_t *w, const void *arg);
+int save_config();
+void migrate_config();
+void get_config_file_info(struct config_file_info *info, uint32_t *skipped);
 void delete_config();
 void print_config();
 
+/* config_tlv.c */
+int config_to_tlv(const struct brickpico_config *cfg, uint8_t **bufptr, uint32_t *sizeptr,
+		struct config_file_info *info);
+int tlv_to_config(const uint8_t *buf, uint32_t size, struct brickpico_config *cfg,
+		struct config_file_info *info);
+
 /* display.c */
 void display_init();
 void clear_display();
@@ -297,6 +430,7 @@ const char* effect2str(enum light_effect_types effect);
 void* effect_parse_args(enum light_effect_types effect, const char *args);
 char* effect_print_args(enum light_effect_types effect, void *ctx);
 uint8_t light_effect(enum light_effect_types effect, void *ctx, uint64_t t, uint8_t pwm, uint8_t pwr);
+uint16_t light_effect_hr(enum light_effect_types effect, void *ctx, uint64_t t, uint8_t pwm, uint8_t pwr);
 
 /* flash.h */
 void lfs_setup(bool multicore);
@@ -323,17 +457,20 @@ const char *network_hostname();
 #if WIFI_SUPPORT
 bool wifi_get_auth_type(const char *name, uint32_t *type);
 const char* wifi_auth_type_name(uint32_t type);
+uint32_t tcp_client_id(uint16_t port);
 
 /* httpd.c */
 void brickpico_setup_http_handlers();
 
 /* telnetd.c */
 void tcpserver_init();
+uint32_t telnetserver_session();
 
 /* sshd.c */
 void sshserver_init();
 void sshserver_disconnect();
 void sshserver_who();
+uint32_t sshserver_session();
 
 /* ssh_util.c */
 void ssh_list_pkeys();
@@ -350,6 +487,7 @@ void brickpico_mqtt_publish_duty();
 void brickpico_mqtt_publish_temp();
 void brickpico_mqtt_scpi_command();
 void brickpico_mqtt_poll();
+uint32_t brickpico_mqtt_session();
 
 #endif
 
@@ -370,6 +508,19 @@ void setup_pwm_inputs();
 void setup_pwm_outputs();
 void set_pwm_duty_cycle(uint out, float duty);
 void set_pwm_lightness(uint out, uint lightness);
+void set_pwm_lightness_hr(uint out, uint16_t level);
+void set_pwm_frame_lightness(uint out, uint16_t level);
+int valid_lightness_curve(const char *spec);
+int valid_pwm_phase(const char *spec);
+void update_pwm_config();
+bool update_pwm_frame();
+void setup_pwm_frame_irq();
+uint32_t get_pwm_frame_seq();
+bool get_pwm_frame_applied(uint32_t seq, uint64_t *t);
+void set_pwm_power_budget(uint32_t budget);
+void set_pwm_output_power(uint out, uint16_t max_current, uint8_t priority);
+void get_pwm_power_stats(struct pwm_power_stats *stats);
+void reset_pwm_power_peak();
 float get_pwm_duty_cycle(uint fan);
 void get_pwm_duty_cycles(const struct brickpico_config *config);
 
@@ -380,19 +531,40 @@ const char* log_priority2str(int pri);
 int str2log_facility(const char *facility);
 const char* log_facility2str(int facility);
 void log_msg(int priority, const char *format, ...);
+uint32_t get_log_dropped_count();
+uint32_t get_log_rb_dropped_count();
+bool get_log_binary_mode();
+void set_log_binary_mode(bool enabled);
+int log_entry_str(const uint8_t *entry, size_t len, char *buf, size_t size);
+int log_rb_drop_binary(u8_ringbuffer_t *rb);
 int get_debug_level();
 void set_debug_level(int level);
 int get_log_level();
 void set_log_level(int level);
 int get_syslog_level();
 void set_syslog_level(int level);
+int get_console_log_level();
+void set_console_log_level(int level);
 void debug(int debug_level, const char *fmt, ...);
 
+/* stream.c */
+void start_stream_mode();
+bool stream_mode_active();
+void process_stream_input();
+void get_stream_stats(struct stream_stats *stats);
+
 /* timer.c */
 int parse_timer_event_str(const char *str, struct timer_event *event);
 const char* timer_event_str(const struct timer_event *event);
+time_t next_timer_event_time(const struct timer_event *e, time_t after);
+time_t prev_timer_event_time(const struct timer_event *e, time_t before);
+void reschedule_timer_events();
+void set_timer_clock(const struct timespec *ts);
+void catchup_timer_events();
 int handle_timer_events(const struct brickpico_config *conf, struct brickpico_state *state);
 const char* timer_action_type_str(enum timer_action_types type);
+const char* timer_action_str(const struct timer_event *e, char *buf, size_t size);
+const char* timer_trigger_str(const struct timer_event *e, char *buf, size_t size);
 
 /* util.c */
 void print_mallinfo();
@@ -441,8 +613,5 @@ void update_temp(const struct brickpico_config *conf, struct brickpico_state *st
 double get_vsensor(uint8_t i, const struct brickpico_config *config,
 		struct brickpico_state *state);
 
-/* crc32.c */
-unsigned int xcrc32 (const unsigned char *buf, int len, unsigned int init);
-
 
 #endif /* BRICKPICO_H */
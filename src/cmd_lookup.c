@@ -0,0 +1,156 @@
+/* cmd_lookup.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Command lookup index (hardware independent).
+
+   For each level of the command tree, entries are grouped into buckets
+   by (case folded) first character. Within a bucket entries are kept in
+   the original table order, so the first match (with same min_match
+   semantics) is found same as with a linear search. */
+
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "cmd_lookup.h"
+
+
+#define CMD_LOOKUP_LEVELS   48
+#define CMD_LOOKUP_ENTRIES  320
+#define CMD_LOOKUP_BUCKETS  32
+#define CMD_BUCKET(c) (toupper((unsigned char)(c)) & (CMD_LOOKUP_BUCKETS - 1))
+
+struct cmd_lookup {
+	const struct cmd_t *level;
+	uint16_t base;     /* offset to cmd_lookup_order[] and cmd_lookup_child[] */
+	uint8_t bucket[CMD_LOOKUP_BUCKETS + 1];
+};
+
+static struct cmd_lookup cmd_lookup[CMD_LOOKUP_LEVELS];
+static uint8_t cmd_lookup_order[CMD_LOOKUP_ENTRIES];  /* entries sorted by bucket */
+static int8_t cmd_lookup_child[CMD_LOOKUP_ENTRIES];   /* lookup index of subcmds */
+static int cmd_lookup_count = -1;
+static int cmd_lookup_entries = 0;
+
+
+int get_cmd_lookup(const struct cmd_t *level)
+{
+	for (int i = 0; i < cmd_lookup_count; i++) {
+		if (cmd_lookup[i].level == level)
+			return i;
+	}
+	return -1;
+}
+
+
+static int build_cmd_lookup(const struct cmd_t *level)
+{
+	struct cmd_lookup *lk;
+	int idx, count = 0;
+	int i, b, n;
+
+	if ((idx = get_cmd_lookup(level)) >= 0)
+		return idx;
+
+	while (level[count].cmd) {
+		/* Entries without min_match would match anything */
+		if (level[count].min_match < 1)
+			return -1;
+		count++;
+	}
+	if (cmd_lookup_count >= CMD_LOOKUP_LEVELS
+		|| cmd_lookup_entries + count > CMD_LOOKUP_ENTRIES
+		|| count > 255)
+		return -1;
+
+	idx = cmd_lookup_count++;
+	lk = &cmd_lookup[idx];
+	lk->level = level;
+	lk->base = cmd_lookup_entries;
+	cmd_lookup_entries += count;
+
+	/* Counting sort (stable) by bucket */
+	memset(lk->bucket, 0, sizeof(lk->bucket));
+	for (i = 0; i < count; i++)
+		lk->bucket[CMD_BUCKET(level[i].cmd[0]) + 1]++;
+	for (b = 0; b < CMD_LOOKUP_BUCKETS; b++)
+		lk->bucket[b + 1] += lk->bucket[b];
+	for (b = 0; b < CMD_LOOKUP_BUCKETS; b++) {
+		n = lk->bucket[b];
+		for (i = 0; i < count; i++) {
+			if (CMD_BUCKET(level[i].cmd[0]) == b)
+				cmd_lookup_order[lk->base + n++] = i;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		cmd_lookup_child[lk->base + i] = -1;
+		if (level[i].subcmds)
+			cmd_lookup_child[lk->base + i] = build_cmd_lookup(level[i].subcmds);
+	}
+
+	return idx;
+}
+
+
+/* Find command from given command level.
+   Lookup index (*lkidx) is updated to match the command found. */
+const struct cmd_t* find_cmd(const struct cmd_t *level, int *lkidx, const char *s)
+{
+	const struct cmd_lookup *lk;
+	int i, b;
+
+	if (*lkidx < 0) {
+		/* Level not indexed, fallback to linear search */
+		for (i = 0; level[i].cmd; i++) {
+			if (!strncasecmp(s, level[i].cmd, level[i].min_match))
+				return &level[i];
+		}
+		return NULL;
+	}
+
+	lk = &cmd_lookup[*lkidx];
+	b = CMD_BUCKET(s[0]);
+	for (i = lk->bucket[b]; i < lk->bucket[b + 1]; i++) {
+		int e = cmd_lookup_order[lk->base + i];
+		const struct cmd_t *c = &level[e];
+		if (!strncasecmp(s, c->cmd, c->min_match)) {
+			*lkidx = cmd_lookup_child[lk->base + e];
+			return c;
+		}
+	}
+
+	return NULL;
+}
+
+
+/* Build lookup index for command tree (if not yet built). */
+void cmd_lookup_init(const struct cmd_t *root)
+{
+	if (cmd_lookup_count >= 0)
+		return;
+
+	cmd_lookup_count = 0;
+	build_cmd_lookup(root);
+}
+
+
+/* eof :-) */
@@ -0,0 +1,41 @@
+/* cmd_lookup.h
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BRICKPICO_CMD_LOOKUP_H
+#define BRICKPICO_CMD_LOOKUP_H 1
+
+#include <stdint.h>
+
+struct cmd_t {
+	const char   *cmd;
+	uint8_t       min_match;
+	const struct cmd_t *subcmds;
+	int (*func)(const char *cmd, const char *args, int query, char *prev_cmd);
+};
+
+
+/* cmd_lookup.c */
+void cmd_lookup_init(const struct cmd_t *root);
+int get_cmd_lookup(const struct cmd_t *level);
+const struct cmd_t* find_cmd(const struct cmd_t *level, int *lkidx, const char *s);
+
+
+#endif /* BRICKPICO_CMD_LOOKUP_H */
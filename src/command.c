@@ -37,6 +37,7 @@
 #include "pico_sensor_lib.h"
 
 #include "brickpico.h"
+#include "cmd_lookup.h"
 #ifdef WIFI_SUPPORT
 #include "lwip/ip_addr.h"
 #include "lwip/stats.h"
@@ -45,13 +46,6 @@
 
 
 
-struct cmd_t {
-	const char   *cmd;
-	uint8_t       min_match;
-	const struct cmd_t *subcmds;
-	int (*func)(const char *cmd, const char *args, int query, char *prev_cmd);
-};
-
 struct error_t {
 	const char    *error;
 	int            error_num;
@@ -62,6 +56,7 @@ const struct error_t error_codes[] = {
 	{ "Command Error", -100 },
 	{ "Syntax Error", -102 },
 	{ "Undefined Header", -113 },
+	{ "Settings Conflict", -221 },
 	{ NULL, 0 }
 };
 
@@ -70,6 +65,26 @@ int last_error_num = 0;
 struct brickpico_state *st = NULL;
 struct brickpico_config *conf = NULL;
 
+#define BATCH_TIMEOUT_MS 30000
+
+/* Batch mode: publishing changes to core1 is deferred from SYS:BATCH:BEGIN
+   until SYS:BATCH:COMMIT. Batch belongs to the session (command source and
+   session of that source) that started it, while it is open, changes from
+   other sessions are rejected. */
+static bool batch_mode = false;
+static enum command_sources batch_source = CMD_SOURCE_USB;
+static uint32_t batch_session = 0;
+static absolute_time_t batch_t_start;
+static enum command_sources cmd_source = CMD_SOURCE_USB;
+
+static const char *command_source_names[CMD_SOURCE_COUNT] = {
+	"USB",
+	"Serial",
+	"Telnet",
+	"SSH",
+	"MQTT",
+};
+
 /* credits.s */
 extern const char brickpico_credits_text[];
 
@@ -370,17 +385,66 @@ int cmd_log_level(const char *cmd, const char *args, int query, char *prev_cmd)
 	return 0;
 }
 
+int cmd_console_log_level(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	int level = get_console_log_level();
+	int new_level;
+	const char *name, *new_name;
+
+	name = log_priority2str(level);
+
+	if (query) {
+		if (name) {
+			printf("%s\n", name);
+		} else {
+			printf("%d\n", level);
+		}
+	} else {
+		if ((new_level = str2log_priority(args)) < 0)
+			return 1;
+		new_name = log_priority2str(new_level);
+
+		log_msg(LOG_NOTICE, "Change console log level: %s (%d) -> %s (%d)",
+			(name ? name : ""), level, new_name, new_level);
+		set_console_log_level(new_level);
+	}
+	return 0;
+}
+
+int cmd_log_dropped(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (!query)
+		return 1;
+
+	printf("%lu,%lu\n", get_log_dropped_count(), get_log_rb_dropped_count());
+	return 0;
+}
+
+int cmd_log_binary(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	bool val = get_log_binary_mode();
+	int ret;
+
+	ret = bool_setting(cmd, args, query, prev_cmd, &val, "Binary log mode");
+	if (!query && ret == 0)
+		set_log_binary_mode(val);
+	return ret;
+}
+
 #define MEM_LOG_BUF_SIZE 256
+#define MEM_LOG_STR_SIZE 320
 
 int cmd_mem_log(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	int c, o, len, next, prev;
 	uint8_t *buf;
+	char *str;
 
 	if (!query)
 		return 1;
-	if (!(buf = malloc(MEM_LOG_BUF_SIZE)))
+	if (!(buf = malloc(MEM_LOG_BUF_SIZE + MEM_LOG_STR_SIZE)))
 		return 2;
+	str = (char*)buf + MEM_LOG_BUF_SIZE;
 
 	printf("logbuffer: items=%u, size=%u, free=%u\n",
 		log_rb->items, log_rb->size, log_rb->free);
@@ -390,8 +454,10 @@ int cmd_mem_log(const char *cmd, const char *args, int query, char *prev_cmd)
 	do {
 		c++;
 		len = u8_ringbuffer_peek(log_rb, o, buf, MEM_LOG_BUF_SIZE, &next, &prev);
-		if (len > 0)
-			printf(">%s\n", buf);
+		if (len > 0) {
+			log_entry_str(buf, len, str, MEM_LOG_STR_SIZE);
+			printf(">%s\n", str);
+		}
 		o = next;
 	} while (len > 0 && o >= 0);
 
@@ -434,7 +500,8 @@ int cmd_echo(const char *cmd, const char *args, int query, char *prev_cmd)
 int cmd_gamma(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	return string_setting(cmd, args, query, prev_cmd,
-			conf->gamma, sizeof(conf->gamma), "Gamma Correction", NULL);
+			conf->gamma, sizeof(conf->gamma), "Gamma Correction",
+			valid_lightness_curve);
 }
 
 int cmd_display_type(const char *cmd, const char *args, int query, char *prev_cmd)
@@ -486,10 +553,20 @@ int cmd_reset(const char *cmd, const char *args, int query, char *prev_cmd)
 
 int cmd_save_config(const char *cmd, const char *args, int query, char *prev_cmd)
 {
-	if (query)
-		return 1;
-	save_config(true);
-	return 0;
+	struct config_file_info info;
+	uint32_t skipped;
+	char buf[32];
+
+	if (query) {
+		get_config_file_info(&info, &skipped);
+		if (info.last_save)
+			time_t_to_str(buf, sizeof(buf), info.last_save);
+		else
+			strncopy(buf, "N/A", sizeof(buf));
+		printf("%lu,%s,%lu\n", info.saves, buf, skipped);
+		return 0;
+	}
+	return (save_config() ? 2 : 0);
 }
 
 int cmd_print_config(const char *cmd, const char *args, int query, char *prev_cmd)
@@ -539,6 +616,32 @@ int cmd_read(const char *cmd, const char *args, int query, char *prev_cmd)
 	return 0;
 }
 
+int cmd_current(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	struct pwm_power_stats s;
+
+	if (!query)
+		return 1;
+
+	get_pwm_power_stats(&s);
+	printf("%lu\n", s.current);
+
+	return 0;
+}
+
+int cmd_current_peak(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	struct pwm_power_stats s;
+
+	if (!query)
+		return 1;
+
+	get_pwm_power_stats(&s);
+	printf("%lu\n", s.peak);
+
+	return 0;
+}
+
 int cmd_defaults_pwm(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	if (query)
@@ -578,6 +681,64 @@ int cmd_out_name(const char *cmd, const char *args, int query, char *prev_cmd)
 	return 1;
 }
 
+int cmd_out_gamma(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	int out = atoi(&prev_cmd[6]) - 1;
+	char name[32];
+
+	if (out >= 0 && out < OUTPUT_COUNT) {
+		snprintf(name, sizeof(name), "output%d: Gamma Correction", out + 1);
+		return string_setting(cmd, args, query, prev_cmd,
+				conf->outputs[out].gamma, sizeof(conf->outputs[out].gamma),
+				name, valid_lightness_curve);
+	}
+	return 1;
+}
+
+int cmd_out_dither(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	int out = atoi(&prev_cmd[6]) - 1;
+	char name[32];
+
+	if (out >= 0 && out < OUTPUT_COUNT) {
+		snprintf(name, sizeof(name), "output%d: PWM dithering", out + 1);
+		return bool_setting(cmd, args, query, prev_cmd,
+				&conf->outputs[out].dither, name);
+	}
+	return 1;
+}
+
+int cmd_out_current(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	int out = atoi(&prev_cmd[6]) - 1;
+	char name[40];
+	uint32_t val;
+	int ret;
+
+	if (out >= 0 && out < OUTPUT_COUNT) {
+		snprintf(name, sizeof(name), "output%d: Full-scale current (mA)", out + 1);
+		val = conf->outputs[out].max_current;
+		ret = uint32_setting(cmd, args, query, prev_cmd,
+				&val, 0, OUTPUT_CURRENT_MAX, name);
+		conf->outputs[out].max_current = val;
+		return ret;
+	}
+	return 1;
+}
+
+int cmd_out_priority(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	int out = atoi(&prev_cmd[6]) - 1;
+	char name[32];
+
+	if (out >= 0 && out < OUTPUT_COUNT) {
+		snprintf(name, sizeof(name), "output%d: Power priority", out + 1);
+		return uint8_setting(cmd, args, query, prev_cmd,
+				&conf->outputs[out].priority, 0, POWER_PRIORITY_MAX, name);
+	}
+	return 1;
+}
+
 int cmd_out_min_pwm(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	int out, val;
@@ -740,10 +901,17 @@ int cmd_out_effect(const char *cmd, const char *args, int query, char *prev_cmd)
 			tok = strtok_r(NULL, "\n", &saveptr);
 			new_ctx = effect_parse_args(new_effect, tok ? tok : "");
 			if (new_effect == EFFECT_NONE || new_ctx != NULL) {
+				/* core1 may still be using the old context */
+				retire_effect_ctx(o->effect_ctx);
 				o->effect = new_effect;
-				if (o->effect_ctx)
-					free(o->effect_ctx);
 				o->effect_ctx = new_ctx;
+				/* Configured effect replaces effect set by timer event */
+				if (st->timer_effect[out]) {
+					retire_effect_ctx(st->effect_ctx[out]);
+					st->effect[out] = EFFECT_NONE;
+					st->effect_ctx[out] = NULL;
+					st->timer_effect[out] = 0;
+				}
 			} else {
 				ret = 1;
 			}
@@ -780,6 +948,7 @@ int cmd_write_state(const char *cmd, const char *args, int query, char *prev_cmd
 				log_msg(LOG_INFO, "output%d: change power %s", out + 1,
 					(val ? "ON" : "OFF"));
 				st->pwr[out] = val;
+				mark_output_change();
 			}
 			return 0;
 		} else {
@@ -808,6 +977,7 @@ int cmd_write_pwm(const char *cmd, const char *args, int query, char *prev_cmd)
 					log_msg(LOG_INFO, "output%d: change PWM %d%% --> %d%%", out + 1,
 						st->pwm[out], val);
 					st->pwm[out] = val;
+					mark_output_change();
 				}
 				return 0;
 			} else {
@@ -821,6 +991,101 @@ int cmd_write_pwm(const char *cmd, const char *args, int query, char *prev_cmd)
 	return 1;
 }
 
+/* Parse comma separated list of values for all outputs (PWM 0-100, or ON/OFF
+   when state is true). Single value is applied to all outputs, empty item
+   leaves that output unchanged (-1). Returns 0 if list is valid. */
+static int parse_output_values(const char *args, int *vals, bool state)
+{
+	char *s, *tok, *next;
+	int count = 0;
+	int ret = 0;
+
+	if (!args || !*args)
+		return -1;
+	if (!(s = strdup(args)))
+		return -2;
+
+	for (tok = s; tok && ret == 0; tok = next) {
+		if ((next = strchr(tok, ',')))
+			*next++ = 0;
+		tok = trim_str(tok);
+		if (count >= OUTPUT_COUNT) {
+			ret = -1;
+		} else if (!*tok) {
+			vals[count++] = -1;
+		} else if (state) {
+			if (!strcasecmp(tok, "on"))
+				vals[count++] = 1;
+			else if (!strcasecmp(tok, "off"))
+				vals[count++] = 0;
+			else
+				ret = -1;
+		} else {
+			if (str_to_int(tok, &vals[count], 10)
+				&& vals[count] >= 0 && vals[count] <= 100)
+				count++;
+			else
+				ret = -1;
+		}
+	}
+	free(s);
+
+	if (ret == 0) {
+		if (count == 1) {
+			for (int i = 1; i < OUTPUT_COUNT; i++)
+				vals[i] = vals[0];
+		} else {
+			for (int i = count; i < OUTPUT_COUNT; i++)
+				vals[i] = -1;
+		}
+	}
+
+	return ret;
+}
+
+static int write_all_outputs(const char *args, bool state)
+{
+	uint8_t *cur = (state ? st->pwr : st->pwm);
+	int vals[OUTPUT_MAX_COUNT];
+	bool changed = false;
+
+	if (parse_output_values(args, vals, state)) {
+		log_msg(LOG_WARNING, "invalid new values for %s: %s",
+			(state ? "power" : "PWM"), args);
+		return 2;
+	}
+
+	/* All outputs updated with single (command) lock and change notification */
+	for (int i = 0; i < OUTPUT_COUNT; i++) {
+		if (vals[i] < 0 || cur[i] == vals[i])
+			continue;
+		log_msg(LOG_INFO, "output%d: change %s %d --> %d", i + 1,
+			(state ? "power" : "PWM"), cur[i], vals[i]);
+		cur[i] = vals[i];
+		changed = true;
+	}
+	if (changed)
+		mark_output_change();
+
+	return 0;
+}
+
+int cmd_write_all_state(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (query)
+		return 1;
+
+	return write_all_outputs(args, true);
+}
+
+int cmd_write_all_pwm(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (query)
+		return 1;
+
+	return write_all_outputs(args, false);
+}
+
 int cmd_wifi(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	if (query) {
@@ -1435,12 +1700,7 @@ int cmd_time(const char *cmd, const char *args, int query, char *prev_cmd)
 	}
 
 	if (str_to_time_t(args, &t)) {
-		time_t_to_timespec(t, &ts);
-		if (aon_timer_is_running()) {
-			aon_timer_set_time(&ts);
-		} else {
-			aon_timer_start(&ts);
-		}
+		set_timer_clock(time_t_to_timespec(t, &ts));
 		time_t_to_str(buf, sizeof(buf), t);
 		log_msg(LOG_NOTICE, "Set system clock: %s", buf);
 		return 0;
@@ -1455,6 +1715,30 @@ int cmd_timezone(const char *cmd, const char *args, int query, char *prev_cmd)
 			conf->timezone, sizeof(conf->timezone), "Timezone", NULL);
 }
 
+int cmd_location(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	float lat, lon;
+
+	if (query) {
+		printf("%.5f,%.5f\n", conf->latitude, conf->longitude);
+		return 0;
+	}
+
+	if (sscanf(args, "%f,%f", &lat, &lon) != 2)
+		return 1;
+	if (lat < -90.0 || lat > 90.0 || lon < -180.0 || lon > 180.0)
+		return 1;
+	if (lat != conf->latitude || lon != conf->longitude) {
+		log_msg(LOG_NOTICE, "Location change '%.5f,%.5f' --> '%.5f,%.5f'",
+			conf->latitude, conf->longitude, lat, lon);
+		conf->latitude = lat;
+		conf->longitude = lon;
+		reschedule_timer_events();
+	}
+
+	return 0;
+}
+
 int cmd_uptime(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	uint32_t secs = to_us_since_boot(get_absolute_time()) / 1000000;
@@ -1709,6 +1993,13 @@ int cmd_spi(const char *cmd, const char *args, int query, char *prev_cmd)
 			&conf->spi_active, "SPI (LCD Display) status");
 }
 
+int cmd_pwm_phase(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	return string_setting(cmd, args, query, prev_cmd,
+			conf->pwm_phase, sizeof(conf->pwm_phase), "PWM Phase",
+			valid_pwm_phase);
+}
+
 int cmd_pwm_freq(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	int val;
@@ -1732,6 +2023,145 @@ int cmd_pwm_freq(const char *cmd, const char *args, int query, char *prev_cmd)
 	return 1;
 }
 
+int cmd_effect_rate(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	return uint32_setting(cmd, args, query, prev_cmd,
+			&conf->effect_rate, EFFECT_RATE_MIN, EFFECT_RATE_MAX,
+			"Effect update rate (Hz)");
+}
+
+int cmd_effect_stats(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	struct effect_tick_stats s;
+
+	if (!query) {
+		reset_effect_tick_stats();
+		return 0;
+	}
+
+	get_effect_tick_stats(&s);
+	printf("Rate (Hz):          %lu\n", s.rate);
+	printf("Ticks:              %lu\n", s.ticks);
+	printf("Missed ticks:       %lu\n", s.missed);
+	printf("Jitter min (us):    %ld\n", s.jitter_min);
+	printf("Jitter avg (us):    %lu\n", (uint32_t)(s.ticks > 0 ? s.jitter_sum / s.ticks : 0));
+	printf("Jitter max (us):    %ld\n", s.jitter_max);
+
+	return 0;
+}
+
+int cmd_power_budget(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	return uint32_setting(cmd, args, query, prev_cmd,
+			&conf->power_budget, 0, POWER_BUDGET_MAX,
+			"Power budget (mA)");
+}
+
+int cmd_power_stats(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	struct pwm_power_stats s;
+
+	if (!query) {
+		reset_pwm_power_peak();
+		return 0;
+	}
+
+	get_pwm_power_stats(&s);
+	printf("Budget (mA):        %lu\n", s.budget);
+	printf("Demand (mA):        %lu\n", s.demand);
+	printf("Current (mA):       %lu\n", s.current);
+	printf("Peak current (mA):  %lu\n", s.peak);
+	printf("Limited outputs:    %s\n", bitmask_to_str(s.limited, OUTPUT_COUNT, 1, true));
+
+	return 0;
+}
+
+int cmd_effect_latency(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	struct output_latency_stats s;
+	bool mode;
+	int val;
+
+	if (query) {
+		mode = get_output_latency_stats(&s);
+		printf("Mode:               %u\n", mode);
+		printf("Samples:            %lu\n", s.count);
+		printf("Latency last (us):  %lu\n", s.last);
+		printf("Latency min (us):   %lu\n", s.min);
+		printf("Latency max (us):   %lu\n", s.max);
+		return 0;
+	}
+
+	if (str_to_int(args, &val, 10)) {
+		log_msg(LOG_NOTICE, "Output latency measurement mode: %s",
+			(val ? "enabled" : "disabled"));
+		set_output_latency_mode(val ? true : false);
+		return 0;
+	}
+	return 1;
+}
+
+int cmd_batch(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (!query)
+		return 1;
+
+	printf("%u\n", batch_mode);
+	return 0;
+}
+
+int cmd_batch_begin(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (query)
+		return 1;
+
+	if (batch_mode) {
+		log_msg(LOG_NOTICE, "Batch already started");
+		return 2;
+	}
+	batch_mode = true;
+	batch_source = cmd_source;
+	batch_session = command_source_session(cmd_source);
+	log_msg(LOG_INFO, "Batch started (%s session %08lx)",
+		command_source_names[batch_source], batch_session);
+	batch_t_start = get_absolute_time();
+	begin_core1_batch();
+	return 0;
+}
+
+int cmd_batch_commit(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	if (query)
+		return 1;
+
+	if (!batch_mode) {
+		log_msg(LOG_NOTICE, "No batch started");
+		return 2;
+	}
+	log_msg(LOG_INFO, "Batch committed");
+	batch_mode = false;
+	commit_core1_batch();
+	return 0;
+}
+
+int cmd_stream(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	struct stream_stats s;
+
+	if (query) {
+		get_stream_stats(&s);
+		printf("Active:             %u\n", stream_mode_active());
+		printf("Frames:             %lu\n", s.frames);
+		printf("Level frames:       %lu\n", s.level_frames);
+		printf("CRC errors:         %lu\n", s.crc_errors);
+		printf("Framing errors:     %lu\n", s.frame_errors);
+		return 0;
+	}
+
+	start_stream_mode();
+	return 0;
+}
+
 int cmd_timer(const char *cmd, const char *args, int query, char *prev_cmd)
 {
 	int i;
@@ -1765,6 +2195,7 @@ int cmd_timer_add(const char *cmd, const char *args, int query, char *prev_cmd)
 	}
 	memcpy(&conf->events[conf->event_count], &e, sizeof(struct timer_event));
 	conf->event_count++;
+	reschedule_timer_events();
 	log_msg(LOG_NOTICE, "Added new timer entry: %s", timer_event_str(&e));
 
 	return 0;
@@ -1785,6 +2216,7 @@ int cmd_timer_del(const char *cmd, const char *args, int query, char *prev_cmd)
 				memcpy(&conf->events[i], &conf->events[i + 1], sizeof(struct timer_event));
 			}
 			conf->event_count--;
+			reschedule_timer_events();
 			res = 0;
 		} else {
 			log_msg(LOG_WARNING, "Timer event does not exist: %d", idx);
@@ -2208,10 +2640,38 @@ const struct cmd_t i2c_commands[] = {
 	{ 0, 0, 0, 0 }
 };
 
+const struct cmd_t log_commands[] = {
+	{ "BINary",    3, NULL,              cmd_log_binary },
+	{ "CONSole",   4, NULL,              cmd_console_log_level },
+	{ "DROPped",   4, NULL,              cmd_log_dropped },
+	{ 0, 0, 0, 0 }
+};
+
+const struct cmd_t system_effect_commands[] = {
+	{ "LATency",   3, NULL,              cmd_effect_latency },
+	{ "RATE",      4, NULL,              cmd_effect_rate },
+	{ "STATS",     5, NULL,              cmd_effect_stats },
+	{ 0, 0, 0, 0 }
+};
+
+const struct cmd_t system_power_commands[] = {
+	{ "BUDget",    3, NULL,              cmd_power_budget },
+	{ "STATS",     5, NULL,              cmd_power_stats },
+	{ 0, 0, 0, 0 }
+};
+
+const struct cmd_t batch_commands[] = {
+	{ "BEGin",     3, NULL,              cmd_batch_begin },
+	{ "COMMit",    4, NULL,              cmd_batch_commit },
+	{ 0, 0, 0, 0 }
+};
+
 const struct cmd_t system_commands[] = {
+	{ "BATCH",     5, batch_commands,    cmd_batch },
 	{ "DEBUG",     5, NULL,              cmd_debug }, /* Obsolete ? */
 	{ "DISPlay",   4, display_commands,  cmd_display_type },
 	{ "ECHO",      4, NULL,              cmd_echo },
+	{ "EFFect",    3, system_effect_commands, NULL },
 	{ "ERRor",     3, NULL,              cmd_err },
 	{ "FLASH",     5, NULL,              cmd_flash },
 	{ "I2C",       3, i2c_commands,      cmd_i2c },
@@ -2219,13 +2679,17 @@ const struct cmd_t system_commands[] = {
 	{ "OUTputs",   3, NULL,              cmd_outputs },
 	{ "LED",       3, NULL,              cmd_led },
 	{ "LFS",       3, lfs_commands,      cmd_lfs },
-	{ "LOG",       3, NULL,              cmd_log_level },
+	{ "LOCation",  3, NULL,              cmd_location },
+	{ "LOG",       3, log_commands,      cmd_log_level },
 	{ "MEMLOG",    6, NULL,              cmd_mem_log },
 	{ "MEMory",    3, NULL,              cmd_memory },
 	{ "NAME",      4, NULL,              cmd_name },
+	{ "POWer",     3, system_power_commands, NULL },
+	{ "PWMPHase",  5, NULL,              cmd_pwm_phase },
 	{ "PWMfreq",   3, NULL,              cmd_pwm_freq },
 	{ "SERIAL",    6, NULL,              cmd_serial },
 	{ "SPI",       3, NULL,              cmd_spi },
+	{ "STREAM",    6, NULL,              cmd_stream },
 	{ "SYSLOG",    6, NULL,              cmd_syslog_level },
 	{ "TIMEZONE",  8, NULL,              cmd_timezone },
 	{ "TIME",      4, NULL,              cmd_time },
@@ -2250,10 +2714,14 @@ const struct cmd_t defaults_c_commands[] = {
 };
 
 const struct cmd_t output_c_commands[] = {
+	{ "CURRent",   4, NULL,              cmd_out_current },
+	{ "DITher",    3, NULL,              cmd_out_dither },
 	{ "EFFect",    3, NULL,              cmd_out_effect },
+	{ "GAMMA",     5, NULL,              cmd_out_gamma },
 	{ "MAXpwm",    3, NULL,              cmd_out_max_pwm },
 	{ "MINpwm",    3, NULL,              cmd_out_min_pwm },
 	{ "NAME",      4, NULL,              cmd_out_name },
+	{ "PRIOrity",  4, NULL,              cmd_out_priority },
 	{ "PWM",       3, NULL,              cmd_out_default_pwm },
 	{ "STAte",     3, NULL,              cmd_out_default_state },
 	{ 0, 0, 0, 0 }
@@ -2302,7 +2770,13 @@ const struct cmd_t vsensor_commands[] = {
 	{ 0, 0, 0, 0 }
 };
 
+const struct cmd_t current_commands[] = {
+	{ "PEAK",      4, NULL,              cmd_current_peak },
+	{ 0, 0, 0, 0 }
+};
+
 const struct cmd_t measure_commands[] = {
+	{ "CURRent",   4, current_commands,  cmd_current },
 	{ "OUTPUT",    6, output_commands,   cmd_out_read },
 	{ "Read",      1, NULL,              cmd_read },
 	{ "VSENSORS",  8, NULL,              cmd_vsensors_read },
@@ -2310,7 +2784,14 @@ const struct cmd_t measure_commands[] = {
 	{ 0, 0, 0, 0 }
 };
 
+const struct cmd_t write_oa_commands[] = {
+	{ "PWM",       3, NULL,              cmd_write_all_pwm },
+	{ "STAte",     3, NULL,              cmd_write_all_state },
+	{ 0, 0, 0, 0 }
+};
+
 const struct cmd_t write_o_commands[] = {
+	{ "ALL",       3, write_oa_commands, cmd_write_all_state },
 	{ "PWM",       3, NULL,              cmd_write_pwm },
 	{ "STAte",     3, NULL,              cmd_write_state },
 	{ 0, 0, 0, 0 }
@@ -2347,9 +2828,13 @@ const struct cmd_t commands[] = {
 
 const struct cmd_t* run_cmd(char *cmd, const struct cmd_t *cmd_level, char **prev_subcmd)
 {
-	int i, query, cmd_len, total_len;
+	int query, cmd_len, total_len;
 	char *saveptr1, *saveptr2, *t, *sub, *s, *arg;
+	const struct cmd_t *c;
 	int res = -1;
+	int lkidx, next_lkidx;
+
+	cmd_lookup_init(commands);
 
 	total_len = strlen(cmd);
 	t = strtok_r(cmd, " \t", &saveptr1);
@@ -2360,35 +2845,41 @@ const struct cmd_t* run_cmd(char *cmd, const struct cmd_t *cmd_level, char **pre
 			cmd_level = commands;
 			*prev_subcmd = NULL;
 		}
+		lkidx = get_cmd_lookup(cmd_level);
+
 		/* Split command to subcommands and search from command tree ... */
 		sub = strtok_r(t, ":", &saveptr2);
 		while (sub && strlen(sub) > 0) {
 			s = sub;
 			sub = NULL;
-			i = 0;
-			while (cmd_level[i].cmd) {
-				if (!strncasecmp(s, cmd_level[i].cmd, cmd_level[i].min_match)) {
-					sub = strtok_r(NULL, ":", &saveptr2);
-					if (cmd_level[i].subcmds && sub && strlen(sub) > 0) {
-						/* Match for subcommand...*/
-						*prev_subcmd = s;
-						cmd_level = cmd_level[i].subcmds;
-					} else if (cmd_level[i].func) {
-						/* Match for command */
-						query = (s[strlen(s)-1] == '?' ? 1 : 0);
-						arg = t + cmd_len + 1;
+			next_lkidx = lkidx;
+			if ((c = find_cmd(cmd_level, &next_lkidx, s))) {
+				sub = strtok_r(NULL, ":", &saveptr2);
+				if (c->subcmds && sub && strlen(sub) > 0) {
+					/* Match for subcommand...*/
+					*prev_subcmd = s;
+					cmd_level = c->subcmds;
+					lkidx = (lkidx < 0 ? get_cmd_lookup(cmd_level) : next_lkidx);
+				} else if (c->func) {
+					/* Match for command */
+					query = (s[strlen(s)-1] == '?' ? 1 : 0);
+					arg = t + cmd_len + 1;
+					if (!query && batch_mode && (cmd_source != batch_source
+							|| command_source_session(cmd_source) != batch_session)) {
+						log_msg(LOG_NOTICE, "Batch active (in %s session), command rejected",
+							command_source_names[batch_source]);
+						res = 3;
+					} else {
 						if (!query)
 							mutex_enter_blocking(config_mutex);
-						res = cmd_level[i].func(s,
+						res = c->func(s,
 								(total_len > cmd_len+1 ? arg : ""),
 								query,
 								(*prev_subcmd ? *prev_subcmd : ""));
 						if (!query)
 							mutex_exit(config_mutex);
 					}
-					break;
 				}
-				i++;
 			}
 		}
 	}
@@ -2405,6 +2896,9 @@ const struct cmd_t* run_cmd(char *cmd, const struct cmd_t *cmd_level, char **pre
 	}
 	else if (res == 2) {
 		last_error_num = -102;
+	}
+	else if (res == 3) {
+		last_error_num = -221;
 	} else {
 		last_error_num = -1;
 	}
@@ -2413,7 +2907,8 @@ const struct cmd_t* run_cmd(char *cmd, const struct cmd_t *cmd_level, char **pre
 }
 
 
-void process_command(struct brickpico_state *state, struct brickpico_config *config, char *command)
+void process_command(struct brickpico_state *state, struct brickpico_config *config, char *command,
+		enum command_sources source)
 {
 	char *saveptr, *cmd;
 	char *prev_subcmd = NULL;
@@ -2424,6 +2919,8 @@ void process_command(struct brickpico_state *state, struct brickpico_config *con
 
 	st = state;
 	conf = config;
+	cmd_source = source;
+	check_command_batch();
 
 	cmd = strtok_r(command, ";", &saveptr);
 	while (cmd) {
@@ -2434,6 +2931,28 @@ void process_command(struct brickpico_state *state, struct brickpico_config *con
 		}
 		cmd = strtok_r(NULL, ";", &saveptr);
 	}
+
+	/* Publish (possibly) changed settings to core1 */
+	update_core1_config();
+}
+
+
+void check_command_batch()
+{
+	if (!batch_mode)
+		return;
+
+	if (command_source_session(batch_source) != batch_session) {
+		log_msg(LOG_WARNING, "%s session that started batch has closed, ending batch now",
+			command_source_names[batch_source]);
+	} else if (absolute_time_diff_us(batch_t_start, get_absolute_time()) > BATCH_TIMEOUT_MS * 1000) {
+		log_msg(LOG_WARNING, "Batch not committed in %d seconds, committing now",
+			BATCH_TIMEOUT_MS / 1000);
+	} else {
+		return;
+	}
+	batch_mode = false;
+	commit_core1_batch();
 }
 
 int last_command_status()
@@ -24,6 +24,7 @@
 #include <string.h>
 #include "pico/stdlib.h"
 #include "pico/mutex.h"
+#include "pico/aon_timer.h"
 #include "cJSON.h"
 #include "pico_sensor_lib.h"
 #ifdef WIFI_SUPPORT
@@ -33,10 +34,16 @@
 #include "brickpico.h"
 
 
+#define CONFIG_FILE       "brickpico.dat"
+#define JSON_CONFIG_FILE  "brickpico.cfg"     /* legacy (JSON) config file */
+
 struct brickpico_config brickpico_config;
 const struct brickpico_config *cfg = &brickpico_config;
 auto_init_mutex(config_mutex_inst);
 mutex_t *config_mutex = &config_mutex_inst;
+static bool config_migrate = false;
+static struct config_file_info config_file;  /* configuration saved in flash */
+static uint32_t config_saves_skipped = 0;
 
 
 
@@ -96,21 +103,18 @@ void json2effect(cJSON *item, enum light_effect_types *effect, void **effect_ctx
 }
 
 
-cJSON* effect2json(enum light_effect_types effect, void *effect_ctx)
+static void effect2json(json_writer_t *w, const char *key,
+			enum light_effect_types effect, void *effect_ctx)
 {
-	cJSON *o;
 	char *s;
 
-	if ((o = cJSON_CreateObject()) == NULL)
-		return NULL;
-
-	cJSON_AddItemToObject(o, "name", cJSON_CreateString(effect2str(effect)));
+	json_writer_begin_object(w, key);
+	json_writer_add_string(w, "name", effect2str(effect));
 	s = effect_print_args(effect, effect_ctx);
-	cJSON_AddItemToObject(o, "args", cJSON_CreateString(s ? s : ""));
+	json_writer_add_string(w, "args", s ? s : "");
 	if (s)
 		free(s);
-
-	return o;
+	json_writer_end_object(w);
 }
 
 
@@ -133,20 +137,17 @@ void json2vsensors(cJSON *item, uint8_t *s)
 }
 
 
-cJSON* vsensors2json(const uint8_t *s)
+static void vsensors2json(json_writer_t *w, const char *key, const uint8_t *s)
 {
 	int i;
-	cJSON *o;
-
-	if ((o = cJSON_CreateArray()) == NULL)
-		return NULL;
 
+	json_writer_begin_array(w, key);
 	for (i = 0; i < VSENSOR_SOURCE_MAX_COUNT; i++) {
 		if (s[i]) {
-			cJSON_AddItemToArray(o, cJSON_CreateNumber(s[i]));
+			json_writer_add_number(w, NULL, s[i]);
 		}
 	}
-	return o;
+	json_writer_end_array(w);
 }
 
 #ifdef WIFI_SUPPORT
@@ -251,41 +252,38 @@ static void json2sshpubkeys(cJSON *list, struct ssh_public_key *keys)
 	}
 }
 
-static cJSON* sshpubkeys2json(const struct ssh_public_key *keys)
+static void sshpubkeys2json(json_writer_t *w, const char *key,
+			const struct ssh_public_key *keys)
 {
 	const size_t buf_len = 256;
 	char *buf;
 	int count = 0;
-	cJSON *o, *r;
+
+	for (int i = 0; i < SSH_MAX_PUB_KEYS; i++) {
+		if (keys[i].pubkey_size > 0 && strlen(keys[i].username) > 0)
+			count++;
+	}
+	if (count < 1)
+		return;
 
 	if (!(buf = calloc(1, buf_len)))
-		return NULL;
+		return;
 
-	if ((o = cJSON_CreateArray())) {
-		for (int i = 0; i < SSH_MAX_PUB_KEYS; i++) {
-			const struct ssh_public_key *k = &keys[i];
-			if (k->pubkey_size > 0 && strlen(k->username) > 0) {
-				if (ssh_pubkey_to_str(k, buf, buf_len)) {
-					if ((r = cJSON_CreateObject())) {
-						cJSON_AddItemToObject(r, "pubkey",
-								cJSON_CreateString(buf));
-						cJSON_AddItemToObject(r, "user",
-								cJSON_CreateString(k->username));
-						cJSON_AddItemToArray(o, r);
-						count++;
-					}
-				}
+	json_writer_begin_array(w, key);
+	for (int i = 0; i < SSH_MAX_PUB_KEYS; i++) {
+		const struct ssh_public_key *k = &keys[i];
+		if (k->pubkey_size > 0 && strlen(k->username) > 0) {
+			if (ssh_pubkey_to_str(k, buf, buf_len)) {
+				json_writer_begin_object(w, NULL);
+				json_writer_add_string(w, "pubkey", buf);
+				json_writer_add_string(w, "user", k->username);
+				json_writer_end_object(w);
 			}
 		}
 	}
+	json_writer_end_array(w);
 
 	free(buf);
-	if (count < 1) {
-		cJSON_Delete(o);
-		o = NULL;
-	}
-
-	return o;
 }
 #endif
 
@@ -306,6 +304,10 @@ void clear_config(struct brickpico_config *cfg)
 		o->default_pwm = 100;
 		o->default_state = 0;
 		o->type = 0;
+		o->gamma[0] = 0;
+		o->dither = false;
+		o->max_current = 0;
+		o->priority = 0;
 		o->effect = EFFECT_NONE;
 		o->effect_ctx = NULL;
 	}
@@ -333,11 +335,18 @@ void clear_config(struct brickpico_config *cfg)
 	for (i = 0; i < MAX_EVENT_COUNT; i++) {
 		struct timer_event *e = &cfg->events[i];
 		e->name[0] = 0;
+		e->trigger = TRIGGER_TIME;
+		e->offset = 0;
 		e->minute = -1;
 		e->hour = -1;
+		e->second = 0;
 		e->wday = 0;
 		e->action = ACTION_NONE;
 		e->mask = 0;
+		e->pwm = 0;
+		e->duration = 0;
+		e->effect = EFFECT_NONE;
+		e->effect_args[0] = 0;
 	}
 	cfg->event_count = 0;
 
@@ -347,6 +356,9 @@ void clear_config(struct brickpico_config *cfg)
 	cfg->i2c_speed = I2C_DEFAULT_SPEED;
 	cfg->led_mode = 0;
 	cfg->pwm_freq = 1000;
+	cfg->pwm_phase[0] = 0;
+	cfg->effect_rate = EFFECT_RATE_DEFAULT;
+	cfg->power_budget = 0;
 	cfg->adc_ref_voltage = 3.3;
 	cfg->temp_offset = 0.0;
 	cfg->temp_coefficient = 1.0;
@@ -357,6 +369,8 @@ void clear_config(struct brickpico_config *cfg)
 	strncopy(cfg->display_layout_r, "", sizeof(cfg->display_layout_r));
 	strncopy(cfg->gamma, "", sizeof(cfg->gamma));
 	strncopy(cfg->timezone, "", sizeof(cfg->timezone));
+	cfg->latitude = 0.0;
+	cfg->longitude = 0.0;
 #ifdef WIFI_SUPPORT
 	cfg->wifi_ssid[0] = 0;
 	cfg->wifi_passwd[0] = 0;
@@ -412,28 +426,32 @@ void clear_config(struct brickpico_config *cfg)
 
 #define STRING_TO_JSON(name, var) {					\
 	if (strlen(var) > 0)						\
-		cJSON_AddItemToObject(config, name, cJSON_CreateString(var)); \
+		json_writer_add_string(w, name, var);			\
 }
 
-cJSON *config_to_json(const struct brickpico_config *cfg)
+/* Generate JSON representation of the configuration. */
+void config_to_json(json_writer_t *w, const void *arg)
 {
-	cJSON *config = cJSON_CreateObject();
-	cJSON *outputs, *events, *vsensors, *o;
+	const struct brickpico_config *cfg = arg;
 	int i;
 
-	if (!config)
-		return NULL;
-
-	cJSON_AddItemToObject(config, "id", cJSON_CreateString("brickpico-config-v1"));
-	cJSON_AddItemToObject(config, "debug", cJSON_CreateNumber(get_debug_level()));
-	cJSON_AddItemToObject(config, "log_level", cJSON_CreateNumber(get_log_level()));
-	cJSON_AddItemToObject(config, "syslog_level", cJSON_CreateNumber(get_syslog_level()));
-	cJSON_AddItemToObject(config, "local_echo", cJSON_CreateBool(cfg->local_echo));
-	cJSON_AddItemToObject(config, "led_mode", cJSON_CreateNumber(cfg->led_mode));
-	cJSON_AddItemToObject(config, "spi_active", cJSON_CreateNumber(cfg->spi_active));
-	cJSON_AddItemToObject(config, "serial_active", cJSON_CreateNumber(cfg->serial_active));
-	cJSON_AddItemToObject(config, "i2c_speed", cJSON_CreateNumber(cfg->i2c_speed));
-	cJSON_AddItemToObject(config, "pwm_freq", cJSON_CreateNumber(cfg->pwm_freq));
+	json_writer_begin_object(w, NULL);
+
+	json_writer_add_string(w, "id", "brickpico-config-v1");
+	json_writer_add_number(w, "debug", get_debug_level());
+	json_writer_add_number(w, "log_level", get_log_level());
+	json_writer_add_number(w, "syslog_level", get_syslog_level());
+	json_writer_add_number(w, "log_binary", get_log_binary_mode());
+	json_writer_add_number(w, "console_log_level", get_console_log_level());
+	json_writer_add_bool(w, "local_echo", cfg->local_echo);
+	json_writer_add_number(w, "led_mode", cfg->led_mode);
+	json_writer_add_number(w, "spi_active", cfg->spi_active);
+	json_writer_add_number(w, "serial_active", cfg->serial_active);
+	json_writer_add_number(w, "i2c_speed", cfg->i2c_speed);
+	json_writer_add_number(w, "pwm_freq", cfg->pwm_freq);
+	json_writer_add_string(w, "pwm_phase", cfg->pwm_phase);
+	json_writer_add_number(w, "effect_rate", cfg->effect_rate);
+	json_writer_add_number(w, "power_budget", cfg->power_budget);
 	STRING_TO_JSON("display_type", cfg->display_type);
 	STRING_TO_JSON("display_theme", cfg->display_theme);
 	STRING_TO_JSON("display_logo", cfg->display_logo);
@@ -441,6 +459,8 @@ cJSON *config_to_json(const struct brickpico_config *cfg)
 	STRING_TO_JSON("gamma", cfg->gamma);
 	STRING_TO_JSON("name", cfg->name);
 	STRING_TO_JSON("timezone", cfg->timezone);
+	json_writer_add_number(w, "latitude", cfg->latitude);
+	json_writer_add_number(w, "longitude", cfg->longitude);
 
 #ifdef WIFI_SUPPORT
 	STRING_TO_JSON("hostname", cfg->hostname);
@@ -449,32 +469,32 @@ cJSON *config_to_json(const struct brickpico_config *cfg)
 	if (strlen(cfg->wifi_passwd) > 0) {
 		char *p = base64encode(cfg->wifi_passwd);
 		if (p) {
-			cJSON_AddItemToObject(config, "wifi_passwd", cJSON_CreateString(p));
+			json_writer_add_string(w, "wifi_passwd", p);
 			free(p);
 		}
 	}
 	STRING_TO_JSON("wifi_auth_mode", cfg->wifi_auth_mode);
 	if (cfg->wifi_mode != 0) {
-		cJSON_AddItemToObject(config, "wifi_mode", cJSON_CreateNumber(cfg->wifi_mode));
+		json_writer_add_number(w, "wifi_mode", cfg->wifi_mode);
 	}
 	if (!ip_addr_isany(&cfg->syslog_server))
-		cJSON_AddItemToObject(config, "syslog_server", cJSON_CreateString(ipaddr_ntoa(&cfg->syslog_server)));
+		json_writer_add_string(w, "syslog_server", ipaddr_ntoa(&cfg->syslog_server));
 	if (!ip_addr_isany(&cfg->ntp_server))
-		cJSON_AddItemToObject(config, "ntp_server", cJSON_CreateString(ipaddr_ntoa(&cfg->ntp_server)));
+		json_writer_add_string(w, "ntp_server", ipaddr_ntoa(&cfg->ntp_server));
 	if (!ip_addr_isany(&cfg->ip))
-		cJSON_AddItemToObject(config, "ip", cJSON_CreateString(ipaddr_ntoa(&cfg->ip)));
+		json_writer_add_string(w, "ip", ipaddr_ntoa(&cfg->ip));
 	if (!ip_addr_isany(&cfg->netmask))
-		cJSON_AddItemToObject(config, "netmask", cJSON_CreateString(ipaddr_ntoa(&cfg->netmask)));
+		json_writer_add_string(w, "netmask", ipaddr_ntoa(&cfg->netmask));
 	if (!ip_addr_isany(&cfg->gateway))
-		cJSON_AddItemToObject(config, "gateway", cJSON_CreateString(ipaddr_ntoa(&cfg->gateway)));
+		json_writer_add_string(w, "gateway", ipaddr_ntoa(&cfg->gateway));
 	STRING_TO_JSON("mqtt_server", cfg->mqtt_server);
 	if (cfg->mqtt_port > 0)
-		cJSON_AddItemToObject(config, "mqtt_port", cJSON_CreateNumber(cfg->mqtt_port));
+		json_writer_add_number(w, "mqtt_port", cfg->mqtt_port);
 	STRING_TO_JSON("mqtt_user", cfg->mqtt_user);
 	if (strlen(cfg->mqtt_pass) > 0) {
 		char *p = base64encode(cfg->mqtt_pass);
 		if (p) {
-			cJSON_AddItemToObject(config, "mqtt_pass", cJSON_CreateString(p));
+			json_writer_add_string(w, "mqtt_pass", p);
 			free(p);
 		}
 	}
@@ -486,121 +506,116 @@ cJSON *config_to_json(const struct brickpico_config *cfg)
 	STRING_TO_JSON("mqtt_pwm_topic", cfg->mqtt_pwm_topic);
 	STRING_TO_JSON("mqtt_temp_topic", cfg->mqtt_temp_topic);
 	if (cfg->mqtt_tls != true)
-		cJSON_AddItemToObject(config, "mqtt_tls", cJSON_CreateNumber(cfg->mqtt_tls));
+		json_writer_add_number(w, "mqtt_tls", cfg->mqtt_tls);
 	if (cfg->mqtt_allow_scpi == true)
-		cJSON_AddItemToObject(config, "mqtt_allow_scpi",
-				cJSON_CreateNumber(cfg->mqtt_allow_scpi));
+		json_writer_add_number(w, "mqtt_allow_scpi", cfg->mqtt_allow_scpi);
 	if (cfg->mqtt_status_interval != DEFAULT_MQTT_STATUS_INTERVAL)
-		cJSON_AddItemToObject(config, "mqtt_status_interval",
-				cJSON_CreateNumber(cfg->mqtt_status_interval));
+		json_writer_add_number(w, "mqtt_status_interval", cfg->mqtt_status_interval);
 	if (cfg->mqtt_temp_interval != DEFAULT_MQTT_TEMP_INTERVAL)
-		cJSON_AddItemToObject(config, "mqtt_temp_interval",
-				cJSON_CreateNumber(cfg->mqtt_temp_interval));
+		json_writer_add_number(w, "mqtt_temp_interval", cfg->mqtt_temp_interval);
 	if (cfg->mqtt_pwm_interval != DEFAULT_MQTT_PWM_INTERVAL)
-		cJSON_AddItemToObject(config, "mqtt_pwm_interval",
-				cJSON_CreateNumber(cfg->mqtt_pwm_interval));
+		json_writer_add_number(w, "mqtt_pwm_interval", cfg->mqtt_pwm_interval);
 	if (cfg->mqtt_pwm_mask)
-		cJSON_AddItemToObject(config, "mqtt_pwm_mask",
-				cJSON_CreateString(
-					bitmask_to_str(cfg->mqtt_pwm_mask, OUTPUT_COUNT,
-						1, true)));
+		json_writer_add_string(w, "mqtt_pwm_mask",
+				bitmask_to_str(cfg->mqtt_pwm_mask, OUTPUT_COUNT,
+					1, true));
 	STRING_TO_JSON("mqtt_ha_discovery_prefix", cfg->mqtt_ha_discovery_prefix);
 	if (cfg->telnet_active)
-		cJSON_AddItemToObject(config, "telnet_active", cJSON_CreateNumber(cfg->telnet_active));
+		json_writer_add_number(w, "telnet_active", cfg->telnet_active);
 	if (cfg->telnet_auth != true)
-		cJSON_AddItemToObject(config, "telnet_auth", cJSON_CreateNumber(cfg->telnet_auth));
+		json_writer_add_number(w, "telnet_auth", cfg->telnet_auth);
 	if (cfg->telnet_raw_mode)
-		cJSON_AddItemToObject(config, "telnet_raw_mode", cJSON_CreateNumber(cfg->telnet_raw_mode));
+		json_writer_add_number(w, "telnet_raw_mode", cfg->telnet_raw_mode);
 	if (cfg->telnet_port > 0)
-		cJSON_AddItemToObject(config, "telnet_port", cJSON_CreateNumber(cfg->telnet_port));
+		json_writer_add_number(w, "telnet_port", cfg->telnet_port);
 	STRING_TO_JSON("telnet_user", cfg->telnet_user);
 	STRING_TO_JSON("telnet_pwhash", cfg->telnet_pwhash);
 	if (cfg->ssh_active)
-		cJSON_AddItemToObject(config, "ssh_active", cJSON_CreateNumber(cfg->ssh_active));
+		json_writer_add_number(w, "ssh_active", cfg->ssh_active);
 	if (cfg->ssh_auth != true)
-		cJSON_AddItemToObject(config, "ssh_auth", cJSON_CreateNumber(cfg->ssh_auth));
+		json_writer_add_number(w, "ssh_auth", cfg->ssh_auth);
 	if (cfg->ssh_port > 0)
-		cJSON_AddItemToObject(config, "ssh_port", cJSON_CreateNumber(cfg->ssh_port));
+		json_writer_add_number(w, "ssh_port", cfg->ssh_port);
 	STRING_TO_JSON("ssh_user", cfg->ssh_user);
 	STRING_TO_JSON("ssh_pwhash", cfg->ssh_pwhash);
-	if ((o = sshpubkeys2json(cfg->ssh_pub_keys))) {
-		cJSON_AddItemToObject(config, "ssh_pubkeys", o);
-	}
+	sshpubkeys2json(w, "ssh_pubkeys", cfg->ssh_pub_keys);
 #endif
 
 	/* PWM Outputs */
-	outputs = cJSON_CreateArray();
-	if (!outputs)
-		goto panic;
+	json_writer_begin_array(w, "outputs");
 	for (i = 0; i < OUTPUT_COUNT; i++) {
 		const struct pwm_output *f = &cfg->outputs[i];
 
-		o = cJSON_CreateObject();
-		if (!o)
-			goto panic;
-		cJSON_AddItemToObject(o, "id", cJSON_CreateNumber(i));
-		cJSON_AddItemToObject(o, "name", cJSON_CreateString(f->name));
-		cJSON_AddItemToObject(o, "min_pwm", cJSON_CreateNumber(f->min_pwm));
-		cJSON_AddItemToObject(o, "max_pwm", cJSON_CreateNumber(f->max_pwm));
-		cJSON_AddItemToObject(o, "default_pwm", cJSON_CreateNumber(f->default_pwm));
-		cJSON_AddItemToObject(o, "default_state", cJSON_CreateNumber(f->default_state));
-		cJSON_AddItemToObject(o, "type", cJSON_CreateNumber(f->type));
-		cJSON_AddItemToObject(o, "effect", effect2json(f->effect, f->effect_ctx));
-		cJSON_AddItemToArray(outputs, o);
-	}
-	cJSON_AddItemToObject(config, "outputs", outputs);
+		json_writer_begin_object(w, NULL);
+		json_writer_add_number(w, "id", i);
+		json_writer_add_string(w, "name", f->name);
+		json_writer_add_number(w, "min_pwm", f->min_pwm);
+		json_writer_add_number(w, "max_pwm", f->max_pwm);
+		json_writer_add_number(w, "default_pwm", f->default_pwm);
+		json_writer_add_number(w, "default_state", f->default_state);
+		json_writer_add_number(w, "type", f->type);
+		json_writer_add_string(w, "gamma", f->gamma);
+		json_writer_add_bool(w, "dither", f->dither);
+		json_writer_add_number(w, "max_current", f->max_current);
+		json_writer_add_number(w, "priority", f->priority);
+		effect2json(w, "effect", f->effect, f->effect_ctx);
+		json_writer_end_object(w);
+	}
+	json_writer_end_array(w);
 
 	/* Timers */
-	if ((events = cJSON_CreateArray()) == NULL)
-		goto panic;
+	json_writer_begin_array(w, "timers");
 	for (i = 0; i < cfg->event_count; i++) {
 		const struct timer_event *e = &cfg->events[i];
 
-		if ((o = cJSON_CreateObject()) == NULL)
-			goto panic;
-		cJSON_AddItemToObject(o, "name", cJSON_CreateString(e->name));
-		cJSON_AddItemToObject(o, "minute", cJSON_CreateNumber(e->minute));
-		cJSON_AddItemToObject(o, "hour", cJSON_CreateNumber(e->hour));
-		cJSON_AddItemToObject(o, "wday", cJSON_CreateNumber(e->wday));
-		cJSON_AddItemToObject(o, "action", cJSON_CreateNumber(e->action));
-		cJSON_AddItemToObject(o, "mask", cJSON_CreateNumber(e->mask));
-		cJSON_AddItemToArray(events, o);
+		json_writer_begin_object(w, NULL);
+		json_writer_add_string(w, "name", e->name);
+		json_writer_add_number(w, "minute", e->minute);
+		json_writer_add_number(w, "hour", e->hour);
+		json_writer_add_number(w, "wday", e->wday);
+		json_writer_add_number(w, "action", e->action);
+		json_writer_add_number(w, "mask", e->mask);
+		if (e->trigger != TRIGGER_TIME) {
+			json_writer_add_number(w, "trigger", e->trigger);
+			json_writer_add_number(w, "offset", e->offset);
+		}
+		if (e->second > 0)
+			json_writer_add_number(w, "second", e->second);
+		if (e->action == ACTION_PWM || e->action == ACTION_RAMP)
+			json_writer_add_number(w, "pwm", e->pwm);
+		if (e->action == ACTION_RAMP)
+			json_writer_add_number(w, "duration", e->duration);
+		if (e->action == ACTION_EFFECT) {
+			json_writer_add_string(w, "effect", effect2str(e->effect));
+			json_writer_add_string(w, "effect_args", e->effect_args);
+		}
+		json_writer_end_object(w);
 	}
-	cJSON_AddItemToObject(config, "timers", events);
+	json_writer_end_array(w);
 
 	/* Virtual Sensors */
-	vsensors = cJSON_CreateArray();
-	if (!vsensors)
-		goto panic;
+	json_writer_begin_array(w, "vsensors");
 	for (i = 0; i < VSENSOR_COUNT; i++) {
 		const struct vsensor_input *s = &cfg->vsensors[i];
 
-		o = cJSON_CreateObject();
-		if (!o)
-			goto panic;
-		cJSON_AddItemToObject(o, "id", cJSON_CreateNumber(i));
-		cJSON_AddItemToObject(o, "name", cJSON_CreateString(s->name));
-		cJSON_AddItemToObject(o, "mode", cJSON_CreateString(vsmode2str(s->mode)));
+		json_writer_begin_object(w, NULL);
+		json_writer_add_number(w, "id", i);
+		json_writer_add_string(w, "name", s->name);
+		json_writer_add_string(w, "mode", vsmode2str(s->mode));
 		if (s->mode == VSMODE_MANUAL) {
-			cJSON_AddItemToObject(o, "default_temp", cJSON_CreateNumber(s->default_temp));
-			cJSON_AddItemToObject(o, "timeout", cJSON_CreateNumber(s->timeout));
+			json_writer_add_number(w, "default_temp", s->default_temp);
+			json_writer_add_number(w, "timeout", s->timeout);
 		} else if (s->mode == VSMODE_I2C) {
-			cJSON_AddItemToObject(o, "i2c_type",
-					cJSON_CreateString(i2c_sensor_type_str(s->i2c_type)));
-			cJSON_AddItemToObject(o, "i2c_addr",
-					cJSON_CreateNumber(s->i2c_addr));
+			json_writer_add_string(w, "i2c_type", i2c_sensor_type_str(s->i2c_type));
+			json_writer_add_number(w, "i2c_addr", s->i2c_addr);
 		} else {
-			cJSON_AddItemToObject(o, "sensors", vsensors2json(s->sensors));
+			vsensors2json(w, "sensors", s->sensors);
 		}
-		cJSON_AddItemToArray(vsensors, o);
+		json_writer_end_object(w);
 	}
-	cJSON_AddItemToObject(config, "vsensors", vsensors);
+	json_writer_end_array(w);
 
-        return config;
-
-panic:
-	cJSON_Delete(config);
-	return NULL;
+	json_writer_end_object(w);
 }
 
 
@@ -634,6 +649,10 @@ int json_to_config(cJSON *config, struct brickpico_config *cfg)
 		set_log_level(cJSON_GetNumberValue(ref));
 	if ((ref = cJSON_GetObjectItem(config, "syslog_level")))
 		set_syslog_level(cJSON_GetNumberValue(ref));
+	if ((ref = cJSON_GetObjectItem(config, "log_binary")))
+		set_log_binary_mode(cJSON_GetNumberValue(ref));
+	if ((ref = cJSON_GetObjectItem(config, "console_log_level")))
+		set_console_log_level(cJSON_GetNumberValue(ref));
 	if ((ref = cJSON_GetObjectItem(config, "local_echo")))
 		cfg->local_echo = (cJSON_IsTrue(ref) ? true : false);
 	if ((ref = cJSON_GetObjectItem(config, "led_mode")))
@@ -646,6 +665,11 @@ int json_to_config(cJSON *config, struct brickpico_config *cfg)
 		cfg->i2c_speed = cJSON_GetNumberValue(ref);
 	if ((ref = cJSON_GetObjectItem(config, "pwm_freq")))
 		cfg->pwm_freq = cJSON_GetNumberValue(ref);
+	JSON_TO_STRING("pwm_phase", cfg->pwm_phase, sizeof(cfg->pwm_phase));
+	if ((ref = cJSON_GetObjectItem(config, "effect_rate")))
+		cfg->effect_rate = cJSON_GetNumberValue(ref);
+	if ((ref = cJSON_GetObjectItem(config, "power_budget")))
+		cfg->power_budget = cJSON_GetNumberValue(ref);
 	JSON_TO_STRING("display_type", cfg->display_type, sizeof(cfg->display_type));
 	JSON_TO_STRING("display_theme", cfg->display_theme, sizeof(cfg->display_theme));
 	JSON_TO_STRING("display_logo", cfg->display_logo, sizeof(cfg->display_logo));
@@ -653,6 +677,10 @@ int json_to_config(cJSON *config, struct brickpico_config *cfg)
 	JSON_TO_STRING("gamma", cfg->gamma, sizeof(cfg->gamma));
 	JSON_TO_STRING("name", cfg->name, sizeof(cfg->name));
 	JSON_TO_STRING("timezone", cfg->timezone, sizeof(cfg->timezone));
+	if ((ref = cJSON_GetObjectItem(config, "latitude")))
+		cfg->latitude = cJSON_GetNumberValue(ref);
+	if ((ref = cJSON_GetObjectItem(config, "longitude")))
+		cfg->longitude = cJSON_GetNumberValue(ref);
 
 #ifdef WIFI_SUPPORT
 	JSON_TO_STRING("hostname", cfg->hostname, sizeof(cfg->hostname));
@@ -788,6 +816,17 @@ int json_to_config(cJSON *config, struct brickpico_config *cfg)
 			if ((ref = cJSON_GetObjectItem(item, "type"))) {
 				f->type = cJSON_GetNumberValue(ref);
 			}
+			name = cJSON_GetStringValue(cJSON_GetObjectItem(item, "gamma"));
+			if (name) strncopy(f->gamma, name, sizeof(f->gamma));
+			if ((ref = cJSON_GetObjectItem(item, "dither"))) {
+				f->dither = (cJSON_IsTrue(ref) ? true : false);
+			}
+			if ((ref = cJSON_GetObjectItem(item, "max_current"))) {
+				f->max_current = cJSON_GetNumberValue(ref);
+			}
+			if ((ref = cJSON_GetObjectItem(item, "priority"))) {
+				f->priority = cJSON_GetNumberValue(ref);
+			}
 			if ((ref = cJSON_GetObjectItem(item, "effect"))) {
 				json2effect(ref, &f->effect, &f->effect_ctx);
 			}
@@ -820,6 +859,27 @@ int json_to_config(cJSON *config, struct brickpico_config *cfg)
 			if ((ref = cJSON_GetObjectItem(item, "mask"))) {
 				e->mask = cJSON_GetNumberValue(ref);
 			}
+			if ((ref = cJSON_GetObjectItem(item, "trigger"))) {
+				e->trigger = cJSON_GetNumberValue(ref);
+			}
+			if ((ref = cJSON_GetObjectItem(item, "offset"))) {
+				e->offset = cJSON_GetNumberValue(ref);
+			}
+			if ((ref = cJSON_GetObjectItem(item, "second"))) {
+				e->second = cJSON_GetNumberValue(ref);
+			}
+			if ((ref = cJSON_GetObjectItem(item, "pwm"))) {
+				e->pwm = cJSON_GetNumberValue(ref);
+			}
+			if ((ref = cJSON_GetObjectItem(item, "duration"))) {
+				e->duration = cJSON_GetNumberValue(ref);
+			}
+			if ((name = cJSON_GetStringValue(cJSON_GetObjectItem(item, "effect")))) {
+				e->effect = str2effect(name);
+			}
+			if ((name = cJSON_GetStringValue(cJSON_GetObjectItem(item, "effect_args")))) {
+				strncopy(e->effect_args, name, sizeof(e->effect_args));
+			}
 		}
 	}
 
@@ -857,33 +917,63 @@ int json_to_config(cJSON *config, struct brickpico_config *cfg)
 }
 
 
+static cJSON* read_json_config()
+{
+	cJSON *config = NULL;
+	uint32_t file_size;
+	char *buf = NULL;
+	int res;
+
+	res = flash_read_file(&buf, &file_size, JSON_CONFIG_FILE);
+	if (res == 0 && buf != NULL) {
+		/* parse saved config... */
+		config = cJSON_Parse(buf);
+		if (!config) {
+			const char *error_str = cJSON_GetErrorPtr();
+			log_msg(LOG_ERR, "Failed to parse saved config: %s",
+				(error_str ? error_str : "") );
+		}
+		free(buf);
+	}
+
+	return config;
+}
+
+
 void read_config(bool use_default_config)
 {
 	cJSON *config = NULL;
 	int res;
 	uint32_t file_size;
 	char  *buf = NULL;
+	absolute_time_t t_start = get_absolute_time();
+	int arena_start = mallinfo().arena;
 
 
-	if (!use_default_config) {
-		log_msg(LOG_INFO, "Reading configuration...");
+	clear_config(&brickpico_config);
 
-		res = flash_read_file(&buf, &file_size, "brickpico.cfg");
-		if (res == 0 && buf != NULL) {
-			/* parse saved config... */
-			config = cJSON_Parse(buf);
-			if (!config) {
-				const char *error_str = cJSON_GetErrorPtr();
-				log_msg(LOG_ERR, "Failed to parse saved config: %s",
-					(error_str ? error_str : "") );
-			}
-			free(buf);
-		}
+	if (use_default_config) {
+		log_msg(LOG_NOTICE, "Using default configuration...");
+		return;
 	}
 
-	clear_config(&brickpico_config);
+	log_msg(LOG_INFO, "Reading configuration...");
+
+	res = flash_read_file(&buf, &file_size, CONFIG_FILE);
+	if (res == 0 && buf != NULL) {
+		res = tlv_to_config((uint8_t*)buf, file_size, &brickpico_config, &config_file);
+		free(buf);
+		if (res == 0) {
+			log_msg(LOG_INFO, "Configuration loaded in %llu us (heap grew %d bytes)",
+				absolute_time_diff_us(t_start, get_absolute_time()),
+				mallinfo().arena - arena_start);
+			return;
+		}
+		log_msg(LOG_ERR, "Failed to load saved config: %d", res);
+	}
 
-	if (!config) {
+	/* Check for configuration saved in (legacy) JSON format */
+	if (!(config = read_json_config())) {
 		log_msg(LOG_NOTICE, "Using default configuration...");
 		return;
 	}
@@ -891,62 +981,95 @@ void read_config(bool use_default_config)
         /* Parse JSON configuration */
 	if (json_to_config(config, &brickpico_config) < 0) {
 		log_msg(LOG_ERR, "Error parsing JSON configuration");
-	}
-
-	if (use_default_config) {
-		/* Enable more verbose logging if in "safe-mode" ... */
-		set_log_level(LOG_INFO);
-		brickpico_config.local_echo = true;
+	} else {
+		log_msg(LOG_INFO, "Configuration (JSON) loaded in %llu us (heap grew %d bytes)",
+			absolute_time_diff_us(t_start, get_absolute_time()),
+			mallinfo().arena - arena_start);
+		config_migrate = true;
 	}
 
 	cJSON_Delete(config);
 }
 
 
-void save_config()
+int save_config()
 {
-	cJSON *config;
-	char *str;
+	struct config_file_info info = config_file;
+	struct timespec ts;
+	uint8_t *buf;
+	uint32_t size;
+	int res;
 
-	log_msg(LOG_NOTICE, "Saving configuration...");
+	info.saves++;
+	info.last_save = 0;
+	if (aon_timer_is_running()) {
+		aon_timer_get_time(&ts);
+		info.last_save = timespec_to_time_t(&ts);
+	}
 
-	config = config_to_json(cfg);
-	if (!config) {
-		log_msg(LOG_ALERT, "Out of memory!");
-		return;
+	if ((res = config_to_tlv(cfg, &buf, &size, &info))) {
+		log_msg(LOG_ERR, "Failed to generate configuration: %d", res);
+		return -1;
 	}
 
-	if ((str = cJSON_Print(config)) == NULL) {
-		log_msg(LOG_ERR, "Failed to generate JSON output");
-	} else {
-		uint32_t config_size = strlen(str) + 1;
-		flash_write_file(str, config_size, "brickpico.cfg");
-		free(str);
+	/* Skip writing to flash if configuration has not changed */
+	if (info.size == config_file.size && info.crc32 == config_file.crc32
+		&& flash_file_size(CONFIG_FILE) == size) {
+		log_msg(LOG_NOTICE, "Configuration not changed.");
+		config_saves_skipped++;
+		free(buf);
+		return 0;
 	}
 
-	cJSON_Delete(config);
+	log_msg(LOG_NOTICE, "Saving configuration...");
+	res = flash_write_file((const char*)buf, size, CONFIG_FILE);
+	free(buf);
+	if (res)
+		return -2;
+
+	config_file = info;
+	return 0;
 }
 
 
-void print_config()
+void get_config_file_info(struct config_file_info *info, uint32_t *skipped)
 {
-	cJSON *config;
-	char *str;
+	memcpy(info, &config_file, sizeof(*info));
+	if (skipped)
+		*skipped = config_saves_skipped;
+}
+
 
-	config = config_to_json(cfg);
-	if (!config) {
-		log_msg(LOG_ALERT, "Out of memory");
+/* Convert configuration saved in JSON format to binary format. */
+void migrate_config()
+{
+	if (!config_migrate)
 		return;
-	}
+	config_migrate = false;
 
-	if ((str = cJSON_Print(config)) == NULL) {
-		log_msg(LOG_ERR, "Failed to generate JSON output");
-	} else {
-		printf("Current Configuration:\n%s\n---\n", str);
-		free(str);
-	}
+	log_msg(LOG_NOTICE, "Migrating configuration to binary format...");
+	if (save_config() == 0)
+		flash_rename_file(JSON_CONFIG_FILE, JSON_CONFIG_FILE ".v1");
+}
 
-	cJSON_Delete(config);
+
+static void print_config_sink(const char *buf, size_t len, void *ctx)
+{
+	fwrite(buf, 1, len, stdout);
+}
+
+void print_config()
+{
+	json_writer_t w;
+	char buf[128];
+
+	printf("Current Configuration:\n");
+	json_writer_init(&w, buf, sizeof(buf), 0);
+	json_writer_set_sink(&w, print_config_sink, NULL);
+	config_to_json(&w, cfg);
+	if (json_writer_finish(&w) < 0)
+		log_msg(LOG_ERR, "Failed to generate JSON output");
+	printf("\n---\n");
 }
 
 
@@ -954,8 +1077,13 @@ void delete_config()
 {
 	int res;
 
-	res = flash_delete_file("brickpico.cfg");
+	res = flash_delete_file(CONFIG_FILE);
 	if (res) {
 		log_msg(LOG_ERR, "Failed to delete configuration.");
 	}
+	/* Keep save counter, so that it continues from the same value on next save */
+	config_file.size = 0;
+	config_file.crc32 = 0;
+	if (flash_file_size(JSON_CONFIG_FILE) >= 0)
+		flash_delete_file(JSON_CONFIG_FILE);
 }
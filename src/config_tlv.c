@@ -0,0 +1,649 @@
+/* config_tlv.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Binary (TLV) configuration file format.
+
+   File starts with a header (struct config_tlv_header) followed by
+   TLV records: tag (1 byte), length (2 bytes, little-endian), value.
+   Outputs, virtual sensors, timers and SSH keys are stored as groups
+   (a record containing TLV records of the group), where first record
+   is always the index (TAG_ID).
+
+   Tags are never reused, unknown tags (and fields with unexpected length)
+   are ignored when loading configuration. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/mutex.h"
+#include "pico_sensor_lib.h"
+#ifdef WIFI_SUPPORT
+#include "lwip/ip_addr.h"
+#endif
+
+#include "brickpico.h"
+
+
+#define CONFIG_TLV_MAGIC    0x46435042  /* "BPCF" */
+#define CONFIG_TLV_VERSION  1
+
+struct config_tlv_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t flags;
+	uint32_t length;   /* length of TLV data following the header */
+	uint32_t crc32;    /* checksum of TLV data */
+	uint32_t saves;    /* number of times configuration has been saved */
+	uint32_t save_time; /* time of the save (UNIX time, 0 = unknown) */
+};
+
+enum tlv_types {
+	TLV_INT = 0,   /* integer/bool/enum (stored as is, length must match) */
+	TLV_FLOAT,
+	TLV_STR,       /* string (stored without terminating NUL) */
+	TLV_RAW,       /* raw bytes (length must match) */
+};
+
+struct tlv_field {
+	uint8_t tag;
+	uint8_t type;
+	uint16_t offset;
+	uint16_t size;
+};
+
+#define TLV_FIELD(tag, type, st, member) \
+	{ tag, type, offsetof(st, member), sizeof(((st*)0)->member) }
+
+#define TLV_HDR_LEN  3
+
+/* Top level tags */
+#define TAG_DEBUG          1
+#define TAG_LOG_LEVEL      2
+#define TAG_SYSLOG_LEVEL   3
+#define TAG_LOG_BINARY     4
+#define TAG_CONSOLE_LEVEL  5
+#define TAG_OUTPUT         128
+#define TAG_VSENSOR        129
+#define TAG_TIMER          130
+#define TAG_SSH_PUBKEY     131
+
+/* Group tags */
+#define TAG_ID             1
+#define TAG_OUT_EFFECT     8
+#define TAG_OUT_EFFECT_ARGS 9
+#define TAG_VS_I2C_TYPE    8
+#define TAG_TIMER_EFFECT   11
+#define TAG_SSH_KEY        5
+
+#define CFG_FIELD(tag, type, member) TLV_FIELD(tag, type, struct brickpico_config, member)
+
+static const struct tlv_field config_fields[] = {
+	CFG_FIELD(16, TLV_INT, local_echo),
+	CFG_FIELD(17, TLV_INT, led_mode),
+	CFG_FIELD(18, TLV_INT, spi_active),
+	CFG_FIELD(19, TLV_INT, serial_active),
+	CFG_FIELD(20, TLV_INT, i2c_speed),
+	CFG_FIELD(21, TLV_INT, pwm_freq),
+	CFG_FIELD(22, TLV_INT, effect_rate),
+	CFG_FIELD(23, TLV_INT, power_budget),
+	CFG_FIELD(32, TLV_STR, display_type),
+	CFG_FIELD(33, TLV_STR, display_theme),
+	CFG_FIELD(34, TLV_STR, display_logo),
+	CFG_FIELD(35, TLV_STR, display_layout_r),
+	CFG_FIELD(36, TLV_STR, gamma),
+	CFG_FIELD(37, TLV_STR, name),
+	CFG_FIELD(38, TLV_STR, timezone),
+	CFG_FIELD(39, TLV_FLOAT, latitude),
+	CFG_FIELD(40, TLV_FLOAT, longitude),
+	CFG_FIELD(41, TLV_STR, pwm_phase),
+#ifdef WIFI_SUPPORT
+	CFG_FIELD(48, TLV_STR, hostname),
+	CFG_FIELD(49, TLV_STR, wifi_country),
+	CFG_FIELD(50, TLV_STR, wifi_ssid),
+	CFG_FIELD(51, TLV_STR, wifi_passwd),
+	CFG_FIELD(52, TLV_STR, wifi_auth_mode),
+	CFG_FIELD(53, TLV_INT, wifi_mode),
+	CFG_FIELD(54, TLV_RAW, syslog_server),
+	CFG_FIELD(55, TLV_RAW, ntp_server),
+	CFG_FIELD(56, TLV_RAW, ip),
+	CFG_FIELD(57, TLV_RAW, netmask),
+	CFG_FIELD(58, TLV_RAW, gateway),
+	CFG_FIELD(64, TLV_STR, mqtt_server),
+	CFG_FIELD(65, TLV_INT, mqtt_port),
+	CFG_FIELD(66, TLV_STR, mqtt_user),
+	CFG_FIELD(67, TLV_STR, mqtt_pass),
+	CFG_FIELD(68, TLV_STR, mqtt_status_topic),
+	CFG_FIELD(69, TLV_STR, mqtt_cmd_topic),
+	CFG_FIELD(70, TLV_STR, mqtt_resp_topic),
+	CFG_FIELD(71, TLV_STR, mqtt_err_topic),
+	CFG_FIELD(72, TLV_STR, mqtt_warn_topic),
+	CFG_FIELD(73, TLV_STR, mqtt_pwm_topic),
+	CFG_FIELD(74, TLV_STR, mqtt_temp_topic),
+	CFG_FIELD(75, TLV_INT, mqtt_tls),
+	CFG_FIELD(76, TLV_INT, mqtt_allow_scpi),
+	CFG_FIELD(77, TLV_INT, mqtt_status_interval),
+	CFG_FIELD(78, TLV_INT, mqtt_temp_interval),
+	CFG_FIELD(79, TLV_INT, mqtt_pwm_interval),
+	CFG_FIELD(80, TLV_INT, mqtt_pwm_mask),
+	CFG_FIELD(81, TLV_STR, mqtt_ha_discovery_prefix),
+	CFG_FIELD(96, TLV_INT, telnet_active),
+	CFG_FIELD(97, TLV_INT, telnet_auth),
+	CFG_FIELD(98, TLV_INT, telnet_raw_mode),
+	CFG_FIELD(99, TLV_INT, telnet_port),
+	CFG_FIELD(100, TLV_STR, telnet_user),
+	CFG_FIELD(101, TLV_STR, telnet_pwhash),
+	CFG_FIELD(104, TLV_INT, ssh_active),
+	CFG_FIELD(105, TLV_INT, ssh_auth),
+	CFG_FIELD(106, TLV_INT, ssh_port),
+	CFG_FIELD(107, TLV_STR, ssh_user),
+	CFG_FIELD(108, TLV_STR, ssh_pwhash),
+#endif
+	{ 0, 0, 0, 0 }
+};
+
+static const struct tlv_field output_fields[] = {
+	TLV_FIELD(2, TLV_STR, struct pwm_output, name),
+	TLV_FIELD(3, TLV_INT, struct pwm_output, min_pwm),
+	TLV_FIELD(4, TLV_INT, struct pwm_output, max_pwm),
+	TLV_FIELD(5, TLV_INT, struct pwm_output, default_pwm),
+	TLV_FIELD(6, TLV_INT, struct pwm_output, default_state),
+	TLV_FIELD(7, TLV_INT, struct pwm_output, type),
+	TLV_FIELD(10, TLV_STR, struct pwm_output, gamma),
+	TLV_FIELD(11, TLV_INT, struct pwm_output, dither),
+	TLV_FIELD(12, TLV_INT, struct pwm_output, max_current),
+	TLV_FIELD(13, TLV_INT, struct pwm_output, priority),
+	{ 0, 0, 0, 0 }
+};
+
+static const struct tlv_field vsensor_fields[] = {
+	TLV_FIELD(2, TLV_STR, struct vsensor_input, name),
+	TLV_FIELD(3, TLV_INT, struct vsensor_input, mode),
+	TLV_FIELD(4, TLV_FLOAT, struct vsensor_input, default_temp),
+	TLV_FIELD(5, TLV_INT, struct vsensor_input, timeout),
+	TLV_FIELD(6, TLV_RAW, struct vsensor_input, sensors),
+	TLV_FIELD(7, TLV_INT, struct vsensor_input, i2c_addr),
+	{ 0, 0, 0, 0 }
+};
+
+static const struct tlv_field timer_fields[] = {
+	TLV_FIELD(2, TLV_STR, struct timer_event, name),
+	TLV_FIELD(3, TLV_INT, struct timer_event, minute),
+	TLV_FIELD(4, TLV_INT, struct timer_event, hour),
+	TLV_FIELD(5, TLV_INT, struct timer_event, wday),
+	TLV_FIELD(6, TLV_INT, struct timer_event, action),
+	TLV_FIELD(7, TLV_INT, struct timer_event, mask),
+	TLV_FIELD(8, TLV_INT, struct timer_event, second),
+	TLV_FIELD(9, TLV_INT, struct timer_event, pwm),
+	TLV_FIELD(10, TLV_INT, struct timer_event, duration),
+	TLV_FIELD(12, TLV_STR, struct timer_event, effect_args),
+	TLV_FIELD(13, TLV_INT, struct timer_event, trigger),
+	TLV_FIELD(14, TLV_INT, struct timer_event, offset),
+	{ 0, 0, 0, 0 }
+};
+
+#ifdef WIFI_SUPPORT
+static const struct tlv_field ssh_key_fields[] = {
+	TLV_FIELD(2, TLV_STR, struct ssh_public_key, username),
+	TLV_FIELD(3, TLV_STR, struct ssh_public_key, type),
+	TLV_FIELD(4, TLV_STR, struct ssh_public_key, name),
+	{ 0, 0, 0, 0 }
+};
+#endif
+
+
+/* TLV writer. If buf is NULL, only calculates required buffer size. */
+struct tlv_writer {
+	uint8_t *buf;
+	uint32_t size;
+	uint32_t pos;
+};
+
+static void tlv_put(struct tlv_writer *w, uint8_t tag, const void *data, uint16_t len)
+{
+	if (w->buf && w->pos + TLV_HDR_LEN + len <= w->size) {
+		w->buf[w->pos] = tag;
+		w->buf[w->pos + 1] = len & 0xff;
+		w->buf[w->pos + 2] = len >> 8;
+		if (len > 0)
+			memcpy(&w->buf[w->pos + TLV_HDR_LEN], data, len);
+	}
+	w->pos += TLV_HDR_LEN + len;
+}
+
+static void tlv_put_u8(struct tlv_writer *w, uint8_t tag, uint8_t val)
+{
+	tlv_put(w, tag, &val, 1);
+}
+
+static void tlv_put_str(struct tlv_writer *w, uint8_t tag, const char *s, size_t size)
+{
+	tlv_put(w, tag, s, (s ? strnlen(s, size) : 0));
+}
+
+static uint32_t tlv_begin_group(struct tlv_writer *w, uint8_t tag)
+{
+	uint32_t start = w->pos;
+
+	tlv_put(w, tag, NULL, 0);
+	return start;
+}
+
+static void tlv_end_group(struct tlv_writer *w, uint32_t start)
+{
+	uint32_t len = w->pos - start - TLV_HDR_LEN;
+
+	if (w->buf && w->pos <= w->size) {
+		w->buf[start + 1] = len & 0xff;
+		w->buf[start + 2] = len >> 8;
+	}
+}
+
+static void tlv_put_fields(struct tlv_writer *w, const struct tlv_field *fields, const void *base)
+{
+	for (const struct tlv_field *f = fields; f->tag; f++) {
+		const uint8_t *p = (const uint8_t*)base + f->offset;
+
+		if (f->type == TLV_STR)
+			tlv_put_str(w, f->tag, (const char*)p, f->size);
+		else
+			tlv_put(w, f->tag, p, f->size);
+	}
+}
+
+static bool tlv_get_field(const struct tlv_field *fields, void *base, uint8_t tag,
+			const uint8_t *data, uint16_t len)
+{
+	for (const struct tlv_field *f = fields; f->tag; f++) {
+		uint8_t *p = (uint8_t*)base + f->offset;
+
+		if (f->tag != tag)
+			continue;
+		if (f->type == TLV_STR) {
+			if (len >= f->size)
+				len = f->size - 1;
+			memcpy(p, data, len);
+			p[len] = 0;
+		} else if (len == f->size) {
+			memcpy(p, data, len);
+		}
+		return true;
+	}
+
+	return false;
+}
+
+static void tlv_get_str(char *dst, size_t size, const uint8_t *data, uint16_t len)
+{
+	if (len >= size)
+		len = size - 1;
+	memcpy(dst, data, len);
+	dst[len] = 0;
+}
+
+
+/* Iterate over TLV records in buffer. Returns pointer to next record,
+   or NULL at the end of buffer (or if buffer is invalid). */
+static const uint8_t* tlv_next(const uint8_t *p, const uint8_t *end,
+			uint8_t *tag, const uint8_t **data, uint16_t *len)
+{
+	if (end - p < TLV_HDR_LEN)
+		return NULL;
+	*tag = p[0];
+	*len = p[1] | (p[2] << 8);
+	*data = p + TLV_HDR_LEN;
+	if (*len > end - *data)
+		return NULL;
+
+	return *data + *len;
+}
+
+
+static void config_to_tlv_records(const struct brickpico_config *cfg, struct tlv_writer *w)
+{
+	uint32_t g;
+	char *s;
+	int i;
+
+	tlv_put_u8(w, TAG_DEBUG, get_debug_level());
+	tlv_put_u8(w, TAG_LOG_LEVEL, get_log_level());
+	tlv_put_u8(w, TAG_SYSLOG_LEVEL, get_syslog_level());
+	tlv_put_u8(w, TAG_LOG_BINARY, get_log_binary_mode());
+	tlv_put_u8(w, TAG_CONSOLE_LEVEL, get_console_log_level());
+	tlv_put_fields(w, config_fields, cfg);
+
+	for (i = 0; i < OUTPUT_COUNT; i++) {
+		const struct pwm_output *o = &cfg->outputs[i];
+
+		g = tlv_begin_group(w, TAG_OUTPUT);
+		tlv_put_u8(w, TAG_ID, i);
+		tlv_put_fields(w, output_fields, o);
+		if (o->effect != EFFECT_NONE) {
+			const char *e = effect2str(o->effect);
+			tlv_put_str(w, TAG_OUT_EFFECT, e, (e ? strlen(e) : 0));
+			if ((s = effect_print_args(o->effect, o->effect_ctx))) {
+				tlv_put_str(w, TAG_OUT_EFFECT_ARGS, s, strlen(s));
+				free(s);
+			}
+		}
+		tlv_end_group(w, g);
+	}
+
+	for (i = 0; i < VSENSOR_COUNT; i++) {
+		const struct vsensor_input *v = &cfg->vsensors[i];
+
+		g = tlv_begin_group(w, TAG_VSENSOR);
+		tlv_put_u8(w, TAG_ID, i);
+		tlv_put_fields(w, vsensor_fields, v);
+		if (v->mode == VSMODE_I2C) {
+			const char *t = i2c_sensor_type_str(v->i2c_type);
+			tlv_put_str(w, TAG_VS_I2C_TYPE, t, (t ? strlen(t) : 0));
+		}
+		tlv_end_group(w, g);
+	}
+
+	for (i = 0; i < cfg->event_count; i++) {
+		g = tlv_begin_group(w, TAG_TIMER);
+		tlv_put_u8(w, TAG_ID, i);
+		tlv_put_fields(w, timer_fields, &cfg->events[i]);
+		if (cfg->events[i].action == ACTION_EFFECT) {
+			const char *e = effect2str(cfg->events[i].effect);
+			tlv_put_str(w, TAG_TIMER_EFFECT, e, (e ? strlen(e) : 0));
+		}
+		tlv_end_group(w, g);
+	}
+
+#ifdef WIFI_SUPPORT
+	for (i = 0; i < SSH_MAX_PUB_KEYS; i++) {
+		const struct ssh_public_key *k = &cfg->ssh_pub_keys[i];
+
+		if (k->pubkey_size == 0 || strlen(k->username) == 0)
+			continue;
+		g = tlv_begin_group(w, TAG_SSH_PUBKEY);
+		tlv_put_u8(w, TAG_ID, i);
+		tlv_put_fields(w, ssh_key_fields, k);
+		tlv_put(w, TAG_SSH_KEY, k->pubkey, k->pubkey_size);
+		tlv_end_group(w, g);
+	}
+#endif
+}
+
+
+/* Generate binary representation of the configuration.
+   Returns 0 on success, and buffer (allocated) in *bufptr.
+   Save counter and time are taken from info, and size and checksum
+   of the configuration data are returned in info. */
+int config_to_tlv(const struct brickpico_config *cfg, uint8_t **bufptr, uint32_t *sizeptr,
+		struct config_file_info *info)
+{
+	struct config_tlv_header hdr;
+	struct tlv_writer w;
+	uint8_t *buf;
+
+	if (!cfg || !bufptr || !sizeptr || !info)
+		return -1;
+
+	/* First pass, calculate size... */
+	w.buf = NULL;
+	w.size = 0;
+	w.pos = 0;
+	config_to_tlv_records(cfg, &w);
+
+	if (!(buf = malloc(sizeof(hdr) + w.pos)))
+		return -3;
+
+	/* Second pass, generate records... */
+	w.buf = buf + sizeof(hdr);
+	w.size = w.pos;
+	w.pos = 0;
+	config_to_tlv_records(cfg, &w);
+	if (w.pos != w.size) {
+		free(buf);
+		return -4;
+	}
+
+	hdr.magic = CONFIG_TLV_MAGIC;
+	hdr.version = CONFIG_TLV_VERSION;
+	hdr.flags = 0;
+	hdr.length = w.size;
+	hdr.crc32 = xcrc32_fast(w.buf, w.size, 0xffffffff);
+	hdr.saves = info->saves;
+	hdr.save_time = info->last_save;
+	memcpy(buf, &hdr, sizeof(hdr));
+
+	info->size = hdr.length;
+	info->crc32 = hdr.crc32;
+
+	*bufptr = buf;
+	*sizeptr = sizeof(hdr) + w.size;
+
+	return 0;
+}
+
+
+static void tlv_to_output(struct brickpico_config *cfg, const uint8_t *p, const uint8_t *end)
+{
+	struct pwm_output *o;
+	const uint8_t *data;
+	char effect[32], args[128];
+	bool have_effect = false;
+	uint16_t len;
+	uint8_t tag;
+
+	if (!(p = tlv_next(p, end, &tag, &data, &len)) || tag != TAG_ID || len != 1
+		|| data[0] >= OUTPUT_COUNT)
+		return;
+	o = &cfg->outputs[data[0]];
+
+	args[0] = 0;
+	while ((p = tlv_next(p, end, &tag, &data, &len))) {
+		if (tag == TAG_OUT_EFFECT) {
+			tlv_get_str(effect, sizeof(effect), data, len);
+			have_effect = true;
+		} else if (tag == TAG_OUT_EFFECT_ARGS) {
+			tlv_get_str(args, sizeof(args), data, len);
+		} else {
+			tlv_get_field(output_fields, o, tag, data, len);
+		}
+	}
+
+	if (have_effect) {
+		o->effect = str2effect(effect);
+		o->effect_ctx = effect_parse_args(o->effect, args);
+		if (!o->effect_ctx)
+			o->effect = EFFECT_NONE;
+	}
+}
+
+static void tlv_to_vsensor(struct brickpico_config *cfg, const uint8_t *p, const uint8_t *end)
+{
+	struct vsensor_input *v;
+	const uint8_t *data;
+	char type[32];
+	uint16_t len;
+	uint8_t tag;
+
+	if (!(p = tlv_next(p, end, &tag, &data, &len)) || tag != TAG_ID || len != 1
+		|| data[0] >= VSENSOR_COUNT)
+		return;
+	v = &cfg->vsensors[data[0]];
+
+	while ((p = tlv_next(p, end, &tag, &data, &len))) {
+		if (tag == TAG_VS_I2C_TYPE) {
+			tlv_get_str(type, sizeof(type), data, len);
+			v->i2c_type = get_i2c_sensor_type(type);
+		} else {
+			tlv_get_field(vsensor_fields, v, tag, data, len);
+		}
+	}
+}
+
+static void tlv_to_timer(struct brickpico_config *cfg, const uint8_t *p, const uint8_t *end)
+{
+	struct timer_event *e;
+	const uint8_t *data;
+	char effect[32];
+	uint16_t len;
+	uint8_t tag;
+
+	if (cfg->event_count >= MAX_EVENT_COUNT)
+		return;
+	if (!(p = tlv_next(p, end, &tag, &data, &len)) || tag != TAG_ID)
+		return;
+	e = &cfg->events[cfg->event_count++];
+
+	while ((p = tlv_next(p, end, &tag, &data, &len))) {
+		if (tag == TAG_TIMER_EFFECT) {
+			tlv_get_str(effect, sizeof(effect), data, len);
+			e->effect = str2effect(effect);
+		} else {
+			tlv_get_field(timer_fields, e, tag, data, len);
+		}
+	}
+}
+
+#ifdef WIFI_SUPPORT
+static void tlv_to_ssh_pubkey(struct brickpico_config *cfg, int *count,
+			const uint8_t *p, const uint8_t *end)
+{
+	struct ssh_public_key *k;
+	const uint8_t *data;
+	uint16_t len;
+	uint8_t tag;
+
+	if (*count >= SSH_MAX_PUB_KEYS)
+		return;
+	if (!(p = tlv_next(p, end, &tag, &data, &len)) || tag != TAG_ID)
+		return;
+	k = &cfg->ssh_pub_keys[*count];
+
+	while ((p = tlv_next(p, end, &tag, &data, &len))) {
+		if (tag == TAG_SSH_KEY) {
+			if (len <= sizeof(k->pubkey)) {
+				memcpy(k->pubkey, data, len);
+				k->pubkey_size = len;
+			}
+		} else {
+			tlv_get_field(ssh_key_fields, k, tag, data, len);
+		}
+	}
+	if (k->pubkey_size > 0 && strlen(k->username) > 0)
+		(*count)++;
+}
+#endif
+
+
+/* Load configuration from its binary representation.
+   If info is not NULL, it is filled with save counter, time, and checksum
+   of the configuration. */
+int tlv_to_config(const uint8_t *buf, uint32_t size, struct brickpico_config *cfg,
+		struct config_file_info *info)
+{
+	struct config_tlv_header hdr;
+	const uint8_t *p, *end, *data;
+	uint16_t len;
+	uint8_t tag;
+#ifdef WIFI_SUPPORT
+	int ssh_keys = 0;
+#endif
+
+	if (!buf || !cfg || size < sizeof(hdr))
+		return -1;
+
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (hdr.magic != CONFIG_TLV_MAGIC)
+		return -2;
+	if (hdr.version != CONFIG_TLV_VERSION) {
+		log_msg(LOG_ERR, "Unsupported config format version: %u", hdr.version);
+		return -3;
+	}
+	if (hdr.length > size - sizeof(hdr)) {
+		log_msg(LOG_ERR, "Config file truncated: %lu < %lu", size - sizeof(hdr), hdr.length);
+		return -4;
+	}
+	p = buf + sizeof(hdr);
+	end = p + hdr.length;
+	if (xcrc32_fast(p, hdr.length, 0xffffffff) != hdr.crc32) {
+		log_msg(LOG_ERR, "Config file checksum mismatch");
+		return -5;
+	}
+
+	mutex_enter_blocking(config_mutex);
+
+	cfg->event_count = 0;
+	while ((p = tlv_next(p, end, &tag, &data, &len))) {
+		switch (tag) {
+		case TAG_DEBUG:
+			if (len == 1)
+				set_debug_level(data[0]);
+			break;
+		case TAG_LOG_LEVEL:
+			if (len == 1)
+				set_log_level(data[0]);
+			break;
+		case TAG_SYSLOG_LEVEL:
+			if (len == 1)
+				set_syslog_level(data[0]);
+			break;
+		case TAG_LOG_BINARY:
+			if (len == 1)
+				set_log_binary_mode(data[0]);
+			break;
+		case TAG_CONSOLE_LEVEL:
+			if (len == 1)
+				set_console_log_level(data[0]);
+			break;
+		case TAG_OUTPUT:
+			tlv_to_output(cfg, data, data + len);
+			break;
+		case TAG_VSENSOR:
+			tlv_to_vsensor(cfg, data, data + len);
+			break;
+		case TAG_TIMER:
+			tlv_to_timer(cfg, data, data + len);
+			break;
+#ifdef WIFI_SUPPORT
+		case TAG_SSH_PUBKEY:
+			tlv_to_ssh_pubkey(cfg, &ssh_keys, data, data + len);
+			break;
+#endif
+		default:
+			tlv_get_field(config_fields, cfg, tag, data, len);
+		}
+	}
+
+	mutex_exit(config_mutex);
+
+	log_msg(LOG_INFO, "Config format version: %u (%lu bytes, saved %lu times)",
+		hdr.version, hdr.length, hdr.saves);
+	if (info) {
+		info->saves = hdr.saves;
+		info->last_save = hdr.save_time;
+		info->size = hdr.length;
+		info->crc32 = hdr.crc32;
+	}
+
+	return 0;
+}
+
+
+/* eof :-) */
@@ -0,0 +1,35 @@
+/* crc32.h
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BRICKPICO_CRC32_H
+#define BRICKPICO_CRC32_H 1
+
+
+/* crc32.c */
+unsigned int xcrc32 (const unsigned char *buf, int len, unsigned int init);
+
+/* crc32_fast.c */
+void crc32_setup();
+unsigned int xcrc32_fast(const unsigned char *buf, int len, unsigned int init);
+unsigned int xcrc32_sw(const unsigned char *buf, int len, unsigned int init);
+
+
+#endif /* BRICKPICO_CRC32_H */
@@ -0,0 +1,201 @@
+/* crc32_fast.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Faster implementations of xcrc32() (non-reflected CRC-32, polynomial
+   0x04c11db7, no final XOR). Results are identical to xcrc32().
+
+   On target, DMA sniffer is used to calculate CRC of larger buffers.
+   On host builds (see tests/), a slice-by-8 software implementation
+   is used. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#ifdef LIB_HARDWARE_DMA
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/sync.h"
+#endif
+
+#include "crc32.h"
+
+
+#ifdef LIB_HARDWARE_DMA
+
+/* Use software CRC for buffers smaller than this (DMA setup overhead) */
+#define CRC32_DMA_MIN_LEN 64
+
+/* Larger buffers are processed in chunks of this size, so that interrupts
+   are not disabled (while holding the lock) for too long. */
+#define CRC32_DMA_CHUNK_LEN 2048
+
+static int crc32_dma_channel = -1;
+static spin_lock_t *crc32_dma_lock = NULL;
+static volatile uint8_t crc32_dma_sink;
+
+
+/**
+ * Claim DMA channel (and spin lock) for CRC calculations.
+ * If this fails, xcrc32_fast() falls back to software implementation.
+ */
+void crc32_setup()
+{
+	int lock;
+
+	if (crc32_dma_channel >= 0)
+		return;
+
+	if ((lock = spin_lock_claim_unused(false)) < 0)
+		return;
+	crc32_dma_lock = spin_lock_init(lock);
+	crc32_dma_channel = dma_claim_unused_channel(false);
+}
+
+
+static uint32_t crc32_dma(const unsigned char *buf, int len, uint32_t init)
+{
+	dma_channel_config c;
+	uint32_t irq, crc;
+
+	/* Sniffer is shared between cores... */
+	irq = spin_lock_blocking(crc32_dma_lock);
+
+	c = dma_channel_get_default_config(crc32_dma_channel);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+	channel_config_set_read_increment(&c, true);
+	channel_config_set_write_increment(&c, false);
+	channel_config_set_sniff_enable(&c, true);
+
+	dma_sniffer_set_data_accumulator(init);
+	dma_sniffer_set_output_reverse_enabled(false);
+	dma_sniffer_set_output_invert_enabled(false);
+	dma_sniffer_enable(crc32_dma_channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC32, true);
+
+	dma_channel_configure(crc32_dma_channel, &c, &crc32_dma_sink, buf, len, true);
+	dma_channel_wait_for_finish_blocking(crc32_dma_channel);
+
+	crc = dma_sniffer_get_data_accumulator();
+	dma_sniffer_disable();
+
+	spin_unlock(crc32_dma_lock, irq);
+
+	return crc;
+}
+
+
+unsigned int xcrc32_fast(const unsigned char *buf, int len, unsigned int init)
+{
+	uint32_t crc = init;
+	int n;
+
+	if (len < CRC32_DMA_MIN_LEN || crc32_dma_channel < 0)
+		return xcrc32(buf, len, init);
+
+	/* CRC (with no final XOR) can be continued from previous chunk */
+	while (len > 0) {
+		n = (len > CRC32_DMA_CHUNK_LEN ? CRC32_DMA_CHUNK_LEN : len);
+		crc = crc32_dma(buf, n, crc);
+		buf += n;
+		len -= n;
+	}
+
+	return crc;
+}
+
+#else
+
+void crc32_setup()
+{
+	xcrc32_sw(NULL, 0, 0);
+}
+
+
+unsigned int xcrc32_fast(const unsigned char *buf, int len, unsigned int init)
+{
+	return xcrc32_sw(buf, len, init);
+}
+
+#endif
+
+
+static uint32_t crc32_sb8_table[8][256];
+static bool crc32_sb8_init = false;
+
+static void crc32_sb8_setup()
+{
+	uint32_t c;
+
+	for (int i = 0; i < 256; i++) {
+		c = (uint32_t)i << 24;
+		for (int j = 0; j < 8; j++)
+			c = (c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1));
+		crc32_sb8_table[0][i] = c;
+	}
+	for (int i = 0; i < 256; i++) {
+		c = crc32_sb8_table[0][i];
+		for (int k = 1; k < 8; k++) {
+			c = (c << 8) ^ crc32_sb8_table[0][c >> 24];
+			crc32_sb8_table[k][i] = c;
+		}
+	}
+	crc32_sb8_init = true;
+}
+
+
+/**
+ * Calculate CRC-32 using slice-by-8 algorithm.
+ *
+ * @param buf Data buffer.
+ * @param len Length of data.
+ * @param init Initial CRC value.
+ *
+ * @return CRC-32 (same as xcrc32()).
+ */
+unsigned int xcrc32_sw(const unsigned char *buf, int len, unsigned int init)
+{
+	const uint32_t (*t)[256] = crc32_sb8_table;
+	uint32_t crc = init;
+	uint32_t a, b;
+
+	if (!crc32_sb8_init)
+		crc32_sb8_setup();
+
+	while (len >= 8) {
+		a = crc ^ (((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16)
+			| ((uint32_t)buf[2] << 8) | buf[3]);
+		b = ((uint32_t)buf[4] << 24) | ((uint32_t)buf[5] << 16)
+			| ((uint32_t)buf[6] << 8) | buf[7];
+		crc = t[7][a >> 24] ^ t[6][(a >> 16) & 0xff]
+			^ t[5][(a >> 8) & 0xff] ^ t[4][a & 0xff]
+			^ t[3][b >> 24] ^ t[2][(b >> 16) & 0xff]
+			^ t[1][(b >> 8) & 0xff] ^ t[0][b & 0xff];
+		buf += 8;
+		len -= 8;
+	}
+	while (len-- > 0) {
+		crc = (crc << 8) ^ t[0][((crc >> 24) ^ *buf++) & 0xff];
+	}
+
+	return crc;
+}
+
+
+/* eof :-) */
@@ -0,0 +1,85 @@
+/* dither.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* PWM temporal dithering calculations (hardware independent). */
+
+#include <stdint.h>
+
+#include "dither.h"
+
+
+/**
+ * Number of fractional bits to store in lightness maps, so that
+ * map values (0..TOP with fractional bits) still fit in 16 bits.
+ *
+ * @param top PWM counter wrap value (TOP).
+ *
+ * @return Number of fractional bits (0..PWM_DITHER_BITS).
+ */
+uint8_t pwm_dither_map_bits(uint32_t top)
+{
+	uint8_t bits = 0;
+
+	while (bits < PWM_DITHER_BITS && (top << (bits + 1)) <= 0xffff)
+		bits++;
+
+	return bits;
+}
+
+
+/**
+ * Convert lightness map value into PWM level with PWM_DITHER_BITS
+ * fractional bits (rounded to nearest).
+ *
+ * @param value Map value (with map_bits fractional bits).
+ * @param map_bits Fractional bits in the map value.
+ *
+ * @return PWM level with PWM_DITHER_BITS fractional bits.
+ */
+uint32_t pwm_dither_map_level(uint32_t value, uint8_t map_bits)
+{
+	return ((value << PWM_DITHER_BITS) + ((1 << map_bits) >> 1)) >> map_bits;
+}
+
+
+/**
+ * Calculate PWM levels for the dithering frames.
+ *
+ * Fractional part of the level is spread over the frames using
+ * first order sigma-delta modulation (error diffusion), so the average
+ * over PWM_DITHER_FRAMES periods equals the (fractional) level, and each
+ * frame uses one of the two adjacent levels.
+ *
+ * @param fx PWM level with PWM_DITHER_BITS fractional bits.
+ * @param levels Array (of PWM_DITHER_FRAMES) to store the levels.
+ */
+void pwm_dither_levels(uint32_t fx, uint32_t *levels)
+{
+	uint32_t n = fx >> PWM_DITHER_BITS;
+	uint32_t f = fx & PWM_DITHER_MASK;
+
+	for (int k = 0; k < PWM_DITHER_FRAMES; k++)
+		levels[k] = n + ((((k + 1) * f) >> PWM_DITHER_BITS)
+				- ((k * f) >> PWM_DITHER_BITS));
+}
+
+
+/* eof :-) */
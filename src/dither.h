@@ -0,0 +1,41 @@
+/* dither.h
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BRICKPICO_DITHER_H
+#define BRICKPICO_DITHER_H 1
+
+#include <stdint.h>
+
+/* Temporal dithering: fractional PWM levels (PWM_DITHER_BITS bits) are
+   produced by cycling through PWM_DITHER_FRAMES frames (one per PWM period)
+   where output level alternates between two adjacent compare values. */
+#define PWM_DITHER_BITS 4
+#define PWM_DITHER_FRAMES (1 << PWM_DITHER_BITS)
+#define PWM_DITHER_MASK (PWM_DITHER_FRAMES - 1)
+
+
+/* dither.c */
+uint8_t pwm_dither_map_bits(uint32_t top);
+uint32_t pwm_dither_map_level(uint32_t value, uint8_t map_bits);
+void pwm_dither_levels(uint32_t fx, uint32_t *levels);
+
+
+#endif /* BRICKPICO_DITHER_H */
@@ -30,17 +30,17 @@
 /* effects_fade.c */
 void* effect_fade_parse_args(const char *args);
 char* effect_fade_print_args(void *ctx);
-uint8_t effect_fade(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr);
+uint16_t effect_fade(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr);
 
 /* effects_blink.c */
 void* effect_blink_parse_args(const char *args);
 char* effect_blink_print_args(void *ctx);
-uint8_t effect_blink(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr);
+uint16_t effect_blink(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr);
 
 /* effects_pulse.c */
 void* effect_pulse_parse_args(const char *args);
 char* effect_pulse_print_args(void *ctx);
-uint8_t effect_pulse(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr);
+uint16_t effect_pulse(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr);
 
 
 static const effect_entry_t effects[] = {
@@ -104,19 +104,37 @@ char* effect_print_args(enum light_effect_types effect, void *ctx)
 }
 
 
-inline uint8_t light_effect(enum light_effect_types effect, void *ctx, uint64_t t, uint8_t pwm, uint8_t pwr)
+/**
+ * Calculate output lightness level for given effect.
+ *
+ * @return Lightness level (0..EFFECT_LEVEL_MAX).
+ */
+inline uint16_t light_effect_hr(enum light_effect_types effect, void *ctx, uint64_t t, uint8_t pwm, uint8_t pwr)
 {
-	uint8_t ret = 0;
+	uint16_t ret = 0;
 
 	if (effect <= EFFECT_ENUM_MAX) {
 		if (effects[effect].effect_func)
 			ret = effects[effect].effect_func(ctx, t, pwm, pwr);
 		else
-			ret = (pwr ? pwm : 0);
+			ret = (pwr ? PWM_TO_EFFECT_LEVEL(pwm) : 0);
 	}
 
 	return ret;
 }
 
 
+/**
+ * Calculate output lightness level for given effect.
+ *
+ * @return Lightness level (0..100).
+ */
+uint8_t light_effect(enum light_effect_types effect, void *ctx, uint64_t t, uint8_t pwm, uint8_t pwr)
+{
+	uint32_t level = light_effect_hr(effect, ctx, t, pwm, pwr);
+
+	return (level * 100 + (EFFECT_LEVEL_MAX / 2)) / EFFECT_LEVEL_MAX;
+}
+
+
 /* eof :-) */
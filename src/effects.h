@@ -30,10 +30,14 @@ enum light_effect_types {
 };
 #define EFFECT_ENUM_MAX 3
 
+/* Effects produce (linear) lightness levels in range 0..EFFECT_LEVEL_MAX */
+#define EFFECT_LEVEL_MAX 0xffff
+#define PWM_TO_EFFECT_LEVEL(pwm) ((uint32_t)(pwm) * EFFECT_LEVEL_MAX / 100)
+
 
 typedef void* (effect_parse_args_func_t)(const char *args);
 typedef char* (effect_print_args_func_t)(void *ctx);
-typedef uint8_t (effect_func_t)(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr);
+typedef uint16_t (effect_func_t)(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr);
 
 typedef struct effect_entry {
 	const char* name;
@@ -89,17 +89,18 @@ char* effect_blink_print_args(void *ctx)
 	return strdup(buf);
 }
 
-uint8_t effect_blink(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr)
+uint16_t effect_blink(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr)
 {
 	blink_context_t *c = (blink_context_t*)ctx;
 	int64_t t_d;
-	uint8_t ret = 0;
+	uint16_t level = PWM_TO_EFFECT_LEVEL(pwm);
+	uint16_t ret = 0;
 
 	if (c->last_state != pwr) {
 		c->start_t = t_now;
 		if (pwr) {
 			c->mode = 1;
-			ret = pwm;
+			ret = level;
 		} else {
 			c->mode = 0;
 			ret = 0;
@@ -112,7 +113,7 @@ uint8_t effect_blink(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr)
 
 			if (c->mode == 1) {
 				if (t_d < c->on_l) {
-					ret = pwm;
+					ret = level;
 				} else {
 					c->start_t = t_now;
 					c->mode = 0;
@@ -125,7 +126,7 @@ uint8_t effect_blink(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr)
 				} else {
 					c->start_t = t_now;
 					c->mode = 1;
-					ret = pwm;
+					ret = level;
 				}
 			}
 		}
@@ -89,11 +89,12 @@ char* effect_fade_print_args(void *ctx)
 	return strdup(buf);
 }
 
-uint8_t effect_fade(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr)
+uint16_t effect_fade(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr)
 {
 	fade_context_t *c = (fade_context_t*)ctx;
 	int64_t t_d;
-	uint8_t ret = 0;
+	uint32_t level = PWM_TO_EFFECT_LEVEL(pwm);
+	uint16_t ret = 0;
 
 	if (c->last_state != pwr) {
 		/* Start fade in/out sequence... */
@@ -103,7 +104,7 @@ uint8_t effect_fade(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr)
 			ret = 0;
 		} else {
 			c->mode = 3;
-			ret = pwm;
+			ret = level;
 		}
 	}
 	else {
@@ -111,18 +112,18 @@ uint8_t effect_fade(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr)
 
 		if (c->mode == 1) { /* Fade in... */
 			if (t_d < c->in_l) {
-				ret = pwm * t_d / c->in_l;
+				ret = level * t_d / c->in_l;
 			} else {
 				c->mode = 2;
-				ret = pwm;
+				ret = level;
 			}
 		}
 		else if (c->mode == 2) { /* On state after fade in... */
-			ret = pwm;
+			ret = level;
 		}
 		else if (c->mode == 3) { /* Fade out... */
 			if (t_d < c->out_l) {
-				ret = pwm - (pwm * t_d / c->out_l);
+				ret = level - (level * t_d / c->out_l);
 			} else {
 				c->mode = 4;
 				ret = 0;
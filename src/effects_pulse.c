@@ -92,23 +92,24 @@ char* effect_pulse_print_args(void *ctx)
 }
 
 
-uint8_t effect_pulse(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr)
+uint16_t effect_pulse(void *ctx, uint64_t t_now, uint8_t pwm, uint8_t pwr)
 {
 	pulse_context_t *c = (pulse_context_t*)ctx;
+	uint32_t level = PWM_TO_EFFECT_LEVEL(pwm);
 	int64_t t;
-	uint8_t ret = 0;
+	uint16_t ret = 0;
 
 	if (pwr) {
 		t = t_now % c->end[3];
 
 		if (t < c->end[0]) { /* Fade In */
-			ret = pwm * t / c->end[0];
+			ret = level * t / c->end[0];
 		}
 		else if (t < c->end[1]) { /* ON */
-			ret = pwm;
+			ret = level;
 		}
 		else if (t < c->end[2]) { /* Fade Out */
-			ret = pwm - (pwm * (t - c->end[1]) / (c->end[2] - c->end[1]));
+			ret = level - (level * (t - c->end[1]) / (c->end[2] - c->end[1]));
 		}
 		else { /* OFF */
 			ret = 0;
@@ -30,9 +30,94 @@
 extern char __flash_binary_start;
 extern char __flash_binary_end;
 
+#define STAT_CACHE_SIZE      8
+#define STAT_CACHE_NAME_MAX  32
+
+/* Cache of file sizes (and nonexistent files) by filename. */
+struct stat_cache_entry {
+	char name[STAT_CACHE_NAME_MAX + 1];
+	int32_t size;       /* file size, or LFS_ERR_NOENT if file does not exist */
+	uint32_t used;      /* for LRU replacement */
+};
+
 static struct lfs_config *lfs_cfg;
 static lfs_t lfs;
+static bool lfs_mounted = false;
+auto_init_recursive_mutex(lfs_mutex_inst);
+static recursive_mutex_t *lfs_mutex = &lfs_mutex_inst;
+static struct stat_cache_entry stat_cache[STAT_CACHE_SIZE];
+static uint32_t stat_cache_counter = 0;
+
+
+/* Acquire filesystem lock (and mount filesystem if not already mounted). */
+static int flash_lock()
+{
+	int res;
+
+	recursive_mutex_enter_blocking(lfs_mutex);
+	if (!lfs_mounted) {
+		if ((res = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
+			recursive_mutex_exit(lfs_mutex);
+			log_msg(LOG_ERR, "lfs_mount() failed: %d", res);
+			return res;
+		}
+		log_msg(LOG_DEBUG, "Filesystem mounted OK");
+		lfs_mounted = true;
+	}
+
+	return LFS_ERR_OK;
+}
 
+static void flash_unlock()
+{
+	recursive_mutex_exit(lfs_mutex);
+}
+
+
+static void stat_cache_invalidate(const char *filename)
+{
+	for (int i = 0; i < STAT_CACHE_SIZE; i++) {
+		if (!filename || !strncmp(stat_cache[i].name, filename, STAT_CACHE_NAME_MAX + 1))
+			stat_cache[i].name[0] = 0;
+	}
+}
+
+/* Return size of a file (or LFS_ERR_NOENT if file does not exist).
+   Must be called while holding filesystem lock. */
+static int32_t stat_cache_size(const char *filename)
+{
+	struct stat_cache_entry *e = NULL;
+	struct lfs_info stat;
+	int32_t size;
+	int i, res;
+
+	if (strnlen(filename, STAT_CACHE_NAME_MAX + 1) <= STAT_CACHE_NAME_MAX) {
+		for (i = 0; i < STAT_CACHE_SIZE; i++) {
+			if (!strcmp(stat_cache[i].name, filename)) {
+				stat_cache[i].used = ++stat_cache_counter;
+				return stat_cache[i].size;
+			}
+			if (!e || stat_cache[i].used < e->used)
+				e = &stat_cache[i];
+		}
+	}
+
+	if ((res = lfs_stat(&lfs, filename, &stat)) == LFS_ERR_OK) {
+		size = (stat.type == LFS_TYPE_REG ? stat.size : LFS_ERR_ISDIR);
+	} else if (res == LFS_ERR_NOENT) {
+		size = LFS_ERR_NOENT;
+	} else {
+		return res;
+	}
+
+	if (e && size != LFS_ERR_ISDIR) {
+		strncopy(e->name, filename, sizeof(e->name));
+		e->size = size;
+		e->used = ++stat_cache_counter;
+	}
+
+	return size;
+}
 
 
 void lfs_setup(bool multicore)
@@ -51,7 +136,8 @@ void lfs_setup(bool multicore)
 			return;
 		log_msg(LOG_ERR, "Filesystem successfully initialized: %d", err);
 	} else {
-		lfs_unmount(&lfs);
+		/* Filesystem stays mounted */
+		lfs_mounted = true;
 	}
 }
 
@@ -62,14 +148,26 @@ int flash_format(bool multicore)
 	int err;
 	bool saved;
 
+	recursive_mutex_enter_blocking(lfs_mutex);
+	if (lfs_mounted) {
+		lfs_unmount(&lfs);
+		lfs_mounted = false;
+	}
+	stat_cache_invalidate(NULL);
+
 	saved = ctx->multicore_lockout_enabled;
 	ctx->multicore_lockout_enabled = (multicore ? true : false);
 
 	if ((err = lfs_format(&lfs, lfs_cfg)) != LFS_ERR_OK) {
 		log_msg(LOG_ERR, "Unable to format flash filesystem: %d", err);
+	} else if ((err = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
+		log_msg(LOG_ERR, "lfs_mount() failed: %d", err);
+	} else {
+		lfs_mounted = true;
 	}
 
 	ctx->multicore_lockout_enabled = saved;
+	recursive_mutex_exit(lfs_mutex);
 
 	return  (err == LFS_ERR_OK ? 0 : 1);
 }
@@ -86,17 +184,14 @@ int flash_read_file(char **bufptr, uint32_t *sizeptr, const char *filename)
 	*bufptr = NULL;
 	*sizeptr = 0;
 
-	/* Mount flash filesystem... */
-	if ((res = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
-		log_msg(LOG_NOTICE, "lfs_mount() failed: %d", res);
+	if (flash_lock())
 		return -1;
-	}
-	log_msg(LOG_DEBUG, "Filesystem mounted OK");
-
-	res = 0;
 
 	/* Open file */
-	if ((res = lfs_file_open(&lfs, &lfs_file, filename, LFS_O_RDONLY)) != LFS_ERR_OK) {
+	if (stat_cache_size(filename) == LFS_ERR_NOENT) {
+		log_msg(LOG_DEBUG, "File not found \"%s\"", filename);
+		res = -3;
+	} else if ((res = lfs_file_open(&lfs, &lfs_file, filename, LFS_O_RDONLY)) != LFS_ERR_OK) {
 		log_msg(LOG_DEBUG, "Cannot open file \"%s\": %d", filename, res);
 		res = -3;
 	} else {
@@ -122,7 +217,7 @@ int flash_read_file(char **bufptr, uint32_t *sizeptr, const char *filename)
 		}
 		lfs_file_close(&lfs, &lfs_file);
 	}
-	lfs_unmount(&lfs);
+	flash_unlock();
 
 	return res;
 }
@@ -131,38 +226,48 @@ int flash_read_file(char **bufptr, uint32_t *sizeptr, const char *filename)
 int flash_write_file(const char *buf, uint32_t size, const char *filename)
 {
 	lfs_file_t lfs_file;
+	char tmpname[LFS_NAME_MAX + 1];
 	int res;
 
 	if (!buf || !filename)
 		return -42;
+	if (snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename) >= sizeof(tmpname))
+		return -43;
 
-	/* Mount flash filesystem... */
-	if ((res = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
-		log_msg(LOG_ERR, "lfs_mount() failed: %d", res);
+	if (flash_lock())
 		return -1;
-	}
-
-	/* Create file */
-	if ((res = lfs_file_open(&lfs, &lfs_file, filename, LFS_O_WRONLY | LFS_O_CREAT)) != LFS_ERR_OK) {
-		log_msg(LOG_ERR, "Failed to create file \"%s\": %d", filename, res);
+	stat_cache_invalidate(filename);
+	stat_cache_invalidate(tmpname);
+
+	/* Write new file under temporary name first, and then rename it
+	   (atomically) over the old file, so that an interrupted write never
+	   leaves behind a truncated file. */
+	if ((res = lfs_file_open(&lfs, &lfs_file, tmpname,
+					LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC)) != LFS_ERR_OK) {
+		log_msg(LOG_ERR, "Failed to create file \"%s\": %d", tmpname, res);
 		res = -2;
 	} else {
 		/* Write to file */
 		lfs_size_t wrote = lfs_file_write(&lfs, &lfs_file, buf, size);
-		if (wrote < size) {
+		if ((res = lfs_file_close(&lfs, &lfs_file)) != LFS_ERR_OK) {
+			log_msg(LOG_ERR, "Failed to close file \"%s\": %d", tmpname, res);
+			res = -3;
+		} else if (wrote < size) {
 			log_msg(LOG_ERR, "Failed to write to file \"%s\": %li",
-				filename, wrote);
+				tmpname, wrote);
 			res = -3;
+		} else if ((res = lfs_rename(&lfs, tmpname, filename)) != LFS_ERR_OK) {
+			log_msg(LOG_ERR, "Failed to rename file \"%s\": %d", tmpname, res);
+			res = -4;
 		} else {
 			log_msg(LOG_INFO, "File \"%s\" successfully created: %li bytes",
 				filename, wrote);
 			res = 0;
 		}
-		lfs_file_close(&lfs, &lfs_file);
+		if (res)
+			lfs_remove(&lfs, tmpname);
 	}
-
-	/* Unmount flash filesystem */
-	lfs_unmount(&lfs);
+	flash_unlock();
 
 	return res;
 }
@@ -177,11 +282,8 @@ int flash_delete_file(const char *filename)
 	if (!filename)
 		return -42;
 
-	/* Mount flash filesystem... */
-	if ((res = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
-		log_msg(LOG_ERR, "lfs_mount() failed: %d", res);
+	if (flash_lock())
 		return -1;
-	}
 
 	/* Check if file exists... */
 	if ((res = lfs_stat(&lfs, filename, &stat)) != LFS_ERR_OK) {
@@ -191,12 +293,13 @@ int flash_delete_file(const char *filename)
 		/* Remove configuration file...*/
 		log_msg(LOG_INFO, "Removing file \"%s\" (%lu bytes)",
 			filename, stat.size);
+		stat_cache_invalidate(filename);
 		if ((res = lfs_remove(&lfs, filename)) != LFS_ERR_OK) {
 			log_msg(LOG_ERR, "Failed to remove file \"%s\": %d", filename, res);
 			ret = -3;
 		}
 	}
-	lfs_unmount(&lfs);
+	flash_unlock();
 
 	return ret;
 }
@@ -211,11 +314,8 @@ int flash_rename_file(const char *oldname, const char *newname)
 	if (!oldname || !newname)
 		return -42;
 
-	/* Mount flash filesystem... */
-	if ((res = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
-		log_msg(LOG_ERR, "lfs_mount() failed: %d", res);
+	if (flash_lock())
 		return -1;
-	}
 
 	/* Check if file exists... */
 	if ((res = lfs_stat(&lfs, oldname, &stat)) != LFS_ERR_OK) {
@@ -225,12 +325,14 @@ int flash_rename_file(const char *oldname, const char *newname)
 		/* Rename file...*/
 		log_msg(LOG_INFO, "Renaming file \"%s\" --> \"%s\"",
 			oldname, newname);
+		/* Could be a directory, so invalidate all cached entries */
+		stat_cache_invalidate(NULL);
 		if ((res = lfs_rename(&lfs, oldname, newname)) != LFS_ERR_OK) {
 			log_msg(LOG_ERR, "Failed to rename file \"%s\": %d", oldname, res);
 			ret = -3;
 		}
 	}
-	lfs_unmount(&lfs);
+	flash_unlock();
 
 	return ret;
 }
@@ -251,11 +353,9 @@ int flash_copy_file(const char *srcname, const char *dstname, bool overwrite)
 	if (!srcname || !dstname)
 		return -42;
 
-	/* Mount flash filesystem... */
-	if ((res = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
-		log_msg(LOG_ERR, "lfs_mount() failed: %d", res);
+	if (flash_lock())
 		return -1;
-	}
+	stat_cache_invalidate(dstname);
 
 	if (!(buf = malloc(buf_size))) {
 		log_msg(LOG_ERR, "Not enough memory.");
@@ -274,7 +374,7 @@ int flash_copy_file(const char *srcname, const char *dstname, bool overwrite)
 
 	/* Create destination file... */
 	if (ret == 0) {
-		int flags = LFS_O_WRONLY | LFS_O_CREAT;
+		int flags = LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC;
 
 		if (!overwrite)
 			flags |= LFS_O_EXCL;
@@ -321,7 +421,7 @@ int flash_copy_file(const char *srcname, const char *dstname, bool overwrite)
 
 	if (buf)
 		free(buf);
-	lfs_unmount(&lfs);
+	flash_unlock();
 
 	return ret;
 }
@@ -329,28 +429,19 @@ int flash_copy_file(const char *srcname, const char *dstname, bool overwrite)
 
 int flash_file_size(const char *filename)
 {
-	struct lfs_info stat;
-	int res;
+	int32_t size;
 
 	if (!filename)
 		return -42;
 
-
-	/* Mount flash filesystem... */
-	if ((res = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
-		log_msg(LOG_ERR, "lfs_mount() failed: %d", res);
+	if (flash_lock())
 		return -1;
-	}
 
 	/* Check if file exists... */
-	if ((res = lfs_stat(&lfs, filename, &stat)) != LFS_ERR_OK) {
-		res = -2;
-	} else {
-		res = stat.size;
-	}
-	lfs_unmount(&lfs);
+	size = stat_cache_size(filename);
+	flash_unlock();
 
-	return res;
+	return (size < 0 ? -2 : size);
 }
 
 
@@ -441,11 +532,8 @@ int flash_get_fs_info(size_t *size, size_t *free, size_t *files,
 	if (!size || !free)
 		return -1;
 
-	/* Mount flash filesystem... */
-	if ((res = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
-		log_msg(LOG_ERR, "lfs_mount() failed: %d", res);
+	if (flash_lock())
 		return -2;
-	}
 
 	used_blocks = lfs_fs_size(&lfs);
 	used = used_blocks * lfs_cfg->block_size;
@@ -465,7 +553,7 @@ int flash_get_fs_info(size_t *size, size_t *free, size_t *files,
 	if (filesizetotal)
 		*filesizetotal = fs_total;
 
-	lfs_unmount(&lfs);
+	flash_unlock();
 
 	return 0;
 }
@@ -544,15 +632,12 @@ int flash_list_directory(const char *path, bool recursive)
 	if (!path)
 		return -1;
 
-	/* Mount flash filesystem... */
-	if ((res = lfs_mount(&lfs, lfs_cfg)) != LFS_ERR_OK) {
-		log_msg(LOG_ERR, "lfs_mount() failed: %d", res);
+	if (flash_lock())
 		return -2;
-	}
 
 	res = littlefs_list_dir(path, recursive);
 
-	lfs_unmount(&lfs);
+	flash_unlock();
 
 	return res;
 }
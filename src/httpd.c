@@ -24,7 +24,6 @@
 #include <time.h>
 #include <assert.h>
 #include "pico/stdlib.h"
-#include "cJSON.h"
 #ifdef LIB_PICO_CYW43_ARCH
 #include "lwip/apps/httpd.h"
 #endif
@@ -35,6 +34,7 @@
 
 #define INDEX_URL "/brickpico-" BRICKPICO_BOARD ".shtml"
 #define BUF_LEN 1024
+#define TIMER_BUF_LEN 2048
 
 
 u16_t timer_table(char *insert, int insertlen, u16_t current_tag_part, u16_t *next_tag_part)
@@ -43,7 +43,7 @@ u16_t timer_table(char *insert, int insertlen, u16_t current_tag_part, u16_t *ne
 	static char *p;
 	static u16_t part;
 	static size_t buf_left;
-	char row[128];
+	char row[192];
 	int i;
 	size_t printed, count;
 
@@ -52,7 +52,7 @@ u16_t timer_table(char *insert, int insertlen, u16_t current_tag_part, u16_t *ne
 
 	if (current_tag_part == 0) {
 		/* Generate 'output' into a buffer that then will be fed in chunks to LwIP... */
-		if (!(buf = malloc(BUF_LEN)))
+		if (!(buf = malloc(TIMER_BUF_LEN)))
 			return 0;
 		buf[0] = 0;
 
@@ -64,19 +64,28 @@ u16_t timer_table(char *insert, int insertlen, u16_t current_tag_part, u16_t *ne
 			strncatenate(row, (e->wday > 0 ? bitmask_to_str(e->wday, 7, 0, true) : "*"),
 				sizeof(row));
 			strncatenate(row, "<td>", sizeof(row));
-			if (e->hour >= 0) {
-				snprintf(tmp, sizeof(tmp), "%02d:", e->hour);
-			} else {
-				strncopy(tmp, "**:", sizeof(tmp));
-			}
-			strncatenate(row, tmp, sizeof(row));
-			if (e->minute >= 0) {
-				snprintf(tmp, sizeof(tmp), "%02d<td>", e->minute);
+			if (timer_trigger_str(e, tmp, sizeof(tmp))) {
+				strncatenate(row, tmp, sizeof(row));
 			} else {
-				strncopy(tmp, "**<td>", sizeof(tmp));
+				if (e->hour >= 0) {
+					snprintf(tmp, sizeof(tmp), "%02d:", e->hour);
+				} else {
+					strncopy(tmp, "**:", sizeof(tmp));
+				}
+				strncatenate(row, tmp, sizeof(row));
+				if (e->minute >= 0) {
+					snprintf(tmp, sizeof(tmp), "%02d", e->minute);
+				} else {
+					strncopy(tmp, "**", sizeof(tmp));
+				}
+				strncatenate(row, tmp, sizeof(row));
+				if (e->second > 0) {
+					snprintf(tmp, sizeof(tmp), ":%02d", e->second);
+					strncatenate(row, tmp, sizeof(row));
+				}
 			}
-			strncatenate(row, tmp, sizeof(row));
-			strncatenate(row, timer_action_type_str(e->action), sizeof(row));
+			strncatenate(row, "<td>", sizeof(row));
+			strncatenate(row, timer_action_str(e, tmp, sizeof(tmp)), sizeof(row));
 			strncatenate(row, "<td>", sizeof(row));
 			if (e->mask > 0) {
 				strncatenate(row, bitmask_to_str(e->mask, OUTPUT_COUNT, 1, true),
@@ -88,11 +97,11 @@ u16_t timer_table(char *insert, int insertlen, u16_t current_tag_part, u16_t *ne
 			strncatenate(row, e->name, sizeof(row));
 			strncatenate(row, "</tr>\n", sizeof(row));
 
-			strncatenate(buf, row, BUF_LEN);
+			strncatenate(buf, row, TIMER_BUF_LEN);
 		}
 
 		if (cfg->event_count == 0) {
-			snprintf(buf, BUF_LEN, "<tr><td colspan=\"6\">No Timers Defined.</tr>\n");
+			snprintf(buf, TIMER_BUF_LEN, "<tr><td colspan=\"6\">No Timers Defined.</tr>\n");
 		}
 
 		p = buf;
@@ -169,70 +178,53 @@ u16_t csv_stats(char *insert, int insertlen, u16_t current_tag_part, u16_t *next
 }
 
 
-u16_t json_stats(char *insert, int insertlen, u16_t current_tag_part, u16_t *next_tag_part)
+static void json_stats_gen(json_writer_t *w, const void *arg)
 {
-	const struct brickpico_state *st = brickpico_state;
-	cJSON *json = NULL;
-	static char *buf = NULL;
-	static char *p;
-	static u16_t part;
-	static size_t buf_left;
+	const struct brickpico_state *st = arg;
 	int i;
-	size_t printed, count;
-
-	if (current_tag_part == 0) {
-		/* Generate 'output' into a buffer that then will be fed in chunks to LwIP... */
-		cJSON *array, *o;
-
-		if (!(json = cJSON_CreateObject()))
-			goto panic;
-
-		/* Outputs */
-		if (!(array = cJSON_CreateArray()))
-			goto panic;
-		for (i = 0; i < OUTPUT_COUNT; i++) {
-			if (!(o = cJSON_CreateObject()))
-				goto panic;
-
-			cJSON_AddItemToObject(o, "output", cJSON_CreateNumber(i+1));
-			cJSON_AddItemToObject(o, "name", cJSON_CreateString(cfg->outputs[i].name));
-			cJSON_AddItemToObject(o, "duty_cycle", cJSON_CreateNumber(round_decimal(st->pwm[i], 1)));
-			cJSON_AddItemToObject(o, "state", cJSON_CreateString(st->pwr[i] ? "ON" : "OFF"));
-			cJSON_AddItemToArray(array, o);
-		}
-		cJSON_AddItemToObject(json, "outputs", array);
-
-		if (!(buf = cJSON_Print(json)))
-			goto panic;
-		cJSON_Delete(json);
-		json = NULL;
 
-		p = buf;
-		buf_left = strlen(buf);
-		part = 1;
+	json_writer_begin_object(w, NULL);
+
+	/* Outputs */
+	json_writer_begin_array(w, "outputs");
+	for (i = 0; i < OUTPUT_COUNT; i++) {
+		json_writer_begin_object(w, NULL);
+		json_writer_add_number(w, "output", i+1);
+		json_writer_add_string(w, "name", cfg->outputs[i].name);
+		json_writer_add_number(w, "duty_cycle", round_decimal(st->pwm[i], 1));
+		json_writer_add_string(w, "state", st->pwr[i] ? "ON" : "OFF");
+		json_writer_end_object(w);
 	}
+	json_writer_end_array(w);
 
-	/* Copy a part of the multi-part response into LwIP buffer ...*/
-	count = (buf_left < insertlen - 1 ? buf_left : insertlen - 1);
-	memcpy(insert, p, count);
+	json_writer_end_object(w);
+}
 
-	p += count;
-	printed = count;
-	buf_left -= count;
+u16_t json_stats(char *insert, int insertlen, u16_t current_tag_part, u16_t *next_tag_part)
+{
+	static struct brickpico_state st;
+	static size_t offset;
+	json_writer_t w;
+	int len;
 
-	if (buf_left > 0) {
-		*next_tag_part = part++;
-	} else {
-		free(buf);
-		buf = p = NULL;
+	if (current_tag_part == 0) {
+		/* Take snapshot of the state, so that all parts of the
+		   (multi-part) response are generated from the same data... */
+		memcpy(&st, brickpico_state, sizeof(st));
+		offset = 0;
 	}
 
-	return printed;
+	/* Generate next part of the response directly into LwIP buffer... */
+	json_writer_init(&w, insert, insertlen, offset);
+	json_stats_gen(&w, &st);
+	if ((len = json_writer_finish(&w)) < 0)
+		return 0;
+
+	offset += w.len;
+	if (offset < len)
+		*next_tag_part = current_tag_part + 1;
 
-panic:
-	if (json)
-		cJSON_Delete(json);
-	return 0;
+	return w.len;
 }
 
 
@@ -414,6 +406,7 @@ static const char* brickpico_cgi_handler(int index, int numparams, char *param[]
 				}
 			}
 		}
+		update_core1_state();
 	}
 
 	/* Redirect back to "/" ... */
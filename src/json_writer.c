@@ -0,0 +1,334 @@
+/* json_writer.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Streaming JSON writer.
+
+   Generates JSON output directly into a (caller provided) buffer without
+   building a tree of the document first. Output is formatted identically
+   to cJSON_Print().
+
+   Output modes:
+     - buf == NULL: output is discarded, only output size is calculated.
+     - sink set: buffer is passed to sink function whenever it gets full
+       (and when json_writer_finish() is called).
+     - otherwise: output starting at 'offset' is stored into buffer
+       (NUL terminated) until buffer is full, rest of the output is
+       only counted. This allows generating output in chunks. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <float.h>
+
+#include "json_writer.h"
+
+
+static void jw_put(json_writer_t *w, const char *s, size_t len)
+{
+	size_t n, cap;
+
+	if (w->pos < w->offset) {
+		n = w->offset - w->pos;
+		if (n >= len) {
+			w->pos += len;
+			return;
+		}
+		w->pos += n;
+		s += n;
+		len -= n;
+	}
+
+	if (!w->buf || w->size < 1) {
+		w->pos += len;
+		return;
+	}
+
+	cap = (w->sink ? w->size : w->size - 1);
+	while (len > 0) {
+		if (w->len >= cap) {
+			if (!w->sink) {
+				w->pos += len;
+				return;
+			}
+			w->sink(w->buf, w->len, w->sink_ctx);
+			w->len = 0;
+		}
+		n = cap - w->len;
+		if (n > len)
+			n = len;
+		memcpy(w->buf + w->len, s, n);
+		w->len += n;
+		w->pos += n;
+		s += n;
+		len -= n;
+	}
+}
+
+static inline void jw_putc(json_writer_t *w, char c)
+{
+	jw_put(w, &c, 1);
+}
+
+static void jw_indent(json_writer_t *w, uint8_t depth)
+{
+	for (int i = 0; i < depth; i++)
+		jw_putc(w, '\t');
+}
+
+static void jw_put_string(json_writer_t *w, const char *s)
+{
+	const char *start = s;
+	char esc[8];
+
+	jw_putc(w, '"');
+	for (; *s; s++) {
+		unsigned char c = *s;
+
+		if (c >= 32 && c != '"' && c != '\\')
+			continue;
+		jw_put(w, start, s - start);
+		start = s + 1;
+		switch (c) {
+		case '"':
+			jw_put(w, "\\\"", 2);
+			break;
+		case '\\':
+			jw_put(w, "\\\\", 2);
+			break;
+		case '\b':
+			jw_put(w, "\\b", 2);
+			break;
+		case '\f':
+			jw_put(w, "\\f", 2);
+			break;
+		case '\n':
+			jw_put(w, "\\n", 2);
+			break;
+		case '\r':
+			jw_put(w, "\\r", 2);
+			break;
+		case '\t':
+			jw_put(w, "\\t", 2);
+			break;
+		default:
+			snprintf(esc, sizeof(esc), "\\u%04x", c);
+			jw_put(w, esc, 6);
+		}
+	}
+	jw_put(w, start, s - start);
+	jw_putc(w, '"');
+}
+
+/* Output separator, and key (if inside an object), before next value. */
+static void jw_begin_value(json_writer_t *w, const char *key)
+{
+	uint32_t bit = 1UL << w->depth;
+
+	if (w->depth > 0) {
+		if (w->array & bit) {
+			if (!(w->first & bit))
+				jw_put(w, ", ", 2);
+		} else {
+			if (!(w->first & bit))
+				jw_put(w, ",\n", 2);
+			jw_indent(w, w->depth);
+			jw_put_string(w, (key ? key : ""));
+			jw_put(w, ":\t", 2);
+		}
+	}
+	w->first &= ~bit;
+}
+
+static void jw_begin_container(json_writer_t *w, const char *key, bool array)
+{
+	uint32_t bit;
+
+	if (w->depth >= JSON_WRITER_MAX_DEPTH) {
+		w->error = true;
+		return;
+	}
+	jw_begin_value(w, key);
+	w->depth++;
+	bit = 1UL << w->depth;
+	w->first |= bit;
+	if (array) {
+		w->array |= bit;
+		jw_putc(w, '[');
+	} else {
+		w->array &= ~bit;
+		jw_put(w, "{\n", 2);
+	}
+}
+
+static void jw_end_container(json_writer_t *w, bool array)
+{
+	uint32_t bit = 1UL << w->depth;
+
+	if (w->depth < 1 || ((w->array & bit) != 0) != array) {
+		w->error = true;
+		return;
+	}
+	if (array) {
+		jw_putc(w, ']');
+	} else {
+		if (!(w->first & bit))
+			jw_putc(w, '\n');
+		jw_indent(w, w->depth - 1);
+		jw_putc(w, '}');
+	}
+	w->depth--;
+}
+
+
+void json_writer_init(json_writer_t *w, char *buf, size_t size, size_t offset)
+{
+	memset(w, 0, sizeof(*w));
+	w->buf = buf;
+	w->size = size;
+	w->offset = offset;
+	w->first = 1;
+}
+
+void json_writer_set_sink(json_writer_t *w, json_writer_sink_t sink, void *ctx)
+{
+	w->sink = sink;
+	w->sink_ctx = ctx;
+	w->offset = 0;
+}
+
+/* Flush output. Returns total size of the (whole) output, or
+   -1 if output is not valid JSON. */
+int json_writer_finish(json_writer_t *w)
+{
+	if (w->buf) {
+		if (w->sink) {
+			if (w->len > 0)
+				w->sink(w->buf, w->len, w->sink_ctx);
+			w->len = 0;
+		} else if (w->size > 0) {
+			w->buf[w->len] = 0;
+		}
+	}
+
+	if (w->error || w->depth != 0)
+		return -1;
+	return (w->pos <= INT_MAX ? w->pos : -1);
+}
+
+/* Generate JSON output into a (malloc allocated) string. */
+char* json_writer_print(json_writer_gen_t gen, const void *arg)
+{
+	json_writer_t w;
+	char *buf;
+	int len;
+
+	/* Calculate output size first, so only the output buffer needs
+	   to be allocated. */
+	json_writer_init(&w, NULL, 0, 0);
+	gen(&w, arg);
+	if ((len = json_writer_finish(&w)) < 0)
+		return NULL;
+
+	if (!(buf = malloc(len + 1)))
+		return NULL;
+	json_writer_init(&w, buf, len + 1, 0);
+	gen(&w, arg);
+	if (json_writer_finish(&w) != len) {
+		free(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
+void json_writer_begin_object(json_writer_t *w, const char *key)
+{
+	jw_begin_container(w, key, false);
+}
+
+void json_writer_end_object(json_writer_t *w)
+{
+	jw_end_container(w, false);
+}
+
+void json_writer_begin_array(json_writer_t *w, const char *key)
+{
+	jw_begin_container(w, key, true);
+}
+
+void json_writer_end_array(json_writer_t *w)
+{
+	jw_end_container(w, true);
+}
+
+void json_writer_add_string(json_writer_t *w, const char *key, const char *val)
+{
+	/* Like cJSON, omit items with NULL value */
+	if (!val)
+		return;
+	jw_begin_value(w, key);
+	jw_put_string(w, val);
+}
+
+void json_writer_add_number(json_writer_t *w, const char *key, double val)
+{
+	char buf[32];
+	double test = 0.0;
+	int len, i;
+
+	jw_begin_value(w, key);
+
+	/* Format number same way as cJSON does... */
+	if (isnan(val) || isinf(val)) {
+		jw_put(w, "null", 4);
+		return;
+	}
+	if (val >= INT_MAX)
+		i = INT_MAX;
+	else if (val <= (double)INT_MIN)
+		i = INT_MIN;
+	else
+		i = (int)val;
+
+	if (val == (double)i) {
+		len = snprintf(buf, sizeof(buf), "%d", i);
+	} else {
+		len = snprintf(buf, sizeof(buf), "%1.15g", val);
+		if (sscanf(buf, "%lg", &test) != 1
+			|| fabs(test - val) > fmax(fabs(test), fabs(val)) * DBL_EPSILON)
+			len = snprintf(buf, sizeof(buf), "%1.17g", val);
+	}
+	jw_put(w, buf, len);
+}
+
+void json_writer_add_bool(json_writer_t *w, const char *key, bool val)
+{
+	jw_begin_value(w, key);
+	if (val)
+		jw_put(w, "true", 4);
+	else
+		jw_put(w, "false", 5);
+}
+
+
+/* eof :-) */
@@ -0,0 +1,63 @@
+/* json_writer.h
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BRICKPICO_JSON_WRITER_H
+#define BRICKPICO_JSON_WRITER_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JSON_WRITER_MAX_DEPTH 31
+
+typedef void (*json_writer_sink_t)(const char *buf, size_t len, void *ctx);
+
+typedef struct json_writer {
+	char *buf;              /* output buffer (NULL = only calculate output size) */
+	size_t size;
+	size_t len;             /* bytes currently in buffer */
+	size_t offset;          /* skip this many bytes from start of output */
+	size_t pos;             /* total bytes of output generated */
+	json_writer_sink_t sink;
+	void *sink_ctx;
+	uint8_t depth;
+	uint32_t first;         /* (bitmask) no items added yet at depth */
+	uint32_t array;         /* (bitmask) container at depth is an array */
+	bool error;
+} json_writer_t;
+
+typedef void (*json_writer_gen_t)(json_writer_t *w, const void *arg);
+
+
+void json_writer_init(json_writer_t *w, char *buf, size_t size, size_t offset);
+void json_writer_set_sink(json_writer_t *w, json_writer_sink_t sink, void *ctx);
+int json_writer_finish(json_writer_t *w);
+char* json_writer_print(json_writer_gen_t gen, const void *arg);
+void json_writer_begin_object(json_writer_t *w, const char *key);
+void json_writer_end_object(json_writer_t *w);
+void json_writer_begin_array(json_writer_t *w, const char *key);
+void json_writer_end_array(json_writer_t *w);
+void json_writer_add_string(json_writer_t *w, const char *key, const char *val);
+void json_writer_add_number(json_writer_t *w, const char *key, double val);
+void json_writer_add_bool(json_writer_t *w, const char *key, bool val);
+
+
+#endif /* BRICKPICO_JSON_WRITER_H */
@@ -30,11 +30,6 @@
 #include <time.h>
 #include "pico/stdlib.h"
 #include "pico/mutex.h"
-#include "pico/unique_id.h"
-#include "pico/util/datetime.h"
-#include "hardware/watchdog.h"
-#include "b64/cencode.h"
-#include "b64/cdecode.h"
 
 #include "brickpico.h"
 #ifdef WIFI_SUPPORT
@@ -45,6 +40,7 @@
 int global_debug_level = 0;
 int global_log_level = LOG_ERR;
 int global_syslog_level = LOG_ERR;
+int global_console_level = LOG_DEBUG;
 
 struct log_priority {
 	uint8_t  priority;
@@ -173,6 +169,16 @@ void set_syslog_level(int level)
 	global_syslog_level = level;
 }
 
+int get_console_log_level()
+{
+	return global_console_level;
+}
+
+void set_console_log_level(int level)
+{
+	global_console_level = level;
+}
+
 int get_debug_level()
 {
 	return global_debug_level;
@@ -185,55 +191,489 @@ void set_debug_level(int level)
 
 
 #define LOG_MAX_MSG_LEN 256
+#define LOG_TSTAMP_LEN  32
+#define LOG_MAX_DEPTH   2   /* max nesting (log_msg() called from IRQ handler) */
+#define LOG_RB_MAX_LEN  255 /* max item size in log ringbuffer */
 
-void log_msg(int priority, const char *format, ...)
+/* Per-core static message buffers (no heap allocation in log_msg()).
+   Each buffer has room for timestamp prefix in front of the message. */
+static char log_buf[NUM_CORES][LOG_MAX_DEPTH][LOG_TSTAMP_LEN + LOG_MAX_MSG_LEN];
+static volatile uint8_t log_depth[NUM_CORES];
+static uint32_t log_dropped[NUM_CORES];
+static uint32_t log_rb_dropped[NUM_CORES];
+
+/* Binary log entries (stored in log ringbuffer instead of formatted text):
+
+   offset  size  description
+   0       1     LOG_BIN_MARKER
+   1       1     priority (bits 4-7), core (bits 0-3)
+   2       6     timestamp (microseconds since boot, little-endian)
+   8       4     format string address (in flash)
+   12      ...   arguments: integers (4 or 8 bytes), doubles (8 bytes),
+                 strings (NUL terminated)
+
+   Entries are formatted only when log is read. */
+#define LOG_BIN_MARKER     0x01
+#define LOG_BIN_HDR_LEN    12
+#define LOG_SPEC_MAX_LEN   16
+
+extern char __flash_binary_start;
+extern char __flash_binary_end;
+
+static bool log_binary_mode = false;
+static uint8_t log_rec[NUM_CORES][LOG_MAX_DEPTH][LOG_RB_MAX_LEN];
+
+
+uint32_t get_log_dropped_count()
+{
+	uint32_t count = 0;
+
+	for (int i = 0; i < NUM_CORES; i++)
+		count += log_dropped[i];
+
+	return count;
+}
+
+uint32_t get_log_rb_dropped_count()
+{
+	uint32_t count = 0;
+
+	for (int i = 0; i < NUM_CORES; i++)
+		count += log_rb_dropped[i];
+
+	return count;
+}
+
+bool get_log_binary_mode()
+{
+	return log_binary_mode;
+}
+
+void set_log_binary_mode(bool enabled)
+{
+	log_binary_mode = enabled;
+}
+
+
+static inline bool log_flash_ptr(const void *p)
+{
+	return ((const char*)p >= &__flash_binary_start && (const char*)p < &__flash_binary_end);
+}
+
+
+/* Parse printf conversion specification (after '%').
+   Returns pointer to conversion character, or NULL if not supported. */
+static const char* log_parse_spec(const char *s, char *lenmod)
+{
+	*lenmod = 0;
+
+	while (*s && strchr("-+ #0", *s))
+		s++;
+	while (*s >= '0' && *s <= '9')
+		s++;
+	if (*s == '.') {
+		s++;
+		while (*s >= '0' && *s <= '9')
+			s++;
+	}
+	if (*s == '*')
+		return NULL;
+
+	if (*s == 'h') {
+		*lenmod = 'h';
+		if (*++s == 'h')
+			s++;
+	} else if (*s == 'l') {
+		*lenmod = 'l';
+		if (*++s == 'l') {
+			*lenmod = 'q';
+			s++;
+		}
+	} else if (*s == 'j') {
+		*lenmod = 'q';
+		s++;
+	} else if (*s == 'z' || *s == 't') {
+		*lenmod = 'z';
+		s++;
+	} else if (*s == 'L') {
+		return NULL;
+	}
+
+	if (!*s || !strchr("diouxXcpfFeEgGaAs", *s))
+		return NULL;
+
+	return s;
+}
+
+
+/**
+ * Encode log message into binary log entry.
+ *
+ * @return Length of entry, or -1 if message cannot be stored in binary format.
+ */
+static int log_encode_binary(uint8_t *rec, size_t size, int priority, uint core,
+			uint64_t t, const char *format, va_list ap)
+{
+	uint8_t *o = rec + LOG_BIN_HDR_LEN;
+	uint8_t *end = rec + size;
+	const char *s = format;
+	char lenmod;
+	uint32_t fmt = (uint32_t)(uintptr_t)format;
+
+	if (!log_flash_ptr(format) || size < LOG_BIN_HDR_LEN)
+		return -1;
+
+	rec[0] = LOG_BIN_MARKER;
+	rec[1] = ((priority & 0x0f) << 4) | (core & 0x0f);
+	for (int i = 0; i < 6; i++)
+		rec[2 + i] = (t >> (i * 8)) & 0xff;
+	for (int i = 0; i < 4; i++)
+		rec[8 + i] = (fmt >> (i * 8)) & 0xff;
+
+	while ((s = strchr(s, '%'))) {
+		s++;
+		if (*s == '%') {
+			s++;
+			continue;
+		}
+		if (!(s = log_parse_spec(s, &lenmod)))
+			return -1;
+
+		if (*s == 's') {
+			const char *str = va_arg(ap, const char *);
+			size_t l;
+
+			if (!str)
+				str = "(null)";
+			l = strnlen(str, end - o);
+			if (l >= end - o)
+				return -1;
+			memcpy(o, str, l);
+			o += l;
+			*o++ = 0;
+		} else if (strchr("fFeEgGaA", *s)) {
+			double d = va_arg(ap, double);
+
+			if (end - o < sizeof(d))
+				return -1;
+			memcpy(o, &d, sizeof(d));
+			o += sizeof(d);
+		} else if (lenmod == 'q') {
+			uint64_t v = va_arg(ap, long long);
+
+			if (end - o < 8)
+				return -1;
+			for (int i = 0; i < 8; i++)
+				*o++ = (v >> (i * 8)) & 0xff;
+		} else {
+			uint32_t v;
+
+			if (*s == 'p')
+				v = (uintptr_t)va_arg(ap, void*);
+			else if (lenmod == 'l')
+				v = va_arg(ap, long);
+			else if (lenmod == 'z')
+				v = va_arg(ap, size_t);
+			else
+				v = va_arg(ap, int);
+			if (end - o < 4)
+				return -1;
+			for (int i = 0; i < 4; i++)
+				*o++ = (v >> (i * 8)) & 0xff;
+		}
+		s++;
+	}
+
+	return o - rec;
+}
+
+
+/**
+ * Format log ringbuffer entry (text or binary) into a string.
+ *
+ * @param entry Log entry.
+ * @param len Length of log entry.
+ * @param buf Output buffer.
+ * @param size Size of output buffer.
+ *
+ * @return Length of the formatted string.
+ */
+int log_entry_str(const uint8_t *entry, size_t len, char *buf, size_t size)
+{
+	const uint8_t *a, *end;
+	const char *s, *spec_end;
+	char spec[LOG_SPEC_MAX_LEN + 2];
+	char *o = buf;
+	char lenmod;
+	uint64_t t = 0;
+	uint32_t fmt = 0;
+	int l;
+
+	if (size < 1)
+		return 0;
+	buf[0] = 0;
+	if (len < 1)
+		return 0;
+
+	if (entry[0] != LOG_BIN_MARKER) {
+		/* Text entry */
+		l = strnlen((const char*)entry, len);
+		if (l >= size)
+			l = size - 1;
+		memcpy(buf, entry, l);
+		buf[l] = 0;
+		return l;
+	}
+
+	if (len < LOG_BIN_HDR_LEN)
+		return snprintf(buf, size, "<truncated binary log entry>");
+	for (int i = 0; i < 6; i++)
+		t |= (uint64_t)entry[2 + i] << (i * 8);
+	for (int i = 0; i < 4; i++)
+		fmt |= (uint32_t)entry[8 + i] << (i * 8);
+	s = (const char*)(uintptr_t)fmt;
+	if (!log_flash_ptr(s))
+		return snprintf(buf, size, "<invalid binary log entry>");
+
+	l = snprintf(o, size, "[%6llu.%06llu][%u] ", (t / 1000000), (t % 1000000),
+		entry[1] & 0x0f);
+	if (l >= size)
+		return size - 1;
+	o += l;
+	size -= l;
+
+	a = entry + LOG_BIN_HDR_LEN;
+	end = entry + len;
+	while (*s && size > 1) {
+		if (*s != '%') {
+			*o++ = *s++;
+			size--;
+			continue;
+		}
+		if (s[1] == '%') {
+			*o++ = '%';
+			size--;
+			s += 2;
+			continue;
+		}
+
+		if (!(spec_end = log_parse_spec(s + 1, &lenmod)))
+			break;
+
+		/* Build conversion specification without length modifiers */
+		l = 0;
+		for (const char *p = s; p < spec_end && l < LOG_SPEC_MAX_LEN - 2; p++) {
+			if (!strchr("hljzt", *p))
+				spec[l++] = *p;
+		}
+		if (!strchr("spcfFeEgGaA", *spec_end)) {
+			spec[l++] = 'l';
+			if (lenmod == 'q')
+				spec[l++] = 'l';
+		}
+		spec[l++] = *spec_end;
+		spec[l] = 0;
+		s = spec_end + 1;
+
+		if (*spec_end == 's') {
+			size_t sl = strnlen((const char*)a, end - a);
+			if (sl >= end - a)
+				break;
+			l = snprintf(o, size, spec, (const char*)a);
+			a += sl + 1;
+		} else if (strchr("fFeEgGaA", *spec_end)) {
+			double d;
+			if (end - a < sizeof(d))
+				break;
+			memcpy(&d, a, sizeof(d));
+			a += sizeof(d);
+			l = snprintf(o, size, spec, d);
+		} else if (lenmod == 'q') {
+			uint64_t v = 0;
+			if (end - a < 8)
+				break;
+			for (int i = 0; i < 8; i++)
+				v |= (uint64_t)*a++ << (i * 8);
+			l = snprintf(o, size, spec, v);
+		} else {
+			uint32_t v = 0;
+			if (end - a < 4)
+				break;
+			for (int i = 0; i < 4; i++)
+				v |= (uint32_t)*a++ << (i * 8);
+			if (*spec_end == 'p') {
+				l = snprintf(o, size, spec, (void*)(uintptr_t)v);
+			} else if (*spec_end == 'c') {
+				l = snprintf(o, size, spec, (int)v);
+			} else if (strchr("di", *spec_end)) {
+				l = snprintf(o, size, spec, (long)(int32_t)v);
+			} else {
+				l = snprintf(o, size, spec, (unsigned long)v);
+			}
+		}
+		if (l < 0)
+			break;
+		if (l >= size)
+			l = size - 1;
+		o += l;
+		size -= l;
+	}
+	*o = 0;
+
+	/* Strip trailing newline */
+	if (o > buf && o[-1] == '\n')
+		*--o = 0;
+
+	return o - buf;
+}
+
+
+/**
+ * Drop binary entries (and all entries older than them) from log
+ * ringbuffer. Used when log was saved by different firmware version.
+ *
+ * @return Number of dropped entries.
+ */
+int log_rb_drop_binary(u8_ringbuffer_t *rb)
+{
+	size_t o = rb->head;
+	int drop = 0;
+
+	for (int i = 0; i < rb->items; i++) {
+		if (rb->buf[(o + 1) % rb->size] == LOG_BIN_MARKER)
+			drop = i + 1;
+		o = (o + rb->buf[o] + 2) % rb->size;
+	}
+
+	for (int i = 0; i < drop; i++)
+		u8_ringbuffer_remove_first_item(rb);
+
+	return drop;
+}
+
+
+static int log_format(char *msg, const char *format, va_list ap)
 {
-	va_list ap;
-	char *buf;
-	char tstamp[32];
 	int len;
+
+	vsnprintf(msg, LOG_MAX_MSG_LEN, format, ap);
+	if ((len = strnlen(msg, LOG_MAX_MSG_LEN - 1)) > 0) {
+		/* If string ends with \n, remove it. */
+		if (msg[len - 1] == '\n')
+			msg[--len] = 0;
+	}
+
+	return len;
+}
+
+
+void log_msg(int priority, const char *format, ...)
+{
+	va_list ap, ap2;
+	char *buf, *msg, *line;
+	uint8_t *rec = NULL;
+	int rec_len = -1;
+	char tstamp[LOG_TSTAMP_LEN];
+	int len, tlen;
 	uint64_t start, end;
 	uint core = get_core_num();
+	uint32_t irq;
+	uint depth;
+	bool to_console, to_syslog, text;
+
 
 	if ((priority > global_log_level) && (priority > global_syslog_level))
 		return;
-	if (!(buf = malloc(LOG_MAX_MSG_LEN)))
+
+	/* Reserve message buffer for this call */
+	irq = save_and_disable_interrupts();
+	depth = log_depth[core];
+	if (depth >= LOG_MAX_DEPTH) {
+		log_dropped[core]++;
+		restore_interrupts(irq);
 		return;
+	}
+	log_depth[core] = depth + 1;
+	restore_interrupts(irq);
+
+	buf = log_buf[core][depth];
+	msg = buf + LOG_TSTAMP_LEN;
 
 	start = to_us_since_boot(get_absolute_time());
 	va_start(ap, format);
-	vsnprintf(buf, LOG_MAX_MSG_LEN, format, ap);
-	va_end(ap);
+	va_copy(ap2, ap);
 
-	if ((len = strnlen(buf, LOG_MAX_MSG_LEN - 1)) > 0) {
-		/* If string ends with \n, remove it. */
-		if (buf[len - 1] == '\n')
-			buf[len - 1] = 0;
-	}
+	/* Format message as text only if some output needs it */
+	to_console = (priority <= global_log_level && priority <= global_console_level);
+#ifdef WIFI_SUPPORT
+	to_syslog = (priority <= global_syslog_level);
+#else
+	to_syslog = false;
+#endif
+	text = (to_console || to_syslog || !log_binary_mode);
+	len = 0;
+	msg[0] = 0;
+	if (text)
+		len = log_format(msg, format, ap);
+	va_end(ap);
 
 	if (priority <= global_log_level) {
 		uint64_t t = to_us_since_boot(get_absolute_time());
-		snprintf(tstamp, sizeof(tstamp), "[%6llu.%06llu][%u]",
-			(t / 1000000), (t % 1000000), core);
-		printf("%s %s\n", tstamp, buf);
-		char *rbuf = malloc(255);
-		if (rbuf) {
-			if (mutex_enter_timeout_us(pmem_mutex, 100)) {
-				snprintf(rbuf, 255, "%s %s", tstamp, buf);
-				u8_ringbuffer_add(log_rb, (uint8_t*)rbuf, strlen(rbuf) + 1, true);
-				update_persistent_memory_crc();
-				mutex_exit(pmem_mutex);
+
+		if (log_binary_mode) {
+			rec = log_rec[core][depth];
+			rec_len = log_encode_binary(rec, LOG_RB_MAX_LEN, priority, core, t, format, ap2);
+			if (rec_len <= 0 && !text) {
+				/* Message cannot be stored in binary format, fallback to text */
+				va_end(ap2);
+				va_start(ap2, format);
+				len = log_format(msg, format, ap2);
+			}
+		}
+
+		/* Prepend timestamp in front of the message */
+		tlen = snprintf(tstamp, sizeof(tstamp), "[%6llu.%06llu][%u] ",
+				(t / 1000000), (t % 1000000), core);
+		if (tlen >= sizeof(tstamp))
+			tlen = sizeof(tstamp) - 1;
+		line = msg - tlen;
+		memcpy(line, tstamp, tlen);
+		if (to_console)
+			printf("%s\n", line);
+
+		if (mutex_enter_timeout_us(pmem_mutex, 100)) {
+			char saved = 0;
+
+			if (rec_len > 0) {
+				/* Binary log entry */
+				line = (char*)rec;
+				len = rec_len;
 			} else {
-				printf("%s mutex timeout: FAILED to access log rinbuffer\n",
-					tstamp);
+				/* Truncate message to fit in log ringbuffer */
+				len += tlen + 1;
+				if (len > LOG_RB_MAX_LEN) {
+					len = LOG_RB_MAX_LEN;
+					saved = line[len - 1];
+					line[len - 1] = 0;
+				}
 			}
-			free(rbuf);
+			if (u8_ringbuffer_add(log_rb, (uint8_t*)line, len, true) == 0)
+				update_persistent_memory_log_crc(log_rb->tail, len + 2);
+			else
+				update_persistent_memory_log_crc(0, 0);
+			mutex_exit(pmem_mutex);
+			if (saved)
+				line[len - 1] = saved;
+		} else {
+			log_rb_dropped[core]++;
+			printf("%smutex timeout: FAILED to access log rinbuffer\n",
+				tstamp);
 		}
 	}
 
 #ifdef WIFI_SUPPORT
-	if (priority <= global_syslog_level) {
-		syslog_msg(priority, "%s", buf);
+	if (to_syslog) {
+		syslog_msg(priority, "%s", msg);
 	}
 #endif
 
@@ -244,9 +684,12 @@ void log_msg(int priority, const char *format, ...)
 #endif
 	}
 
-	free(buf);
-}
+	va_end(ap2);
 
+	irq = save_and_disable_interrupts();
+	log_depth[core] = depth;
+	restore_interrupts(irq);
+}
 
 
 void debug(int debug_level, const char *fmt, ...)
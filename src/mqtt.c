@@ -24,7 +24,6 @@
 #include <time.h>
 #include <assert.h>
 #include "pico/stdlib.h"
-#include "cJSON.h"
 #ifdef LIB_PICO_CYW43_ARCH
 #include "pico/cyw43_arch.h"
 #include "lwip/dns.h"
@@ -73,6 +72,7 @@ u16_t mqtt_reconnect = 0;
 u16_t mqtt_ha_discovery = 0;
 
 static absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(t_mqtt_disconnect, 0);
+static uint32_t mqtt_session = 0;
 static absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(t_mqtt_ha_discovery, 0);
 static absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(publish_status_t, 0);
 static absolute_time_t ABSOLUTE_TIME_INITIALIZED_VAR(publish_pwm_t, 0);
@@ -142,27 +142,28 @@ static int mqtt_publish_message(const char *topic, const char *buf, u16_t buf_le
 	return err;
 }
 
-static char* json_response_message(const char *cmd, int result, const char *msg)
-{
-	char *buf;
-	cJSON *json;
+struct mqtt_response {
+	const char *cmd;
+	int result;
+	const char *msg;
+};
 
-	if (!(json = cJSON_CreateObject()))
-		goto panic;
+static void json_response_gen(json_writer_t *w, const void *arg)
+{
+	const struct mqtt_response *r = arg;
 
-	cJSON_AddItemToObject(json, "command", cJSON_CreateString(cmd));
-	cJSON_AddItemToObject(json, "result", cJSON_CreateString(result == 0 ? "OK" : "ERROR"));
-	cJSON_AddItemToObject(json, "message", cJSON_CreateString(msg));
+	json_writer_begin_object(w, NULL);
+	json_writer_add_string(w, "command", r->cmd);
+	json_writer_add_string(w, "result", r->result == 0 ? "OK" : "ERROR");
+	json_writer_add_string(w, "message", r->msg);
+	json_writer_end_object(w);
+}
 
-	if (!(buf = cJSON_Print(json)))
-		goto panic;
-	cJSON_Delete(json);
-	return buf;
+static char* json_response_message(const char *cmd, int result, const char *msg)
+{
+	struct mqtt_response r = { cmd, result, msg };
 
-panic:
-	if (json)
-		cJSON_Delete(json);
-	return NULL;
+	return json_writer_print(json_response_gen, &r);
 }
 
 static void send_mqtt_command_response(const char *cmd, int result, const char *msg)
@@ -283,6 +284,8 @@ static void incoming_ha_cmd(const u8_t *data, u16_t len)
 	}
 
 
+	update_core1_state();
+
 	/* Triggersending status message immediately... */
 	publish_status_t = 0;
 }
@@ -394,6 +397,7 @@ static void mqtt_connection_cb(mqtt_client_t *client, void *arg, mqtt_connection
 	if (status == MQTT_CONNECT_ACCEPTED) {
 		log_msg(LOG_INFO, "MQTT connected to %s:%u", ipaddr_ntoa(&mqtt_server_ip),
 			mqtt_server_port);
+		mqtt_session++;
 		mqtt_set_inpub_callback(client, mqtt_incoming_publish_cb, mqtt_incoming_data_cb, arg);
 		if (strlen(cfg->mqtt_cmd_topic) > 0) {
 			log_msg(LOG_INFO, "MQTT subscribe to command topic: %s", cfg->mqtt_cmd_topic);
@@ -582,6 +586,15 @@ int brickpico_mqtt_client_connected()
 	return (mqtt_client_is_connected(mqtt_client) ? 1 : 0);
 }
 
+/* Return identifier of current MQTT connection (0 = not connected). */
+uint32_t brickpico_mqtt_session()
+{
+	if (mqtt_client_status != MQTT_CONNECT_ACCEPTED)
+		return 0;
+
+	return mqtt_session;
+}
+
 static void brickpico_mqtt_reconnect()
 {
 	log_msg(LOG_INFO, "MQTT attempt reconnecting to server");
@@ -598,106 +611,91 @@ static void brickpico_mqtt_reconnect()
 }
 
 
-static cJSON* brickpico_ha_component(const char *type, int idx, bool active)
+static void brickpico_ha_component(json_writer_t *w, const char *key,
+				const char *type, int idx, bool active)
 {
-	cJSON *o;
 	char tmp[100];
 
-	if (!(o = cJSON_CreateObject()))
-		return NULL;
+	json_writer_begin_object(w, key);
 
 	if (!strncmp(type, "temp", 5)) {
-		cJSON_AddItemToObject(o, "p", cJSON_CreateString("sensor"));
+		json_writer_add_string(w, "p", "sensor");
 		if (active) {
-			cJSON_AddItemToObject(o, "name", cJSON_CreateString("Temperature (Pico)"));
-			cJSON_AddItemToObject(o, "dev_cla", cJSON_CreateString("temperature"));
-			cJSON_AddItemToObject(o, "unit_of_meas", cJSON_CreateString("°C"));
-			cJSON_AddItemToObject(o, "val_tpl", cJSON_CreateString("{{ value_json.temp }}"));
+			json_writer_add_string(w, "name", "Temperature (Pico)");
+			json_writer_add_string(w, "dev_cla", "temperature");
+			json_writer_add_string(w, "unit_of_meas", "°C");
+			json_writer_add_string(w, "val_tpl", "{{ value_json.temp }}");
 			snprintf(tmp, sizeof(tmp), "%s_temp_int", pico_serial_str());
-			cJSON_AddItemToObject(o, "uniq_id", cJSON_CreateString(tmp));
+			json_writer_add_string(w, "uniq_id", tmp);
 		}
 	}
 	else if (!strncmp(type, "out", 4)) {
-		cJSON_AddItemToObject(o, "p", cJSON_CreateString("light"));
+		json_writer_add_string(w, "p", "light");
 		if (active) {
-			cJSON_AddItemToObject(o, "schema", cJSON_CreateString("template"));
+			json_writer_add_string(w, "schema", "template");
 			snprintf(tmp, sizeof(tmp), "%d. %s", idx, cfg->outputs[idx - 1].name);
-			cJSON_AddItemToObject(o, "name", cJSON_CreateString(tmp));
+			json_writer_add_string(w, "name", tmp);
 			snprintf(tmp, sizeof(tmp), "{{ value_json.state%02d|lower }}", idx);
-			cJSON_AddItemToObject(o, "stat_tpl", cJSON_CreateString(tmp));
+			json_writer_add_string(w, "stat_tpl", tmp);
 			snprintf(tmp, sizeof(tmp), "{{ value_json.bri%02d|d }}", idx);
-			cJSON_AddItemToObject(o, "bri_tpl", cJSON_CreateString(tmp));
-			cJSON_AddItemToObject(o, "bri_scl", cJSON_CreateNumber(100));
-			cJSON_AddItemToObject(o, "cmd_on_tpl", cJSON_CreateString("ON,{{ brightness|d }}"));
-			cJSON_AddItemToObject(o, "cmd_off_tpl", cJSON_CreateString("OFF"));
+			json_writer_add_string(w, "bri_tpl", tmp);
+			json_writer_add_number(w, "bri_scl", 100);
+			json_writer_add_string(w, "cmd_on_tpl", "ON,{{ brightness|d }}");
+			json_writer_add_string(w, "cmd_off_tpl", "OFF");
 			snprintf(tmp, sizeof(tmp), "%s%02d", mqtt_ha_cmd_base_topic, idx);
-			cJSON_AddItemToObject(o, "cmd_t", cJSON_CreateString(tmp));
+			json_writer_add_string(w, "cmd_t", tmp);
 			snprintf(tmp, sizeof(tmp), "%s_output_%02d", pico_serial_str(), idx);
-			cJSON_AddItemToObject(o, "uniq_id", cJSON_CreateString(tmp));
+			json_writer_add_string(w, "uniq_id", tmp);
 		}
 	}
 
-	return o;
+	json_writer_end_object(w);
 }
 
-static char* json_ha_discovery_message()
+static void json_ha_discovery_gen(json_writer_t *w, const void *arg)
 {
-	char *buf;
-	cJSON *json, *o, *c, *a;
 	char tmp[100];
 
-	if (!(json = cJSON_CreateObject()))
-		return NULL;
+	json_writer_begin_object(w, NULL);
 
 	/* Device Section */
-	if (!(o = cJSON_CreateObject()))
-		goto panic;
-	if (!(a = cJSON_CreateArray()))
-		goto panic;
-	cJSON_AddItemToArray(a, cJSON_CreateString(pico_serial_str()));
-	cJSON_AddItemToObject(o, "ids", a);
-	cJSON_AddItemToObject(o, "name", cJSON_CreateString(cfg->name));
-	cJSON_AddItemToObject(o, "mf", cJSON_CreateString("TJKO Industries"));
-	cJSON_AddItemToObject(o, "mdl", cJSON_CreateString("BrickPico"));
-	cJSON_AddItemToObject(o, "mdl_id", cJSON_CreateString(BRICKPICO_MODEL));
-	cJSON_AddItemToObject(o, "sn", cJSON_CreateString(pico_serial_str()));
-	cJSON_AddItemToObject(o, "sw", cJSON_CreateString(BRICKPICO_VERSION));
-	cJSON_AddItemToObject(json, "dev", o);
+	json_writer_begin_object(w, "dev");
+	json_writer_begin_array(w, "ids");
+	json_writer_add_string(w, NULL, pico_serial_str());
+	json_writer_end_array(w);
+	json_writer_add_string(w, "name", cfg->name);
+	json_writer_add_string(w, "mf", "TJKO Industries");
+	json_writer_add_string(w, "mdl", "BrickPico");
+	json_writer_add_string(w, "mdl_id", BRICKPICO_MODEL);
+	json_writer_add_string(w, "sn", pico_serial_str());
+	json_writer_add_string(w, "sw", BRICKPICO_VERSION);
+	json_writer_end_object(w);
 
 	/* Origin Section */
-	if (!(o = cJSON_CreateObject()))
-		goto panic;
-	cJSON_AddItemToObject(o, "name", cJSON_CreateString("BrickPico MQTT"));
-	cJSON_AddItemToObject(o, "sw", cJSON_CreateString(BRICKPICO_VERSION));
-	cJSON_AddItemToObject(o, "url", cJSON_CreateString("https://github.com/tjko/brickpico/wiki"));
-	cJSON_AddItemToObject(json, "o", o);
+	json_writer_begin_object(w, "o");
+	json_writer_add_string(w, "name", "BrickPico MQTT");
+	json_writer_add_string(w, "sw", BRICKPICO_VERSION);
+	json_writer_add_string(w, "url", "https://github.com/tjko/brickpico/wiki");
+	json_writer_end_object(w);
 
 	/* Components Section */
-	if (!(o = cJSON_CreateObject()))
-		goto panic;
-	if (!(c = brickpico_ha_component("temp", 0, true)))
-		goto panic;
-	cJSON_AddItemToObject(o, "temp_int0", c);
+	json_writer_begin_object(w, "cmps");
+	brickpico_ha_component(w, "temp_int0", "temp", 0, true);
 	for (int i = 1; i <= OUTPUT_COUNT; i++) {
-		if (!(c = brickpico_ha_component("out", i, cfg->mqtt_pwm_mask & (1 << (i -1)))))
-			goto panic;
 		snprintf(tmp, sizeof(tmp), "output_%d", i);
-		cJSON_AddItemToObject(o, tmp, c);
+		brickpico_ha_component(w, tmp, "out", i, cfg->mqtt_pwm_mask & (1 << (i -1)));
 	}
-	cJSON_AddItemToObject(json, "cmps", o);
+	json_writer_end_object(w);
 
 	snprintf(tmp, sizeof(tmp), "%s/state", mqtt_ha_base_topic);
-	cJSON_AddItemToObject(json, "state_topic", cJSON_CreateString(tmp));
-
+	json_writer_add_string(w, "state_topic", tmp);
 
-	if (!(buf = cJSON_Print(json)))
-		goto panic;
-	cJSON_Delete(json);
-	return buf;
+	json_writer_end_object(w);
+}
 
-panic:
-	cJSON_Delete(json);
-	return NULL;
+static char* json_ha_discovery_message()
+{
+	return json_writer_print(json_ha_discovery_gen, NULL);
 }
 
 
@@ -721,76 +719,71 @@ static void brickpico_mqtt_ha_discovery()
 	publish_status_t = 0;
 }
 
-static char* json_ha_state_message()
+static void json_ha_state_gen(json_writer_t *w, const void *arg)
 {
 	const struct brickpico_state *st = brickpico_state;
-	cJSON *json;
 	uint32_t bri;
-	char *buf, name[32];
-
-	if (!(json = cJSON_CreateObject()))
-		return NULL;
+	char name[32];
 
+	json_writer_begin_object(w, NULL);
 
 	for (int i = 0; i < OUTPUT_COUNT; i++) {
 		if (cfg->mqtt_pwm_mask & (1 << i)) {
 			snprintf(name, sizeof(name), "state%02d", i + 1);
-			cJSON_AddItemToObject(json, name, cJSON_CreateString(st->pwr[i] ? "ON" : "OFF"));
+			json_writer_add_string(w, name, st->pwr[i] ? "ON" : "OFF");
 			snprintf(name, sizeof(name), "bri%02d", i + 1);
 			bri = st->pwm[i] * 255 / 100; /* scale brightness from 0..100 to 0..255 range */
-			cJSON_AddItemToObject(json, name, cJSON_CreateNumber(bri));
+			json_writer_add_number(w, name, bri);
 		}
 	}
 
-	cJSON_AddItemToObject(json, "temp", cJSON_CreateNumber(round_decimal(st->temp,1)));
+	json_writer_add_number(w, "temp", round_decimal(st->temp,1));
 
-	if (!(buf = cJSON_Print(json)))
-		goto panic;
-	cJSON_Delete(json);
-	return buf;
+	json_writer_end_object(w);
+}
 
-panic:
-	cJSON_Delete(json);
-	return NULL;
+static char* json_ha_state_message()
+{
+	return json_writer_print(json_ha_state_gen, NULL);
 }
 
 
-char* json_status_message()
+static void json_status_gen(json_writer_t *w, const void *arg)
 {
 	const struct brickpico_state *st = brickpico_state;
-	char *buf;
-	cJSON *json, *outputs, *o;
+	const struct pwm_power_stats *power = arg;
 	int i;
 
-	if (!(json = cJSON_CreateObject()))
-		goto panic;
+	json_writer_begin_object(w, NULL);
 
-	cJSON_AddItemToObject(json, "name", cJSON_CreateString(cfg->name));
-	cJSON_AddItemToObject(json, "hostname", cJSON_CreateString(network_hostname()));
+	json_writer_add_string(w, "name", cfg->name);
+	json_writer_add_string(w, "hostname", network_hostname());
 	if (network_ip())
-		cJSON_AddItemToObject(json, "ip", cJSON_CreateString(network_ip()));
-	if (!(outputs = cJSON_CreateArray()))
-		goto panic;
-	cJSON_AddItemToObject(json, "outputs", outputs);
+		json_writer_add_string(w, "ip", network_ip());
+	json_writer_add_number(w, "current", power->current);
+	json_writer_add_number(w, "current_peak", power->peak);
+	json_writer_begin_array(w, "outputs");
 	for (i = 0; i < OUTPUT_COUNT; i++) {
-		if (!(o = cJSON_CreateObject()))
-			goto panic;
-		cJSON_AddItemToObject(o, "id", cJSON_CreateNumber(i + 1));
-		// cJSON_AddItemToObject(o, "name", cJSON_CreateString(cfg->outputs[i].name));
-		cJSON_AddItemToObject(o, "pwm", cJSON_CreateNumber(round_decimal(st->pwm[i], 1)));
-		cJSON_AddItemToObject(o, "state", cJSON_CreateString(st->pwr[i] ? "ON" : "OFF"));
-		cJSON_AddItemToArray(outputs, o);
+		json_writer_begin_object(w, NULL);
+		json_writer_add_number(w, "id", i + 1);
+		// json_writer_add_string(w, "name", cfg->outputs[i].name);
+		json_writer_add_number(w, "pwm", round_decimal(st->pwm[i], 1));
+		json_writer_add_string(w, "state", st->pwr[i] ? "ON" : "OFF");
+		json_writer_end_object(w);
 	}
+	json_writer_end_array(w);
+
+	json_writer_end_object(w);
+}
+
+char* json_status_message()
+{
+	struct pwm_power_stats power;
 
-	if (!(buf = cJSON_Print(json)))
-		goto panic;
-	cJSON_Delete(json);
-	return buf;
+	/* Take snapshot, as output is generated twice (size, content) */
+	get_pwm_power_stats(&power);
 
-panic:
-	if (json)
-		cJSON_Delete(json);
-	return NULL;
+	return json_writer_print(json_status_gen, &power);
 }
 
 void brickpico_mqtt_publish()
@@ -868,7 +861,7 @@ void brickpico_mqtt_scpi_command()
 		return;
 
 	strncopy(cmd, mqtt_scpi_cmd, sizeof(cmd));
-	process_command(st, (struct brickpico_config *)cfg, cmd);
+	process_command(st, (struct brickpico_config *)cfg, cmd, CMD_SOURCE_MQTT);
 	if ((res = last_command_status()) == 0) {
 		log_msg(LOG_INFO, "MQTT SCPI command successfull: '%s'", mqtt_scpi_cmd);
 		send_mqtt_command_response(mqtt_scpi_cmd, res, "SCPI command successfull");
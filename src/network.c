@@ -30,6 +30,7 @@
 #include "pico/cyw43_arch.h"
 #include "lwip/pbuf.h"
 #include "lwip/tcp.h"
+#include "lwip/priv/tcp_priv.h"
 #include "lwip/prot/dhcp.h"
 #include "lwip/apps/sntp.h"
 #include "lwip/apps/httpd.h"
@@ -112,6 +113,30 @@ const char* wifi_auth_type_name(uint32_t type)
 }
 
 
+/* Return identifier of the TCP client connected to given local port
+   (0 = no client connected). Identifier is derived from client address
+   and port, so it changes when client reconnects. */
+uint32_t tcp_client_id(uint16_t port)
+{
+	struct tcp_pcb *pcb;
+	uint32_t id = 0;
+
+	cyw43_arch_lwip_begin();
+	for (pcb = tcp_active_pcbs; pcb; pcb = pcb->next) {
+		if (pcb->local_port == port && pcb->state == ESTABLISHED) {
+			id = (ip4_addr_get_u32(ip_2_ip4(&pcb->remote_ip)) * 2654435761UL)
+				^ pcb->remote_port;
+			if (!id)
+				id = 1;
+			break;
+		}
+	}
+	cyw43_arch_lwip_end();
+
+	return id;
+}
+
+
 void wifi_mac()
 {
 	printf("%s\n", mac_address_str(cyw43_mac));
@@ -444,6 +469,7 @@ void pico_dhcp_option_parse_hook(struct netif *netif, struct dhcp *dhcp, u8_t st
 			log_msg(LOG_INFO, "Set (POSIX) Timezone from DHCP: %s", dhcp_timezone);
 			setenv("TZ", dhcp_timezone, 1);
 			tzset();
+			reschedule_timer_events();
 		} else {
 			log_msg(LOG_INFO, "Ignore (POSIX) Timezone from DHCP: %s", dhcp_timezone);
 		}
@@ -456,21 +482,34 @@ void pico_dhcp_option_parse_hook(struct netif *netif, struct dhcp *dhcp, u8_t st
 /****************************************************************************/
 
 
+/* Clock adjustment (seconds) that causes output states to be
+   reconstructed from past timer events. */
+#define SNTP_CATCHUP_THRESHOLD 5
+
 void pico_set_system_time(long int sec)
 {
 	struct timespec ts;
 	struct tm *ntp;
 	time_t ntp_time = sec;
+	time_t delta = 0;
+	bool running;
 
 
 	if (!(ntp = localtime(&ntp_time)))
 		return;
 
-	time_t_to_timespec(ntp_time, &ts);
-	if (aon_timer_is_running()) {
-		aon_timer_set_time(&ts);
+	if ((running = aon_timer_is_running())) {
+		aon_timer_get_time(&ts);
+		delta = ntp_time - ts.tv_sec;
+	}
+	set_timer_clock(time_t_to_timespec(ntp_time, &ts));
+	if (!running || delta > SNTP_CATCHUP_THRESHOLD || delta < -SNTP_CATCHUP_THRESHOLD) {
+		/* Clock was not set (or was wrong), events may have been missed */
+		if (running)
+			log_msg(LOG_INFO, "SNTP clock adjustment: %lld seconds", (long long)delta);
+		catchup_timer_events();
 	} else {
-		aon_timer_start(&ts);
+		reschedule_timer_events();
 	}
 
 	log_msg(LOG_NOTICE, "SNTP Set System time: %s", asctime(ntp));
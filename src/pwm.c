@@ -20,14 +20,19 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include "pico/stdlib.h"
 #include "hardware/gpio.h"
 #include "hardware/pwm.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
 #include "hardware/clocks.h"
 
 #include "lightness.h"
+#include "dither.h"
+#include "pwm_phase.h"
 #include "brickpico.h"
 
 
@@ -57,8 +62,143 @@ uint8_t output_gpio_pwm_map[OUTPUT_MAX_COUNT] = {
 #define PWM_TOP_MAX (1<<16)
 #define LIGHTNESS_MAX 100
 
+/* High resolution lightness map: EFFECT_LEVEL_MAX range split into
+   LIGHTNESS_HR_STEPS segments, values between are linearly interpolated. */
+#define LIGHTNESS_HR_BITS 10
+#define LIGHTNESS_HR_STEPS (1 << LIGHTNESS_HR_BITS)
+#define LIGHTNESS_HR_SHIFT (16 - LIGHTNESS_HR_BITS)
+#define LIGHTNESS_HR_MASK ((1 << LIGHTNESS_HR_SHIFT) - 1)
+
+#define PWM_SLICE_MAX_COUNT (OUTPUT_MAX_COUNT / 2)
+
+/* Maximum number of different lightness curves in use at the same time.
+   Outputs using same curve share the same map. */
+#define LIGHTNESS_CURVE_MAX 4
+#define LIGHTNESS_POINTS_MAX 64
+
+struct lightness_curve {
+	char spec[MAX_GAMMA_LEN];
+	uint16_t *map;
+};
+
+/* PWM output parameters (calculated from the configuration) */
+struct pwm_params {
+	uint16_t top;
+	uint8_t clk_div;
+	uint8_t map_bits;  /* fractional bits in lightness maps */
+	const uint16_t *map[OUTPUT_MAX_COUNT];
+};
+
+/* Settings the current parameters were calculated from */
+struct pwm_settings {
+	uint pwm_freq;
+	char gamma[MAX_GAMMA_LEN];
+	char out_gamma[OUTPUT_MAX_COUNT][MAX_GAMMA_LEN];
+};
+
 static uint16_t pwm_out_top = 0;
-static uint16_t pwm_lightness_map[LIGHTNESS_MAX + 1];
+static uint8_t pwm_clk_div = 1;
+static uint8_t pwm_map_bits = 0;  /* fractional bits in lightness maps */
+static uint16_t pwm_lightness_hr_map[LIGHTNESS_HR_STEPS + 1];
+static const uint16_t *pwm_output_map[OUTPUT_MAX_COUNT];
+static uint16_t pwm_out_level[OUTPUT_MAX_COUNT];  /* current lightness levels */
+
+/* Runtime reconfiguration: core0 calculates new parameters (and lightness
+   maps into the curve set not in use) and core1 takes them into use
+   at next frame update. */
+static struct lightness_curve pwm_curves[2][LIGHTNESS_CURVE_MAX];
+static uint pwm_curve_set = 0;
+static struct pwm_settings pwm_settings;
+static struct pwm_params pwm_next;
+static volatile bool pwm_next_pending = false;
+static uint8_t pwm_next_stage = 0;
+static bool pwm_next_longer = false;
+static absolute_time_t pwm_next_t;
+
+
+/* PWM "frame buffer": compare (CC) register values for each PWM slice
+   used by outputs (in slice order). Frames are copied into the CC registers
+   using a chain of DMA transfers, so that all outputs get updated at once. */
+
+struct pwm_dma_block {
+	const volatile void *read_addr;
+	volatile void *write_addr;
+};
+
+static uint pwm_slice_count = 0;
+static uint8_t pwm_slice_num[PWM_SLICE_MAX_COUNT];
+static uint8_t pwm_frame_index[OUTPUT_MAX_COUNT];  /* output -> frame slot */
+static uint8_t pwm_frame_shift[OUTPUT_MAX_COUNT];  /* output -> CC channel A/B */
+static uint32_t pwm_frame[PWM_SLICE_MAX_COUNT];
+static uint32_t pwm_dma_frame[PWM_SLICE_MAX_COUNT];
+static bool pwm_frame_dirty = false;
+static struct pwm_dma_block pwm_dma_blocks[PWM_SLICE_MAX_COUNT + 1];
+static const struct pwm_dma_block *pwm_dma_blocks_ptr = pwm_dma_blocks;
+static int pwm_dma_start = -1;
+static int pwm_dma_ctrl = -1;
+static int pwm_dma_data = -1;
+
+/* Frames pushed to the hardware, and time when latest of them took effect
+   (CC values got latched at PWM wrap). Frames written by the DMA chain
+   are timestamped from the end of chain interrupt. */
+static uint32_t pwm_out_period_us = 0;
+static volatile uint32_t pwm_frame_seq = 0;
+static volatile uint32_t pwm_frame_done_seq = 0;
+static volatile uint64_t pwm_frame_done_t = 0;
+static bool pwm_frame_irq = false;
+
+/* Dithering frame buffers: with dithering enabled, DMA chain runs on every
+   PWM counter wrap copying next frame into CC registers and then re-arms
+   itself (by re-triggering the start channel), without CPU involvement. */
+static bool pwm_dither = false;
+static bool pwm_dither_running = false;
+static uint16_t pwm_dither_mask = 0;   /* outputs with dithering enabled */
+static uint16_t pwm_dither_dirty = 0;  /* outputs with level changed */
+static uint32_t pwm_frame_fx[OUTPUT_MAX_COUNT];  /* level (PWM_DITHER_BITS fraction) */
+static uint32_t pwm_dither_frame[PWM_DITHER_FRAMES][PWM_SLICE_MAX_COUNT];
+static struct pwm_dma_block pwm_dither_blocks[PWM_DITHER_FRAMES][PWM_SLICE_MAX_COUNT + 2];
+static const struct pwm_dma_block *pwm_dither_ring[PWM_DITHER_FRAMES]
+	__attribute__((aligned(PWM_DITHER_FRAMES * sizeof(void*))));
+static const uint32_t pwm_dither_rearm = 1;
+
+/* Slices phase shifted by more than half of PWM period, use inverted
+   output polarity (and inverted compare values). */
+static uint32_t pwm_out_invert[OUTPUT_MAX_COUNT];  /* 0 or TOP + 1 */
+
+/* Power budget limiter: output currents are estimated from PWM levels
+   and (configured) full-scale currents. If total exceeds the budget,
+   outputs are scaled down, higher priority outputs are served first and
+   outputs with same priority are scaled proportionally. Requested levels
+   are kept as is, scaling is only applied when frames are written out. */
+#define PWM_SCALE_ONE (1UL << 16)
+
+static uint32_t pwm_power_budget = 0;  /* mA (0 = no limit) */
+static uint16_t pwm_out_current[OUTPUT_MAX_COUNT];  /* full-scale current (mA) */
+static uint8_t pwm_out_priority[OUTPUT_MAX_COUNT];
+static uint32_t pwm_out_scale[OUTPUT_MAX_COUNT];  /* Q16 (PWM_SCALE_ONE = no limiting) */
+static uint16_t pwm_out_pwm[OUTPUT_MAX_COUNT];  /* requested PWM level (no dithering) */
+static volatile uint16_t pwm_power_limited = 0;  /* outputs being scaled */
+static volatile uint32_t pwm_power_demand = 0;
+static volatile uint32_t pwm_power_current = 0;
+static volatile uint32_t pwm_power_peak = 0;
+static volatile bool pwm_power_peak_reset = false;
+
+
+/* Map PWM level to compare (CC) register value of an output. */
+static inline uint32_t pwm_cc_level(uint out, uint32_t level)
+{
+	return pwm_phase_cc_level(pwm_out_invert[out], level);
+}
+
+
+/* Record frame pushed to the hardware, that takes effect at given time. */
+static void pwm_frame_pushed(uint64_t t_latch)
+{
+	pwm_frame_seq++;
+	pwm_frame_done_t = t_latch;
+	__dmb();
+	pwm_frame_done_seq = pwm_frame_seq;
+}
 
 
 /**
@@ -80,7 +220,7 @@ void set_pwm_duty_cycle(uint out, float duty)
 	} else {
 		level = 0;
 	}
-	pwm_set_gpio_level(pin, level);
+	pwm_set_gpio_level(pin, pwm_cc_level(out, level));
 }
 
 
@@ -92,66 +232,893 @@ void set_pwm_duty_cycle(uint out, float duty)
  */
 void set_pwm_lightness(uint out, uint lightness)
 {
-	uint pin;
-	uint16_t level;
+	assert(out < OUTPUT_COUNT);
+	set_pwm_lightness_hr(out, PWM_TO_EFFECT_LEVEL(lightness > LIGHTNESS_MAX ?
+							LIGHTNESS_MAX : lightness));
+}
+
+
+/**
+ * Map (high resolution) lightness level to PWM level using
+ * lightness curve of an output.
+ *
+ * @param out Output port.
+ * @param level Lightness level (0..EFFECT_LEVEL_MAX).
+ *
+ * @return PWM level (0..TOP).
+ */
+static inline uint16_t pwm_lightness_hr_level(uint out, uint16_t level)
+{
+	const uint16_t *map = pwm_output_map[out];
+	uint i = level >> LIGHTNESS_HR_SHIFT;
+	uint frac = level & LIGHTNESS_HR_MASK;
+	int a, b;
+
+	if (level >= EFFECT_LEVEL_MAX)
+		return map[LIGHTNESS_HR_STEPS] >> pwm_map_bits;
+
+	a = map[i];
+	b = map[i + 1];
+
+	/* Curve may be decreasing (user supplied point table) */
+	return (a + (((b - a) * (int)frac) >> LIGHTNESS_HR_SHIFT)) >> pwm_map_bits;
+}
+
+
+/**
+ * Map (high resolution) lightness level to fractional PWM level.
+ *
+ * @param out Output port.
+ * @param level Lightness level (0..EFFECT_LEVEL_MAX).
+ *
+ * @return PWM level (0..TOP) with PWM_DITHER_BITS fractional bits.
+ */
+static inline uint32_t pwm_lightness_hr_level_fx(uint out, uint16_t level)
+{
+	const uint16_t *map = pwm_output_map[out];
+	uint i = level >> LIGHTNESS_HR_SHIFT;
+	uint frac = level & LIGHTNESS_HR_MASK;
+	int a, b;
+
+	if (level >= EFFECT_LEVEL_MAX)
+		return pwm_dither_map_level(map[LIGHTNESS_HR_STEPS], pwm_map_bits);
+
+	a = map[i];
+	b = map[i + 1];
+
+	/* Round (instead of truncate), to avoid bias in the average level */
+	return ((a << PWM_DITHER_BITS) + (((b - a) * (int)frac
+				+ (1 << (LIGHTNESS_HR_SHIFT - PWM_DITHER_BITS - 1)))
+			>> (LIGHTNESS_HR_SHIFT - PWM_DITHER_BITS))
+		+ ((1 << pwm_map_bits) >> 1)) >> pwm_map_bits;
+}
+
 
+/**
+ * Set PWM output signal to approximate desired lightness level
+ * (using full PWM resolution).
+ *
+ * @param out Output port.
+ * @param level Lightness level (0..EFFECT_LEVEL_MAX).
+ */
+void set_pwm_lightness_hr(uint out, uint16_t level)
+{
 	assert(out < OUTPUT_COUNT);
-	pin = output_gpio_pwm_map[out];
-	level = pwm_lightness_map[lightness > LIGHTNESS_MAX ? LIGHTNESS_MAX : lightness];
+	pwm_set_gpio_level(output_gpio_pwm_map[out],
+			pwm_cc_level(out, pwm_lightness_hr_level(out, level)));
+}
+
+
+/**
+ * Set lightness level for an output in the PWM frame buffer.
+ * Change does not take effect until update_pwm_frame() is called.
+ *
+ * @param out Output port.
+ * @param level Lightness level (0..EFFECT_LEVEL_MAX).
+ */
+void set_pwm_frame_lightness(uint out, uint16_t level)
+{
+	uint32_t *slot;
+	uint shift;
 
-	pwm_set_gpio_level(pin, level);
+	assert(out < OUTPUT_COUNT);
+	pwm_out_level[out] = level;
+	if (pwm_dither) {
+		pwm_frame_fx[out] = pwm_lightness_hr_level_fx(out, level);
+		pwm_dither_dirty |= (1 << out);
+		pwm_frame_dirty = true;
+		return;
+	}
+	pwm_out_pwm[out] = pwm_lightness_hr_level(out, level);
+	slot = &pwm_frame[pwm_frame_index[out]];
+	shift = pwm_frame_shift[out];
+	*slot = (*slot & ~(0xffffUL << shift)) | (pwm_cc_level(out, pwm_out_pwm[out]) << shift);
+	pwm_frame_dirty = true;
+}
+
+
+/* Apply power limiting scale factor of an output to a PWM level. */
+static inline uint32_t pwm_power_scale(uint out, uint32_t level)
+{
+	uint32_t scale = pwm_out_scale[out];
+
+	if (scale >= PWM_SCALE_ONE)
+		return level;
+	return ((uint64_t)level * scale) >> 16;
 }
 
 
 /**
- * Precalculate PWM level values for each lightness value.
+ * Estimate output currents from the (requested) PWM levels, and
+ * calculate scale factors for outputs if power budget is exceeded.
  *
- * @param pwm_wrap PWM Counter wrap value.
+ * In dithering mode, outputs with changed scale factor are marked dirty.
  */
-static void calculate_pwm_lightness(uint16_t pwm_wrap, double gamma)
+static void update_pwm_power()
 {
+	uint32_t demand[POWER_PRIORITY_MAX + 1];
+	uint32_t scale[POWER_PRIORITY_MAX + 1];
+	uint32_t current[OUTPUT_MAX_COUNT];
+	uint32_t top = pwm_out_top + 1;
+	uint32_t total = 0;
+	uint32_t used = 0;
+	uint32_t remaining = pwm_power_budget;
+	uint16_t limited = 0;
 	int i;
-	double l;
 
-	for (i = 0; i <= LIGHTNESS_MAX; i++) {
-		if (gamma >= 1.0)
-			l = gamma_lightness_inverse(gamma, i, LIGHTNESS_MAX);
-		else
-			l = cie_1931_lightness_inverse(i, LIGHTNESS_MAX);
-		pwm_lightness_map[i] = (pwm_wrap * l) / LIGHTNESS_MAX;
-#if 0
-		double l_r;
-		if (gamma >= 1.0)
-			l_r = gamma_lightness(gamma, l, LIGHTNESS_MAX);
+	memset(demand, 0, sizeof(demand));
+	for (i = 0; i < OUTPUT_COUNT; i++) {
+		uint32_t level = (pwm_dither ? pwm_frame_fx[i] >> PWM_DITHER_BITS : pwm_out_pwm[i]);
+
+		if (level > top)
+			level = top;
+		/* Round up, so that limited outputs never exceed the budget */
+		current[i] = ((uint32_t)pwm_out_current[i] * level + top - 1) / top;
+		demand[pwm_out_priority[i]] += current[i];
+		total += current[i];
+	}
+
+	for (i = POWER_PRIORITY_MAX; i >= 0; i--) {
+		if (!pwm_power_budget || demand[i] <= remaining) {
+			scale[i] = PWM_SCALE_ONE;
+			remaining -= (pwm_power_budget ? demand[i] : 0);
+		} else {
+			scale[i] = (remaining << 16) / demand[i];
+			remaining = 0;
+		}
+	}
+
+	for (i = 0; i < OUTPUT_COUNT; i++) {
+		uint32_t s = (pwm_out_current[i] ? scale[pwm_out_priority[i]] : PWM_SCALE_ONE);
+
+		if (s != pwm_out_scale[i]) {
+			pwm_out_scale[i] = s;
+			pwm_dither_dirty |= (1 << i);
+		}
+		if (s < PWM_SCALE_ONE) {
+			limited |= (1 << i);
+			used += (current[i] * s) >> 16;
+		} else {
+			used += current[i];
+		}
+	}
+
+	pwm_power_limited = limited;
+	pwm_power_demand = total;
+	pwm_power_current = used;
+	if (used > pwm_power_peak)
+		pwm_power_peak = used;
+}
+
+
+/* Build frame to be written into CC registers (with power limiting applied). */
+static void build_pwm_frame(uint32_t *frame)
+{
+	memcpy(frame, pwm_frame, sizeof(uint32_t) * pwm_slice_count);
+	if (!pwm_power_limited)
+		return;
+
+	for (int i = 0; i < OUTPUT_COUNT; i++) {
+		uint32_t *slot = &frame[pwm_frame_index[i]];
+		uint shift = pwm_frame_shift[i];
+
+		if (!(pwm_power_limited & (1 << i)))
+			continue;
+		*slot = (*slot & ~(0xffffUL << shift))
+			| (pwm_cc_level(i, pwm_power_scale(i, pwm_out_pwm[i])) << shift);
+	}
+}
+
+
+/**
+ * Update output levels in the dithering frames
+ * (see pwm_dither_levels()).
+ */
+static void update_pwm_dither_frames(uint16_t outputs)
+{
+	uint32_t levels[PWM_DITHER_FRAMES];
+
+	for (int i = 0; i < OUTPUT_COUNT; i++) {
+		uint32_t mask, fx;
+		uint slot, shift;
+
+		if (!(outputs & (1 << i)))
+			continue;
+
+		fx = pwm_power_scale(i, pwm_frame_fx[i]);
+		if (!(pwm_dither_mask & (1 << i)))
+			fx = (fx + (1 << (PWM_DITHER_BITS - 1))) & ~PWM_DITHER_MASK;
+		pwm_dither_levels(fx, levels);
+		slot = pwm_frame_index[i];
+		shift = pwm_frame_shift[i];
+		mask = ~(0xffffUL << shift);
+
+		for (int k = 0; k < PWM_DITHER_FRAMES; k++) {
+			uint32_t v = pwm_cc_level(i, levels[k]);
+			uint32_t *p = &pwm_dither_frame[k][slot];
+
+			/* Single (word) write, as DMA may be reading the frame */
+			*p = (*p & mask) | (v << shift);
+		}
+	}
+}
+
+
+/**
+ * Push updated levels into the dithering frames.
+ * DMA is continuously cycling through the frames (once started).
+ */
+static void push_pwm_dither_frames()
+{
+	update_pwm_dither_frames(pwm_dither_dirty);
+	pwm_dither_dirty = 0;
+	pwm_frame_dirty = false;
+	if (!pwm_dither_running) {
+		pwm_dither_running = true;
+		dma_channel_start(pwm_dma_start);
+	}
+
+	/* DMA copies next frame into CC registers at next wrap,
+	   and values get latched on the following wrap */
+	pwm_frame_pushed(time_us_64() + 2 * pwm_out_period_us);
+}
+
+
+/* Length of PWM period in microseconds. */
+static uint32_t pwm_period_us(uint16_t top, uint8_t clk_div)
+{
+	return (uint64_t)2 * (top + 1) * clk_div * 1000000 / clock_get_hz(clk_sys) + 1;
+}
+
+
+/* Write TOP and clock divider of a slice (these are latched at next wrap). */
+static void set_pwm_slice_top(uint slot, uint16_t top, uint8_t clk_div)
+{
+	uint slice_num = pwm_slice_num[slot];
+
+	pwm_set_clkdiv_int_frac(slice_num, clk_div, 0);
+	pwm_set_wrap(slice_num, top);
+}
+
+
+/* Check if TOP should be written before CC values when switching
+   to new TOP value. Order is selected so that if slice happens to wrap
+   between the writes, output duty cycle (for that period) is lower than
+   either before or after the change (so change never causes a flash). */
+static inline bool pwm_top_first(uint slot, bool longer)
+{
+	bool inverted = (pwm_out_invert[slot * 2] != 0);
+
+	return (longer != inverted);
+}
+
+
+/**
+ * Take into use PWM parameters staged by core0 (with update_pwm_config()).
+ *
+ * Current output levels are recalculated using the new parameters.
+ * New TOP and CC values get latched by each slice at its next counter wrap.
+ *
+ * @return false if change could not be started yet (DMA busy),
+ *         and should be retried later.
+ */
+static bool apply_pwm_params()
+{
+	const struct pwm_params *p = &pwm_next;
+	uint32_t wait;
+	int i;
+
+	__dmb();
+	if (pwm_next_stage == 1) {
+		/* Waiting for DMA to write new frames, before updating
+		   TOP on rest of the slices */
+		if (!time_reached(pwm_next_t))
+			return true;
+		for (i = 0; i < pwm_slice_count; i++) {
+			if (!pwm_top_first(i, pwm_next_longer))
+				set_pwm_slice_top(i, p->top, p->clk_div);
+		}
+		goto done;
+	}
+
+	if (!pwm_dither && pwm_dma_start >= 0
+		&& (dma_channel_is_busy(pwm_dma_start) || dma_channel_is_busy(pwm_dma_ctrl)
+			|| dma_channel_is_busy(pwm_dma_data)
+			|| (pwm_frame_irq && pwm_frame_done_seq != pwm_frame_seq)))
+		return false;
+
+	pwm_next_longer = (p->top > pwm_out_top);
+	for (i = 0; i < pwm_slice_count; i++) {
+		if (pwm_top_first(i, pwm_next_longer))
+			set_pwm_slice_top(i, p->top, p->clk_div);
+	}
+
+	wait = pwm_period_us(pwm_out_top, pwm_clk_div);
+	if (wait < pwm_period_us(p->top, p->clk_div))
+		wait = pwm_period_us(p->top, p->clk_div);
+	pwm_out_top = p->top;
+	pwm_clk_div = p->clk_div;
+	pwm_out_period_us = pwm_period_us(p->top, p->clk_div);
+	pwm_map_bits = p->map_bits;
+	memcpy(pwm_output_map, p->map, sizeof(pwm_output_map));
+	for (i = 0; i < OUTPUT_COUNT; i++) {
+		if (pwm_out_invert[i])
+			pwm_out_invert[i] = p->top + 1;
+		set_pwm_frame_lightness(i, pwm_out_level[i]);
+	}
+	update_pwm_power();
+
+	if (pwm_dither) {
+		/* New CC values are written by DMA (at next wrap of first slice),
+		   so wait until that has happened for sure */
+		push_pwm_dither_frames();
+		pwm_next_t = delayed_by_us(get_absolute_time(), 2 * wait);
+		pwm_next_stage = 1;
+		return true;
+	}
+
+	build_pwm_frame(pwm_dma_frame);
+	for (i = 0; i < pwm_slice_count; i++) {
+		*(volatile uint32_t*)pwm_dma_blocks[i].write_addr = pwm_dma_frame[i];
+	}
+	pwm_frame_dirty = false;
+	pwm_frame_pushed(time_us_64() + wait);
+	for (i = 0; i < pwm_slice_count; i++) {
+		if (!pwm_top_first(i, pwm_next_longer))
+			set_pwm_slice_top(i, p->top, p->clk_div);
+	}
+
+done:
+	pwm_next_stage = 0;
+	__dmb();
+	pwm_next_pending = false;
+	log_msg(LOG_INFO, "PWM: new output parameters in use (TOP=%u, CLK_DIV=%u)",
+		pwm_out_top, pwm_clk_div);
+
+	return true;
+}
+
+
+/**
+ * Write PWM frame buffer into PWM hardware (using DMA).
+ * Transfer is started at the next PWM counter wrap, and since CC registers
+ * are double buffered, new values will take effect on the following wrap.
+ *
+ * @return true if frame was updated, false if DMA was still busy with
+ *         previous frame (in which case update should be retried later).
+ */
+bool update_pwm_frame()
+{
+	if (pwm_next_pending && !apply_pwm_params())
+		return false;
+
+	if (pwm_power_peak_reset) {
+		pwm_power_peak = pwm_power_current;
+		pwm_power_peak_reset = false;
+	}
+
+	if (!pwm_frame_dirty)
+		return true;
+
+	if (pwm_dither) {
+		update_pwm_power();
+		push_pwm_dither_frames();
+		return true;
+	}
+
+	if (pwm_dma_start < 0) {
+		/* No DMA available, fallback to updating registers directly */
+		update_pwm_power();
+		build_pwm_frame(pwm_dma_frame);
+		for (int i = 0; i < pwm_slice_count; i++) {
+			*(volatile uint32_t*)pwm_dma_blocks[i].write_addr = pwm_dma_frame[i];
+		}
+		pwm_frame_dirty = false;
+		pwm_frame_pushed(time_us_64() + pwm_out_period_us);
+		return true;
+	}
+
+	/* Previous frame still in progress (or its end of chain interrupt
+	   not yet handled) */
+	if (dma_channel_is_busy(pwm_dma_start) || dma_channel_is_busy(pwm_dma_ctrl)
+		|| dma_channel_is_busy(pwm_dma_data)
+		|| (pwm_frame_irq && pwm_frame_done_seq != pwm_frame_seq))
+		return false;
+
+	update_pwm_power();
+	build_pwm_frame(pwm_dma_frame);
+	pwm_frame_dirty = false;
+	if (pwm_frame_irq)
+		pwm_frame_seq++;
+	else /* chain starts within one period, values get latched on the following wrap */
+		pwm_frame_pushed(time_us_64() + 2 * pwm_out_period_us);
+	dma_channel_start(pwm_dma_start);
+
+	return true;
+}
+
+
+/* End of DMA chain (NULL trigger on data channel) interrupt handler.
+   Chain runs right after PWM wrap of the first slice, so new CC values get
+   latched (by all slices) within one PWM period. */
+static void pwm_frame_irq_handler()
+{
+	if (!dma_channel_get_irq1_status(pwm_dma_data))
+		return;
+	dma_channel_acknowledge_irq1(pwm_dma_data);
+	pwm_frame_done_t = time_us_64() + pwm_out_period_us;
+	__dmb();
+	pwm_frame_done_seq = pwm_frame_seq;
+}
+
+
+/**
+ * Enable (end of DMA chain) interrupt on the calling core, to timestamp
+ * when frames pushed by update_pwm_frame() take effect.
+ */
+void setup_pwm_frame_irq()
+{
+	if (pwm_dma_data < 0 || pwm_dither)
+		return;
+
+	irq_add_shared_handler(DMA_IRQ_1, pwm_frame_irq_handler,
+			PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+	dma_channel_acknowledge_irq1(pwm_dma_data);
+	dma_channel_set_irq1_enabled(pwm_dma_data, true);
+	irq_set_enabled(DMA_IRQ_1, true);
+	pwm_frame_irq = true;
+}
+
+
+/**
+ * Get number of frames pushed to the hardware (by update_pwm_frame()).
+ */
+uint32_t get_pwm_frame_seq()
+{
+	return pwm_frame_seq;
+}
+
+
+/**
+ * Check if a frame pushed to the hardware has taken effect.
+ *
+ * @param seq Frame (sequence number) returned by get_pwm_frame_seq().
+ * @param t Time when the frame took effect (us since boot).
+ *
+ * @return true if frame has taken effect, false if not yet known.
+ */
+bool get_pwm_frame_applied(uint32_t seq, uint64_t *t)
+{
+	if ((int32_t)(pwm_frame_done_seq - seq) < 0)
+		return false;
+	__dmb();
+	*t = pwm_frame_done_t;
+	return true;
+}
+
+
+/**
+ * Set power budget (limit for total estimated current of outputs).
+ * Change takes effect at next update_pwm_frame() call.
+ *
+ * @param budget Budget in mA (0 = no limit).
+ */
+void set_pwm_power_budget(uint32_t budget)
+{
+	if (budget > POWER_BUDGET_MAX)
+		budget = POWER_BUDGET_MAX;
+	if (budget == pwm_power_budget)
+		return;
+	pwm_power_budget = budget;
+	pwm_frame_dirty = true;
+}
+
+
+/**
+ * Set power limiting parameters of an output.
+ * Change takes effect at next update_pwm_frame() call.
+ *
+ * @param out Output port.
+ * @param max_current Output current at 100% duty cycle in mA (0 = not counted).
+ * @param priority Priority (0..POWER_PRIORITY_MAX), higher priority outputs
+ *                 get limited only after lower priority ones are fully limited.
+ */
+void set_pwm_output_power(uint out, uint16_t max_current, uint8_t priority)
+{
+	assert(out < OUTPUT_COUNT);
+	if (max_current > OUTPUT_CURRENT_MAX)
+		max_current = OUTPUT_CURRENT_MAX;
+	if (priority > POWER_PRIORITY_MAX)
+		priority = POWER_PRIORITY_MAX;
+	if (max_current == pwm_out_current[out] && priority == pwm_out_priority[out])
+		return;
+	pwm_out_current[out] = max_current;
+	pwm_out_priority[out] = priority;
+	pwm_frame_dirty = true;
+}
+
+
+/**
+ * Get (estimated) output current statistics.
+ */
+void get_pwm_power_stats(struct pwm_power_stats *stats)
+{
+	stats->budget = pwm_power_budget;
+	stats->demand = pwm_power_demand;
+	stats->current = pwm_power_current;
+	stats->peak = pwm_power_peak;
+	stats->limited = pwm_power_limited;
+}
+
+
+/**
+ * Reset peak (estimated) output current.
+ */
+void reset_pwm_power_peak()
+{
+	pwm_power_peak_reset = true;
+}
+
+
+/**
+ * Initialize DMA channels for PWM frame buffer updates.
+ *
+ * Three channels are used:
+ *   start - paced by PWM wrap of first slice, (re)starts control channel
+ *   ctrl  - loads next (read_addr, write_addr) block into data channel
+ *   data  - copies one frame slot into CC register of a slice, then
+ *           chains back to control channel.
+ * Chain ends when control channel loads the terminating NULL block.
+ */
+static void setup_pwm_dma()
+{
+	dma_channel_config c;
+
+	/* Initialize frame buffer with current CC register values */
+	for (int i = 0; i < pwm_slice_count; i++) {
+		pwm_frame[i] = *(volatile uint32_t*)pwm_dma_blocks[i].write_addr;
+		pwm_dma_frame[i] = pwm_frame[i];
+		pwm_dma_blocks[i].read_addr = &pwm_dma_frame[i];
+	}
+	pwm_dma_blocks[pwm_slice_count].read_addr = NULL;
+	pwm_dma_blocks[pwm_slice_count].write_addr = NULL;
+	pwm_frame_dirty = false;
+
+	pwm_dma_start = dma_claim_unused_channel(false);
+	pwm_dma_ctrl = dma_claim_unused_channel(false);
+	pwm_dma_data = dma_claim_unused_channel(false);
+	if (pwm_dma_start < 0 || pwm_dma_ctrl < 0 || pwm_dma_data < 0) {
+		log_msg(LOG_ERR, "Not enough DMA channels available for PWM updates");
+		if (pwm_dma_start >= 0)
+			dma_channel_unclaim(pwm_dma_start);
+		if (pwm_dma_ctrl >= 0)
+			dma_channel_unclaim(pwm_dma_ctrl);
+		if (pwm_dma_data >= 0)
+			dma_channel_unclaim(pwm_dma_data);
+		pwm_dma_start = pwm_dma_ctrl = pwm_dma_data = -1;
+		return;
+	}
+	log_msg(LOG_DEBUG, "PWM DMA channels: start=%d, ctrl=%d, data=%d",
+		pwm_dma_start, pwm_dma_ctrl, pwm_dma_data);
+
+	/* Data channel: one 32bit word per slice, triggered by control channel */
+	c = dma_channel_get_default_config(pwm_dma_data);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+	channel_config_set_read_increment(&c, false);
+	channel_config_set_write_increment(&c, false);
+	channel_config_set_dreq(&c, DREQ_FORCE);
+	channel_config_set_chain_to(&c, pwm_dma_ctrl);
+	channel_config_set_irq_quiet(&c, true);
+	dma_channel_configure(pwm_dma_data, &c, NULL, NULL, 1, false);
+
+	/* Control channel: writes block into data channel READ_ADDR and WRITE_ADDR_TRIG */
+	c = dma_channel_get_default_config(pwm_dma_ctrl);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+	channel_config_set_read_increment(&c, true);
+	channel_config_set_write_increment(&c, true);
+	channel_config_set_ring(&c, true, 3);
+	dma_channel_configure(pwm_dma_ctrl, &c, &dma_hw->ch[pwm_dma_data].al2_read_addr,
+			pwm_dma_blocks, 2, false);
+
+	/* Start channel: waits for PWM wrap and then kicks off control channel */
+	c = dma_channel_get_default_config(pwm_dma_start);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+	channel_config_set_read_increment(&c, false);
+	channel_config_set_write_increment(&c, false);
+	channel_config_set_dreq(&c, pwm_get_dreq(pwm_gpio_to_slice_num(output_gpio_pwm_map[0])));
+	dma_channel_configure(pwm_dma_start, &c, &dma_hw->ch[pwm_dma_ctrl].al3_read_addr_trig,
+			&pwm_dma_blocks_ptr, 1, false);
+}
+
+
+/**
+ * Setup DMA for (continuous) dithering frame updates.
+ *
+ * Each frame has its own chain of blocks, where last block re-triggers
+ * the start channel (that then waits for the next PWM wrap). Start channel
+ * reads chain addresses from a ring buffer, so it cycles through the frames.
+ */
+static void setup_pwm_dither()
+{
+	dma_channel_config c;
+	int i, k;
+
+	if (pwm_dma_start < 0) {
+		log_msg(LOG_WARNING, "PWM dithering not available (no DMA)");
+		return;
+	}
+
+	for (k = 0; k < PWM_DITHER_FRAMES; k++) {
+		for (i = 0; i < pwm_slice_count; i++) {
+			pwm_dither_frame[k][i] = pwm_frame[i];
+			pwm_dither_blocks[k][i].read_addr = &pwm_dither_frame[k][i];
+			pwm_dither_blocks[k][i].write_addr = pwm_dma_blocks[i].write_addr;
+		}
+		pwm_dither_blocks[k][i].read_addr = &pwm_dither_rearm;
+		pwm_dither_blocks[k][i].write_addr = &dma_hw->ch[pwm_dma_start].al1_transfer_count_trig;
+		pwm_dither_blocks[k][i + 1].read_addr = NULL;
+		pwm_dither_blocks[k][i + 1].write_addr = NULL;
+		pwm_dither_ring[k] = pwm_dither_blocks[k];
+	}
+	for (i = 0; i < OUTPUT_COUNT; i++) {
+		uint32_t v = pwm_frame[pwm_frame_index[i]] >> pwm_frame_shift[i];
+		pwm_frame_fx[i] = pwm_cc_level(i, v & 0xffff) << PWM_DITHER_BITS;
+	}
+
+	c = dma_channel_get_default_config(pwm_dma_start);
+	channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+	channel_config_set_read_increment(&c, true);
+	channel_config_set_write_increment(&c, false);
+	channel_config_set_ring(&c, false, PWM_DITHER_BITS + 2);
+	channel_config_set_dreq(&c, pwm_get_dreq(pwm_gpio_to_slice_num(output_gpio_pwm_map[0])));
+	dma_channel_configure(pwm_dma_start, &c, &dma_hw->ch[pwm_dma_ctrl].al3_read_addr_trig,
+			pwm_dither_ring, 1, false);
+
+	pwm_dither = true;
+	pwm_dither_dirty = 0;
+	log_msg(LOG_INFO, "PWM dithering enabled: outputs=0x%04x, frames=%u",
+		pwm_dither_mask, PWM_DITHER_FRAMES);
+}
+
+
+/**
+ * Load lightness curve point table from a file.
+ *
+ * File contains (input, output) pairs (in percent), one per line, with
+ * input values in increasing order. Lines starting with '#' are ignored.
+ *
+ * @return Number of points loaded, or negative value on error.
+ */
+static int load_lightness_points(const char *filename, float *x, float *y, int max_points)
+{
+	char *buf, *line, *saveptr;
+	uint32_t size;
+	int count = 0;
+
+	if (flash_read_file(&buf, &size, filename) || !buf)
+		return -1;
+
+	line = strtok_r(buf, "\r\n", &saveptr);
+	while (line && count < max_points) {
+		float in, out;
+
+		while (*line == ' ' || *line == '\t')
+			line++;
+		if (*line && *line != '#') {
+			if (sscanf(line, "%f%*[ \t,]%f", &in, &out) != 2
+				|| in < 0.0 || in > 100.0 || out < 0.0 || out > 100.0
+				|| (count > 0 && in <= x[count - 1])) {
+				log_msg(LOG_WARNING, "%s: invalid line: %s", filename, line);
+				count = -2;
+				break;
+			}
+			x[count] = in;
+			y[count] = out;
+			count++;
+		}
+		line = strtok_r(NULL, "\r\n", &saveptr);
+	}
+	free(buf);
+
+	return (count < 2 ? -2 : count);
+}
+
+
+/**
+ * Precalculate lightness to PWM level map.
+ *
+ * Map splits the EFFECT_LEVEL_MAX range into LIGHTNESS_HR_STEPS
+ * segments, values in between are linearly interpolated.
+ *
+ * @param map Map to calculate (LIGHTNESS_HR_STEPS + 1 entries).
+ * @param pwm_wrap PWM Counter wrap value.
+ * @param spec Lightness curve: "cie", gamma value or "file:<name>"
+ *             ("" selects default curve).
+ *
+ * @return 0 on success, -1 if curve spec is not valid (in which case
+ *         map is calculated using default curve).
+ */
+static int calculate_pwm_lightness(uint16_t *map, uint16_t pwm_wrap, const char *spec)
+{
+	float px[LIGHTNESS_POINTS_MAX], py[LIGHTNESS_POINTS_MAX];
+	double gamma = 0.0;
+	double l, x;
+	float val;
+	int points = 0;
+	int i, j = 0;
+	int res = 0;
+
+	if (!strncasecmp(spec, "file:", 5)) {
+		if ((points = load_lightness_points(spec + 5, px, py, LIGHTNESS_POINTS_MAX)) < 2) {
+			log_msg(LOG_WARNING, "Cannot load lightness curve: %s", spec + 5);
+			res = -1;
+		}
+	} else if (str_to_float(spec, &val)) {
+		if (val >= 1.0 && val <= 10.0)
+			gamma = val;
 		else
-			l_r = cie_1931_lightness(l, LIGHTNESS_MAX);
-		printf("[%3d] %lf : %lf\n", i, l, l_r);
-#endif
+			res = -1;
+	} else if (strlen(spec) > 0 && strncasecmp(spec, "cie", 4)) {
+		res = -1;
 	}
+
+	for (i = 0; i <= LIGHTNESS_HR_STEPS; i++) {
+		x = (double)i * LIGHTNESS_MAX / LIGHTNESS_HR_STEPS;
+		if (points >= 2) {
+			/* Linear interpolation between points (clamped at the ends) */
+			while (j < points - 1 && x > px[j + 1])
+				j++;
+			if (x <= px[0])
+				l = py[0];
+			else if (x >= px[points - 1])
+				l = py[points - 1];
+			else
+				l = py[j] + (py[j + 1] - py[j]) * (x - px[j]) / (px[j + 1] - px[j]);
+		} else if (gamma >= 1.0) {
+			l = gamma_lightness_inverse(gamma, x, LIGHTNESS_MAX);
+		} else {
+			l = cie_1931_lightness_inverse(x, LIGHTNESS_MAX);
+		}
+		map[i] = (pwm_wrap * l) / LIGHTNESS_MAX + 0.5;
+	}
+
+	return res;
 }
 
 
+/**
+ * Release lightness maps of a curve set.
+ */
+static void free_lightness_curves(uint set)
+{
+	for (int i = 0; i < LIGHTNESS_CURVE_MAX; i++) {
+		struct lightness_curve *c = &pwm_curves[set][i];
+
+		if (c->map && c->map != pwm_lightness_hr_map)
+			free(c->map);
+		c->map = NULL;
+		c->spec[0] = 0;
+	}
+}
+
 
 /**
- * Initialize PWM hardware to generate 25kHz PWM signal on output pins.
+ * Get lightness map for given lightness curve (calculating new map,
+ * if curve is not yet in use).
+ *
+ * @param set Curve set.
+ * @param spec Lightness curve.
+ * @param pwm_wrap PWM Counter wrap value.
+ *
+ * @return Pointer to lightness map, or NULL if no more curves can be added.
  */
-void setup_pwm_outputs()
+static const uint16_t* get_lightness_curve(uint set, const char *spec, uint16_t pwm_wrap)
+{
+	struct lightness_curve *c;
+	int i;
+
+	for (i = 0; i < LIGHTNESS_CURVE_MAX; i++) {
+		c = &pwm_curves[set][i];
+		if (!c->map)
+			break;
+		if (!strncmp(c->spec, spec, sizeof(c->spec)))
+			return c->map;
+	}
+	if (i >= LIGHTNESS_CURVE_MAX)
+		return NULL;
+
+	/* First (system default) curve of first set uses static map */
+	if (set == 0 && i == 0)
+		c->map = pwm_lightness_hr_map;
+	else if (!(c->map = malloc(sizeof(pwm_lightness_hr_map))))
+		return NULL;
+	strncopy(c->spec, spec, sizeof(c->spec));
+
+	if (calculate_pwm_lightness(c->map, pwm_wrap, spec))
+		log_msg(LOG_WARNING, "Invalid PWM mapping '%s': using default", spec);
+	log_msg(LOG_INFO, "Output PWM mapping [%d]: %s", i + 1,
+		(strlen(spec) > 0 ? spec : "default"));
+
+	return c->map;
+}
+
+
+/**
+ * Check if lightness curve specification is valid.
+ */
+int valid_lightness_curve(const char *spec)
+{
+	float val;
+
+	if (!spec)
+		return 0;
+	if (strlen(spec) == 0 || !strncasecmp(spec, "cie", 4))
+		return 1;
+	if (!strncasecmp(spec, "file:", 5))
+		return (strlen(spec) > 5 ? 1 : 0);
+	if (str_to_float(spec, &val))
+		return (val >= 1.0 && val <= 10.0 ? 1 : 0);
+
+	return 0;
+}
+
+
+
+/**
+ * Check if PWM phase setting is valid.
+ */
+int valid_pwm_phase(const char *spec)
+{
+	uint32_t offset[PWM_SLICE_MAX_COUNT];
+
+	if (!spec)
+		return 0;
+	return (pwm_phase_offsets(spec, PWM_SLICE_MAX_COUNT, 100, offset) == 0 ? 1 : 0);
+}
+
+
+/**
+ * Calculate PWM output parameters (and lightness maps) from configuration.
+ *
+ * @param config Configuration.
+ * @param set Curve set to store lightness maps into.
+ * @param p Parameters to calculate.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int calculate_pwm_params(const struct brickpico_config *config, uint set,
+				struct pwm_params *p)
 {
 	uint32_t sys_clock = clock_get_hz(clk_sys);
-	pwm_config config = pwm_get_default_config();
-	uint pwm_freq = cfg->pwm_freq;
+	uint pwm_freq = config->pwm_freq;
 	uint clk_div = 1;
-	uint slice_num, top;
-	double gamma = -1.0;
+	uint top;
 	int i;
 
-
 	if (pwm_freq < 10)
 		pwm_freq = 10;
 	else if (pwm_freq > 100000)
 		pwm_freq = 100000;
-
-	log_msg(LOG_NOTICE, "Initializing PWM outputs...");
 	log_msg(LOG_NOTICE, "PWM Frequency: %u Hz", pwm_freq);
 
 	top = sys_clock / clk_div / pwm_freq / 2 - 1;  /* for phase-correct PWM signal */
@@ -160,46 +1127,165 @@ void setup_pwm_outputs()
 		log_msg(LOG_INFO, "Set PWM clock divider: %u", clk_div);
 		top = sys_clock / clk_div / pwm_freq / 2 - 1;  /* for phase-correct PWM signal */
 	}
-	pwm_out_top = top;
+	p->top = top;
+	p->clk_div = clk_div;
 
-	/* Lightness (Gamma Correction) */
-	if (strlen(cfg->gamma) > 0) {
-		float val;
-		if (!strncasecmp(cfg->gamma, "cie", 4)) {
-			gamma = 0.0;
-			log_msg(LOG_INFO, "Output PWM mapping: CIE (1931)");
-		}
-		if (str_to_float(cfg->gamma, &val)) {
-			if (val >= 1.0 && val <= 10.0) {
-				gamma = val;
-				log_msg(LOG_INFO, "Output PWM mapping: Gamma %1.1f", val);
-			}
+	/* With dithering, store lightness maps with extra precision (if possible) */
+	p->map_bits = (pwm_dither_mask ? pwm_dither_map_bits(top) : 0);
+
+	/* Lightness (Gamma Correction) curves, system default curve goes first */
+	free_lightness_curves(set);
+	if (!get_lightness_curve(set, config->gamma, top << p->map_bits)) {
+		log_msg(LOG_ERR, "Failed to allocate PWM mapping");
+		return -1;
+	}
+	for (i = 0; i < OUTPUT_MAX_COUNT; i++) {
+		const char *spec = config->outputs[i].gamma;
+		const uint16_t *map = NULL;
+
+		if (i < OUTPUT_COUNT && strlen(spec) > 0) {
+			if (!(map = get_lightness_curve(set, spec, top << p->map_bits)))
+				log_msg(LOG_WARNING, "output%d: too many PWM mappings in use", i + 1);
 		}
+		p->map[i] = (map ? map : pwm_curves[set][0].map);
 	}
-	if (gamma < 0.0) {
-		log_msg(LOG_INFO, "Output PWM mapping: default");
+
+	return 0;
+}
+
+
+/* Save settings PWM output parameters were calculated from. */
+static void save_pwm_settings(const struct brickpico_config *config)
+{
+	struct pwm_settings *s = &pwm_settings;
+
+	s->pwm_freq = config->pwm_freq;
+	strncopy(s->gamma, config->gamma, sizeof(s->gamma));
+	for (int i = 0; i < OUTPUT_COUNT; i++)
+		strncopy(s->out_gamma[i], config->outputs[i].gamma, sizeof(s->out_gamma[i]));
+}
+
+
+/**
+ * Check for PWM frequency and lightness curve changes in the configuration,
+ * and stage new PWM output parameters for core1 to take into use.
+ * (Called from core0)
+ */
+void update_pwm_config()
+{
+	const struct pwm_settings *s = &pwm_settings;
+	bool changed;
+
+	if (pwm_out_top == 0 || pwm_next_pending)
+		return;
+
+	changed = (s->pwm_freq != cfg->pwm_freq
+		|| strncmp(s->gamma, cfg->gamma, sizeof(s->gamma)));
+	for (int i = 0; i < OUTPUT_COUNT && !changed; i++) {
+		if (strncmp(s->out_gamma[i], cfg->outputs[i].gamma, sizeof(s->out_gamma[i])))
+			changed = true;
 	}
-	calculate_pwm_lightness(top, gamma);
+	if (!changed)
+		return;
+
+	log_msg(LOG_NOTICE, "Reconfiguring PWM outputs...");
+	save_pwm_settings(cfg);
+	if (calculate_pwm_params(cfg, pwm_curve_set ^ 1, &pwm_next))
+		return;
+	pwm_curve_set ^= 1;
+	__dmb();
+	pwm_next_pending = true;
+}
 
-	log_msg(LOG_DEBUG, "PWM: TOP=%u (max %u), CLK_DIV=%u", pwm_out_top, PWM_TOP_MAX, clk_div);
-	pwm_config_set_clkdiv_int(&config, clk_div);
+
+/**
+ * Initialize PWM hardware to generate PWM signal on output pins.
+ */
+void setup_pwm_outputs()
+{
+	pwm_config config = pwm_get_default_config();
+	struct pwm_params p;
+	uint slice_num, top;
+	uint32_t offset[PWM_SLICE_MAX_COUNT];
+	uint32_t slice_mask = 0;
+	int i;
+
+
+	log_msg(LOG_NOTICE, "Initializing PWM outputs...");
+
+	pwm_dither_mask = 0;
+	for (i = 0; i < OUTPUT_COUNT; i++) {
+		if (cfg->outputs[i].dither)
+			pwm_dither_mask |= (1 << i);
+		pwm_out_scale[i] = PWM_SCALE_ONE;
+		pwm_out_current[i] = cfg->outputs[i].max_current;
+		pwm_out_priority[i] = cfg->outputs[i].priority;
+	}
+	pwm_power_budget = cfg->power_budget;
+
+	save_pwm_settings(cfg);
+	calculate_pwm_params(cfg, 0, &p);
+	pwm_curve_set = 0;
+	top = p.top;
+	pwm_out_top = p.top;
+	pwm_clk_div = p.clk_div;
+	pwm_out_period_us = pwm_period_us(p.top, p.clk_div);
+	pwm_map_bits = p.map_bits;
+	memcpy(pwm_output_map, p.map, sizeof(pwm_output_map));
+
+	log_msg(LOG_DEBUG, "PWM: TOP=%u (max %u), CLK_DIV=%u", pwm_out_top, PWM_TOP_MAX, pwm_clk_div);
+	pwm_config_set_clkdiv_int(&config, pwm_clk_div);
 	pwm_config_set_phase_correct(&config, 1);
 	pwm_config_set_wrap(&config, pwm_out_top);
 
+	/* Stagger slices across PWM period (to spread switching current spikes).
+	   Counter covers first half of the period (in phase-correct mode),
+	   second half is reached by inverting output polarity. */
+	if (pwm_phase_offsets(cfg->pwm_phase, OUTPUT_COUNT / 2, 2 * (top + 1), offset))
+		log_msg(LOG_WARNING, "Invalid PWM phase setting '%s': using default",
+			cfg->pwm_phase);
+
 	/* Configure PWM outputs */
 
+	pwm_slice_count = 0;
 	for (i = 0; i < OUTPUT_COUNT; i=i+2) {
 		uint pin1 = output_gpio_pwm_map[i];
 		uint pin2 = output_gpio_pwm_map[i + 1];
+		uint32_t counter;
+		bool invert = pwm_phase_counter(offset[pwm_slice_count], top, &counter);
 
-		gpio_set_function(pin1, GPIO_FUNC_PWM);
-		gpio_set_function(pin2, GPIO_FUNC_PWM);
 		slice_num = pwm_gpio_to_slice_num(pin1);
 		/* two consecutive pins must belong to same PWM slice... */
 		assert(slice_num == pwm_gpio_to_slice_num(pin2));
-		pwm_init(slice_num, &config, true);
+		pwm_out_invert[i] = (invert ? top + 1 : 0);
+		pwm_out_invert[i + 1] = pwm_out_invert[i];
+
+		/* Configure slice (with outputs off), but do not start it yet */
+		pwm_init(slice_num, &config, false);
+		pwm_set_both_levels(slice_num, pwm_cc_level(i, 0), pwm_cc_level(i + 1, 0));
+		pwm_set_output_polarity(slice_num, invert, invert);
+		pwm_set_counter(slice_num, counter);
+		log_msg(LOG_DEBUG, "PWM slice %u: phase offset %lu%s", slice_num,
+			counter, (invert ? " (inverted)" : ""));
+		slice_mask |= (1 << slice_num);
+		gpio_set_function(pin1, GPIO_FUNC_PWM);
+		gpio_set_function(pin2, GPIO_FUNC_PWM);
+
+		pwm_frame_index[i] = pwm_slice_count;
+		pwm_frame_index[i + 1] = pwm_slice_count;
+		pwm_frame_shift[i] = (pwm_gpio_to_channel(pin1) == PWM_CHAN_B ? 16 : 0);
+		pwm_frame_shift[i + 1] = (pwm_gpio_to_channel(pin2) == PWM_CHAN_B ? 16 : 0);
+		pwm_dma_blocks[pwm_slice_count].write_addr = &pwm_hw->slice[slice_num].cc;
+		pwm_slice_num[pwm_slice_count] = slice_num;
+		pwm_slice_count++;
 	}
 
+	/* Start all slices at once, so phase offsets are maintained */
+	pwm_set_mask_enabled(pwm_hw->en | slice_mask);
+
+	setup_pwm_dma();
+	if (pwm_dither_mask)
+		setup_pwm_dither();
 }
 
 
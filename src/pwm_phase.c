@@ -0,0 +1,98 @@
+/* pwm_phase.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* PWM slice phase offset calculations (hardware independent). */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "pwm_phase.h"
+
+
+/**
+ * Calculate PWM counter phase offsets for the slices.
+ *
+ * @param spec Phase setting: "" or "auto" (evenly distributed), "off"
+ *             (all slices in phase), or comma separated list of phases
+ *             (in % of PWM period) for each slice.
+ * @param count Number of slices.
+ * @param period PWM period (in counter ticks).
+ * @param offset Array to store phase offsets (in counter ticks).
+ *
+ * @return 0 on success, -1 if spec is not valid (in which case offsets
+ *         are evenly distributed).
+ */
+int pwm_phase_offsets(const char *spec, unsigned int count, uint32_t period, uint32_t *offset)
+{
+	char *buf, *tok, *saveptr, *endptr;
+	int i;
+	long val;
+
+	for (i = 0; i < count; i++)
+		offset[i] = 0;
+
+	if (!strncasecmp(spec, "off", 4))
+		return 0;
+
+	if (strlen(spec) > 0 && strncasecmp(spec, "auto", 5) && (buf = strdup(spec))) {
+		i = 0;
+		tok = strtok_r(buf, ",", &saveptr);
+		while (tok) {
+			val = strtol(tok, &endptr, 10);
+			if (i >= count || endptr == tok || val < 0 || val > 99)
+				break;
+			offset[i++] = (uint64_t)period * val / 100;
+			tok = strtok_r(NULL, ",", &saveptr);
+		}
+		free(buf);
+		if (!tok && i > 0)
+			return 0;
+	}
+
+	for (i = 0; i < count; i++)
+		offset[i] = (uint64_t)period * i / count;
+
+	return (strlen(spec) > 0 && strncasecmp(spec, "auto", 5) ? -1 : 0);
+}
+
+
+/**
+ * Map phase offset to slice counter start value (and output polarity).
+ *
+ * @param offset Phase offset (0..2 * (TOP + 1) - 1 counter ticks).
+ * @param top PWM counter wrap value (TOP).
+ * @param counter Counter start value (0..TOP).
+ *
+ * @return true if slice needs inverted output polarity.
+ */
+bool pwm_phase_counter(uint32_t offset, uint32_t top, uint32_t *counter)
+{
+	if (offset > top) {
+		*counter = offset - (top + 1);
+		return true;
+	}
+	*counter = offset;
+	return false;
+}
+
+
+/* eof :-) */
@@ -0,0 +1,52 @@
+/* pwm_phase.h
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BRICKPICO_PWM_PHASE_H
+#define BRICKPICO_PWM_PHASE_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* PWM slices run in phase-correct mode, so PWM period is 2 * (TOP + 1)
+   counter ticks. Slices are staggered across the period by starting
+   the counters at different values, counter only covers first half of
+   the period, second half is reached by inverting output polarity
+   (and compare values). */
+
+
+/**
+ * Map PWM level to compare (CC) register value.
+ *
+ * @param invert 0 (normal polarity) or TOP + 1 (inverted polarity).
+ * @param level PWM level (0..TOP + 1).
+ */
+static inline uint32_t pwm_phase_cc_level(uint32_t invert, uint32_t level)
+{
+	return (invert ? invert - level : level);
+}
+
+
+/* pwm_phase.c */
+int pwm_phase_offsets(const char *spec, unsigned int count, uint32_t period, uint32_t *offset);
+bool pwm_phase_counter(uint32_t offset, uint32_t top, uint32_t *counter);
+
+
+#endif /* BRICKPICO_PWM_PHASE_H */
@@ -170,6 +170,8 @@ int u8_ringbuffer_add(u8_ringbuffer_t *rb, uint8_t *data, uint8_t len, bool over
 			dst = rb->buf;
 		*dst++ = *src++;
 	}
+	if (dst >= rb->buf + rb->size)
+		dst = rb->buf;
 	*dst++ = len;
 
 	rb->free -= len + PREFIX_LEN + SUFFIX_LEN;
@@ -0,0 +1,131 @@
+/* solar.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Sunrise, sunset and civil twilight calculations.
+
+   Uses the NOAA "General Solar Position" approximations (fractional year,
+   equation of time and solar declination), which are accurate to
+   about one minute outside polar regions. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+
+#include "solar.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define DEG2RAD(x) ((x) * (M_PI / 180.0))
+#define RAD2DEG(x) ((x) * (180.0 / M_PI))
+
+
+/* Zenith angle (degrees) of the sun for each event */
+static const double solar_event_zenith[SOLAR_EVENT_COUNT] = {
+	96.0,     /* civil dawn */
+	90.833,   /* sunrise (refraction and solar disc size corrected) */
+	90.833,   /* sunset */
+	96.0,     /* civil dusk */
+};
+
+
+/* Convert (proleptic Gregorian) date into days since 1970-01-01. */
+static int32_t days_from_civil(int y, unsigned int m, unsigned int d)
+{
+	int era;
+	unsigned int yoe, doy, doe;
+
+	y -= (m <= 2);
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = (unsigned int)(y - era * 400);
+	doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + (int32_t)doe - 719468;
+}
+
+/* Calculate time of event (in minutes from UTC midnight). Returns false
+   if sun does not reach the given zenith angle on given day. */
+static bool solar_event_minutes(double lat, double lon, int yday, int year_days,
+				double zenith, bool rising, double *minutes)
+{
+	double t = 720.0 - 4.0 * lon;  /* start from solar noon */
+	double g, eqtime, decl, c, ha;
+
+	/* Refine estimate, as sun position is calculated for the time of event */
+	for (int i = 0; i < 2; i++) {
+		g = 2.0 * M_PI / year_days * (yday + (t / 60.0 - 12.0) / 24.0);
+		eqtime = 229.18 * (0.000075 + 0.001868 * cos(g) - 0.032077 * sin(g)
+				- 0.014615 * cos(2 * g) - 0.040849 * sin(2 * g));
+		decl = 0.006918 - 0.399912 * cos(g) + 0.070257 * sin(g)
+			- 0.006758 * cos(2 * g) + 0.000907 * sin(2 * g)
+			- 0.002697 * cos(3 * g) + 0.00148 * sin(3 * g);
+		c = cos(DEG2RAD(zenith)) / (cos(DEG2RAD(lat)) * cos(decl))
+			- tan(DEG2RAD(lat)) * tan(decl);
+		if (c < -1.0 || c > 1.0)
+			return false;
+		ha = RAD2DEG(acos(c));
+		t = 720.0 - 4.0 * (lon + (rising ? ha : -ha)) - eqtime;
+	}
+
+	*minutes = t;
+	return true;
+}
+
+
+/**
+ * Calculate civil dawn, sunrise, sunset and civil dusk times for a date.
+ *
+ * @param lat Latitude (degrees, north positive).
+ * @param lon Longitude (degrees, east positive).
+ * @param date Date (tm_year, tm_mon, tm_mday and tm_yday are used).
+ * @param times Array (of SOLAR_EVENT_COUNT) to store event times, time is
+ *              set to 0 if event does not occur on given day.
+ *
+ * @return Number of events that occur on given day.
+ */
+int solar_event_times(double lat, double lon, const struct tm *date, time_t *times)
+{
+	int year = date->tm_year + 1900;
+	int year_days = ((year % 4 == 0 && year % 100 != 0) || year % 400 == 0) ? 366 : 365;
+	time_t midnight = (time_t)days_from_civil(year, date->tm_mon + 1, date->tm_mday) * 86400;
+	double minutes;
+	int count = 0;
+
+	for (int i = 0; i < SOLAR_EVENT_COUNT; i++) {
+		times[i] = 0;
+		if (solar_event_minutes(lat, lon, date->tm_yday, year_days,
+						solar_event_zenith[i],
+						(i == SOLAR_DAWN || i == SOLAR_SUNRISE),
+						&minutes)) {
+			times[i] = midnight + (time_t)lround(minutes * 60.0);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+
+/* eof :-) */
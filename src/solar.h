@@ -0,0 +1,40 @@
+/* solar.h
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef BRICKPICO_SOLAR_H
+#define BRICKPICO_SOLAR_H 1
+
+#include <time.h>
+
+enum solar_events {
+	SOLAR_DAWN = 0,
+	SOLAR_SUNRISE = 1,
+	SOLAR_SUNSET = 2,
+	SOLAR_DUSK = 3,
+};
+#define SOLAR_EVENT_COUNT 4
+
+
+/* solar.c */
+int solar_event_times(double lat, double lon, const struct tm *date, time_t *times);
+
+
+#endif /* BRICKPICO_SOLAR_H */
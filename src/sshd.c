@@ -50,6 +50,7 @@ void sshserver_init()
 	char *buf = NULL;
 	uint32_t buf_size = 0;
 	const char *alg_name;
+	struct stdio_driver *last;
 	int pkey_count = 0;
 	int i, res;
 
@@ -123,10 +124,13 @@ void sshserver_init()
 	if (cfg->ssh_port > 0)
 		ssh_srv->port = cfg->ssh_port;
 
-	/* Start SSH server */
+	/* Start SSH server (registers its own stdio driver) */
+	last = last_stdio_driver();
 	if (!ssh_server_start(ssh_srv, true)) {
 		log_msg(LOG_ERR, "Failed to start SSH server.");
+		return;
 	}
+	set_console_driver(CMD_SOURCE_SSH, last);
 }
 
 
@@ -139,6 +143,16 @@ void sshserver_disconnect()
 }
 
 
+/* Return identifier of current SSH session (0 = no session). */
+uint32_t sshserver_session()
+{
+	if (!ssh_srv || !ssh_server_client_connected(ssh_srv))
+		return 0;
+
+	return tcp_client_id(ssh_srv->port);
+}
+
+
 void sshserver_who()
 {
 	ip_addr_t ip;
@@ -0,0 +1,283 @@
+/* stream.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Binary (framed) output streaming protocol over the (USB) console.
+
+   Frames are COBS encoded and terminated by a zero byte:
+
+     COBS( type[1] | data[0..STREAM_DATA_MAX] | crc32[4] ) | 0x00
+
+   CRC is calculated using xcrc32() (init 0xffffffff) over type and data,
+   and is stored in little-endian byte order. All multi-byte values are
+   little-endian.
+
+   Frames from host:
+     0x01 LEVELS   data: uint16 level for outputs 1..N (N <= OUTPUT_COUNT),
+                   0 = off, 65535 = max. Outputs are driven directly
+                   with these levels (bypassing effects and output state).
+     0x02 PING     data: any (echoed back in PONG)
+     0x03 STATS    data: none
+     0x04 EXIT     data: none (leave streaming mode)
+
+   Frames from device:
+     0x80 HELLO    data: protocol version, output count
+     0x82 PONG     data: PING data
+     0x83 STATS    data: uint32 frames, level frames, crc errors, frame errors
+     0x84 EXIT     data: none
+     0xff ERROR    data: type of the rejected frame
+
+   Streaming mode ends when EXIT frame is received, or if no valid frames
+   have been received in STREAM_IDLE_TIMEOUT_MS. Outputs then return to
+   normal operation. Any text output (log messages) from the device is
+   not framed, so host must discard frames that fail the CRC check.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "brickpico.h"
+
+
+#define STREAM_PROTOCOL_VERSION  1
+#define STREAM_DATA_MAX          (2 * OUTPUT_MAX_COUNT)
+#define STREAM_FRAME_MAX         (1 + STREAM_DATA_MAX + 4)
+#define STREAM_COBS_MAX          (STREAM_FRAME_MAX + STREAM_FRAME_MAX / 254 + 1)
+#define STREAM_IDLE_TIMEOUT_MS   30000
+#define STREAM_READ_BUF_SIZE     256
+
+#define STREAM_LEVELS  0x01
+#define STREAM_PING    0x02
+#define STREAM_STATS   0x03
+#define STREAM_EXIT    0x04
+#define STREAM_REPLY   0x80
+#define STREAM_ERROR   0xff
+
+
+static bool stream_mode = false;
+static absolute_time_t stream_t_last;
+static uint8_t stream_rx[STREAM_COBS_MAX];
+static uint stream_rx_len = 0;
+static bool stream_rx_overflow = false;
+static struct stream_stats stream_stats;
+
+
+static uint stream_cobs_decode(const uint8_t *in, uint len, uint8_t *out)
+{
+	uint i = 0, o = 0;
+
+	while (i < len) {
+		uint8_t code = in[i++];
+
+		if (code == 0 || i + code - 1 > len)
+			return 0;
+		for (uint j = 1; j < code; j++)
+			out[o++] = in[i++];
+		if (code < 0xff && i < len)
+			out[o++] = 0;
+	}
+
+	return o;
+}
+
+static uint stream_cobs_encode(const uint8_t *in, uint len, uint8_t *out)
+{
+	uint code_pos = 0, o = 1;
+	uint8_t code = 1;
+
+	for (uint i = 0; i < len; i++) {
+		if (in[i]) {
+			out[o++] = in[i];
+			code++;
+		}
+		if (!in[i] || code == 0xff) {
+			out[code_pos] = code;
+			code_pos = o++;
+			code = 1;
+		}
+	}
+	out[code_pos] = code;
+
+	return o;
+}
+
+static void stream_send(uint8_t type, const uint8_t *data, uint len)
+{
+	uint8_t frame[STREAM_FRAME_MAX];
+	uint8_t buf[STREAM_COBS_MAX + 2];
+	uint32_t crc;
+	uint l;
+
+	if (len > STREAM_DATA_MAX)
+		len = STREAM_DATA_MAX;
+
+	frame[0] = type;
+	memcpy(&frame[1], data, len);
+	crc = xcrc32_fast(frame, len + 1, 0xffffffff);
+	for (int i = 0; i < 4; i++)
+		frame[len + 1 + i] = crc >> (8 * i);
+
+	/* Leading delimiter separates frame from any preceding text output */
+	buf[0] = 0;
+	l = stream_cobs_encode(frame, len + 5, &buf[1]);
+	buf[l + 1] = 0;
+	stdio_put_string((const char*)buf, l + 2, false, false);
+	stdio_flush();
+}
+
+static void stream_send_stats()
+{
+	uint8_t buf[16];
+	uint32_t v[4] = { stream_stats.frames, stream_stats.level_frames,
+			  stream_stats.crc_errors, stream_stats.frame_errors };
+
+	for (int i = 0; i < 16; i++)
+		buf[i] = v[i / 4] >> (8 * (i % 4));
+	stream_send(STREAM_REPLY | STREAM_STATS, buf, sizeof(buf));
+}
+
+static void stream_stop()
+{
+	stream_mode = false;
+	clear_direct_output_levels();
+	log_msg(LOG_NOTICE, "Output streaming mode disabled (frames=%lu, errors=%lu)",
+		stream_stats.frames, stream_stats.crc_errors + stream_stats.frame_errors);
+}
+
+static void stream_process_frame(const uint8_t *frame, uint len)
+{
+	uint16_t level[OUTPUT_MAX_COUNT];
+	uint32_t crc;
+	uint count;
+
+	if (len < 5) {
+		stream_stats.frame_errors++;
+		return;
+	}
+	len -= 4;
+	crc = frame[len] | (frame[len + 1] << 8) | (frame[len + 2] << 16)
+		| ((uint32_t)frame[len + 3] << 24);
+	if (crc != xcrc32_fast(frame, len, 0xffffffff)) {
+		stream_stats.crc_errors++;
+		return;
+	}
+	stream_stats.frames++;
+	stream_t_last = get_absolute_time();
+
+	switch (frame[0]) {
+	case STREAM_LEVELS:
+		count = (len - 1) / 2;
+		if (count < 1 || count > OUTPUT_COUNT || (len - 1) % 2)
+			break;
+		for (uint i = 0; i < count; i++)
+			level[i] = frame[1 + 2 * i] | (frame[2 + 2 * i] << 8);
+		set_direct_output_levels(level, count);
+		stream_stats.level_frames++;
+		return;
+	case STREAM_PING:
+		stream_send(STREAM_REPLY | STREAM_PING, &frame[1], len - 1);
+		return;
+	case STREAM_STATS:
+		stream_send_stats();
+		return;
+	case STREAM_EXIT:
+		stream_send(STREAM_REPLY | STREAM_EXIT, NULL, 0);
+		stream_stop();
+		return;
+	}
+
+	stream_send(STREAM_ERROR, &frame[0], 1);
+}
+
+
+void start_stream_mode()
+{
+	uint8_t hello[2] = { STREAM_PROTOCOL_VERSION, OUTPUT_COUNT };
+
+	if (stream_mode)
+		return;
+
+	log_msg(LOG_NOTICE, "Output streaming mode enabled");
+	memset(&stream_stats, 0, sizeof(stream_stats));
+	stream_rx_len = 0;
+	stream_rx_overflow = false;
+	stream_t_last = get_absolute_time();
+	stream_mode = true;
+	stream_send(STREAM_REPLY, hello, sizeof(hello));
+}
+
+bool stream_mode_active()
+{
+	return stream_mode;
+}
+
+void get_stream_stats(struct stream_stats *stats)
+{
+	memcpy(stats, &stream_stats, sizeof(*stats));
+}
+
+void process_stream_input()
+{
+	char buf[STREAM_READ_BUF_SIZE];
+	uint8_t frame[STREAM_COBS_MAX];
+	uint len;
+	int n;
+
+	if (!stream_mode)
+		return;
+
+	/* Read all available input in blocks */
+	while (stream_mode && (n = stdio_get_until(buf, sizeof(buf), get_absolute_time())) > 0) {
+		for (int i = 0; i < n && stream_mode; i++) {
+			uint8_t c = buf[i];
+
+			if (c != 0) {
+				if (stream_rx_len < sizeof(stream_rx))
+					stream_rx[stream_rx_len++] = c;
+				else
+					stream_rx_overflow = true;
+				continue;
+			}
+
+			/* End of frame */
+			if (stream_rx_overflow) {
+				stream_stats.frame_errors++;
+			} else if (stream_rx_len > 0) {
+				len = stream_cobs_decode(stream_rx, stream_rx_len, frame);
+				if (len > 0)
+					stream_process_frame(frame, len);
+				else
+					stream_stats.frame_errors++;
+			}
+			stream_rx_len = 0;
+			stream_rx_overflow = false;
+		}
+	}
+
+	if (stream_mode && time_passed(&stream_t_last, STREAM_IDLE_TIMEOUT_MS)) {
+		log_msg(LOG_NOTICE, "Output streaming idle timeout");
+		stream_stop();
+	}
+}
+
+
+/* eof :-) */
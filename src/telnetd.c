@@ -42,6 +42,8 @@ static const char *telnet_banner = "\r\n"
 	"\\____/|_|  |_|\\___|_|\\_\\_|   |_|\\___\\___/\r\n";
 
 
+static tcp_server_t *telnet_srv = NULL;
+
 static user_pwhash_entry_t users[] = {
 	{ NULL, NULL },
 	{ NULL, NULL }
@@ -50,6 +52,7 @@ static user_pwhash_entry_t users[] = {
 void tcpserver_init()
 {
 	tcp_server_t *srv = telnet_server_init(4096, 10240);
+	struct stdio_driver *last;
 
 	if (!srv)
 		return;
@@ -66,6 +69,20 @@ void tcpserver_init()
 	srv->log_cb = log_msg;
 	srv->banner = telnet_banner;
 
+	last = last_stdio_driver();
 	telnet_server_start(srv, true);
+	/* Telnet server registers its own stdio driver */
+	set_console_driver(CMD_SOURCE_TELNET, last);
+	telnet_srv = srv;
+}
+
+
+/* Return identifier of current Telnet session (0 = no session). */
+uint32_t telnetserver_session()
+{
+	if (!telnet_srv)
+		return 0;
+
+	return tcp_client_id(telnet_srv->port);
 }
 
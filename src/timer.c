@@ -22,18 +22,37 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include "pico/stdlib.h"
+#include "pico/aon_timer.h"
 
 #include "brickpico.h"
 
 
 /* Event string syntax:
-    <minute> <hour> <day of week> <action> <fans> <comments> ...
+    <minute>[:<second>] <hour> <day of week> <action> <fans> <comments> ...
+    <sun event>[+|-<minutes>] <day of week> <action> <fans> <comments> ...
 
     30 18 * on 1,2,3,4 Turn 1-4 on at 18:30
     45 18 * on 5,6,7,8 Turn 5-8 on at 18:45
     0 23 1-5 off * Turn all off at 23:00 during the week
     0 0 0,6 off * Turn all off at 00:00 on weekends
+    15:30 20 * pwm=50 1 Set output 1 to 50% at 20:15:30
+    0 21 * ramp=0,600 * Fade all outputs to 0% over 10 minutes at 21:00
+    0 22 5 effect=blink,0.5,0.5 2 Start blinking output 2 at 22:00 on Fridays
+    sunset-30 * on 1-4 Turn 1-4 on 30 minutes before sunset
+    dawn * off * Turn all off at dawn (beginning of civil twilight)
+
+   Sun events:
+    DAWN, SUNRISE, SUNSET, DUSK (dawn and dusk are start and end of
+    civil twilight). Location must be configured (SYS:LOCATION).
+
+   Actions:
+    ON, OFF                     Turn output(s) on/off
+    PWM=<level>                 Set output PWM level (0..100)
+    RAMP=<level>,<seconds>      Turn output on and ramp from current level
+                                to given PWM level (over given time)
+    EFFECT=<effect>[,<args>]    Set light effect (see CONF:OUTPUTx:EFFECT)
 */
 
 
@@ -44,12 +63,72 @@ const char* timer_action_type_str(enum timer_action_types type)
 		return "ON";
 	case ACTION_OFF:
 		return "OFF";
+	case ACTION_PWM:
+		return "PWM";
+	case ACTION_EFFECT:
+		return "EFFECT";
+	case ACTION_RAMP:
+		return "RAMP";
 	default:
 		break;
 	}
 	return "NONE";
 }
 
+static const char *timer_trigger_names[] = {
+	"TIME",
+	"DAWN",
+	"SUNRISE",
+	"SUNSET",
+	"DUSK",
+	NULL
+};
+
+/* Parse sun event trigger: <event>[+|-<minutes>] */
+static int parse_timer_trigger(const char *str, struct timer_event *event)
+{
+	const char *o;
+	int i, len, offset = 0;
+
+	for (i = TRIGGER_DAWN; i <= TIMER_TRIGGER_ENUM_MAX; i++) {
+		len = strlen(timer_trigger_names[i]);
+		if (!strncasecmp(str, timer_trigger_names[i], len))
+			break;
+	}
+	if (i > TIMER_TRIGGER_ENUM_MAX)
+		return 1;
+
+	o = str + len;
+	if (*o) {
+		if ((*o != '+' && *o != '-') || !str_to_int(o, &offset, 10))
+			return 2;
+		if (offset < -TIMER_OFFSET_MAX || offset > TIMER_OFFSET_MAX)
+			return 2;
+	}
+
+	event->trigger = i;
+	event->offset = offset;
+	event->minute = -1;
+	event->hour = -1;
+	event->second = 0;
+	return 0;
+}
+
+const char* timer_trigger_str(const struct timer_event *e, char *buf, size_t size)
+{
+	if (!e || !buf || size < 1)
+		return NULL;
+	if (e->trigger == TRIGGER_TIME || e->trigger > TIMER_TRIGGER_ENUM_MAX)
+		return NULL;
+
+	if (e->offset)
+		snprintf(buf, size, "%s%+d", timer_trigger_names[e->trigger], e->offset);
+	else
+		strncopy(buf, timer_trigger_names[e->trigger], size);
+
+	return buf;
+}
+
 enum timer_action_types str_to_timer_action_type(const char *str)
 {
 	if (!str)
@@ -59,10 +138,101 @@ enum timer_action_types str_to_timer_action_type(const char *str)
 		return ACTION_ON;
 	else if (!strncasecmp(str, "OFF", 3))
 		return ACTION_OFF;
+	else if (!strncasecmp(str, "PWM", 3))
+		return ACTION_PWM;
+	else if (!strncasecmp(str, "EFFECT", 6))
+		return ACTION_EFFECT;
+	else if (!strncasecmp(str, "RAMP", 4))
+		return ACTION_RAMP;
 
 	return ACTION_NONE;
 }
 
+/* Parse action (and its parameters) from string: <action>[=<params>] */
+static int parse_timer_action(const char *str, struct timer_event *event)
+{
+	enum timer_action_types a = str_to_timer_action_type(str);
+	const char *params = strchr(str, '=');
+	char name[16];
+	const char *args;
+	void *ctx;
+	int i, len;
+
+	if (params)
+		params++;
+
+	switch (a) {
+	case ACTION_ON:
+	case ACTION_OFF:
+		if (params)
+			return 1;
+		break;
+	case ACTION_PWM:
+		if (!params || !str_to_int(params, &i, 10) || i < 0 || i > 100)
+			return 1;
+		event->pwm = i;
+		break;
+	case ACTION_RAMP:
+		if (!params || sscanf(params, "%d,%d", &i, &len) != 2)
+			return 1;
+		if (i < 0 || i > 100 || len < 0 || len > TIMER_RAMP_MAX)
+			return 1;
+		event->pwm = i;
+		event->duration = len;
+		break;
+	case ACTION_EFFECT:
+		if (!params)
+			return 1;
+		args = strchr(params, ',');
+		len = (args ? args - params : strlen(params));
+		if (len >= sizeof(name))
+			return 1;
+		memcpy(name, params, len);
+		name[len] = 0;
+		args = (args ? args + 1 : "");
+		if (strlen(args) >= sizeof(event->effect_args))
+			return 1;
+		event->effect = str2effect(name);
+		if (event->effect == EFFECT_NONE && strcasecmp(name, effect2str(EFFECT_NONE)))
+			return 1;
+		/* Validate effect parameters */
+		ctx = effect_parse_args(event->effect, args);
+		if (event->effect != EFFECT_NONE && !ctx)
+			return 1;
+		free(ctx);
+		strncopy(event->effect_args, args, sizeof(event->effect_args));
+		break;
+	default:
+		return 1;
+	}
+
+	event->action = a;
+	return 0;
+}
+
+const char* timer_action_str(const struct timer_event *e, char *buf, size_t size)
+{
+	if (!e || !buf || size < 1)
+		return NULL;
+
+	switch (e->action) {
+	case ACTION_PWM:
+		snprintf(buf, size, "PWM=%u", e->pwm);
+		break;
+	case ACTION_RAMP:
+		snprintf(buf, size, "RAMP=%u,%u", e->pwm, e->duration);
+		break;
+	case ACTION_EFFECT:
+		snprintf(buf, size, "EFFECT=%s%s%s", effect2str(e->effect),
+			(e->effect_args[0] ? "," : ""), e->effect_args);
+		break;
+	default:
+		strncopy(buf, timer_action_type_str(e->action), size);
+	}
+
+	return buf;
+}
+
 int parse_timer_event_str(const char *str, struct timer_event *event)
 {
 	char *tok, *saveptr, *s;
@@ -75,12 +245,37 @@ int parse_timer_event_str(const char *str, struct timer_event *event)
 		return -2;
 
 	event->name[0] = 0;
+	event->trigger = TRIGGER_TIME;
+	event->offset = 0;
+	event->second = 0;
+	event->pwm = 0;
+	event->duration = 0;
+	event->effect = EFFECT_NONE;
+	event->effect_args[0] = 0;
 
 	tok = strtok_r(s, " ", &saveptr);
 	while (tok) {
 		int i;
 		int as = (tok[0] == '*' && tok[1] == 0) ? 1 : 0;
-		if (count == 0) { /* minute */
+		if (count == 0 && isalpha((unsigned char)tok[0])) { /* sun event */
+			if (parse_timer_trigger(tok, event)) {
+				res = 1;
+				goto abort;
+			}
+			/* no separate hour field */
+			count++;
+		} else if (count == 0) { /* minute[:second] */
+			char *sec = strchr(tok, ':');
+			if (sec) {
+				*sec++ = 0;
+				as = (tok[0] == '*' && tok[1] == 0) ? 1 : 0;
+				if (str_to_int(sec, &i, 10) && i >= 0 && i <= 59) {
+					event->second = i;
+				} else {
+					res = 1;
+					goto abort;
+				}
+			}
 			if (as) {
 				event->minute = -1;
 			} else if (str_to_int(tok, &i, 10)) {
@@ -117,10 +312,7 @@ int parse_timer_event_str(const char *str, struct timer_event *event)
 				goto abort;
 			}
 		} else if (count == 3) { /* action */
-			enum timer_action_types a = str_to_timer_action_type(tok);
-			if (a != ACTION_NONE) {
-				event->action = a;
-			} else {
+			if (parse_timer_action(tok, event)) {
 				res = 4;
 				goto abort;
 			}
@@ -151,27 +343,38 @@ abort:
 
 const char* timer_event_str(const struct timer_event *e)
 {
-	static char buf[128];
-	char tmp[16];
+	static char buf[160];
+	char tmp[64];
 
 	if (!e)
 		return NULL;
 
 	buf[0] = 0;
 
-	/* minute */
-	if (e->minute >= 0)
-		snprintf(tmp, sizeof(tmp), "%02d ", e->minute);
-	else
-		strncopy(tmp, "* ", sizeof(tmp));
-	strncatenate(buf, tmp, sizeof(buf));
+	if (timer_trigger_str(e, tmp, sizeof(tmp))) {
+		/* sun event */
+		strncatenate(buf, tmp, sizeof(buf));
+		strncatenate(buf, " ", sizeof(buf));
+	} else {
+		/* minute[:second] */
+		if (e->minute >= 0)
+			snprintf(tmp, sizeof(tmp), "%02d", e->minute);
+		else
+			strncopy(tmp, "*", sizeof(tmp));
+		strncatenate(buf, tmp, sizeof(buf));
+		if (e->second > 0) {
+			snprintf(tmp, sizeof(tmp), ":%02d", e->second);
+			strncatenate(buf, tmp, sizeof(buf));
+		}
+		strncatenate(buf, " ", sizeof(buf));
 
-	/* hour */
-	if (e->hour >= 0)
-		snprintf(tmp, sizeof(tmp), "%02d ", e->hour);
-	else
-		strncopy(tmp, "* ", sizeof(tmp));
-	strncatenate(buf, tmp, sizeof(buf));
+		/* hour */
+		if (e->hour >= 0)
+			snprintf(tmp, sizeof(tmp), "%02d ", e->hour);
+		else
+			strncopy(tmp, "* ", sizeof(tmp));
+		strncatenate(buf, tmp, sizeof(buf));
+	}
 
 	/* day of week */
 	if (e->wday > 0) {
@@ -182,7 +385,7 @@ const char* timer_event_str(const struct timer_event *e)
 	}
 
 	/* action */
-	strncatenate(buf, timer_action_type_str(e->action), sizeof(buf));
+	strncatenate(buf, timer_action_str(e, tmp, sizeof(tmp)), sizeof(buf));
 	strncatenate(buf, " ", sizeof(buf));
 
 	/* mask */
@@ -202,69 +405,564 @@ const char* timer_event_str(const struct timer_event *e)
 }
 
 
-int check_timer_event(const struct timer_event *e, struct tm *t)
+/* Convert local time to time_t. Returns first matching time that is
+   after time 'after', so that during the repeated hour (at the end of DST)
+   both occurrences are considered. */
+static time_t local_time_to_time_t(const struct tm *tm, time_t after)
 {
-	if (!e || !t)
-		return 0;
+	struct tm c;
+	time_t t, best = 0;
+
+	for (int dst = 0; dst <= 1; dst++) {
+		c = *tm;
+		c.tm_isdst = dst;
+		t = mktime(&c);
+		if (t <= after || c.tm_hour != tm->tm_hour || c.tm_min != tm->tm_min)
+			continue;
+		if (best == 0 || t < best)
+			best = t;
+	}
+	if (best == 0) {
+		/* Non-existent local time (start of DST), let mktime() normalize it */
+		c = *tm;
+		c.tm_isdst = -1;
+		best = mktime(&c);
+	}
 
-	if (e->minute >= 0 && e->minute != t->tm_min)
-		return 0;
-	if (e->hour >= 0 && e->hour != t->tm_hour)
+	return best;
+}
+
+/* Cache of daily sun event times, so that solar calculations are done
+   only once per day (per location). */
+
+#define SOLAR_CACHE_DAYS 8
+
+struct solar_cache_entry {
+	bool valid;
+	int16_t year;
+	int16_t yday;
+	time_t t[SOLAR_EVENT_COUNT];
+};
+
+static struct solar_cache_entry solar_cache[SOLAR_CACHE_DAYS];
+static float solar_latitude = 0.0;
+static float solar_longitude = 0.0;
+
+
+static void set_solar_location(float lat, float lon)
+{
+	if (lat == solar_latitude && lon == solar_longitude)
+		return;
+
+	solar_latitude = lat;
+	solar_longitude = lon;
+	memset(solar_cache, 0, sizeof(solar_cache));
+}
+
+/* Return sun event times for given (local) date. */
+static const time_t* solar_day_times(const struct tm *date)
+{
+	struct solar_cache_entry *c = &solar_cache[date->tm_yday % SOLAR_CACHE_DAYS];
+
+	if (!c->valid || c->year != date->tm_year || c->yday != date->tm_yday) {
+		solar_event_times(solar_latitude, solar_longitude, date, c->t);
+		c->year = date->tm_year;
+		c->yday = date->tm_yday;
+		c->valid = true;
+	}
+
+	return c->t;
+}
+
+/* Calculate next time (after time 'after') when sun event is scheduled
+   to fire. Returns 0 if event does not occur within next week. */
+static time_t next_solar_event_time(const struct timer_event *e, time_t after)
+{
+	struct tm t;
+	time_t next;
+
+	next = after + 1;
+	localtime_r(&next, &t);
+
+	/* Offset may move event into previous (or next) day, so start
+	   from previous day */
+	t.tm_mday--;
+	for (int day = 0; day < 10; day++) {
+		t.tm_hour = 12;
+		t.tm_min = 0;
+		t.tm_sec = 0;
+		t.tm_isdst = -1;
+		if (mktime(&t) == (time_t)-1)
+			return 0;
+		if (e->wday == 0 || (e->wday & (1 << t.tm_wday))) {
+			next = solar_day_times(&t)[e->trigger - TRIGGER_DAWN];
+			if (next > 0) {
+				next += e->offset * 60;
+				if (next > after)
+					return next;
+			}
+		}
+		t.tm_mday++;
+	}
+
+	return 0;
+}
+
+/* Calculate next time (after time 'after') when timer event is
+   scheduled to fire. Returns 0 if event never fires. */
+time_t next_timer_event_time(const struct timer_event *e, time_t after)
+{
+	struct tm t, c;
+	time_t next, best, hour_ago;
+	int day, hour, min, first_hour;
+	bool repeat;
+
+	if (!e)
 		return 0;
-	if (e->wday > 0 && !(e->wday & ((1 << t->tm_wday))))
+	if (e->trigger != TRIGGER_TIME) {
+		if (e->trigger > TIMER_TRIGGER_ENUM_MAX)
+			return 0;
+		return next_solar_event_time(e, after);
+	}
+
+	/* Start from the next second */
+	next = after + 1;
+	localtime_r(&next, &t);
+
+	/* Check if current hour repeats (end of DST) */
+	c = t;
+	c.tm_isdst = 0;
+	repeat = (t.tm_isdst > 0 && mktime(&c) != (time_t)-1
+		&& c.tm_hour == t.tm_hour && c.tm_min == t.tm_min);
+
+	/* Check if previous hour was skipped (start of DST), events during
+	   the skipped hour fire after it (see local_time_to_time_t()) */
+	first_hour = t.tm_hour;
+	hour_ago = next - 3600;
+	localtime_r(&hour_ago, &c);
+	if (c.tm_isdst < t.tm_isdst)
+		first_hour = (c.tm_mday == t.tm_mday ? c.tm_hour + 1 : 0);
+
+	for (day = 0; day < 8; day++) {
+		if (e->wday == 0 || (e->wday & (1 << t.tm_wday))) {
+			for (hour = first_hour; hour < 24; hour++) {
+				if (e->hour >= 0 && e->hour != hour)
+					continue;
+				/* Earlier minute of current hour can still match,
+				   if the hour repeats */
+				min = (hour == t.tm_hour && e->minute < 0 && !repeat ? t.tm_min : 0);
+				best = 0;
+				for (; min < 60; min++) {
+					if (e->minute >= 0 && e->minute != min)
+						continue;
+					c = t;
+					c.tm_hour = hour;
+					c.tm_min = min;
+					c.tm_sec = e->second;
+					next = local_time_to_time_t(&c, after);
+					if (next <= after)
+						continue;
+					if (best == 0 || next < best)
+						best = next;
+					/* During repeating hour any minute may occur first */
+					if (hour != t.tm_hour || !repeat)
+						break;
+				}
+				if (best > 0)
+					return best;
+			}
+		}
+		/* Move to beginning of next day */
+		t.tm_mday++;
+		t.tm_hour = 0;
+		t.tm_min = 0;
+		t.tm_sec = 0;
+		t.tm_isdst = -1;
+		if (mktime(&t) == (time_t)-1)
 			return 0;
+		first_hour = 0;
+		repeat = false;
+	}
+
+	return 0;
+}
+
+
+/* Find most recent time (at or before time 'before') when timer event
+   fired. Returns 0 if event has not fired during the past week.
+
+   Search starts from a short window that is grown until an occurrence
+   is found, so only few occurrences need to be stepped through even
+   for frequently firing events. */
+time_t prev_timer_event_time(const struct timer_event *e, time_t before)
+{
+	static const time_t windows[] = { 60, 3600, 86400, 9 * 86400 };
+	time_t t, next;
+
+	if (!e)
+		return 0;
+
+	for (int i = 0; i < sizeof(windows) / sizeof(windows[0]); i++) {
+		t = next_timer_event_time(e, before - windows[i]);
+		if (t == 0 || t > before)
+			continue;
+		while ((next = next_timer_event_time(e, t)) > 0 && next <= before)
+			t = next;
+		return t;
+	}
+
+	return 0;
+}
+
+
+/* Timer event schedule: min-heap of next fire times of all events. */
+
+struct timer_schedule_entry {
+	time_t when;
+	uint16_t idx;
+};
+
+static struct timer_schedule_entry timer_schedule[MAX_EVENT_COUNT];
+static uint timer_schedule_count = 0;
+static bool timer_schedule_valid = false;
+static bool timer_catchup_pending = true;
+static time_t timer_schedule_expires = 0;
+static absolute_time_t timer_deadline;
+
+#define CLOCK_TICK_MAX_US 10000
+
+/* RTC to system timer anchor: system time when RTC second clock_anchor_sec
+   started. RTC on RP2040 has only 1 second resolution (tv_nsec is always 0),
+   so anchor is established when RTC is set, or by watching RTC seconds
+   tick over. */
+static time_t clock_anchor_sec = 0;
+static absolute_time_t clock_anchor_t;
+static time_t clock_last_sec = 0;
+static absolute_time_t clock_last_t;
+
+
+static void timer_schedule_sift_down(uint i)
+{
+	struct timer_schedule_entry tmp;
+	uint child;
+
+	while ((child = 2 * i + 1) < timer_schedule_count) {
+		if (child + 1 < timer_schedule_count
+			&& timer_schedule[child + 1].when < timer_schedule[child].when)
+			child++;
+		if (timer_schedule[i].when <= timer_schedule[child].when)
+			break;
+		tmp = timer_schedule[i];
+		timer_schedule[i] = timer_schedule[child];
+		timer_schedule[child] = tmp;
+		i = child;
+	}
+}
+
+static void timer_schedule_build(const struct brickpico_config *conf, time_t t_now)
+{
+	time_t next;
+
+	set_solar_location(conf->latitude, conf->longitude);
+	timer_schedule_count = 0;
+	timer_schedule_expires = 0;
+	for (int i = 0; i < conf->event_count && i < MAX_EVENT_COUNT; i++) {
+		/* Event scheduled for current second still fires */
+		if ((next = next_timer_event_time(&conf->events[i], t_now - 1)) == 0) {
+			/* Sun event may not occur for a while (polar regions),
+			   check again tomorrow */
+			if (conf->events[i].trigger != TRIGGER_TIME)
+				timer_schedule_expires = t_now + 86400;
+			continue;
+		}
+		timer_schedule[timer_schedule_count].when = next;
+		timer_schedule[timer_schedule_count].idx = i;
+		timer_schedule_count++;
+	}
+	for (int i = timer_schedule_count / 2 - 1; i >= 0; i--)
+		timer_schedule_sift_down(i);
+
+	timer_schedule_valid = true;
+	log_msg(LOG_INFO, "Timer schedule updated: %u events", timer_schedule_count);
+}
+
+static void timer_clock_anchor(const struct timespec *ts, absolute_time_t t)
+{
+	uint64_t us = to_us_since_boot(t);
+	uint64_t ns_us = ts->tv_nsec / 1000;
+
+	clock_anchor_t = from_us_since_boot(us > ns_us ? us - ns_us : 0);
+	clock_anchor_sec = ts->tv_sec;
+	clock_last_sec = ts->tv_sec;
+	clock_last_t = t;
+}
+
+/* Check RTC time against the anchor, re-anchor when RTC second is seen
+   ticking over (or sub-second time is available). */
+static void timer_clock_check(const struct timespec *ts, absolute_time_t t)
+{
+	int64_t elapsed;
+	bool tick = (ts->tv_sec == clock_last_sec + 1
+		&& absolute_time_diff_us(clock_last_t, t) < CLOCK_TICK_MAX_US);
+
+	clock_last_sec = ts->tv_sec;
+	clock_last_t = t;
+
+	if (clock_anchor_sec > 0) {
+		elapsed = absolute_time_diff_us(clock_anchor_t, t);
+		if (elapsed >= 0 && clock_anchor_sec + elapsed / 1000000 == ts->tv_sec)
+			return;
+		/* RTC was changed (or has drifted), anchor is no longer valid */
+		clock_anchor_sec = 0;
+	}
+
+	/* While there is no anchor, RTC is polled on every main loop pass,
+	   so second tick over is seen within one pass */
+	if (ts->tv_nsec > 0 || tick)
+		timer_clock_anchor(ts, t);
+}
+
+static void timer_schedule_set_deadline()
+{
+	time_t next;
+	int64_t delay;
+
+	if (timer_schedule_count > 0)
+		next = timer_schedule[0].when;
+	else
+		next = timer_schedule_expires;
+	if (timer_schedule_expires > 0 && timer_schedule_expires < next)
+		next = timer_schedule_expires;
+	if (next == 0) {
+		timer_deadline = at_the_end_of_time;
+		return;
+	}
+
+	delay = (int64_t)(next - clock_anchor_sec) * 1000000;
+	timer_deadline = delayed_by_us(clock_anchor_t, (delay > 0 ? delay : 0));
+}
+
+
+/* Set system clock (RTC). */
+void set_timer_clock(const struct timespec *ts)
+{
+	if (aon_timer_is_running()) {
+		aon_timer_set_time(ts);
+	} else {
+		aon_timer_start(ts);
+	}
+	/* RTC starts counting the new second when it is set */
+	timer_clock_anchor(ts, get_absolute_time());
+	timer_schedule_valid = false;
+}
+
+
+/* Force timer schedule to be recalculated (after configuration change,
+   clock or timezone change). */
+void reschedule_timer_events()
+{
+	timer_schedule_valid = false;
+}
+
+/* Request output states to be reconstructed from the timer events that
+   (would) have fired before current time (after clock has been set). */
+void catchup_timer_events()
+{
+	timer_catchup_pending = true;
+	timer_schedule_valid = false;
+}
+
+
+/* Effect set by timer is kept in (runtime) output state, so that it
+   does not end up in saved configuration. */
+static void set_timer_effect(struct brickpico_state *state, int out,
+			const struct timer_event *e)
+{
+	void *ctx = effect_parse_args(e->effect, e->effect_args);
 
-	return 1;
+	if (e->effect != EFFECT_NONE && !ctx) {
+		log_msg(LOG_WARNING, "timer_event: invalid effect parameters: %s",
+			e->effect_args);
+		return;
+	}
+	/* core1 may still be using the old context */
+	retire_effect_ctx(state->effect_ctx[out]);
+	state->effect[out] = e->effect;
+	state->effect_ctx[out] = ctx;
+	state->timer_effect[out] = 1;
+}
+
+static void run_timer_action(struct brickpico_state *state, const struct timer_event *e, int out)
+{
+	switch (e->action) {
+	case ACTION_ON:
+		state->pwr[out] = 1;
+		break;
+	case ACTION_OFF:
+		state->pwr[out] = 0;
+		break;
+	case ACTION_PWM:
+		state->pwm[out] = e->pwm;
+		break;
+	case ACTION_RAMP:
+		/* Ramp itself is run by core1 (from the current output level) */
+		state->pwm[out] = e->pwm;
+		state->pwr[out] = 1;
+		start_output_ramp(out, (uint32_t)e->duration * 1000);
+		break;
+	case ACTION_EFFECT:
+		set_timer_effect(state, out, e);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Apply latest past event of each output (in the order events fired),
+   instead of waiting for the next events to fire. */
+static int timer_catchup(const struct brickpico_config *conf, struct brickpico_state *state,
+			time_t t_now)
+{
+	struct timer_schedule_entry past[MAX_EVENT_COUNT], tmp;
+	const struct timer_event *e;
+	int ramp[OUTPUT_MAX_COUNT], effect[OUTPUT_MAX_COUNT];
+	time_t when;
+	int count = 0;
+	int i, j, o;
+
+	/* Find last occurrence of each event, events due at current second
+	   are handled by the schedule */
+	for (i = 0; i < conf->event_count && i < MAX_EVENT_COUNT; i++) {
+		if ((when = prev_timer_event_time(&conf->events[i], t_now - 1)) == 0)
+			continue;
+		past[count].when = when;
+		past[count].idx = i;
+		count++;
+	}
+
+	/* Sort by time (keep configuration order for events at same time) */
+	for (i = 1; i < count; i++) {
+		tmp = past[i];
+		for (j = i; j > 0 && past[j - 1].when > tmp.when; j--)
+			past[j] = past[j - 1];
+		past[j] = tmp;
+	}
+
+	/* Single pass over events, later events override earlier ones */
+	for (o = 0; o < OUTPUT_COUNT; o++) {
+		ramp[o] = -1;
+		effect[o] = -1;
+	}
+	for (i = 0; i < count; i++) {
+		e = &conf->events[past[i].idx];
+		for (o = 0; o < OUTPUT_COUNT; o++) {
+			if (!(e->mask & (1 << o)))
+				continue;
+			switch (e->action) {
+			case ACTION_ON:
+				state->pwr[o] = 1;
+				break;
+			case ACTION_OFF:
+				state->pwr[o] = 0;
+				break;
+			case ACTION_PWM:
+				state->pwm[o] = e->pwm;
+				ramp[o] = -1;
+				break;
+			case ACTION_RAMP:
+				state->pwm[o] = e->pwm;
+				state->pwr[o] = 1;
+				ramp[o] = i;
+				break;
+			case ACTION_EFFECT:
+				effect[o] = i;
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	for (o = 0; o < OUTPUT_COUNT; o++) {
+		if (ramp[o] >= 0) {
+			/* Finish ramp that is still in progress */
+			e = &conf->events[past[ramp[o]].idx];
+			when = past[ramp[o]].when + e->duration;
+			if (when > t_now)
+				start_output_ramp(o, (uint32_t)(when - t_now) * 1000);
+		}
+		if (effect[o] >= 0)
+			set_timer_effect(state, o, &conf->events[past[effect[o]].idx]);
+	}
+
+	log_msg(LOG_NOTICE, "Timer catch-up: applied %d past events", count);
+
+	return count;
 }
 
 int handle_timer_events(const struct brickpico_config *conf, struct brickpico_state *state)
 {
-	static time_t lastevent[MAX_EVENT_COUNT];
-	static uint8_t initialized = 0;
-	char tmp[32];
-	struct tm t;
-	time_t t_now;
+	const struct timer_event *e;
+	struct timespec ts;
+	absolute_time_t t;
+	char tmp[32], action[64];
+	time_t t_now, when;
 	int res = 0;
 	int i, o;
 
 
-	if (!initialized) {
-		for (i = 0; i < MAX_EVENT_COUNT; i++) {
-			lastevent[i] = 0;
-		}
-		initialized = 1;
-	}
+	if (timer_schedule_valid && clock_anchor_sec > 0 && !time_reached(timer_deadline))
+		return 0;
 
 	/* Get current time from RTC */
-	if (!rtc_get_time(&t_now))
+	if (!aon_timer_is_running()) {
+		timer_schedule_valid = false;
 		return -1;
-	localtime_r(&t_now, &t);
+	}
+	t = get_absolute_time();
+	aon_timer_get_time(&ts);
+	t_now = ts.tv_sec;
+	timer_clock_check(&ts, t);
+
+	if (!timer_schedule_valid
+		|| (timer_schedule_expires > 0 && t_now >= timer_schedule_expires))
+		timer_schedule_build(conf, t_now);
+
+	if (timer_catchup_pending) {
+		timer_catchup_pending = false;
+		res += timer_catchup(conf, state, t_now);
+	}
 
-	/* Check if any of the timer events match current RTC time... */
-	for (i = 0; i < conf->event_count; i++) {
-		const struct timer_event *e = &conf->events[i];
-
-		if (t_now < lastevent[i] + 60)
-			continue;
-		if (!check_timer_event(e, &t))
-			continue;
+	/* Fire all events that are due... */
+	while (timer_schedule_count > 0 && timer_schedule[0].when <= t_now) {
+		when = timer_schedule[0].when;
+		i = timer_schedule[0].idx;
+		e = &conf->events[i];
 
 		log_msg(LOG_NOTICE,"timer_event[%d]: outputs=%s, action=%s, time=%s",
 			i + 1,
 			bitmask_to_str(e->mask, OUTPUT_COUNT, 1, true),
-			timer_action_type_str(e->action),
-			time_t_to_str(tmp, sizeof(tmp), t_now));
+			timer_action_str(e, action, sizeof(action)),
+			time_t_to_str(tmp, sizeof(tmp), when));
 
 		for (o = 0; o < OUTPUT_COUNT; o++) {
-			if (e->mask & (1 << o)) {
-				state->pwr[o] = (e->action == ACTION_ON ? 1 : 0);
-			}
+			if (e->mask & (1 << o))
+				run_timer_action(state, e, o);
 		}
-
-		lastevent[i] = t_now;
 		res++;
+
+		/* Schedule next occurrence of the event */
+		if ((when = next_timer_event_time(e, t_now)) > 0) {
+			timer_schedule[0].when = when;
+		} else {
+			timer_schedule[0] = timer_schedule[--timer_schedule_count];
+		}
+		timer_schedule_sift_down(0);
 	}
 
+	if (clock_anchor_sec > 0)
+		timer_schedule_set_deadline();
+
 	return res;
 }
 
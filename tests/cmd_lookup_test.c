@@ -0,0 +1,418 @@
+/* cmd_lookup_test.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Host test for the command lookup index: command tables (struct cmd_t)
+   are read from src/command.c (with or without WIFI_SUPPORT), and every
+   command, its abbreviations, case variations and near-misses (plus all
+   short strings) are resolved at every level of the command tree with
+   both the lookup index and the linear search (find_cmd() with no index).
+   Results must be identical, and every level must be covered by the index.
+
+   When built with CMD_LOOKUP_BENCHMARK defined, measures lookup time
+   of both methods over the same corpus instead. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "cmd_lookup.h"
+
+#define MAX_TABLES   128
+#define MAX_ENTRIES  64
+#define MAX_NAME_LEN 64
+
+struct table {
+	char name[MAX_NAME_LEN];
+	int count;
+	struct cmd_t *cmds;
+	char sub[MAX_ENTRIES][MAX_NAME_LEN];
+	bool visited;
+};
+
+struct corpus_item {
+	const struct cmd_t *level;
+	int lkidx;
+	char s[MAX_NAME_LEN + 8];
+};
+
+static struct table tables[MAX_TABLES];
+static int table_count = 0;
+
+static struct corpus_item *corpus = NULL;
+static int corpus_count = 0;
+static int corpus_size = 0;
+
+
+static int dummy_func(const char *cmd, const char *args, int query, char *prev_cmd)
+{
+	return 0;
+}
+
+static struct table* find_table(const char *name)
+{
+	for (int i = 0; i < table_count; i++) {
+		if (!strcmp(tables[i].name, name))
+			return &tables[i];
+	}
+	return NULL;
+}
+
+static char* trim(char *s)
+{
+	char *e;
+
+	while (isspace((unsigned char)*s))
+		s++;
+	e = s + strlen(s);
+	while (e > s && isspace((unsigned char)e[-1]))
+		*--e = 0;
+	return s;
+}
+
+
+/* Read command tables from source file. Conditional blocks depending on
+   WIFI_SUPPORT are included only if wifi is set, other conditional blocks
+   are always included. */
+static int parse_tables(const char *filename, bool wifi)
+{
+	char line[512], name[MAX_NAME_LEN], cmd[MAX_NAME_LEN], sub[MAX_NAME_LEN], func[MAX_NAME_LEN];
+	bool active[32];
+	bool wifi_cond[32];
+	int depth = 0;
+	struct table *t = NULL;
+	FILE *fp;
+	int n, min;
+
+	if (!(fp = fopen(filename, "r"))) {
+		perror(filename);
+		return -1;
+	}
+	active[0] = true;
+
+	while (fgets(line, sizeof(line), fp)) {
+		char *l = trim(line);
+
+		if (*l == '#') {
+			l = trim(l + 1);
+			if (!strncmp(l, "if", 2)) {
+				bool w = (strstr(l, "WIFI_SUPPORT") != NULL);
+				bool neg = !strncmp(l, "ifndef", 6);
+
+				if (depth >= 31)
+					break;
+				depth++;
+				wifi_cond[depth] = w;
+				active[depth] = active[depth - 1] && (!w || (neg ? !wifi : wifi));
+			} else if (!strncmp(l, "else", 4) && depth > 0) {
+				if (wifi_cond[depth])
+					active[depth] = active[depth - 1] && !active[depth];
+			} else if (!strncmp(l, "endif", 5) && depth > 0) {
+				depth--;
+			}
+			continue;
+		}
+		if (!active[depth])
+			continue;
+
+		if (!t) {
+			if (sscanf(l, "const struct cmd_t %63[a-zA-Z0-9_][] = {", name) == 1
+				&& strstr(l, "[] = {")) {
+				if (table_count >= MAX_TABLES) {
+					printf("too many tables\n");
+					return -1;
+				}
+				t = &tables[table_count++];
+				strcpy(t->name, name);
+				t->cmds = calloc(MAX_ENTRIES + 1, sizeof(struct cmd_t));
+			}
+			continue;
+		}
+
+		if (!strncmp(l, "};", 2)) {
+			t = NULL;
+			continue;
+		}
+		if (sscanf(l, "{ \"%63[^\"]\" , %d , %63[a-zA-Z0-9_] , %63[a-zA-Z0-9_] }",
+				cmd, &min, sub, func) == 4) {
+			if (t->count >= MAX_ENTRIES) {
+				printf("%s: too many entries\n", t->name);
+				return -1;
+			}
+			n = t->count++;
+			t->cmds[n].cmd = strdup(cmd);
+			t->cmds[n].min_match = min;
+			t->cmds[n].func = (strcmp(func, "NULL") ? dummy_func : NULL);
+			strcpy(t->sub[n], sub);
+		}
+	}
+	fclose(fp);
+
+	/* Resolve subcommand tables */
+	for (int i = 0; i < table_count; i++) {
+		t = &tables[i];
+		for (int j = 0; j < t->count; j++) {
+			struct table *s;
+
+			if (!strcmp(t->sub[j], "NULL"))
+				continue;
+			if (!(s = find_table(t->sub[j]))) {
+				printf("%s: unknown subcommand table: %s\n", t->name, t->sub[j]);
+				return -1;
+			}
+			t->cmds[j].subcmds = s->cmds;
+		}
+	}
+
+	return table_count;
+}
+
+
+static void add_corpus(const struct cmd_t *level, int lkidx, const char *s)
+{
+	struct corpus_item *c;
+
+	if (corpus_count >= corpus_size) {
+		corpus_size = (corpus_size ? corpus_size * 2 : 4096);
+		corpus = realloc(corpus, corpus_size * sizeof(struct corpus_item));
+	}
+	c = &corpus[corpus_count++];
+	c->level = level;
+	c->lkidx = lkidx;
+	snprintf(c->s, sizeof(c->s), "%s", s);
+}
+
+static void add_variants(const struct cmd_t *level, int lkidx, const char *name, int min)
+{
+	static const char *suffixes[] = { "1", "16", "?", "x" };
+	char s[MAX_NAME_LEN + 8];
+	int len = strlen(name);
+
+	for (int k = 1; k <= len; k++) {
+		/* Abbreviations (and too short ones), in original, upper and lower case */
+		snprintf(s, sizeof(s), "%.*s", k, name);
+		add_corpus(level, lkidx, s);
+		for (int i = 0; i < k; i++)
+			s[i] = toupper((unsigned char)s[i]);
+		add_corpus(level, lkidx, s);
+		for (int i = 0; i < k; i++)
+			s[i] = tolower((unsigned char)s[i]);
+		add_corpus(level, lkidx, s);
+	}
+
+	for (int i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+		snprintf(s, sizeof(s), "%s%s", name, suffixes[i]);
+		add_corpus(level, lkidx, s);
+	}
+
+	/* Near-misses: one character changed within min_match */
+	for (int i = 0; i < min && i < len; i++) {
+		snprintf(s, sizeof(s), "%s", name);
+		s[i] = (s[i] == 'Z' || s[i] == 'z' ? 'A' : s[i] + 1);
+		add_corpus(level, lkidx, s);
+	}
+}
+
+static void add_short_strings(const struct cmd_t *level, int lkidx)
+{
+	static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ*?1";
+	int n = strlen(chars);
+	char s[4];
+
+	for (int a = 0; a < n; a++) {
+		s[0] = chars[a];
+		s[1] = 0;
+		add_corpus(level, lkidx, s);
+		for (int b = 0; b < n; b++) {
+			s[1] = chars[b];
+			s[2] = 0;
+			add_corpus(level, lkidx, s);
+			for (int c = 0; c < n; c++) {
+				s[2] = chars[c];
+				s[3] = 0;
+				add_corpus(level, lkidx, s);
+			}
+		}
+	}
+}
+
+static int build_corpus(const struct cmd_t *level, const char *path)
+{
+	struct table *t = NULL;
+	int lkidx = get_cmd_lookup(level);
+	int fails = 0;
+	char sub_path[256];
+
+	for (int i = 0; i < table_count; i++) {
+		if (tables[i].cmds == level)
+			t = &tables[i];
+	}
+	if (!t || t->visited)
+		return 0;
+	t->visited = true;
+
+	if (lkidx < 0) {
+		printf("%s (%s): level not in lookup index\n", path, t->name);
+		fails++;
+	}
+
+	add_short_strings(level, lkidx);
+	for (int i = 0; level[i].cmd; i++) {
+		add_variants(level, lkidx, level[i].cmd, level[i].min_match);
+		if (level[i].subcmds) {
+			snprintf(sub_path, sizeof(sub_path), "%s:%s", path, level[i].cmd);
+			fails += build_corpus(level[i].subcmds, sub_path);
+		}
+	}
+
+	return fails;
+}
+
+/* Resolve full command paths (as run_cmd() does) with both methods. */
+static int check_paths(const struct cmd_t *level, int lkidx, const char *path, int depth,
+		int *tests)
+{
+	char sub_path[256];
+	int fails = 0;
+
+	if (depth > 8)
+		return 0;
+
+	for (int i = 0; level[i].cmd; i++) {
+		const struct cmd_t *c1, *c2;
+		int idx1 = lkidx;
+		int idx2 = -1;
+
+		snprintf(sub_path, sizeof(sub_path), "%s:%s", path, level[i].cmd);
+		c1 = find_cmd(level, &idx1, level[i].cmd);
+		c2 = find_cmd(level, &idx2, level[i].cmd);
+		(*tests)++;
+		if (c1 != c2 || !c1) {
+			printf("%s: lookup mismatch (%s vs %s)\n", sub_path,
+				(c1 ? c1->cmd : "none"), (c2 ? c2->cmd : "none"));
+			fails++;
+			continue;
+		}
+		if (c1 != &level[i])
+			printf("%s: shadowed by %s\n", sub_path, c1->cmd);
+		if (c1->subcmds) {
+			if (idx1 != get_cmd_lookup(c1->subcmds)) {
+				printf("%s: wrong lookup index for subcommands\n", sub_path);
+				fails++;
+			}
+			fails += check_paths(c1->subcmds, idx1, sub_path, depth + 1, tests);
+		}
+	}
+
+	return fails;
+}
+
+
+#ifdef CMD_LOOKUP_BENCHMARK
+
+static double bench(bool indexed, int rounds, long *found)
+{
+	struct timespec t0, t1;
+	long f = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < corpus_count; i++) {
+			int lkidx = (indexed ? corpus[i].lkidx : -1);
+
+			if (find_cmd(corpus[i].level, &lkidx, corpus[i].s))
+				f++;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	*found = f;
+
+	return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec))
+		/ ((double)rounds * corpus_count);
+}
+
+#endif
+
+int main(int argc, char **argv)
+{
+	struct table *root;
+	bool wifi = (argc > 2 && !strcmp(argv[2], "wifi"));
+	int fails = 0;
+	int tests = 0;
+
+	if (argc < 2) {
+		printf("usage: %s <command.c> [wifi]\n", argv[0]);
+		return 2;
+	}
+	if (parse_tables(argv[1], wifi) < 1 || !(root = find_table("commands"))) {
+		printf("%s: failed to read command tables\n", argv[1]);
+		return 1;
+	}
+
+	cmd_lookup_init(root->cmds);
+	fails += build_corpus(root->cmds, "");
+
+#ifdef CMD_LOOKUP_BENCHMARK
+	{
+		long f1, f2;
+		int rounds = 100;
+		double linear = bench(false, rounds, &f1);
+		double indexed = bench(true, rounds, &f2);
+
+		printf("corpus: %d lookups (%s), %ld matches\n", corpus_count,
+			(wifi ? "wifi" : "no wifi"), f1 / rounds);
+		printf("%16s %16s\n", "linear ns", "indexed ns");
+		printf("%16.1f %16.1f\n", linear, indexed);
+		return (f1 != f2 ? 1 : 0);
+	}
+#endif
+
+	for (int i = 0; i < corpus_count; i++) {
+		const struct corpus_item *c = &corpus[i];
+		const struct cmd_t *c1, *c2;
+		int idx1 = c->lkidx;
+		int idx2 = -1;
+
+		c1 = find_cmd(c->level, &idx1, c->s);
+		c2 = find_cmd(c->level, &idx2, c->s);
+		tests++;
+		if (c1 != c2) {
+			printf("'%s': indexed lookup %s, linear lookup %s\n", c->s,
+				(c1 ? c1->cmd : "none"), (c2 ? c2->cmd : "none"));
+			fails++;
+		} else if (c1 && c1->subcmds && idx1 != get_cmd_lookup(c1->subcmds)) {
+			printf("'%s': wrong lookup index for subcommands\n", c->s);
+			fails++;
+		}
+	}
+
+	fails += check_paths(root->cmds, get_cmd_lookup(root->cmds), "", 0, &tests);
+
+	printf("cmd_lookup: %d tables%s, %d tests, %d failures\n", table_count,
+		(wifi ? " (wifi)" : ""), tests, fails);
+
+	return (fails > 0 ? 1 : 0);
+}
+
+
+/* eof :-) */
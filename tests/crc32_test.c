@@ -0,0 +1,156 @@
+/* crc32_test.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Host test for xcrc32_fast() (slice-by-8 implementation on host builds):
+   results must be identical to xcrc32(), for any buffer length,
+   alignment and initial value.
+
+   When built with CRC32_BENCHMARK defined, measures throughput
+   of both implementations instead. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "crc32.h"
+
+#define BUF_SIZE (64 * 1024)
+
+
+static unsigned char buf[BUF_SIZE + 8];
+
+
+#ifdef CRC32_BENCHMARK
+
+static double bench(unsigned int (*f)(const unsigned char*, int, unsigned int),
+		int len, unsigned int *crc)
+{
+	struct timespec t0, t1;
+	unsigned int c = 0xffffffff;
+	int rounds = (256 * 1024 * 1024) / len;
+	double t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int i = 0; i < rounds; i++)
+		c = f(buf, len, c);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	*crc = c;
+
+	return (double)rounds * len / t / (1024 * 1024);
+}
+
+int main(int argc, char **argv)
+{
+	static const int lens[] = { 16, 64, 256, 4096, BUF_SIZE };
+	unsigned int c1, c2;
+
+	for (int i = 0; i < BUF_SIZE; i++)
+		buf[i] = rand();
+
+	printf("%8s %16s %16s\n", "len", "xcrc32 MB/s", "xcrc32_fast MB/s");
+	for (int i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		double a = bench(xcrc32, lens[i], &c1);
+		double b = bench(xcrc32_fast, lens[i], &c2);
+
+		printf("%8d %16.1f %16.1f%s\n", lens[i], a, b, (c1 != c2 ? "  MISMATCH" : ""));
+	}
+
+	return 0;
+}
+
+#else
+
+int main(int argc, char **argv)
+{
+	const unsigned char *check = (const unsigned char *)"123456789";
+	unsigned int a, b, init;
+	int fails = 0;
+	int tests = 0;
+
+	srand(12345);
+	crc32_setup();
+
+	/* CRC-32/MPEG-2 check value */
+	if ((a = xcrc32_fast(check, 9, 0xffffffff)) != 0x0376e6e7) {
+		printf("check value mismatch: 0x%08x\n", a);
+		fails++;
+	}
+
+	for (int i = 0; i < BUF_SIZE + 8; i++)
+		buf[i] = rand();
+
+	/* All short lengths and alignments */
+	for (int len = 0; len <= 256; len++) {
+		for (int ofs = 0; ofs < 8; ofs++) {
+			init = (len & 1 ? 0xffffffff : (unsigned int)rand());
+			a = xcrc32(buf + ofs, len, init);
+			b = xcrc32_fast(buf + ofs, len, init);
+			tests++;
+			if (a != b) {
+				printf("mismatch: len=%d offset=%d init=0x%08x: 0x%08x != 0x%08x\n",
+					len, ofs, init, a, b);
+				fails++;
+			}
+		}
+	}
+
+	/* Random lengths, alignments and initial values */
+	for (int i = 0; i < 10000; i++) {
+		int len = rand() % (BUF_SIZE + 1);
+		int ofs = rand() % 8;
+
+		init = rand() ^ ((unsigned int)rand() << 16);
+		a = xcrc32(buf + ofs, len, init);
+		b = xcrc32_fast(buf + ofs, len, init);
+		tests++;
+		if (a != b) {
+			printf("mismatch: len=%d offset=%d init=0x%08x: 0x%08x != 0x%08x\n",
+				len, ofs, init, a, b);
+			fails++;
+		}
+	}
+
+	/* Calculating in pieces must give same result */
+	for (int i = 0; i < 1000; i++) {
+		int len = rand() % (BUF_SIZE + 1);
+		int split = (len > 0 ? rand() % len : 0);
+
+		a = xcrc32(buf, len, 0xffffffff);
+		b = xcrc32_fast(buf + split, len - split, xcrc32_fast(buf, split, 0xffffffff));
+		tests++;
+		if (a != b) {
+			printf("mismatch: len=%d split=%d: 0x%08x != 0x%08x\n", len, split, a, b);
+			fails++;
+		}
+	}
+
+	printf("crc32: %d tests, %d failures\n", tests, fails);
+
+	return (fails > 0 ? 1 : 0);
+}
+
+#endif
+
+
+/* eof :-) */
@@ -0,0 +1,128 @@
+/* dither_test.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Host test for PWM dithering frame generation: for every level (integer
+   part n and fractional part f) reachable with given PWM TOP value and
+   lightness map precision (map_bits), average over the dithering frames
+   must equal the fractional level, and frames may only use the two
+   adjacent levels n and n + 1 (never above TOP + 1). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "dither.h"
+
+
+static int check_levels(uint32_t top, uint8_t map_bits, uint32_t fx)
+{
+	uint32_t levels[PWM_DITHER_FRAMES];
+	uint32_t n = fx >> PWM_DITHER_BITS;
+	uint32_t f = fx & PWM_DITHER_MASK;
+	uint32_t sum = 0;
+	int fails = 0;
+
+	pwm_dither_levels(fx, levels);
+	for (int k = 0; k < PWM_DITHER_FRAMES; k++) {
+		sum += levels[k];
+		if (levels[k] != n && levels[k] != n + 1) {
+			printf("top=%u map_bits=%u n=%u f=%u: frame %d level %u not adjacent\n",
+				top, map_bits, n, f, k, levels[k]);
+			fails++;
+		}
+		if (levels[k] > top + 1) {
+			printf("top=%u map_bits=%u n=%u f=%u: frame %d level %u above TOP\n",
+				top, map_bits, n, f, k, levels[k]);
+			fails++;
+		}
+	}
+	if (sum != fx) {
+		printf("top=%u map_bits=%u n=%u f=%u: frame average %u/%u != level %u/%u\n",
+			top, map_bits, n, f, sum, PWM_DITHER_FRAMES, fx, PWM_DITHER_FRAMES);
+		fails++;
+	}
+
+	return fails;
+}
+
+static int check_top(uint32_t top, int *tests)
+{
+	uint8_t map_bits = pwm_dither_map_bits(top);
+	uint32_t max = top << map_bits;
+	int fails = 0;
+
+	if (max > 0xffff || (map_bits < PWM_DITHER_BITS && (top << (map_bits + 1)) <= 0xffff)) {
+		printf("top=%u: invalid map_bits %u\n", top, map_bits);
+		fails++;
+	}
+
+	/* All integer and fractional parts */
+	for (uint32_t n = 0; n <= top; n++) {
+		for (uint32_t f = 0; f < PWM_DITHER_FRAMES; f++) {
+			if (n == top && f > 0)
+				break;
+			fails += check_levels(top, map_bits, (n << PWM_DITHER_BITS) | f);
+			(*tests)++;
+		}
+	}
+
+	/* All lightness map values */
+	for (uint32_t v = 0; v <= max; v++) {
+		uint32_t fx = pwm_dither_map_level(v, map_bits);
+		/* Expected: v / 2^map_bits rounded to nearest 1/PWM_DITHER_FRAMES */
+		uint64_t exact = ((uint64_t)v << (PWM_DITHER_BITS + 1)) >> map_bits;
+
+		if (fx != (exact + 1) / 2 || fx > (top << PWM_DITHER_BITS)) {
+			printf("top=%u map_bits=%u: map value %u -> level %u/%u\n",
+				top, map_bits, v, fx, PWM_DITHER_FRAMES);
+			fails++;
+		}
+		fails += check_levels(top, map_bits, fx);
+		(*tests)++;
+	}
+
+	return fails;
+}
+
+int main(int argc, char **argv)
+{
+	static const uint32_t tops[] = {
+		624, 1249, 2499, 3124, 4095, 4096, 6249, 8191, 12499,
+		16383, 16384, 31249, 32767, 32768, 62499, 65535
+	};
+	int fails = 0;
+	int tests = 0;
+
+	/* Small TOP values (all map_bits) */
+	for (uint32_t top = 1; top <= 1024; top++)
+		fails += check_top(top, &tests);
+
+	/* TOP values around map_bits boundaries and typical PWM frequencies */
+	for (int i = 0; i < sizeof(tops) / sizeof(tops[0]); i++)
+		fails += check_top(tops[i], &tests);
+
+	printf("dither: %d tests, %d failures\n", tests, fails);
+
+	return (fails > 0 ? 1 : 0);
+}
+
+
+/* eof :-) */
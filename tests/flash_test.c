@@ -0,0 +1,258 @@
+/* flash_test.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Host test for flash.c filesystem functions, using an in-memory stand-in
+   for littlefs (tests/host/lfs_host.c): filesystem must get mounted only
+   once, and results through the file metadata (stat) cache must always
+   match the filesystem contents, also after writes, deletes, renames,
+   copies and format. Number of littlefs operations is checked for
+   repeated lookups that should be served from the cache. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "brickpico.h"
+#include "pico_lfs.h"
+
+#define FILES 20   /* more than stat cache entries */
+
+
+char __flash_binary_start;
+char __flash_binary_end;
+
+static int fails = 0;
+static int tests = 0;
+
+
+void log_msg(int priority, const char *format, ...)
+{
+}
+
+char *strncopy(char *dst, const char *src, size_t size)
+{
+	if (!dst || !src || size < 1)
+		return dst;
+	if (size > 1)
+		strncpy(dst, src, size - 1);
+	dst[size - 1] = 0;
+	return dst;
+}
+
+char *strncatenate(char *dst, const char *src, size_t size)
+{
+	size_t used = strnlen(dst, size);
+
+	if (used + 1 < size)
+		strncopy(dst + used, src, size - used);
+	return dst;
+}
+
+
+#define CHECK(cond, ...) do {					\
+		tests++;					\
+		if (!(cond)) {					\
+			printf("%s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);			\
+			printf("\n");				\
+			fails++;				\
+		}						\
+	} while (0)
+
+
+/* Check file size and contents (expected size -2 = file does not exist). */
+static void check_file(const char *name, int expected, char fill)
+{
+	char *buf;
+	uint32_t size;
+	int res, size_res;
+
+	size_res = flash_file_size(name);
+	CHECK(size_res == expected, "%s: size %d, expected %d", name, size_res, expected);
+
+	res = flash_read_file(&buf, &size, name);
+	if (expected < 0) {
+		CHECK(res != 0 && !buf, "%s: read returned %d, expected error", name, res);
+	} else {
+		CHECK(res == 0 && size == expected, "%s: read returned %d (%u bytes), expected %d bytes",
+			name, res, size, expected);
+		for (int i = 0; buf && i < size; i++) {
+			if (buf[i] != fill) {
+				CHECK(false, "%s: contents mismatch at %d", name, i);
+				break;
+			}
+		}
+	}
+	free(buf);
+}
+
+static int write_file(const char *name, int size, char fill)
+{
+	char *buf = malloc(size + 1);
+	int res;
+
+	memset(buf, fill, size);
+	res = flash_write_file(buf, size, name);
+	free(buf);
+	CHECK(res == 0, "%s: write failed: %d", name, res);
+	return res;
+}
+
+
+static void test_cache()
+{
+	char name[64];
+	int sizes[FILES];
+
+	/* Files exist / do not exist, lookups through full LRU cycles */
+	for (int i = 0; i < FILES; i++) {
+		snprintf(name, sizeof(name), "file%02d.txt", i);
+		sizes[i] = (i % 3 == 0 ? -2 : 10 + i * 7);
+		if (sizes[i] >= 0)
+			write_file(name, sizes[i], 'a' + i);
+	}
+	for (int round = 0; round < 3; round++) {
+		for (int i = 0; i < FILES; i++) {
+			int j = (round == 1 ? FILES - 1 - i : (i * 7) % FILES);
+
+			snprintf(name, sizeof(name), "file%02d.txt", j);
+			check_file(name, sizes[j], 'a' + j);
+		}
+	}
+
+	/* Overwrite, delete and create files (with cached entries) */
+	for (int i = 0; i < FILES; i++) {
+		snprintf(name, sizeof(name), "file%02d.txt", i);
+		flash_file_size(name);
+		if (sizes[i] < 0) {
+			sizes[i] = 100 + i;
+			write_file(name, sizes[i], 'A' + i);
+		} else if (i % 2) {
+			CHECK(flash_delete_file(name) == 0, "%s: delete failed", name);
+			sizes[i] = -2;
+		} else {
+			sizes[i] = 3 * i + 1;
+			write_file(name, sizes[i], 'A' + i);
+		}
+		check_file(name, sizes[i], (sizes[i] < 0 ? 0 : 'A' + i));
+	}
+
+	/* Rename (over existing file) */
+	flash_file_size("file00.txt");
+	flash_file_size("file02.txt");
+	CHECK(flash_rename_file("file02.txt", "file00.txt") == 0, "rename failed");
+	check_file("file02.txt", -2, 0);
+	check_file("file00.txt", sizes[2], 'A' + 2);
+	sizes[0] = sizes[2];
+	sizes[2] = -2;
+
+	/* Copy (overwrite and create) */
+	flash_file_size("copy.txt");
+	CHECK(flash_copy_file("file04.txt", "copy.txt", false) == 0, "copy failed");
+	check_file("copy.txt", sizes[4], 'A' + 4);
+	CHECK(flash_copy_file("file00.txt", "copy.txt", false) != 0, "copy did not fail");
+	CHECK(flash_copy_file("file00.txt", "copy.txt", true) == 0, "copy (overwrite) failed");
+	check_file("copy.txt", sizes[0], 'A' + 2);
+
+	/* Long filenames are not cached */
+	snprintf(name, sizeof(name), "%s", "a_very_long_filename_that_is_not_cached.txt");
+	check_file(name, -2, 0);
+	write_file(name, 5, 'x');
+	check_file(name, 5, 'x');
+
+	/* Format */
+	CHECK(flash_format(false) == 0, "format failed");
+	for (int i = 0; i < FILES; i++) {
+		snprintf(name, sizeof(name), "file%02d.txt", i);
+		check_file(name, -2, 0);
+	}
+	check_file("copy.txt", -2, 0);
+}
+
+static void test_counts()
+{
+	struct lfs_host_stats s;
+	static const char *keys[] = {
+		"ssh-ed25519.der", "ssh-ecdsa.der", "ssh-rsa.der", "cert.pem"
+	};
+	const int rounds = 100;
+	char *buf;
+	uint32_t size;
+
+	write_file("brickpico.cfg", 2000, '{');
+	flash_file_size("brickpico.cfg");
+	for (int i = 0; i < 4; i++)
+		flash_file_size(keys[i]);
+
+	/* Repeated lookups of existing and nonexistent (optional) files */
+	s = lfs_host_stats;
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < 4; i++) {
+			flash_read_file(&buf, &size, keys[i]);
+			free(buf);
+		}
+		flash_file_size("brickpico.cfg");
+	}
+	CHECK(lfs_host_stats.mount == s.mount, "filesystem remounted %u times",
+		lfs_host_stats.mount - s.mount);
+	CHECK(lfs_host_stats.stat == s.stat, "%u stat calls for cached files",
+		lfs_host_stats.stat - s.stat);
+	CHECK(lfs_host_stats.open == s.open, "%u open calls for nonexistent files",
+		lfs_host_stats.open - s.open);
+
+	/* Reading existing file */
+	s = lfs_host_stats;
+	for (int r = 0; r < rounds; r++) {
+		flash_read_file(&buf, &size, "brickpico.cfg");
+		free(buf);
+	}
+	CHECK(lfs_host_stats.mount == s.mount && lfs_host_stats.stat == s.stat
+		&& lfs_host_stats.open - s.open == rounds,
+		"read: %u mounts, %u stats, %u opens per %d reads",
+		lfs_host_stats.mount - s.mount, lfs_host_stats.stat - s.stat,
+		lfs_host_stats.open - s.open, rounds);
+}
+
+
+int main(int argc, char **argv)
+{
+	/* Filesystem is not formatted at first */
+	lfs_setup(false);
+	CHECK(lfs_host_stats.format == 1 && lfs_host_stats.mount == 2,
+		"setup: %u formats, %u mounts", lfs_host_stats.format, lfs_host_stats.mount);
+
+	test_cache();
+	test_counts();
+
+	CHECK(lfs_host_stats.mount == 3 && lfs_host_stats.unmount == 1,
+		"%u mounts, %u unmounts (expected mount at setup and after format)",
+		lfs_host_stats.mount, lfs_host_stats.unmount);
+
+	printf("flash: %d tests, %d failures (lfs calls: %u mount, %u stat, %u open)\n",
+		tests, fails, lfs_host_stats.mount, lfs_host_stats.stat, lfs_host_stats.open);
+
+	return (fails > 0 ? 1 : 0);
+}
+
+
+/* eof :-) */
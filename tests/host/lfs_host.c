@@ -0,0 +1,275 @@
+/* lfs_host.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico_lfs.h"
+
+#define HOST_FILES_MAX 32
+#define HOST_BLOCK_SIZE 4096
+
+struct host_file {
+	bool used;
+	char name[LFS_NAME_MAX + 1];
+	uint8_t *data;
+	lfs_size_t size;
+};
+
+struct lfs_host_stats lfs_host_stats;
+
+static struct pico_lfs_context host_ctx;
+static struct host_file files[HOST_FILES_MAX];
+static bool formatted = false;
+
+
+static const char* base_name(const char *path)
+{
+	while (*path == '/')
+		path++;
+	return path;
+}
+
+static int find_file(const char *path)
+{
+	path = base_name(path);
+	for (int i = 0; i < HOST_FILES_MAX; i++) {
+		if (files[i].used && !strcmp(files[i].name, path))
+			return i;
+	}
+	return -1;
+}
+
+static void delete_file(int i)
+{
+	free(files[i].data);
+	memset(&files[i], 0, sizeof(files[i]));
+}
+
+
+struct lfs_config* pico_lfs_init(uint32_t offset, uint32_t size)
+{
+	host_ctx.cfg.context = &host_ctx;
+	host_ctx.cfg.block_size = HOST_BLOCK_SIZE;
+	host_ctx.cfg.block_count = size / HOST_BLOCK_SIZE;
+
+	return &host_ctx.cfg;
+}
+
+int lfs_format(lfs_t *lfs, const struct lfs_config *cfg)
+{
+	lfs_host_stats.format++;
+	for (int i = 0; i < HOST_FILES_MAX; i++)
+		delete_file(i);
+	formatted = true;
+	return LFS_ERR_OK;
+}
+
+int lfs_mount(lfs_t *lfs, const struct lfs_config *cfg)
+{
+	lfs_host_stats.mount++;
+	if (!formatted)
+		return LFS_ERR_INVAL;
+	lfs->mounted = true;
+	return LFS_ERR_OK;
+}
+
+int lfs_unmount(lfs_t *lfs)
+{
+	lfs_host_stats.unmount++;
+	lfs->mounted = false;
+	return LFS_ERR_OK;
+}
+
+int lfs_stat(lfs_t *lfs, const char *path, struct lfs_info *info)
+{
+	int i;
+
+	lfs_host_stats.stat++;
+	if (!lfs->mounted)
+		return LFS_ERR_INVAL;
+	if (!strcmp(base_name(path), "")) {
+		info->type = LFS_TYPE_DIR;
+		info->size = 0;
+		strcpy(info->name, "/");
+		return LFS_ERR_OK;
+	}
+	if ((i = find_file(path)) < 0)
+		return LFS_ERR_NOENT;
+	info->type = LFS_TYPE_REG;
+	info->size = files[i].size;
+	strcpy(info->name, files[i].name);
+	return LFS_ERR_OK;
+}
+
+int lfs_remove(lfs_t *lfs, const char *path)
+{
+	int i;
+
+	lfs_host_stats.remove++;
+	if ((i = find_file(path)) < 0)
+		return LFS_ERR_NOENT;
+	delete_file(i);
+	return LFS_ERR_OK;
+}
+
+int lfs_rename(lfs_t *lfs, const char *oldpath, const char *newpath)
+{
+	int i, j;
+
+	lfs_host_stats.rename++;
+	if ((i = find_file(oldpath)) < 0)
+		return LFS_ERR_NOENT;
+	if ((j = find_file(newpath)) >= 0 && j != i)
+		delete_file(j);
+	strcpy(files[i].name, base_name(newpath));
+	return LFS_ERR_OK;
+}
+
+lfs_ssize_t lfs_fs_size(lfs_t *lfs)
+{
+	lfs_ssize_t blocks = 2;
+
+	for (int i = 0; i < HOST_FILES_MAX; i++) {
+		if (files[i].used)
+			blocks += (files[i].size + HOST_BLOCK_SIZE - 1) / HOST_BLOCK_SIZE;
+	}
+	return blocks;
+}
+
+
+int lfs_file_open(lfs_t *lfs, lfs_file_t *file, const char *path, int flags)
+{
+	int i;
+
+	lfs_host_stats.open++;
+	file->file = -1;
+	if (!lfs->mounted)
+		return LFS_ERR_INVAL;
+	if ((i = find_file(path)) >= 0) {
+		if ((flags & LFS_O_CREAT) && (flags & LFS_O_EXCL))
+			return LFS_ERR_EXIST;
+		if (flags & LFS_O_TRUNC) {
+			free(files[i].data);
+			files[i].data = NULL;
+			files[i].size = 0;
+		}
+	} else {
+		if (!(flags & LFS_O_CREAT))
+			return LFS_ERR_NOENT;
+		for (i = 0; i < HOST_FILES_MAX && files[i].used; i++)
+			;
+		if (i >= HOST_FILES_MAX)
+			return LFS_ERR_NOSPC;
+		files[i].used = true;
+		strncpy(files[i].name, base_name(path), LFS_NAME_MAX);
+	}
+	file->file = i;
+	file->flags = flags;
+	file->pos = 0;
+	return LFS_ERR_OK;
+}
+
+int lfs_file_close(lfs_t *lfs, lfs_file_t *file)
+{
+	file->file = -1;
+	return LFS_ERR_OK;
+}
+
+lfs_soff_t lfs_file_size(lfs_t *lfs, lfs_file_t *file)
+{
+	if (file->file < 0)
+		return LFS_ERR_INVAL;
+	return files[file->file].size;
+}
+
+lfs_ssize_t lfs_file_read(lfs_t *lfs, lfs_file_t *file, void *buffer, lfs_size_t size)
+{
+	struct host_file *f;
+
+	if (file->file < 0 || !(file->flags & LFS_O_RDONLY))
+		return LFS_ERR_INVAL;
+	f = &files[file->file];
+	if (file->pos >= f->size)
+		return 0;
+	if (size > f->size - file->pos)
+		size = f->size - file->pos;
+	memcpy(buffer, f->data + file->pos, size);
+	file->pos += size;
+	return size;
+}
+
+lfs_ssize_t lfs_file_write(lfs_t *lfs, lfs_file_t *file, const void *buffer, lfs_size_t size)
+{
+	struct host_file *f;
+	uint8_t *data;
+
+	if (file->file < 0 || !(file->flags & LFS_O_WRONLY))
+		return LFS_ERR_INVAL;
+	f = &files[file->file];
+	if (file->pos + size > f->size) {
+		if (!(data = realloc(f->data, file->pos + size)))
+			return LFS_ERR_NOMEM;
+		f->data = data;
+		f->size = file->pos + size;
+	}
+	memcpy(f->data + file->pos, buffer, size);
+	file->pos += size;
+	return size;
+}
+
+
+int lfs_dir_open(lfs_t *lfs, lfs_dir_t *dir, const char *path)
+{
+	if (strcmp(base_name(path), ""))
+		return LFS_ERR_NOENT;
+	dir->pos = 0;
+	return LFS_ERR_OK;
+}
+
+int lfs_dir_read(lfs_t *lfs, lfs_dir_t *dir, struct lfs_info *info)
+{
+	while (dir->pos < HOST_FILES_MAX) {
+		struct host_file *f = &files[dir->pos++];
+
+		if (!f->used)
+			continue;
+		info->type = LFS_TYPE_REG;
+		info->size = f->size;
+		strcpy(info->name, f->name);
+		return 1;
+	}
+	return 0;
+}
+
+int lfs_dir_rewind(lfs_t *lfs, lfs_dir_t *dir)
+{
+	dir->pos = 0;
+	return LFS_ERR_OK;
+}
+
+int lfs_dir_close(lfs_t *lfs, lfs_dir_t *dir)
+{
+	return LFS_ERR_OK;
+}
+
+
+/* eof :-) */
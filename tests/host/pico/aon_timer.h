@@ -0,0 +1,2 @@
+/* Host stand-in for Pico SDK header (see pico_host.h) */
+#include "pico_host.h"
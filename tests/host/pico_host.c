@@ -0,0 +1,80 @@
+/* pico_host.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "pico_host.h"
+
+
+static uint64_t host_time = 1000000;  /* simulated time since boot (us) */
+static uint32_t dma_claimed = 0;
+
+static pwm_hw_t host_pwm_hw;
+static dma_hw_t host_dma_hw;
+
+pwm_hw_t *pwm_hw = &host_pwm_hw;
+dma_hw_t *dma_hw = &host_dma_hw;
+
+
+void panic(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+	abort();
+}
+
+
+uint64_t time_us_64(void)
+{
+	return host_time;
+}
+
+void host_advance_us(uint64_t us)
+{
+	host_time += us;
+}
+
+
+int dma_claim_unused_channel(bool required)
+{
+	for (int i = 0; i < NUM_DMA_CHANNELS; i++) {
+		if (!(dma_claimed & (1 << i))) {
+			dma_claimed |= (1 << i);
+			return i;
+		}
+	}
+	assert(!required);
+	return -1;
+}
+
+void dma_channel_unclaim(uint channel)
+{
+	dma_claimed &= ~(1 << channel);
+}
+
+
+/* eof :-) */
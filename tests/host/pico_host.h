@@ -0,0 +1,235 @@
+/* pico_host.h
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Minimal stand-ins for the Pico SDK, for building firmware sources
+   on the host (in host tests and benchmarks). Hardware access functions
+   do nothing, and time is simulated (see host_advance_us()). */
+
+#ifndef BRICKPICO_PICO_HOST_H
+#define BRICKPICO_PICO_HOST_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+#include <time.h>
+
+typedef unsigned int uint;
+
+
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+
+void panic(const char *fmt, ...);
+
+
+/* pico/time.h */
+typedef uint64_t absolute_time_t;
+
+uint64_t time_us_64(void);
+void host_advance_us(uint64_t us);
+
+static inline uint32_t time_us_32(void) { return (uint32_t)time_us_64(); }
+static inline absolute_time_t get_absolute_time(void) { return time_us_64(); }
+static inline uint64_t to_us_since_boot(absolute_time_t t) { return t; }
+static inline absolute_time_t from_us_since_boot(uint64_t us) { return us; }
+static inline uint32_t to_ms_since_boot(absolute_time_t t) { return t / 1000; }
+static inline absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us) { return t + us; }
+static inline absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms) { return t + (uint64_t)ms * 1000; }
+static inline absolute_time_t make_timeout_time_us(uint64_t us) { return time_us_64() + us; }
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) { return time_us_64() + (uint64_t)ms * 1000; }
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) { return (int64_t)(to - from); }
+static inline bool time_reached(absolute_time_t t) { return time_us_64() >= t; }
+
+#define at_the_end_of_time ((absolute_time_t)INT64_MAX)
+
+
+/* pico/aon_timer.h (clock is never running) */
+static inline bool aon_timer_is_running(void) { return false; }
+static inline bool aon_timer_get_time(struct timespec *ts) { return false; }
+static inline bool aon_timer_set_time(const struct timespec *ts) { return false; }
+static inline bool aon_timer_start(const struct timespec *ts) { return false; }
+
+
+/* pico/stdio.h (no default implementation, tests using these provide them) */
+void stdio_put_string(const char *s, int len, bool newline, bool cr_translation);
+int stdio_get_until(char *buf, int len, absolute_time_t until);
+void stdio_flush(void);
+
+
+/* pico/sync.h */
+typedef struct { int owner; } mutex_t;
+typedef struct { int owner; int count; } recursive_mutex_t;
+typedef volatile uint32_t spin_lock_t;
+
+#define auto_init_mutex(name) mutex_t name
+#define auto_init_recursive_mutex(name) recursive_mutex_t name
+
+static inline void mutex_init(mutex_t *m) { m->owner = 0; }
+static inline void mutex_enter_blocking(mutex_t *m) { m->owner = 1; }
+static inline bool mutex_enter_timeout_ms(mutex_t *m, uint32_t ms) { m->owner = 1; return true; }
+static inline bool mutex_enter_timeout_us(mutex_t *m, uint32_t us) { m->owner = 1; return true; }
+static inline void mutex_exit(mutex_t *m) { m->owner = 0; }
+static inline void recursive_mutex_enter_blocking(recursive_mutex_t *m) { m->count++; }
+static inline void recursive_mutex_exit(recursive_mutex_t *m) { m->count--; }
+static inline uint32_t spin_lock_blocking(spin_lock_t *l) { *l = 1; return 0; }
+static inline void spin_unlock(spin_lock_t *l, uint32_t saved) { *l = 0; }
+static inline uint32_t save_and_disable_interrupts(void) { return 0; }
+static inline void restore_interrupts(uint32_t status) { }
+static inline uint get_core_num(void) { return 0; }
+
+#define NUM_CORES 2
+
+#define __dmb() __sync_synchronize()
+#define __compiler_memory_barrier() __asm__ volatile ("" : : : "memory")
+#define __not_in_flash_func(f) f
+#define __time_critical_func(f) f
+
+
+/* hardware/clocks.h */
+enum clock_index { clk_sys = 5 };
+
+static inline uint32_t clock_get_hz(enum clock_index clk) { return 125000000; }
+
+
+/* hardware/irq.h */
+typedef void (*irq_handler_t)(void);
+
+#define DMA_IRQ_0 11
+#define DMA_IRQ_1 12
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+
+static inline void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order) { }
+static inline void irq_set_enabled(uint num, bool enabled) { }
+
+
+/* hardware/gpio.h */
+#define GPIO_FUNC_PWM 4
+
+static inline void gpio_set_function(uint gpio, int fn) { }
+
+
+/* hardware/pwm.h */
+#define NUM_PWM_SLICES 8
+#define PWM_CHAN_A 0
+#define PWM_CHAN_B 1
+
+typedef struct {
+	uint32_t csr;
+	uint32_t div;
+	uint32_t top;
+} pwm_config;
+
+typedef struct {
+	volatile uint32_t csr;
+	volatile uint32_t div;
+	volatile uint32_t ctr;
+	volatile uint32_t cc;
+	volatile uint32_t top;
+} pwm_slice_hw_t;
+
+typedef struct {
+	pwm_slice_hw_t slice[NUM_PWM_SLICES];
+	volatile uint32_t en;
+} pwm_hw_t;
+
+extern pwm_hw_t *pwm_hw;
+
+static inline uint pwm_gpio_to_slice_num(uint gpio) { return (gpio >> 1) & 7; }
+static inline uint pwm_gpio_to_channel(uint gpio) { return gpio & 1; }
+static inline uint pwm_get_dreq(uint slice) { return 24 + slice; }
+static inline pwm_config pwm_get_default_config(void) { pwm_config c = { 0, 1 << 4, 0xffff }; return c; }
+static inline void pwm_config_set_clkdiv_int(pwm_config *c, uint div) { c->div = div << 4; }
+static inline void pwm_config_set_phase_correct(pwm_config *c, bool phase_correct) { c->csr = phase_correct; }
+static inline void pwm_config_set_wrap(pwm_config *c, uint16_t wrap) { c->top = wrap; }
+static inline void pwm_init(uint slice, pwm_config *c, bool start) { pwm_hw->slice[slice].top = c->top; }
+static inline void pwm_set_wrap(uint slice, uint16_t wrap) { pwm_hw->slice[slice].top = wrap; }
+static inline void pwm_set_clkdiv_int_frac(uint slice, uint8_t integer, uint8_t fract) { }
+static inline void pwm_set_counter(uint slice, uint16_t c) { pwm_hw->slice[slice].ctr = c; }
+static inline void pwm_set_output_polarity(uint slice, bool a, bool b) { }
+static inline void pwm_set_mask_enabled(uint32_t mask) { pwm_hw->en = mask; }
+static inline void pwm_set_both_levels(uint slice, uint16_t a, uint16_t b)
+{
+	pwm_hw->slice[slice].cc = ((uint32_t)b << 16) | a;
+}
+static inline void pwm_set_gpio_level(uint gpio, uint16_t level)
+{
+	volatile uint32_t *cc = &pwm_hw->slice[pwm_gpio_to_slice_num(gpio)].cc;
+	uint shift = pwm_gpio_to_channel(gpio) * 16;
+
+	*cc = (*cc & ~(0xffffUL << shift)) | ((uint32_t)level << shift);
+}
+
+
+/* hardware/dma.h */
+#define NUM_DMA_CHANNELS 12
+#define DREQ_FORCE 0x3f
+
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+
+typedef struct {
+	uint32_t ctrl;
+} dma_channel_config;
+
+typedef struct {
+	volatile uint32_t read_addr;
+	volatile uint32_t write_addr;
+	volatile uint32_t transfer_count;
+	volatile uint32_t ctrl_trig;
+	volatile uint32_t al1_ctrl;
+	volatile uint32_t al1_read_addr;
+	volatile uint32_t al1_write_addr;
+	volatile uint32_t al1_transfer_count_trig;
+	volatile uint32_t al2_ctrl;
+	volatile uint32_t al2_transfer_count;
+	volatile uint32_t al2_read_addr;
+	volatile uint32_t al2_write_addr_trig;
+	volatile uint32_t al3_ctrl;
+	volatile uint32_t al3_write_addr;
+	volatile uint32_t al3_transfer_count;
+	volatile uint32_t al3_read_addr_trig;
+} dma_channel_hw_t;
+
+typedef struct {
+	dma_channel_hw_t ch[NUM_DMA_CHANNELS];
+} dma_hw_t;
+
+extern dma_hw_t *dma_hw;
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_unclaim(uint channel);
+static inline dma_channel_config dma_channel_get_default_config(uint channel) { dma_channel_config c = { 0 }; return c; }
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) { }
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) { }
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) { }
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) { }
+static inline void channel_config_set_chain_to(dma_channel_config *c, uint channel) { }
+static inline void channel_config_set_irq_quiet(dma_channel_config *c, bool quiet) { }
+static inline void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) { }
+static inline void dma_channel_configure(uint channel, const dma_channel_config *c, volatile void *write_addr,
+					const volatile void *read_addr, uint count, bool trigger) { }
+static inline void dma_channel_start(uint channel) { }
+static inline bool dma_channel_is_busy(uint channel) { return false; }
+static inline bool dma_channel_get_irq1_status(uint channel) { return false; }
+static inline void dma_channel_acknowledge_irq1(uint channel) { }
+static inline void dma_channel_set_irq1_enabled(uint channel, bool enabled) { }
+
+
+#endif /* BRICKPICO_PICO_HOST_H */
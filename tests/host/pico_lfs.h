@@ -0,0 +1,132 @@
+/* pico_lfs.h
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Stand-in for pico-lfs (littlefs) for host tests: a flat in-memory
+   filesystem (root directory only) implementing the subset of littlefs
+   API used by flash.c, that counts calls of littlefs operations. */
+
+#ifndef BRICKPICO_PICO_LFS_HOST_H
+#define BRICKPICO_PICO_LFS_HOST_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define LFS_NAME_MAX 255
+
+typedef uint32_t lfs_size_t;
+typedef int32_t lfs_ssize_t;
+typedef int32_t lfs_soff_t;
+
+enum lfs_error {
+	LFS_ERR_OK      = 0,
+	LFS_ERR_IO      = -5,
+	LFS_ERR_NOENT   = -2,
+	LFS_ERR_EXIST   = -17,
+	LFS_ERR_ISDIR   = -21,
+	LFS_ERR_INVAL   = -22,
+	LFS_ERR_NOSPC   = -28,
+	LFS_ERR_NOMEM   = -12,
+};
+
+enum lfs_type {
+	LFS_TYPE_REG = 0x001,
+	LFS_TYPE_DIR = 0x002,
+};
+
+enum lfs_open_flags {
+	LFS_O_RDONLY = 1,
+	LFS_O_WRONLY = 2,
+	LFS_O_RDWR   = 3,
+	LFS_O_CREAT  = 0x0100,
+	LFS_O_EXCL   = 0x0200,
+	LFS_O_TRUNC  = 0x0400,
+	LFS_O_APPEND = 0x0800,
+};
+
+struct lfs_config {
+	void *context;
+	lfs_size_t block_size;
+	lfs_size_t block_count;
+};
+
+struct pico_lfs_context {
+	struct lfs_config cfg;
+	bool multicore_lockout_enabled;
+};
+
+struct lfs_info {
+	uint8_t type;
+	lfs_size_t size;
+	char name[LFS_NAME_MAX + 1];
+};
+
+typedef struct {
+	bool mounted;
+} lfs_t;
+
+typedef struct {
+	int file;
+	int flags;
+	lfs_size_t pos;
+} lfs_file_t;
+
+typedef struct {
+	int pos;
+} lfs_dir_t;
+
+/* Number of calls of (metadata) operations */
+struct lfs_host_stats {
+	uint32_t mount;
+	uint32_t unmount;
+	uint32_t format;
+	uint32_t stat;
+	uint32_t open;
+	uint32_t remove;
+	uint32_t rename;
+};
+
+extern struct lfs_host_stats lfs_host_stats;
+
+
+struct lfs_config* pico_lfs_init(uint32_t offset, uint32_t size);
+
+int lfs_format(lfs_t *lfs, const struct lfs_config *cfg);
+int lfs_mount(lfs_t *lfs, const struct lfs_config *cfg);
+int lfs_unmount(lfs_t *lfs);
+int lfs_stat(lfs_t *lfs, const char *path, struct lfs_info *info);
+int lfs_remove(lfs_t *lfs, const char *path);
+int lfs_rename(lfs_t *lfs, const char *oldpath, const char *newpath);
+lfs_ssize_t lfs_fs_size(lfs_t *lfs);
+
+int lfs_file_open(lfs_t *lfs, lfs_file_t *file, const char *path, int flags);
+int lfs_file_close(lfs_t *lfs, lfs_file_t *file);
+lfs_soff_t lfs_file_size(lfs_t *lfs, lfs_file_t *file);
+lfs_ssize_t lfs_file_read(lfs_t *lfs, lfs_file_t *file, void *buffer, lfs_size_t size);
+lfs_ssize_t lfs_file_write(lfs_t *lfs, lfs_file_t *file, const void *buffer, lfs_size_t size);
+
+int lfs_dir_open(lfs_t *lfs, lfs_dir_t *dir, const char *path);
+int lfs_dir_read(lfs_t *lfs, lfs_dir_t *dir, struct lfs_info *info);
+int lfs_dir_rewind(lfs_t *lfs, lfs_dir_t *dir);
+int lfs_dir_close(lfs_t *lfs, lfs_dir_t *dir);
+
+
+#endif /* BRICKPICO_PICO_LFS_HOST_H */
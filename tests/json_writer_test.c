@@ -0,0 +1,372 @@
+/* json_writer_test.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Host test for json_writer: test documents are built as cJSON trees,
+   and then generated with json_writer (by walking the tree). Output must
+   be byte-for-byte identical to cJSON_Print(), when generated as a whole
+   (json_writer_print()), in chunks (with every buffer size and offset)
+   and through a sink (with every buffer size). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+
+#include "cJSON.h"
+#include "json_writer.h"
+
+
+struct sink_buf {
+	char *buf;
+	size_t len;
+	size_t size;
+	int calls;
+	int bad_calls;
+	size_t max_chunk;
+};
+
+
+/* Generate item (and its children) with json_writer. */
+static void gen_item(json_writer_t *w, const cJSON *item, const char *key)
+{
+	const cJSON *c;
+
+	if (cJSON_IsObject(item)) {
+		json_writer_begin_object(w, key);
+		cJSON_ArrayForEach(c, item)
+			gen_item(w, c, c->string);
+		json_writer_end_object(w);
+	} else if (cJSON_IsArray(item)) {
+		json_writer_begin_array(w, key);
+		cJSON_ArrayForEach(c, item)
+			gen_item(w, c, NULL);
+		json_writer_end_array(w);
+	} else if (cJSON_IsString(item)) {
+		json_writer_add_string(w, key, item->valuestring);
+	} else if (cJSON_IsNumber(item)) {
+		json_writer_add_number(w, key, item->valuedouble);
+	} else if (cJSON_IsBool(item)) {
+		json_writer_add_bool(w, key, cJSON_IsTrue(item));
+	}
+}
+
+static void gen_doc(json_writer_t *w, const void *arg)
+{
+	gen_item(w, (const cJSON *)arg, NULL);
+}
+
+static void sink_cb(const char *buf, size_t len, void *ctx)
+{
+	struct sink_buf *s = (struct sink_buf *)ctx;
+
+	s->calls++;
+	if (len < 1 || len > s->max_chunk || s->len + len > s->size) {
+		s->bad_calls++;
+		return;
+	}
+	memcpy(s->buf + s->len, buf, len);
+	s->len += len;
+}
+
+
+static cJSON* doc_escapes()
+{
+	cJSON *root = cJSON_CreateObject();
+	cJSON *a;
+	char ctrl[32];
+	char key[8];
+
+	for (int i = 1; i < 32; i++)
+		ctrl[i - 1] = i;
+	ctrl[31] = 0;
+	cJSON_AddStringToObject(root, "control", ctrl);
+	cJSON_AddStringToObject(root, "quote", "say \"hello\"");
+	cJSON_AddStringToObject(root, "backslash", "C:\\path\\to\\file\\");
+	cJSON_AddStringToObject(root, "slash", "a/b</script>");
+	cJSON_AddStringToObject(root, "utf8", "\xc3\xa4\xc3\xb6 \xe2\x82\xac \xf0\x9f\x92\xa1");
+	cJSON_AddStringToObject(root, "high", "\x7f\x80\xff");
+	cJSON_AddStringToObject(root, "empty", "");
+	cJSON_AddStringToObject(root, "key \"with\"\tescapes\n", "value");
+	cJSON_AddStringToObject(root, "", "empty key");
+
+	a = cJSON_AddArrayToObject(root, "chars");
+	for (int i = 1; i < 128; i++) {
+		key[0] = i;
+		key[1] = 0;
+		cJSON_AddItemToArray(a, cJSON_CreateString(key));
+	}
+
+	return root;
+}
+
+static cJSON* doc_nested()
+{
+	cJSON *root = cJSON_CreateObject();
+	cJSON *o, *a, *a2, *p;
+
+	cJSON_AddObjectToObject(root, "empty_object");
+	cJSON_AddArrayToObject(root, "empty_array");
+
+	a = cJSON_AddArrayToObject(root, "array");
+	cJSON_AddItemToArray(a, cJSON_CreateObject());
+	cJSON_AddItemToArray(a, cJSON_CreateArray());
+	o = cJSON_CreateObject();
+	cJSON_AddStringToObject(o, "name", "output1");
+	cJSON_AddNumberToObject(o, "pwm", 50);
+	cJSON_AddItemToArray(a, o);
+	a2 = cJSON_CreateArray();
+	cJSON_AddItemToArray(a2, cJSON_CreateNumber(1));
+	cJSON_AddItemToArray(a2, cJSON_CreateString("two"));
+	cJSON_AddItemToArray(a2, cJSON_CreateFalse());
+	cJSON_AddItemToArray(a, a2);
+
+	/* Deep nesting, alternating objects and arrays */
+	p = root;
+	for (int i = 0; i < 12; i++) {
+		char key[16];
+
+		snprintf(key, sizeof(key), "level%d", i);
+		if (i & 1) {
+			o = cJSON_CreateArray();
+			cJSON_AddItemToArray(o, cJSON_CreateNumber(i));
+		} else {
+			o = cJSON_CreateObject();
+			cJSON_AddNumberToObject(o, "depth", i);
+		}
+		if (cJSON_IsArray(p))
+			cJSON_AddItemToArray(p, o);
+		else
+			cJSON_AddItemToObject(p, key, o);
+		p = o;
+	}
+	cJSON_AddBoolToObject(root, "true", 1);
+	cJSON_AddBoolToObject(root, "false", 0);
+
+	return root;
+}
+
+static cJSON* doc_numbers()
+{
+	static const double numbers[] = {
+		0.0, -0.0, 1.0, -1.0, 42.0, 100.0, 65535.0, -65536.0,
+		INT_MAX, INT_MIN, (double)INT_MAX + 1.0, (double)INT_MIN - 1.0,
+		2147483646.5, 4294967296.0, 1e15, 1e16, 1e17, 1e21, 1e300, -1e300,
+		0.1, 0.2, 0.3, 0.5, 1.5, -2.5, 3.14159, 123.456, 1.0 / 3.0, 2.0 / 3.0,
+		1e-5, -2.5e-7, 1e-300, 5e-324, DBL_MIN, DBL_MAX, -DBL_MAX,
+		0.1 + 0.2, 100.0 / 7.0, 25.125, 3.3, 21.5, 1234567.891,
+		9007199254740991.0, 9007199254740993.0,
+	};
+	cJSON *root = cJSON_CreateObject();
+	cJSON *a = cJSON_AddArrayToObject(root, "numbers");
+	char key[16];
+
+	for (int i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+		snprintf(key, sizeof(key), "n%d", i);
+		cJSON_AddNumberToObject(root, key, numbers[i]);
+		cJSON_AddItemToArray(a, cJSON_CreateNumber(numbers[i]));
+	}
+	cJSON_AddNumberToObject(root, "nan", NAN);
+	cJSON_AddNumberToObject(root, "inf", INFINITY);
+	cJSON_AddNumberToObject(root, "-inf", -INFINITY);
+
+	/* Integer and fractional values over typical (sensor) ranges */
+	for (int i = -200; i <= 200; i += 13) {
+		cJSON_AddItemToArray(a, cJSON_CreateNumber(i));
+		cJSON_AddItemToArray(a, cJSON_CreateNumber(i / 10.0));
+		cJSON_AddItemToArray(a, cJSON_CreateNumber(i / 3.0));
+	}
+
+	return root;
+}
+
+static cJSON* doc_empty_object()
+{
+	return cJSON_CreateObject();
+}
+
+static cJSON* doc_empty_array()
+{
+	return cJSON_CreateArray();
+}
+
+
+static int check_doc(const char *name, cJSON *doc, int *tests)
+{
+	char *ref, *out, *buf;
+	struct sink_buf s;
+	json_writer_t w;
+	size_t ref_len;
+	int fails = 0;
+	int len;
+
+	ref = cJSON_Print(doc);
+	if (!ref) {
+		printf("%s: cJSON_Print() failed\n", name);
+		return 1;
+	}
+	ref_len = strlen(ref);
+
+	/* Whole output */
+	out = json_writer_print(gen_doc, doc);
+	(*tests)++;
+	if (!out || strcmp(out, ref)) {
+		printf("%s: json_writer_print() output differs from cJSON_Print()\n", name);
+		if (out)
+			printf("--- cJSON:\n%s\n--- json_writer:\n%s\n", ref, out);
+		fails++;
+	}
+	free(out);
+
+	/* Chunked output: every buffer size, output collected with offsets */
+	buf = malloc(ref_len + 2);
+	out = malloc(ref_len + 1);
+	for (size_t size = 1; size <= ref_len + 1; size++) {
+		size_t pos = 0;
+		int chunk_fails = 0;
+
+		do {
+			size_t expect = (size - 1 < ref_len - pos ? size - 1 : ref_len - pos);
+
+			json_writer_init(&w, buf, size, pos);
+			gen_doc(&w, doc);
+			len = json_writer_finish(&w);
+			if (len != ref_len || strlen(buf) != expect) {
+				chunk_fails++;
+				break;
+			}
+			memcpy(out + pos, buf, strlen(buf));
+			pos += strlen(buf);
+		} while (pos < ref_len && size > 1);
+		(*tests)++;
+		if (size == 1) {
+			/* Buffer can only hold the terminating NUL */
+			if (chunk_fails || buf[0] != 0)
+				chunk_fails++;
+		} else if (!chunk_fails && memcmp(out, ref, ref_len)) {
+			chunk_fails++;
+		}
+		if (chunk_fails) {
+			printf("%s: chunked output (buffer size %zu) differs\n", name, size);
+			fails++;
+		}
+	}
+	free(out);
+
+	/* Sink output: every buffer size */
+	s.size = ref_len;
+	s.buf = malloc(ref_len + 1);
+	for (size_t size = 1; size <= ref_len + 1; size++) {
+		memset(s.buf, 0, ref_len + 1);
+		s.len = 0;
+		s.calls = 0;
+		s.bad_calls = 0;
+		s.max_chunk = size;
+		json_writer_init(&w, buf, size, 0);
+		json_writer_set_sink(&w, sink_cb, &s);
+		gen_doc(&w, doc);
+		len = json_writer_finish(&w);
+		(*tests)++;
+		if (len != ref_len || s.bad_calls || s.len != ref_len
+			|| memcmp(s.buf, ref, ref_len)
+			|| s.calls != (ref_len + size - 1) / size) {
+			printf("%s: sink output (buffer size %zu) differs\n", name, size);
+			fails++;
+		}
+	}
+	free(s.buf);
+	free(buf);
+
+	/* Size calculation only */
+	json_writer_init(&w, NULL, 0, 0);
+	gen_doc(&w, doc);
+	(*tests)++;
+	if (json_writer_finish(&w) != ref_len) {
+		printf("%s: calculated output size differs\n", name);
+		fails++;
+	}
+
+	cJSON_free(ref);
+	cJSON_Delete(doc);
+
+	return fails;
+}
+
+static int check_errors(int *tests)
+{
+	json_writer_t w;
+	int fails = 0;
+
+	/* Unbalanced or mismatched containers */
+	json_writer_init(&w, NULL, 0, 0);
+	json_writer_begin_object(&w, NULL);
+	json_writer_begin_array(&w, "a");
+	json_writer_end_object(&w);
+	(*tests)++;
+	if (json_writer_finish(&w) >= 0) {
+		printf("errors: mismatched container not detected\n");
+		fails++;
+	}
+
+	json_writer_init(&w, NULL, 0, 0);
+	json_writer_begin_object(&w, NULL);
+	(*tests)++;
+	if (json_writer_finish(&w) >= 0) {
+		printf("errors: unterminated object not detected\n");
+		fails++;
+	}
+
+	/* Nesting too deep */
+	json_writer_init(&w, NULL, 0, 0);
+	for (int i = 0; i < JSON_WRITER_MAX_DEPTH + 1; i++)
+		json_writer_begin_array(&w, NULL);
+	for (int i = 0; i < JSON_WRITER_MAX_DEPTH + 1; i++)
+		json_writer_end_array(&w);
+	(*tests)++;
+	if (json_writer_finish(&w) >= 0) {
+		printf("errors: too deep nesting not detected\n");
+		fails++;
+	}
+
+	return fails;
+}
+
+
+int main(int argc, char **argv)
+{
+	int fails = 0;
+	int tests = 0;
+
+	fails += check_doc("escapes", doc_escapes(), &tests);
+	fails += check_doc("nested", doc_nested(), &tests);
+	fails += check_doc("numbers", doc_numbers(), &tests);
+	fails += check_doc("empty_object", doc_empty_object(), &tests);
+	fails += check_doc("empty_array", doc_empty_array(), &tests);
+	fails += check_errors(&tests);
+
+	printf("json_writer: %d tests, %d failures\n", tests, fails);
+
+	return (fails > 0 ? 1 : 0);
+}
+
+
+/* eof :-) */
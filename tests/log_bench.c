@@ -0,0 +1,194 @@
+/* log_bench.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Host benchmark of log_msg() throughput (messages per second): log.c is
+   built against the Pico SDK stand-ins (tests/host) and compared against
+   the previous implementation (heap allocated message buffers), that is
+   included here for reference.
+
+   Console output goes to /dev/null, and persistent memory checksum
+   updates are not included (see crc32_bench for CRC-32 throughput). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "brickpico.h"
+
+#define MESSAGES 500000
+#define LOG_SIZE (16 * 1024)
+
+
+static uint8_t log_buf[LOG_SIZE];
+static u8_ringbuffer_t log_ringbuffer;
+static mutex_t log_mutex;
+
+u8_ringbuffer_t *log_rb = &log_ringbuffer;
+mutex_t *pmem_mutex = &log_mutex;
+
+extern int global_log_level;
+extern int global_syslog_level;
+
+
+void update_persistent_memory_crc()
+{
+}
+
+void update_persistent_memory_log_crc(size_t offset, size_t len)
+{
+}
+
+
+/* Previous log_msg() implementation (for reference). */
+static void log_msg_malloc(int priority, const char *format, ...)
+{
+	va_list ap;
+	char *buf;
+	char tstamp[32];
+	int len;
+	uint64_t start, end;
+	uint core = get_core_num();
+
+	if ((priority > global_log_level) && (priority > global_syslog_level))
+		return;
+	if (!(buf = malloc(256)))
+		return;
+
+	start = to_us_since_boot(get_absolute_time());
+	va_start(ap, format);
+	vsnprintf(buf, 256, format, ap);
+	va_end(ap);
+
+	if ((len = strnlen(buf, 256 - 1)) > 0) {
+		/* If string ends with \n, remove it. */
+		if (buf[len - 1] == '\n')
+			buf[len - 1] = 0;
+	}
+
+	if (priority <= global_log_level) {
+		uint64_t t = to_us_since_boot(get_absolute_time());
+		snprintf(tstamp, sizeof(tstamp), "[%6llu.%06llu][%u]",
+			(t / 1000000), (t % 1000000), core);
+		printf("%s %s\n", tstamp, buf);
+		char *rbuf = malloc(255);
+		if (rbuf) {
+			if (mutex_enter_timeout_us(pmem_mutex, 100)) {
+				snprintf(rbuf, 255, "%s %s", tstamp, buf);
+				u8_ringbuffer_add(log_rb, (uint8_t*)rbuf, strlen(rbuf) + 1, true);
+				update_persistent_memory_crc();
+				mutex_exit(pmem_mutex);
+			} else {
+				printf("%s mutex timeout: FAILED to access log rinbuffer\n",
+					tstamp);
+			}
+			free(rbuf);
+		}
+	}
+
+	end = to_us_since_boot(get_absolute_time());
+	if (end - start > 10000) {
+		printf("log_msg: core%u: %llu (duration=%llu)\n", core, end, end - start);
+	}
+
+	free(buf);
+}
+
+
+static double bench(void (*f)(int, const char*, ...), int priority)
+{
+	struct timespec t0, t1;
+	double t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int i = 0; i < MESSAGES; i++) {
+		f(priority, "output%d: level %u -> %u (%s), %.1f s", (i & 15) + 1,
+			i & 0xffff, (i * 7) & 0xffff, "fade", 2.5);
+		host_advance_us(10);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	return MESSAGES / t;
+}
+
+static void run(const char *desc, int priority, int console_level, bool binary,
+		bool compare, int out)
+{
+	uint8_t entry[256];
+	double a = 0, b;
+	int saved;
+
+	set_console_log_level(console_level);
+	set_log_binary_mode(binary);
+
+	fflush(stdout);
+	saved = dup(STDOUT_FILENO);
+	dup2(out, STDOUT_FILENO);
+	if (compare)
+		a = bench(log_msg_malloc, priority);
+	b = bench(log_msg, priority);
+	fflush(stdout);
+	dup2(saved, STDOUT_FILENO);
+	close(saved);
+
+	/* Check latest entry got stored in requested format */
+	if (priority <= get_log_level()
+		&& u8_ringbuffer_peek(log_rb, log_rb->tail, entry, sizeof(entry), NULL, NULL) > 0
+		&& (entry[0] == 0x01) != binary)
+		printf("warning: log entry not in %s format\n", (binary ? "binary" : "text"));
+
+	if (compare)
+		printf("%-34s %14.0f %14.0f %8.2fx\n", desc, a, b, b / a);
+	else
+		printf("%-34s %14s %14.0f\n", desc, "-", b);
+}
+
+int main(int argc, char **argv)
+{
+	int out;
+
+	if ((out = open("/dev/null", O_WRONLY)) < 0) {
+		perror("/dev/null");
+		return 1;
+	}
+	u8_ringbuffer_init(log_rb, log_buf, sizeof(log_buf));
+	set_log_level(LOG_INFO);
+	set_syslog_level(LOG_ERR);
+
+	printf("%-34s %14s %14s\n", "messages/s", "before", "after");
+	run("console + log (text)", LOG_INFO, LOG_DEBUG, false, true, out);
+	run("log only (text)", LOG_INFO, LOG_ERR, false, false, out);
+	run("log only (binary)", LOG_INFO, LOG_ERR, true, false, out);
+	run("below log level", LOG_DEBUG, LOG_DEBUG, false, true, out);
+
+	printf("\nlog entries: %u, dropped: %u\n", (uint)log_rb->items,
+		get_log_dropped_count() + get_log_rb_dropped_count());
+
+	return 0;
+}
+
+
+/* eof :-) */
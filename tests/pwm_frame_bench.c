@@ -0,0 +1,144 @@
+/* pwm_frame_bench.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Host benchmark of per effect tick cost of PWM frame updates on core1:
+   pwm.c is built against the Pico SDK stand-ins (tests/host), and
+   on every tick all outputs get a new (16-bit) lightness level with
+   set_pwm_frame_lightness(), followed by update_pwm_frame().
+
+   Time is reported separately for the level mapping (16 calls of
+   set_pwm_frame_lightness()) and for the whole tick, without and with
+   power limiting and with dithering, and compared against the tick
+   interval at maximum effect rate (EFFECT_RATE_MAX). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "brickpico.h"
+
+#define TICKS 200000
+
+
+static struct brickpico_config config;
+const struct brickpico_config *cfg = &config;
+
+
+void log_msg(int priority, const char *format, ...)
+{
+}
+
+int flash_read_file(char **bufptr, uint32_t *sizeptr, const char *filename)
+{
+	return -1;
+}
+
+int str_to_float(const char *str, float *val)
+{
+	char *endptr;
+
+	if (!str || !val)
+		return 0;
+	*val = strtof(str, &endptr);
+	return (str == endptr ? 0 : 1);
+}
+
+char *strncopy(char *dst, const char *src, size_t size)
+{
+	if (!dst || !src || size < 1)
+		return dst;
+	if (size > 1)
+		strncpy(dst, src, size - 1);
+	dst[size - 1] = 0;
+	return dst;
+}
+
+
+/* Run effect ticks, return average time per tick (ns). */
+static double bench(bool frame_update)
+{
+	struct timespec t0, t1;
+	uint32_t busy = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (uint32_t t = 0; t < TICKS; t++) {
+		/* Every output fading at different speed */
+		for (int i = 0; i < OUTPUT_COUNT; i++)
+			set_pwm_frame_lightness(i, (t * (i + 1) * 37) & EFFECT_LEVEL_MAX);
+		if (frame_update && !update_pwm_frame())
+			busy++;
+		host_advance_us(1000000 / EFFECT_RATE_MAX);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	if (busy > 0)
+		printf("warning: %u frame updates skipped\n", busy);
+
+	return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / TICKS;
+}
+
+static void run(const char *desc)
+{
+	struct pwm_power_stats stats;
+	double levels = bench(false);
+	double tick = bench(true);
+
+	get_pwm_power_stats(&stats);
+	printf("%-24s %12.1f %12.1f %12.1f %9.3f%%%s\n", desc, levels, tick - levels, tick,
+		tick / (1e7 / EFFECT_RATE_MAX), (stats.limited ? "  (limited)" : ""));
+}
+
+int main(int argc, char **argv)
+{
+	config.pwm_freq = 1000;
+	strncopy(config.pwm_phase, "auto", sizeof(config.pwm_phase));
+	for (int i = 0; i < OUTPUT_COUNT; i++) {
+		config.outputs[i].max_current = 500;
+		config.outputs[i].priority = i % 3;
+	}
+
+	printf("%d outputs, PWM %u Hz, tick interval %u us (%u Hz effect rate)\n\n",
+		OUTPUT_COUNT, config.pwm_freq, 1000000 / EFFECT_RATE_MAX, EFFECT_RATE_MAX);
+	printf("%-24s %12s %12s %12s %10s\n", "", "levels ns", "frame ns", "tick ns", "of tick");
+
+	setup_pwm_outputs();
+	run("no limiting");
+
+	set_pwm_power_budget(2000);
+	run("power limiting");
+
+	config.power_budget = 0;
+	for (int i = 0; i < OUTPUT_COUNT; i++)
+		config.outputs[i].dither = true;
+	setup_pwm_outputs();
+	run("dithering");
+
+	set_pwm_power_budget(2000);
+	run("dithering + limiting");
+
+	return 0;
+}
+
+
+/* eof :-) */
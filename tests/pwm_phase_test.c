@@ -0,0 +1,241 @@
+/* pwm_phase_test.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Host test for PWM slice phase staggering: slices are configured the same
+   way as setup_pwm_outputs() does (phase offsets, counter start values,
+   output polarity and compare values), and the outputs are simulated tick
+   by tick over one PWM period of phase-correct PWM (counter counts up from
+   0 to TOP and then back down to 0).
+
+   With staggered phases, on-time of every output must be unchanged
+   (compared to all slices in phase), and peak number of outputs on at the
+   same time must never be higher, and must be lower when the outputs are
+   not on for (nearly) the whole period. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pwm_phase.h"
+
+#define SLICES 8                 /* OUTPUT_COUNT / 2 */
+#define OUTPUTS (SLICES * 2)
+
+
+struct sim_result {
+	uint32_t on[OUTPUTS];    /* ticks output was on (during one period) */
+	uint32_t peak;           /* max outputs on at the same time */
+};
+
+
+/* Simulate outputs over one PWM period. */
+static int simulate(const char *spec, uint32_t top, const uint32_t *level,
+		struct sim_result *res)
+{
+	uint32_t period = 2 * (top + 1);
+	uint32_t offset[SLICES];
+	uint32_t counter[SLICES];
+	uint32_t cc[OUTPUTS];
+	bool invert[SLICES];
+	int ret;
+
+	ret = pwm_phase_offsets(spec, SLICES, period, offset);
+	for (int s = 0; s < SLICES; s++) {
+		invert[s] = pwm_phase_counter(offset[s], top, &counter[s]);
+		for (int c = 0; c < 2; c++) {
+			int out = s * 2 + c;
+			cc[out] = pwm_phase_cc_level(invert[s] ? top + 1 : 0, level[out]);
+		}
+	}
+
+	for (int i = 0; i < OUTPUTS; i++)
+		res->on[i] = 0;
+	res->peak = 0;
+
+	for (uint32_t t = 0; t < period; t++) {
+		uint32_t count = 0;
+
+		for (int s = 0; s < SLICES; s++) {
+			/* Counter starts at given value counting up */
+			uint32_t p = (counter[s] + t) % period;
+			uint32_t ctr = (p <= top ? p : period - 1 - p);
+
+			for (int c = 0; c < 2; c++) {
+				int out = s * 2 + c;
+				bool high = (ctr < cc[out]) != invert[s];
+
+				if (high) {
+					res->on[out]++;
+					count++;
+				}
+			}
+		}
+		if (count > res->peak)
+			res->peak = count;
+	}
+
+	return ret;
+}
+
+static int check_levels(uint32_t top, const uint32_t *level, const char *desc, int *tests)
+{
+	struct sim_result off, stag;
+	uint32_t max_on = 0;
+	uint32_t bound;
+	int fails = 0;
+
+	simulate("off", top, level, &off);
+	simulate("auto", top, level, &stag);
+	(*tests)++;
+
+	for (int i = 0; i < OUTPUTS; i++) {
+		/* Output is on while counter < level, both when counting up and down */
+		if (off.on[i] != 2 * level[i] || stag.on[i] != off.on[i]) {
+			printf("top=%u %s: output%d on-time %u (in phase %u, expected %u)\n",
+				top, desc, i + 1, stag.on[i], off.on[i], 2 * level[i]);
+			fails++;
+		}
+		if (stag.on[i] > max_on)
+			max_on = stag.on[i];
+	}
+
+	if (stag.peak > off.peak) {
+		printf("top=%u %s: peak increased %u --> %u\n", top, desc, off.peak, stag.peak);
+		fails++;
+	}
+
+	/* With slices evenly spread over the period, on-windows (max_on ticks)
+	   of at most ceil(max_on * SLICES / period) + 1 slices can overlap. */
+	bound = 2 * ((max_on * SLICES + 2 * (top + 1) - 1) / (2 * (top + 1)) + 1);
+	if (bound < off.peak && stag.peak > bound) {
+		printf("top=%u %s: peak %u not reduced (in phase %u, expected <= %u)\n",
+			top, desc, stag.peak, off.peak, bound);
+		fails++;
+	}
+
+	return fails;
+}
+
+static int check_top(uint32_t top, int *tests)
+{
+	uint32_t level[OUTPUTS];
+	char desc[64];
+	int fails = 0;
+	uint32_t step = (top > 200 ? top / 97 : 1);
+
+	/* All outputs at same level */
+	for (uint32_t l = 0; l <= top + 1; l += step) {
+		for (int i = 0; i < OUTPUTS; i++)
+			level[i] = l;
+		snprintf(desc, sizeof(desc), "level=%u", l);
+		fails += check_levels(top, level, desc, tests);
+	}
+
+	/* Mixed levels */
+	srand(top);
+	for (int n = 0; n < 200; n++) {
+		for (int i = 0; i < OUTPUTS; i++)
+			level[i] = rand() % (top + 2);
+		snprintf(desc, sizeof(desc), "random levels #%d", n);
+		fails += check_levels(top, level, desc, tests);
+	}
+
+	return fails;
+}
+
+static int check_spec(const char *spec, int expect_ret, const uint32_t *expect, int *tests)
+{
+	uint32_t offset[SLICES];
+	int ret, fails = 0;
+
+	ret = pwm_phase_offsets(spec, SLICES, 1000, offset);
+	(*tests)++;
+	if (ret != expect_ret) {
+		printf("spec '%s': returned %d, expected %d\n", spec, ret, expect_ret);
+		fails++;
+	}
+	for (int i = 0; i < SLICES; i++) {
+		if (offset[i] != expect[i]) {
+			printf("spec '%s': slice %d offset %u, expected %u\n",
+				spec, i, offset[i], expect[i]);
+			fails++;
+		}
+	}
+
+	return fails;
+}
+
+static int check_specs(int *tests)
+{
+	static const uint32_t zero[SLICES] = { 0 };
+	static const uint32_t even[SLICES] = { 0, 125, 250, 375, 500, 625, 750, 875 };
+	static const uint32_t list[SLICES] = { 0, 500, 250, 990, 0, 0, 0, 0 };
+	int fails = 0;
+
+	fails += check_spec("", 0, even, tests);
+	fails += check_spec("auto", 0, even, tests);
+	fails += check_spec("AUTO", 0, even, tests);
+	fails += check_spec("off", 0, zero, tests);
+	fails += check_spec("0,50,25,99", 0, list, tests);
+	fails += check_spec("0,100", -1, even, tests);
+	fails += check_spec("-1", -1, even, tests);
+	fails += check_spec("foo", -1, even, tests);
+	fails += check_spec("0,1,2,3,4,5,6,7,8", -1, even, tests);
+
+	/* Counter start values and polarity */
+	for (uint32_t top = 1; top < 300; top++) {
+		for (uint32_t ofs = 0; ofs < 2 * (top + 1); ofs++) {
+			uint32_t counter;
+			bool inv = pwm_phase_counter(ofs, top, &counter);
+
+			(*tests)++;
+			if (counter > top || inv != (ofs > top)
+				|| counter + (inv ? top + 1 : 0) != ofs) {
+				printf("top=%u offset=%u: counter %u%s\n", top, ofs,
+					counter, (inv ? " (inverted)" : ""));
+				fails++;
+			}
+		}
+	}
+
+	return fails;
+}
+
+
+int main(int argc, char **argv)
+{
+	static const uint32_t tops[] = { 1, 2, 3, 7, 15, 99, 100, 255, 624, 1249 };
+	int fails = 0;
+	int tests = 0;
+
+	fails += check_specs(&tests);
+
+	for (int i = 0; i < sizeof(tops) / sizeof(tops[0]); i++)
+		fails += check_top(tops[i], &tests);
+
+	printf("pwm_phase: %d tests, %d failures\n", tests, fails);
+
+	return (fails > 0 ? 1 : 0);
+}
+
+
+/* eof :-) */
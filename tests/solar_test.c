@@ -0,0 +1,223 @@
+/* solar_test.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Host test for solar_event_times(): event times are compared against
+   published sunrise/sunset (and civil twilight) times for reference
+   cities, including polar day and polar night. Then every day of a year
+   is checked for consistency of the results. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "solar.h"
+
+#define TOLERANCE 120   /* seconds */
+
+#define NONE (-10000)   /* event does not occur */
+#define SKIP (-20000)   /* event occurs, time not checked */
+
+/* Helper to express reference times as (UTC) hours and minutes
+   relative to UTC midnight of the date. */
+#define HM(h, m) ((h) * 60 + (m))
+
+struct location {
+	const char *name;
+	double lat;
+	double lon;
+	bool polar;
+};
+
+static const struct location locations[] = {
+	{ "Helsinki",     60.1699,   24.9384, false },
+	{ "London",       51.5074,   -0.1278, false },
+	{ "Sydney",      -33.8688,  151.2093, false },
+	{ "New York",     40.7128,  -74.0060, false },
+	{ "Tromso",       69.6492,   18.9553, true },
+	{ "Longyearbyen", 78.2232,   15.6267, true },
+};
+
+/* Reference times (minutes from UTC midnight of date) in the order of
+   enum solar_events: dawn, sunrise, sunset, dusk. */
+struct reference {
+	int loc;
+	int month;
+	int day;
+	int t[SOLAR_EVENT_COUNT];
+};
+
+static const struct reference references[] = {
+	/* Helsinki: 03:54 / 22:50 EEST, 09:24 / 15:13 EET */
+	{ 0,  6, 21, { SKIP, HM(0, 54), HM(19, 50), SKIP } },
+	{ 0, 12, 21, { SKIP, HM(7, 24), HM(13, 13), SKIP } },
+	/* London: 03:55 / 04:43 / 21:21 / 22:09 BST, 07:24 / 08:04 / 15:53 / 16:33 GMT */
+	{ 1,  6, 21, { HM(2, 55), HM(3, 43), HM(20, 21), HM(21, 9) } },
+	{ 1, 12, 21, { HM(7, 24), HM(8, 4), HM(15, 53), HM(16, 33) } },
+	/* Sydney: 05:41 / 20:05 AEDT, 07:00 / 16:54 AEST (sunrise on previous UTC day) */
+	{ 2, 12, 21, { SKIP, HM(18, 41) - HM(24, 0), HM(9, 5), SKIP } },
+	{ 2,  6, 21, { SKIP, HM(21, 0) - HM(24, 0), HM(6, 54), SKIP } },
+	/* New York: 07:00 / 19:08 EDT, 05:25 / 20:31 EDT (sunset on next UTC day) */
+	{ 3,  3, 20, { SKIP, HM(11, 0), HM(23, 8), SKIP } },
+	{ 3,  6, 21, { SKIP, HM(9, 25), HM(24, 31), SKIP } },
+	/* Tromso: midnight sun, polar night (civil twilight only) */
+	{ 4,  6, 21, { NONE, NONE, NONE, NONE } },
+	{ 4, 12, 21, { SKIP, NONE, NONE, SKIP } },
+	/* Longyearbyen: midnight sun, polar night (no twilight) */
+	{ 5,  6, 21, { NONE, NONE, NONE, NONE } },
+	{ 5, 12, 21, { NONE, NONE, NONE, NONE } },
+};
+
+static const char *event_names[SOLAR_EVENT_COUNT] = {
+	"dawn", "sunrise", "sunset", "dusk"
+};
+
+
+static time_t make_date(int year, int month, int day, struct tm *tm)
+{
+	time_t t;
+
+	tm->tm_year = year - 1900;
+	tm->tm_mon = month - 1;
+	tm->tm_mday = day;
+	tm->tm_hour = 0;
+	tm->tm_min = 0;
+	tm->tm_sec = 0;
+	t = timegm(tm);
+	gmtime_r(&t, tm);
+
+	return t;
+}
+
+static int check_reference(const struct reference *r)
+{
+	const struct location *l = &locations[r->loc];
+	struct tm tm;
+	time_t midnight, times[SOLAR_EVENT_COUNT];
+	int fails = 0;
+
+	midnight = make_date(2024, r->month, r->day, &tm);
+	solar_event_times(l->lat, l->lon, &tm, times);
+
+	for (int i = 0; i < SOLAR_EVENT_COUNT; i++) {
+		if (r->t[i] == NONE) {
+			if (times[i] != 0) {
+				printf("%s 2024-%02d-%02d: %s: expected no event\n",
+					l->name, r->month, r->day, event_names[i]);
+				fails++;
+			}
+			continue;
+		}
+		if (times[i] == 0) {
+			printf("%s 2024-%02d-%02d: %s: event missing\n",
+				l->name, r->month, r->day, event_names[i]);
+			fails++;
+			continue;
+		}
+		if (r->t[i] == SKIP)
+			continue;
+		if (labs((long)(times[i] - (midnight + r->t[i] * 60))) > TOLERANCE) {
+			printf("%s 2024-%02d-%02d: %s: %+ld minutes (from UTC midnight), expected %+d\n",
+				l->name, r->month, r->day, event_names[i],
+				(long)(times[i] - midnight) / 60, r->t[i]);
+			fails++;
+		}
+	}
+
+	return fails;
+}
+
+/* Check every day of year: events are in order, and (outside polar
+   regions) always occur and change smoothly. Near start and end of polar
+   day/night only one of sunrise/sunset (or dawn/dusk) may occur. */
+static int check_year(const struct location *l, int *days)
+{
+	struct tm tm;
+	time_t t, midnight, times[SOLAR_EVENT_COUNT];
+	long len, prev_len = -1;
+	int fails = 0;
+
+	t = make_date(2024, 1, 1, &tm);
+	for (int d = 0; d < 366; d++, t += 86400) {
+		gmtime_r(&t, &tm);
+		midnight = t;
+		solar_event_times(l->lat, l->lon, &tm, times);
+		(*days)++;
+
+		if (times[SOLAR_SUNRISE] && times[SOLAR_SUNSET]
+			&& times[SOLAR_SUNRISE] >= times[SOLAR_SUNSET]) {
+			printf("%s 2024-%02d-%02d: sunrise after sunset\n",
+				l->name, tm.tm_mon + 1, tm.tm_mday);
+			fails++;
+		}
+		if ((times[SOLAR_DAWN] && times[SOLAR_SUNRISE]
+				&& times[SOLAR_DAWN] >= times[SOLAR_SUNRISE])
+			|| (times[SOLAR_SUNSET] && times[SOLAR_DUSK]
+				&& times[SOLAR_SUNSET] >= times[SOLAR_DUSK])) {
+			printf("%s 2024-%02d-%02d: twilight out of order\n",
+				l->name, tm.tm_mon + 1, tm.tm_mday);
+			fails++;
+		}
+		if (l->polar)
+			continue;
+
+		/* Events must be within (about) half a day of local solar noon */
+		for (int i = 0; i < SOLAR_EVENT_COUNT; i++) {
+			long ofs = (long)(times[i] - midnight) - (720 - 4 * l->lon) * 60;
+
+			if (times[i] == 0 || labs(ofs) > 43200) {
+				printf("%s 2024-%02d-%02d: %s missing or on wrong day\n",
+					l->name, tm.tm_mon + 1, tm.tm_mday, event_names[i]);
+				fails++;
+			}
+		}
+		len = (long)(times[SOLAR_SUNSET] - times[SOLAR_SUNRISE]);
+		if (prev_len >= 0 && labs(len - prev_len) > 10 * 60) {
+			printf("%s 2024-%02d-%02d: day length jumps %ld seconds\n",
+				l->name, tm.tm_mon + 1, tm.tm_mday, len - prev_len);
+			fails++;
+		}
+		prev_len = len;
+	}
+
+	return fails;
+}
+
+int main(int argc, char **argv)
+{
+	int fails = 0;
+	int tests = 0;
+
+	for (int i = 0; i < sizeof(references) / sizeof(references[0]); i++) {
+		fails += check_reference(&references[i]);
+		tests++;
+	}
+
+	for (int i = 0; i < sizeof(locations) / sizeof(locations[0]); i++)
+		fails += check_year(&locations[i], &tests);
+
+	printf("solar: %d tests, %d failures\n", tests, fails);
+
+	return (fails > 0 ? 1 : 0);
+}
+
+
+/* eof :-) */
@@ -0,0 +1,505 @@
+/* stream_test.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Host test for output streaming protocol (stream.c): frames are encoded
+   here (COBS + reference xcrc32()) and fed to process_stream_input()
+   through the console input stand-in, in varying read sizes. Checked are
+   decoded output levels, stream statistics, replies from the device, and
+   handling of corrupt, truncated and oversized frames and idle timeout. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "brickpico.h"
+
+#define FRAME_MAX 512
+#define IO_BUF_SIZE 8192
+
+
+static uint8_t in_buf[IO_BUF_SIZE];
+static int in_len = 0;
+static int in_pos = 0;
+static int in_chunk = 256;   /* max bytes returned per stdio_get_until() call */
+
+static uint8_t out_buf[IO_BUF_SIZE];
+static int out_len = 0;
+
+static uint16_t levels[OUTPUT_MAX_COUNT];
+static uint level_count = 0;
+static int level_calls = 0;
+static int clear_calls = 0;
+
+static int fails = 0;
+static int tests = 0;
+
+
+void log_msg(int priority, const char *format, ...)
+{
+}
+
+int time_passed(absolute_time_t *t, uint32_t ms)
+{
+	absolute_time_t t_now = get_absolute_time();
+
+	if (t == NULL)
+		return -1;
+
+	if (to_us_since_boot(*t) == 0 ||
+	    to_us_since_boot(delayed_by_ms(*t, ms)) < to_us_since_boot(t_now)) {
+		*t = t_now;
+		return 1;
+	}
+
+	return 0;
+}
+
+void set_direct_output_levels(const uint16_t *level, uint count)
+{
+	memcpy(levels, level, count * sizeof(uint16_t));
+	level_count = count;
+	level_calls++;
+}
+
+void clear_direct_output_levels()
+{
+	clear_calls++;
+}
+
+
+void stdio_put_string(const char *s, int len, bool newline, bool cr_translation)
+{
+	if (out_len + len <= sizeof(out_buf)) {
+		memcpy(out_buf + out_len, s, len);
+		out_len += len;
+	}
+}
+
+int stdio_get_until(char *buf, int len, absolute_time_t until)
+{
+	int n = in_len - in_pos;
+
+	if (n <= 0)
+		return -1;
+	if (n > len)
+		n = len;
+	if (n > in_chunk)
+		n = in_chunk;
+	memcpy(buf, in_buf + in_pos, n);
+	in_pos += n;
+	if (in_pos >= in_len)
+		in_pos = in_len = 0;
+
+	return n;
+}
+
+void stdio_flush(void)
+{
+}
+
+
+#define CHECK(cond, ...) do {					\
+		tests++;					\
+		if (!(cond)) {					\
+			printf("%s:%d: ", __FILE__, __LINE__);	\
+			printf(__VA_ARGS__);			\
+			printf("\n");				\
+			fails++;				\
+		}						\
+	} while (0)
+
+
+static int cobs_encode(const uint8_t *in, int len, uint8_t *out)
+{
+	int code_pos = 0, o = 1;
+	uint8_t code = 1;
+
+	for (int i = 0; i < len; i++) {
+		if (in[i]) {
+			out[o++] = in[i];
+			if (++code < 0xff)
+				continue;
+		}
+		out[code_pos] = code;
+		code_pos = o++;
+		code = 1;
+	}
+	out[code_pos] = code;
+
+	return o;
+}
+
+static int cobs_decode(const uint8_t *in, int len, uint8_t *out)
+{
+	int i = 0, o = 0;
+
+	while (i < len) {
+		int code = in[i++];
+
+		if (code == 0 || i + code - 1 > len)
+			return -1;
+		for (int j = 1; j < code; j++)
+			out[o++] = in[i++];
+		if (code < 0xff && i < len)
+			out[o++] = 0;
+	}
+
+	return o;
+}
+
+/* Build (unencoded) frame with CRC, return its length. */
+static int make_frame(uint8_t *frame, uint8_t type, const uint8_t *data, int len)
+{
+	uint32_t crc;
+
+	frame[0] = type;
+	if (len > 0)
+		memcpy(&frame[1], data, len);
+	crc = xcrc32(frame, len + 1, 0xffffffff);
+	for (int i = 0; i < 4; i++)
+		frame[len + 1 + i] = crc >> (8 * i);
+
+	return len + 5;
+}
+
+/* Queue raw bytes to console input. */
+static void input(const uint8_t *data, int len)
+{
+	if (in_len + len > sizeof(in_buf)) {
+		printf("input buffer overflow\n");
+		exit(2);
+	}
+	memcpy(in_buf + in_len, data, len);
+	in_len += len;
+}
+
+/* Queue COBS encoded frame (and terminating zero) to console input. */
+static void input_frame(const uint8_t *frame, int len)
+{
+	uint8_t buf[FRAME_MAX + FRAME_MAX / 254 + 2];
+	int l = cobs_encode(frame, len, buf);
+
+	buf[l++] = 0;
+	input(buf, l);
+}
+
+static void send(uint8_t type, const uint8_t *data, int len)
+{
+	uint8_t frame[FRAME_MAX + 5];
+
+	input_frame(frame, make_frame(frame, type, data, len));
+	process_stream_input();
+}
+
+static void send_levels(const uint16_t *level, int count)
+{
+	uint8_t data[FRAME_MAX];
+
+	for (int i = 0; i < count; i++) {
+		data[2 * i] = level[i] & 0xff;
+		data[2 * i + 1] = level[i] >> 8;
+	}
+	send(0x01, data, 2 * count);
+}
+
+/* Return next frame from device output (type, data length), or -1 if none. */
+static int reply(uint8_t *data, int *len)
+{
+	static int pos = 0;
+	uint8_t frame[FRAME_MAX + 5];
+	uint32_t crc;
+	int start, l;
+
+	while (pos < out_len && out_buf[pos] == 0)
+		pos++;
+	if (pos >= out_len) {
+		pos = out_len = 0;
+		return -1;
+	}
+	start = pos;
+	while (pos < out_len && out_buf[pos] != 0)
+		pos++;
+	l = cobs_decode(out_buf + start, pos - start, frame);
+	if (l < 5 || pos >= out_len) {
+		CHECK(false, "invalid frame from device");
+		return -1;
+	}
+	l -= 4;
+	crc = frame[l] | (frame[l + 1] << 8) | (frame[l + 2] << 16)
+		| ((uint32_t)frame[l + 3] << 24);
+	CHECK(crc == xcrc32(frame, l, 0xffffffff), "CRC error in frame from device");
+	*len = l - 1;
+	memcpy(data, &frame[1], *len);
+
+	return frame[0];
+}
+
+static void check_reply(uint8_t type, const uint8_t *data, int len)
+{
+	uint8_t buf[FRAME_MAX];
+	int l, t;
+
+	t = reply(buf, &l);
+	CHECK(t == type, "reply type 0x%02x, expected 0x%02x", t, type);
+	if (t == type && data)
+		CHECK(l == len && !memcmp(buf, data, len), "reply 0x%02x data mismatch", type);
+}
+
+static void check_no_reply()
+{
+	uint8_t buf[FRAME_MAX];
+	int l, t;
+
+	t = reply(buf, &l);
+	CHECK(t < 0, "unexpected reply 0x%02x", t);
+}
+
+static void check_stats(uint32_t frames, uint32_t level_frames, uint32_t crc_errors,
+			uint32_t frame_errors)
+{
+	struct stream_stats s;
+
+	get_stream_stats(&s);
+	CHECK(s.frames == frames && s.level_frames == level_frames
+		&& s.crc_errors == crc_errors && s.frame_errors == frame_errors,
+		"stats: frames=%u levels=%u crc=%u framing=%u, expected %u %u %u %u",
+		s.frames, s.level_frames, s.crc_errors, s.frame_errors,
+		frames, level_frames, crc_errors, frame_errors);
+}
+
+static void check_levels(const uint16_t *level, int count, int calls)
+{
+	CHECK(level_calls == calls, "%d level updates, expected %d", level_calls, calls);
+	CHECK(level_count == count && !memcmp(levels, level, count * sizeof(uint16_t)),
+		"levels mismatch (%u outputs, expected %d)", level_count, count);
+}
+
+
+static void test_levels()
+{
+	uint16_t l[OUTPUT_MAX_COUNT + 1];
+	uint16_t last[OUTPUT_COUNT];
+	uint8_t hello[2] = { 1, OUTPUT_COUNT };
+	uint8_t frame[FRAME_MAX + 5];
+	uint8_t data[FRAME_MAX];
+	int calls = 0, len;
+	uint32_t frames = 0, crc_errors = 0, frame_errors = 0;
+
+	start_stream_mode();
+	CHECK(stream_mode_active(), "streaming mode not active");
+	check_reply(0x80, hello, sizeof(hello));
+	check_stats(0, 0, 0, 0);
+
+	/* All outputs, levels with zero bytes (COBS), in different read sizes */
+	for (int chunk = 1; chunk <= 256; chunk *= 2) {
+		in_chunk = chunk;
+		for (int i = 0; i < OUTPUT_COUNT; i++)
+			l[i] = (i == 0 ? 0 : i == 1 ? 0xffff : i == 2 ? 0x0100 : i == 3 ? 0x00ff
+				: (i * 4099 + chunk * 257) & 0xffff);
+		send_levels(l, OUTPUT_COUNT);
+		check_levels(l, OUTPUT_COUNT, ++calls);
+		frames++;
+	}
+	in_chunk = 256;
+
+	/* Fewer levels than outputs */
+	for (int count = 1; count < OUTPUT_COUNT; count += 5) {
+		for (int i = 0; i < count; i++)
+			l[i] = 1000 * (i + count);
+		send_levels(l, count);
+		check_levels(l, count, ++calls);
+		frames++;
+	}
+	memcpy(last, l, sizeof(last));
+	check_stats(frames, frames, 0, 0);
+	check_no_reply();
+
+	/* Several frames in one read, and extra delimiters */
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < OUTPUT_COUNT; j++)
+			l[j] = 0x0101 * (i + j + 1);
+		for (int j = 0; j < OUTPUT_COUNT; j++) {
+			data[2 * j] = l[j] & 0xff;
+			data[2 * j + 1] = l[j] >> 8;
+		}
+		input((const uint8_t*)"\0\0", 2);
+		input_frame(frame, make_frame(frame, 0x01, data, 2 * OUTPUT_COUNT));
+	}
+	process_stream_input();
+	calls += 3;
+	frames += 3;
+	check_levels(l, OUTPUT_COUNT, calls);
+	memcpy(last, l, sizeof(last));
+	check_stats(frames, frames, 0, 0);
+
+	/* Corrupt frames: every single bit error in type, data and CRC */
+	for (int j = 0; j < OUTPUT_COUNT; j++) {
+		data[2 * j] = 0x11 + j;
+		data[2 * j + 1] = 0x22 + j;
+	}
+	len = make_frame(frame, 0x01, data, 2 * OUTPUT_COUNT);
+	for (int i = 0; i < len * 8; i++) {
+		frame[i / 8] ^= 1 << (i % 8);
+		input_frame(frame, len);
+		frame[i / 8] ^= 1 << (i % 8);
+		process_stream_input();
+		crc_errors++;
+	}
+	check_levels(last, OUTPUT_COUNT, calls);
+	check_stats(frames, frames, crc_errors, 0);
+	check_no_reply();
+
+	/* Truncated frames: (no zero bytes, so single COBS block) */
+	for (int i = 1; i < len + 1; i++) {
+		uint8_t buf[FRAME_MAX];
+		int n = cobs_encode(frame, len, buf);
+
+		CHECK(n == len + 1, "frame not a single COBS block");
+		buf[i] = 0;
+		input(buf, i + 1);
+		frame_errors++;
+	}
+	process_stream_input();
+	check_levels(last, OUTPUT_COUNT, calls);
+	check_stats(frames, frames, crc_errors, frame_errors);
+
+	/* Short frames (after COBS decoding), length 1..4 */
+	for (int i = 1; i < 5; i++) {
+		memset(frame, 0x01, i);
+		input_frame(frame, i);
+		frame_errors++;
+	}
+	process_stream_input();
+	check_stats(frames, frames, crc_errors, frame_errors);
+
+	/* Oversized frame (more levels than fit in receive buffer) */
+	for (int i = 0; i < OUTPUT_MAX_COUNT + 1; i++)
+		l[i] = 0x0101 * (i + 1);
+	send_levels(l, OUTPUT_MAX_COUNT + 1);
+	frame_errors++;
+	check_levels(last, OUTPUT_COUNT, calls);
+	check_stats(frames, frames, crc_errors, frame_errors);
+
+	/* Text (not framed) before a frame, then valid frame */
+	input((const uint8_t*)"log message\r\n", 13);
+	for (int i = 0; i < OUTPUT_COUNT; i++)
+		l[i] = 0x8000 + i;
+	send_levels(l, OUTPUT_COUNT);
+	frame_errors++;
+	check_levels(last, OUTPUT_COUNT, calls);
+	send_levels(l, OUTPUT_COUNT);
+	frames++;
+	check_levels(l, OUTPUT_COUNT, ++calls);
+	memcpy(last, l, sizeof(last));
+	check_stats(frames, frames, crc_errors, frame_errors);
+
+	/* Valid frames with invalid contents (rejected with ERROR reply) */
+	send(0x01, data, 2 * OUTPUT_COUNT - 1);
+	check_reply(0xff, (const uint8_t*)"\x01", 1);
+	send(0x01, data, 0);
+	check_reply(0xff, (const uint8_t*)"\x01", 1);
+	send(0x55, data, 2);
+	check_reply(0xff, (const uint8_t*)"\x55", 1);
+	frames += 3;
+	check_levels(last, OUTPUT_COUNT, calls);
+	check_stats(frames, frames - 3, crc_errors, frame_errors);
+
+	/* PING and STATS */
+	for (int i = 0; i < 2 * OUTPUT_COUNT; i++)
+		data[i] = i * 3;
+	send(0x02, data, 2 * OUTPUT_COUNT);
+	check_reply(0x82, data, 2 * OUTPUT_COUNT);
+	send(0x02, NULL, 0);
+	check_reply(0x82, data, 0);
+	frames += 2;
+	send(0x03, NULL, 0);
+	frames++;
+	{
+		uint32_t v[4] = { frames, frames - 6, crc_errors, frame_errors };
+
+		for (int i = 0; i < 16; i++)
+			data[i] = v[i / 4] >> (8 * (i % 4));
+		check_reply(0x83, data, 16);
+	}
+	check_no_reply();
+	CHECK(clear_calls == 0, "outputs released while streaming");
+
+	/* EXIT */
+	send(0x04, NULL, 0);
+	check_reply(0x84, NULL, 0);
+	CHECK(!stream_mode_active(), "streaming mode still active after EXIT");
+	CHECK(clear_calls == 1, "outputs not released after EXIT");
+
+	/* Input is not processed when streaming mode is not active */
+	input_frame(frame, make_frame(frame, 0x02, NULL, 0));
+	process_stream_input();
+	check_no_reply();
+	in_pos = in_len = 0;
+}
+
+static void test_timeout()
+{
+	uint16_t l[OUTPUT_COUNT] = { 0 };
+	uint8_t frame[FRAME_MAX + 5];
+	int len;
+
+	clear_calls = 0;
+	start_stream_mode();
+	check_reply(0x80, NULL, 0);
+	check_stats(0, 0, 0, 0);
+
+	/* Valid frames keep streaming mode active */
+	for (int i = 0; i < 5; i++) {
+		host_advance_us(29000000);
+		process_stream_input();
+		CHECK(stream_mode_active(), "idle timeout too early");
+		send_levels(l, OUTPUT_COUNT);
+	}
+
+	/* Invalid frames do not */
+	len = make_frame(frame, 0x01, (const uint8_t*)"\x01\x02", 2);
+	frame[1] ^= 0x80;
+	for (int i = 0; i < 3; i++) {
+		host_advance_us(11000000);
+		input_frame(frame, len);
+		process_stream_input();
+	}
+	CHECK(!stream_mode_active(), "no idle timeout");
+	CHECK(clear_calls == 1, "outputs not released after timeout");
+	check_stats(5, 5, 3, 0);
+	check_no_reply();
+}
+
+
+int main(int argc, char **argv)
+{
+	test_levels();
+	test_timeout();
+
+	printf("stream: %d tests, %d failures\n", tests, fails);
+
+	return (fails > 0 ? 1 : 0);
+}
+
+
+/* eof :-) */
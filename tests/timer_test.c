@@ -0,0 +1,327 @@
+/* timer_test.c
+   Copyright (C) 2025 Timo Kokkonen <tjko@iki.fi>
+
+   SPDX-License-Identifier: GPL-3.0-or-later
+
+   This file is part of BrickPico.
+
+   BrickPico is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   BrickPico is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with BrickPico. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Host test for timer event scheduling across DST transitions:
+   next_timer_event_time() and prev_timer_event_time() are compared
+   against a brute-force reference, that walks through every minute
+   around both DST transitions of the year (in local time zone set with
+   POSIX TZ string, as on the device) and lists the times when an event
+   fires:
+
+    - local time matches the event (so events in the repeated hour at
+      the end of DST fire twice);
+    - local time that does not exist (skipped hour at the start of DST)
+      fires at the same offset after the transition (02:30 -> 03:30). */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "brickpico.h"
+
+#define YEAR 2025
+#define WINDOW (12 * 86400)  /* reference window (each side of transition) */
+#define RANGE (2 * 86400)    /* checked range (each side of transition) */
+#define MAX_FIRES (2 * WINDOW / 60 + 120)
+
+
+struct test_zone {
+	const char *name;
+	const char *tz;
+};
+
+static const struct test_zone zones[] = {
+	{ "Europe/Helsinki", "EET-2EEST,M3.5.0/3,M10.5.0/4" },
+	{ "America/New_York", "EST5EDT,M3.2.0,M11.1.0" },
+	{ "Australia/Sydney", "AEST-10AEDT,M10.1.0,M4.1.0/3" },
+};
+
+/* hour, minute, second, wday mask (-1 = any) */
+static const int8_t events[][4] = {
+	{ 3, 30, 0, 0 },
+	{ 2, 30, 0, 0 },
+	{ 1, 30, 0, 0 },
+	{ 4, 0, 0, 0 },
+	{ 2, 0, 0, 1 << 0 },
+	{ 3, 0, 0, 1 << 0 },
+	{ 3, 45, 0, (1 << 0) | (1 << 6) },
+	{ 23, 59, 0, 1 << 0 },
+	{ 0, 0, 0, 0x3e },
+	{ -1, 15, 30, 0 },
+	{ 1, -1, 0, 0 },
+	{ 2, -1, 10, 0 },
+	{ 3, -1, 0, 0 },
+	{ -1, -1, 45, 0 },
+};
+
+static time_t fires[MAX_FIRES];
+static int fire_count;
+
+static int fails = 0;
+static int tests = 0;
+
+
+void log_msg(int priority, const char *format, ...)
+{
+}
+
+char *strncopy(char *dst, const char *src, size_t size)
+{
+	if (!dst || !src || size < 1)
+		return dst;
+	if (size > 1)
+		strncpy(dst, src, size - 1);
+	dst[size - 1] = 0;
+	return dst;
+}
+
+char *strncatenate(char *dst, const char *src, size_t size)
+{
+	size_t used = strnlen(dst, size);
+
+	if (used + 1 < size)
+		strncopy(dst + used, src, size - used);
+	return dst;
+}
+
+char* time_t_to_str(char *buf, size_t size, const time_t t)
+{
+	struct tm tm;
+
+	localtime_r(&t, &tm);
+	strftime(buf, size, "%Y-%m-%d %H:%M:%S %Z", &tm);
+	return buf;
+}
+
+/* Not used by the scheduling functions tested here. */
+int str_to_int(const char *str, int *val, int base) { return 0; }
+int str_to_bitmask(const char *str, uint8_t len, uint32_t *mask, uint8_t base) { return -1; }
+char *bitmask_to_str(uint32_t mask, uint8_t len, uint8_t base, bool range) { return ""; }
+int str2effect(const char *s) { return 0; }
+const char* effect2str(enum light_effect_types effect) { return ""; }
+void* effect_parse_args(enum light_effect_types effect, const char *args) { return NULL; }
+void retire_effect_ctx(void *ctx) { }
+void start_output_ramp(uint out, uint32_t duration_ms) { }
+
+
+#define CHECK(cond, ...) do {					\
+		tests++;					\
+		if (!(cond)) {					\
+			if (fails++ < 50) {			\
+				printf("%s:%d: ", __FILE__, __LINE__); \
+				printf(__VA_ARGS__);		\
+				printf("\n");			\
+			}					\
+		}						\
+	} while (0)
+
+
+static bool event_matches(const struct timer_event *e, const struct tm *tm)
+{
+	return (e->wday == 0 || (e->wday & (1 << tm->tm_wday)))
+		&& (e->hour < 0 || e->hour == tm->tm_hour)
+		&& (e->minute < 0 || e->minute == tm->tm_min);
+}
+
+static int cmp_time(const void *a, const void *b)
+{
+	time_t x = *(const time_t*)a, y = *(const time_t*)b;
+
+	return (x < y ? -1 : x > y ? 1 : 0);
+}
+
+/* List all times event fires within the window around transition. */
+static void reference_fires(const struct timer_event *e, time_t transition)
+{
+	struct tm tm, before, after;
+	time_t t, prev;
+	long skip;
+	int n = 0;
+
+	for (t = transition - WINDOW; t < transition + WINDOW; t += 60) {
+		localtime_r(&t, &tm);
+		if (event_matches(e, &tm))
+			fires[n++] = t + e->second;
+	}
+
+	/* Local times skipped at start of DST */
+	prev = transition - 60;
+	localtime_r(&prev, &before);
+	localtime_r(&transition, &after);
+	skip = after.tm_gmtoff - before.tm_gmtoff;
+	for (long s = 0; s < skip; s += 60) {
+		t = transition + before.tm_gmtoff + s;
+		gmtime_r(&t, &tm);
+		if (event_matches(e, &tm))
+			fires[n++] = transition + s + e->second;
+	}
+
+	qsort(fires, n, sizeof(fires[0]), cmp_time);
+	fire_count = 0;
+	for (int i = 0; i < n; i++) {
+		if (fire_count == 0 || fires[fire_count - 1] != fires[i])
+			fires[fire_count++] = fires[i];
+	}
+}
+
+static time_t reference_next(time_t after)
+{
+	int lo = 0, hi = fire_count;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (fires[mid] <= after)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo < fire_count ? fires[lo] : 0);
+}
+
+static time_t reference_prev(time_t before)
+{
+	int lo = 0, hi = fire_count;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (fires[mid] <= before)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo > 0 ? fires[lo - 1] : 0);
+}
+
+static const char* event_str(const struct timer_event *e)
+{
+	static char buf[32];
+
+	snprintf(buf, sizeof(buf), "%d:%d %d wday=0x%02x", e->minute, e->second,
+		e->hour, e->wday);
+	return buf;
+}
+
+static void check_time(const char *func, const struct timer_event *e, time_t t,
+		time_t res, time_t expected)
+{
+	char a[40], b[40], c[40];
+
+	CHECK(res == expected, "%s(%s, %s): %s, expected %s", func, event_str(e),
+		time_t_to_str(a, sizeof(a), t), time_t_to_str(b, sizeof(b), res),
+		time_t_to_str(c, sizeof(c), expected));
+}
+
+static void check(const struct timer_event *e, time_t t)
+{
+	check_time("next_timer_event_time", e, t, next_timer_event_time(e, t),
+		reference_next(t));
+	check_time("prev_timer_event_time", e, t, prev_timer_event_time(e, t),
+		reference_prev(t));
+}
+
+static void test_transition(time_t transition)
+{
+	struct timer_event e;
+
+	memset(&e, 0, sizeof(e));
+	e.trigger = TRIGGER_TIME;
+	e.action = ACTION_ON;
+
+	for (int i = 0; i < sizeof(events) / sizeof(events[0]); i++) {
+		e.hour = events[i][0];
+		e.minute = events[i][1];
+		e.second = events[i][2];
+		e.wday = events[i][3];
+		reference_fires(&e, transition);
+
+		/* Regular intervals (odd step, so seconds vary) */
+		for (time_t t = transition - RANGE; t < transition + RANGE; t += 7 * 60 + 13)
+			check(&e, t);
+
+		/* Around every firing time, and the transition */
+		for (int j = 0; j < fire_count; j++) {
+			if (fires[j] < transition - RANGE || fires[j] >= transition + RANGE)
+				continue;
+			check(&e, fires[j] - 1);
+			check(&e, fires[j]);
+		}
+		for (time_t t = transition - 3601; t <= transition + 3601; t += 60)
+			check(&e, t);
+	}
+}
+
+/* Find time when DST starts or ends after time t. */
+static time_t find_transition(time_t t, time_t end)
+{
+	struct tm tm;
+	int isdst;
+
+	localtime_r(&t, &tm);
+	isdst = tm.tm_isdst;
+	for (; t < end; t += 3600) {
+		localtime_r(&t, &tm);
+		if (tm.tm_isdst != isdst)
+			break;
+	}
+	if (t >= end)
+		return 0;
+	for (t -= 3600; ; t += 60) {
+		localtime_r(&t, &tm);
+		if (tm.tm_isdst != isdst)
+			return t;
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	struct tm tm = { .tm_year = YEAR - 1900, .tm_mon = 0, .tm_mday = 1 };
+	time_t start = timegm(&tm);
+	time_t end = start + 365 * 86400;
+
+	for (int z = 0; z < sizeof(zones) / sizeof(zones[0]); z++) {
+		time_t t = start;
+		int count = 0;
+		char buf[40];
+
+		setenv("TZ", zones[z].tz, 1);
+		tzset();
+		while ((t = find_transition(t, end)) > 0) {
+			printf("%s: DST %s at %s\n", zones[z].name,
+				(localtime_r(&t, &tm)->tm_isdst ? "starts" : "ends"),
+				time_t_to_str(buf, sizeof(buf), t));
+			test_transition(t);
+			count++;
+		}
+		CHECK(count == 2, "%s: %d DST transitions found", zones[z].name, count);
+	}
+
+	printf("timer: %d tests, %d failures\n", tests, fails);
+
+	return (fails > 0 ? 1 : 0);
+}
+
+
+/* eof :-) */